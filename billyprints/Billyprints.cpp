@@ -1,6 +1,12 @@
 #include "Billyprints.hpp"
 
 namespace Billyprints {
+// Frames drawn after the last input before the loop may block; ImGui needs a
+// couple of frames to settle hover and layout state.
+static const int SettleFrames = 3;
+// Longest wait while idle, so time-based UI still updates occasionally.
+static const double IdleWaitTimeout = 0.5;
+
 void Billyprints::glfw_error_callback(int error, const char *description) {
   fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
@@ -66,10 +72,24 @@ int Billyprints::Mainloop() {
   ImVec4 clear_color = ImVec4(0.00f, 0.00f, 0.00f, 1.00f);
 
   NodeEditor nodeEditor;
+  nodeEditor.SetWakeCallback([] { glfwPostEmptyEvent(); });
 
+  int pendingFrames = SettleFrames;
   while (!glfwWindowShouldClose(window)) {
-    // Poll and handle events (inputs, window resize, etc.)
-    glfwPollEvents();
+    // Poll and handle events (inputs, window resize, etc.). When nothing has
+    // changed for a few frames, sleep until input or a wake-up arrives.
+    if (pendingFrames > 0) {
+      glfwPollEvents();
+    } else {
+      double waitStart = glfwGetTime();
+      glfwWaitEventsTimeout(IdleWaitTimeout);
+      // Input or Wake() ends the wait early and needs settling; a timeout
+      // that brought nothing only refreshes time-based UI once
+      if (glfwGetTime() - waitStart < IdleWaitTimeout)
+        pendingFrames = SettleFrames;
+      else
+        pendingFrames = 1;
+    }
 
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
@@ -92,6 +112,11 @@ int Billyprints::Mainloop() {
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
     glfwSwapBuffers(window);
+
+    if (nodeEditor.WantsRedraw())
+      pendingFrames = SettleFrames;
+    else
+      pendingFrames--;
   }
 
   // Cleanup
@@ -0,0 +1,431 @@
+#include "AigerCircuit.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+namespace Billyprints {
+
+namespace {
+constexpr float ColumnSpacing = 200.0f;
+constexpr float RowSpacing = 100.0f;
+constexpr uint32_t None = UINT32_MAX;
+
+// Builds the nodes of an imported AIG. Columns follow logic depth: inputs
+// in column 0, the gates of depth d in column 2d and the NOT of a signal in
+// the column after its driver, so every wire runs left to right.
+class AigerLayout {
+public:
+  explicit AigerLayout(GateDefinition &def) : def(def) {}
+
+  void Build(const AigerGraph &aig) {
+    const uint32_t variables = aig.VariableCount();
+    depth.assign(variables + 1, 0);
+    driver.assign(variables + 1, None);
+    inverter.assign(variables + 1, None);
+    def.nodes.reserve(variables + aig.outputs.size() + variables / 2);
+    def.connections.reserve(2 * aig.ands.size() + variables / 2 +
+                            aig.outputs.size());
+
+    for (uint32_t v = 1; v <= aig.inputCount; ++v) {
+      driver[v] = AddNode(GateType_In, 0);
+      def.inputPinIndices.push_back(driver[v]);
+    }
+    if (HasNames(aig.inputNames))
+      def.inputNames = aig.inputNames;
+    if (HasNames(aig.outputNames))
+      def.outputNames = aig.outputNames;
+
+    uint32_t deepest = 0;
+    for (uint32_t i = 0; i < (uint32_t)aig.ands.size(); ++i) {
+      const auto &gate = aig.ands[i];
+      uint32_t v = aig.inputCount + i + 1;
+      depth[v] = 1 + std::max(depth[gate.left / 2], depth[gate.right / 2]);
+      deepest = std::max(deepest, depth[v]);
+      driver[v] = AddNode(GateType_AND, 2 * depth[v]);
+      Wire(gate.left, driver[v], 0);
+      Wire(gate.right, driver[v], 1);
+    }
+
+    for (uint32_t lit : aig.outputs) {
+      uint32_t pin = AddNode(GateType_Out, 2 * deepest + 2);
+      def.outputPinIndices.push_back(pin);
+      Wire(lit, pin, 0);
+    }
+    Place();
+  }
+
+private:
+  static bool HasNames(const std::vector<std::string> &names) {
+    return std::any_of(names.begin(), names.end(),
+                       [](const std::string &name) { return !name.empty(); });
+  }
+
+  uint32_t AddNode(uint32_t type, uint32_t column) {
+    NodeDefinition nd;
+    nd.type = type;
+    def.nodes.push_back(nd);
+    this->column.push_back(column);
+    fanin.emplace_back();
+    return (uint32_t)def.nodes.size() - 1;
+  }
+
+  // Node whose output carries 'literal', or None for false
+  uint32_t Source(uint32_t literal) {
+    uint32_t v = literal / 2;
+    if (!(literal & 1))
+      return v ? driver[v] : None;
+    if (inverter[v] == None) {
+      inverter[v] = AddNode(GateType_NOT, 2 * depth[v] + 1);
+      // The NOT of the constant has no input and reads true
+      if (v)
+        Connect(driver[v], inverter[v], 0);
+    }
+    return inverter[v];
+  }
+
+  void Wire(uint32_t literal, uint32_t node, uint16_t slot) {
+    uint32_t source = Source(literal);
+    if (source != None)
+      Connect(source, node, slot);
+  }
+
+  void Connect(uint32_t from, uint32_t to, uint16_t slot) {
+    ConnectionDefinition cd;
+    cd.outputNodeId = from;
+    cd.outputSlot = 0;
+    cd.inputNodeId = to;
+    cd.inputSlot = slot;
+    def.connections.push_back(cd);
+    fanin[to].push_back(from);
+  }
+
+  // Orders each column by the mean height of what drives its nodes, one
+  // sweep from left to right, and centres the columns on each other
+  void Place() {
+    uint32_t columns = 0;
+    for (uint32_t c : column)
+      columns = std::max(columns, c + 1);
+    std::vector<std::vector<uint32_t>> byColumn(columns);
+    for (uint32_t i = 0; i < (uint32_t)column.size(); ++i)
+      byColumn[column[i]].push_back(i);
+
+    std::vector<float> key(def.nodes.size(), 0);
+    for (uint32_t c = 0; c < columns; ++c) {
+      auto &nodes = byColumn[c];
+      for (uint32_t node : nodes) {
+        if (fanin[node].empty())
+          continue;
+        float sum = 0;
+        for (uint32_t from : fanin[node])
+          sum += def.nodes[from].pos.y;
+        key[node] = sum / fanin[node].size();
+      }
+      // Inputs keep their order
+      if (c > 0)
+        std::stable_sort(
+            nodes.begin(), nodes.end(),
+            [&](uint32_t a, uint32_t b) { return key[a] < key[b]; });
+      float top = -0.5f * RowSpacing * (nodes.size() - 1);
+      for (size_t row = 0; row < nodes.size(); ++row)
+        def.nodes[nodes[row]].pos =
+            ImVec2(c * ColumnSpacing, top + row * RowSpacing);
+    }
+  }
+
+  GateDefinition &def;
+  std::vector<uint32_t> depth;    // Per variable
+  std::vector<uint32_t> driver;   // Variable -> In or AND node
+  std::vector<uint32_t> inverter; // Variable -> its NOT node
+  std::vector<uint32_t> column;   // Per node
+  std::vector<std::vector<uint32_t>> fanin;
+};
+
+using Bits = std::vector<uint32_t>; // One literal per bit, bit 0 first
+
+// Expands definitions into an AIG, one instance at a time. The evaluation
+// order of each definition is worked out once and reused by every instance.
+class AigerFlattener {
+public:
+  AigerFlattener(AigerGraph &aig, std::string &error, bool reduce)
+      : aig(aig), error(error), reduce(reduce) {}
+
+  // Top level: the definition's pins become the AIG's inputs and outputs
+  bool Flatten(const GateDefinition &def) {
+    const Netlist *net = Compile(def, "the circuit");
+    if (!net)
+      return false;
+    const auto &pins = net->inputPins;
+    std::vector<Bits> inputs, outputs;
+    for (size_t pin = 0; pin < pins.size(); ++pin) {
+      int width = def.nodes[pins[pin]].width;
+      const std::string name = PinName(def.inputNames, "in", pin, pins.size());
+      Bits &bits = inputs.emplace_back();
+      for (int i = 0; i < width; ++i)
+        bits.push_back(aig.AddInput(BitName(name, i, width)));
+    }
+    if (!Expand(def, *net, inputs, outputs))
+      return false;
+    for (size_t pin = 0; pin < outputs.size(); ++pin) {
+      int width = (int)outputs[pin].size();
+      const std::string name =
+          PinName(def.outputNames, "out", pin, outputs.size());
+      for (int i = 0; i < width; ++i)
+        aig.AddOutput(outputs[pin][i], BitName(name, i, width));
+    }
+    return true;
+  }
+
+private:
+  struct Source {
+    uint32_t node = None;
+    uint16_t slot = 0;
+  };
+  struct Netlist {
+    std::vector<uint32_t> order; // Every node after the nodes it reads
+    std::vector<std::vector<Source>> inputs; // Per node, per input slot
+    // Pin nodes in the order CustomGate gives them slots, and each pin's
+    // position among them
+    std::vector<uint32_t> inputPins, outputPins;
+    std::unordered_map<uint32_t, uint32_t> pinIndex;
+  };
+
+  // The pin's own name, or its slot name on a CustomGate
+  static std::string PinName(const std::vector<std::string> &names,
+                             const char *prefix, size_t pin, size_t pins) {
+    if (pin < names.size() && !names[pin].empty())
+      return names[pin];
+    return pins > 1 ? prefix + std::to_string(pin) : prefix;
+  }
+
+  static std::string BitName(const std::string &pin, int bit, int width) {
+    return width > 1 ? pin + "[" + std::to_string(bit) + "]" : pin;
+  }
+
+  const Netlist *Compile(const GateDefinition &def, const std::string &what) {
+    auto cached = netlists.find(&def);
+    if (cached != netlists.end())
+      return &cached->second;
+
+    Netlist net;
+    const uint32_t count = (uint32_t)def.nodes.size();
+    net.inputs.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      uint32_t type = def.nodes[i].type;
+      if (type == GateType_In || type == GateType_Out) {
+        auto &pins = type == GateType_In ? net.inputPins : net.outputPins;
+        net.pinIndex[i] = (uint32_t)pins.size();
+        pins.push_back(i);
+      }
+    }
+
+    // The first wire into a slot drives it
+    std::vector<std::vector<uint32_t>> readers(count);
+    std::vector<uint32_t> pending(count, 0);
+    for (const auto &conn : def.connections) {
+      if (conn.inputNodeId >= count || conn.outputNodeId >= count)
+        continue;
+      auto &slots = net.inputs[conn.inputNodeId];
+      if (slots.size() <= conn.inputSlot)
+        slots.resize(conn.inputSlot + 1);
+      if (slots[conn.inputSlot].node != None)
+        continue;
+      slots[conn.inputSlot] = {conn.outputNodeId, conn.outputSlot};
+      readers[conn.outputNodeId].push_back(conn.inputNodeId);
+      ++pending[conn.inputNodeId];
+    }
+
+    net.order.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+      if (!pending[i])
+        net.order.push_back(i);
+    for (size_t next = 0; next < net.order.size(); ++next)
+      for (uint32_t reader : readers[net.order[next]])
+        if (--pending[reader] == 0)
+          net.order.push_back(reader);
+    if (net.order.size() != count) {
+      error = what + " has a feedback loop";
+      return nullptr;
+    }
+    return &netlists.emplace(&def, std::move(net)).first->second;
+  }
+
+  bool Expand(const GateDefinition &def, const Netlist &net,
+              const std::vector<Bits> &inputs, std::vector<Bits> &outputs) {
+    // Per node, the bits of each output slot
+    std::vector<std::vector<Bits>> values(def.nodes.size());
+    auto read = [&](uint32_t node, size_t slot, int width) {
+      Bits bits;
+      const auto &slots = net.inputs[node];
+      if (slot < slots.size() && slots[slot].node != None) {
+        const auto &from = values[slots[slot].node];
+        if (slots[slot].slot < from.size())
+          bits = from[slots[slot].slot];
+      }
+      bits.resize(width, AigerGraph::False);
+      return bits;
+    };
+
+    outputs.assign(net.outputPins.size(), Bits());
+    for (uint32_t node : net.order) {
+      const NodeDefinition &nd = def.nodes[node];
+      const int width = nd.width;
+      auto &out = values[node];
+      switch (nd.type) {
+      case GateType_In: {
+        Bits bits = inputs[net.pinIndex.at(node)];
+        bits.resize(width, AigerGraph::False);
+        out.push_back(std::move(bits));
+        break;
+      }
+      case GateType_Out:
+        outputs[net.pinIndex.at(node)] = read(node, 0, width);
+        break;
+      case GateType_AND: {
+        Bits a = read(node, 0, width), b = read(node, 1, width);
+        for (int i = 0; i < width; ++i)
+          a[i] = reduce ? aig.AddAnd(a[i], b[i]) : aig.AddGate(a[i], b[i]);
+        out.push_back(std::move(a));
+        break;
+      }
+      case GateType_NOT: {
+        Bits a = read(node, 0, width);
+        for (auto &bit : a)
+          bit = AigerGraph::Not(bit);
+        out.push_back(std::move(a));
+        break;
+      }
+      case GateType_Split: {
+        Bits a = read(node, 0, width);
+        for (uint32_t bit : a)
+          out.push_back({bit});
+        break;
+      }
+      case GateType_Merge: {
+        Bits bits;
+        for (int i = 0; i < width; ++i)
+          bits.push_back(read(node, i, 1)[0]);
+        out.push_back(std::move(bits));
+        break;
+      }
+      default:
+        if (!ExpandGate(node, nd, read, out))
+          return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename Read>
+  bool ExpandGate(uint32_t node, const NodeDefinition &nd, Read &read,
+                  std::vector<Bits> &out) {
+    const std::string &name = GateTypeName(nd.type);
+    GateDefinitionRef def = CustomGate::FindDefinition(name);
+    if (!def) {
+      error = "the gate " + name + " isn't loaded";
+      return false;
+    }
+    if (std::find(active.begin(), active.end(), def.get()) != active.end()) {
+      error = "the gate " + name + " contains itself";
+      return false;
+    }
+    const Netlist *net = Compile(*def, "the gate " + name);
+    if (!net)
+      return false;
+
+    std::vector<Bits> inputs;
+    for (size_t pin = 0; pin < net->inputPins.size(); ++pin)
+      inputs.push_back(
+          read(node, pin, def->nodes[net->inputPins[pin]].width));
+    active.push_back(def.get());
+    bool ok = Expand(*def, *net, inputs, out);
+    active.pop_back();
+    return ok;
+  }
+
+  AigerGraph &aig;
+  std::string &error;
+  bool reduce;
+  // Keyed by address; the registry keeps definitions alive meanwhile
+  std::unordered_map<const GateDefinition *, Netlist> netlists;
+  std::vector<const GateDefinition *> active; // Being expanded
+};
+} // namespace
+
+GateDefinition AigerToDefinition(const AigerGraph &aig, std::string name) {
+  GateDefinition def;
+  def.name = std::move(name);
+  AigerLayout(def).Build(aig);
+  return def;
+}
+
+SceneData AigerToScene(const AigerGraph &aig) {
+  GateDefinition def = AigerToDefinition(aig, {});
+
+  // Slot counts and input slot names of the four types a layout uses
+  struct TypeInfo {
+    const char *name;
+    uint32_t inputCount, outputCount;
+    const char *inputs[2];
+  };
+  static const TypeInfo types[] = {{"AND", 2, 1, {"in0", "in1"}},
+                                   {"NOT", 1, 1, {"in"}},
+                                   {"In", 0, 1, {}},
+                                   {"Out", 1, 0, {"in"}}};
+  SceneData scene;
+  uint32_t typeString[4], inputString[4][2];
+  for (int t = 0; t < 4; ++t) {
+    typeString[t] = scene.Intern(types[t].name);
+    for (uint32_t slot = 0; slot < types[t].inputCount; ++slot)
+      inputString[t][slot] = scene.Intern(types[t].inputs[slot]);
+  }
+  const uint32_t out = scene.Intern("out");
+
+  scene.nodes.reserve(def.nodes.size());
+  for (const auto &nd : def.nodes) {
+    SceneData::Node node;
+    node.type = typeString[nd.type];
+    node.pos = nd.pos;
+    node.inputCount = types[nd.type].inputCount;
+    node.outputCount = types[nd.type].outputCount;
+    scene.nodes.push_back(node);
+  }
+  scene.connections.reserve(def.connections.size());
+  for (const auto &cd : def.connections)
+    scene.connections.push_back(
+        {cd.outputNodeId, out, cd.inputNodeId,
+         inputString[def.nodes[cd.inputNodeId].type][cd.inputSlot]});
+  return scene;
+}
+
+bool DefinitionToAiger(const GateDefinition &def, AigerGraph &aig,
+                       std::string &error, bool reduce) {
+  aig = AigerGraph();
+  return AigerFlattener(aig, error, reduce).Flatten(def);
+}
+
+bool SceneToAiger(const SceneData &scene, AigerGraph &aig,
+                  std::string &error) {
+  // Scenes name their slots; definitions number them
+  GateDefinition def;
+  std::vector<uint32_t> types(scene.strings.size(), None);
+  def.nodes.reserve(scene.nodes.size());
+  for (const auto &node : scene.nodes) {
+    uint32_t &type = types[node.type];
+    if (type == None)
+      type = InternGateType(scene.strings[node.type]);
+    NodeDefinition nd;
+    nd.type = type;
+    nd.width = (uint8_t)std::clamp<uint32_t>(node.width, 1, MaxBusWidth);
+    def.nodes.push_back(nd);
+  }
+  def.connections.reserve(scene.connections.size());
+  for (const auto &conn : scene.connections) {
+    int outputSlot = SlotIndexFromName(scene.strings[conn.outputSlot]);
+    int inputSlot = SlotIndexFromName(scene.strings[conn.inputSlot]);
+    if (outputSlot < 0 || inputSlot < 0)
+      continue;
+    def.connections.push_back({conn.inputNode, conn.outputNode,
+                               (uint16_t)inputSlot, (uint16_t)outputSlot});
+  }
+  return DefinitionToAiger(def, aig, error);
+}
+} // namespace Billyprints
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "../Nodes/Gates/CustomGate.hpp"
+#include "AigerFile.hpp"
+#include "SceneFile.hpp"
+#include <string>
+
+namespace Billyprints {
+// Conversions between AIGs and Billyprints circuits.
+
+// Lays 'aig' out as a definition: an In pin per input and an Out pin per
+// output, in order, an AND per gate and one NOT per inverted signal, placed
+// in columns by logic depth. A true constant is a NOT with nothing wired to
+// it, a false one an input left unconnected. Symbol names name the pins.
+GateDefinition AigerToDefinition(const AigerGraph &aig, std::string name);
+
+// AigerToDefinition() as a scene
+SceneData AigerToScene(const AigerGraph &aig);
+
+// Flattens a definition into 'aig', expanding the custom gates it uses and
+// splitting buses into bits. Its In and Out pins become the AIG's inputs
+// and outputs, in order, named after the pins or else their slots: "a",
+// "in1[3]" and so on. Returns false with 'error' set if the circuit has a
+// feedback loop, which AIGER can't express without latches, or uses a gate
+// that isn't loaded. ANDs go through AigerGraph::AddAnd(), or with
+// 'reduce' off through AddGate(), one per AND bit of the flattened circuit.
+bool DefinitionToAiger(const GateDefinition &def, AigerGraph &aig,
+                       std::string &error, bool reduce = true);
+
+// DefinitionToAiger() for a scene
+bool SceneToAiger(const SceneData &scene, AigerGraph &aig,
+                  std::string &error);
+} // namespace Billyprints
@@ -0,0 +1,424 @@
+#include "AigerFile.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+
+namespace Billyprints {
+
+// AIGER, as described in "The AIGER And-Inverter Graph (AIG) Format
+// Version 20071012" and its 1.9 extension:
+//   Header   "aag" or "aig", then M I L O A (max variable, inputs, latches,
+//            outputs, ANDs) and in 1.9 optionally B C J F
+//   aag      one line per input, latch, output and AND, as literals
+//   aig      inputs and latches implied; outputs as ASCII lines; each AND as
+//            two 7-bit varints, lhs - rhs0 and rhs0 - rhs1
+//   Symbols  "i3 name" and "o0 name" lines, then an optional "c" line
+//            starting free-form comments
+namespace {
+constexpr float ReadShare = 0.5f;
+constexpr size_t GatesPerReport = 1 << 16;
+
+// Reads the text parts of a file held in memory
+class TextReader {
+public:
+  TextReader(const uint8_t *data, size_t size)
+      : at(data), end(data + size) {}
+
+  bool AtEnd() const { return at == end; }
+  void Seek(const uint8_t *position) { at = position; }
+
+  // A decimal number after at most one space
+  bool Number(uint64_t &v) {
+    if (at != end && *at == ' ')
+      ++at;
+    if (at == end || *at < '0' || *at > '9')
+      return false;
+    v = 0;
+    for (; at != end && *at >= '0' && *at <= '9'; ++at) {
+      v = v * 10 + (*at - '0');
+      if (v > UINT32_MAX)
+        return false;
+    }
+    return true;
+  }
+
+  bool Newline() {
+    if (at != end && *at == '\r')
+      ++at;
+    if (at == end || *at != '\n')
+      return false;
+    ++at;
+    return true;
+  }
+
+  // The rest of the line, without its newline
+  std::string_view Line() {
+    const uint8_t *start = at;
+    while (at != end && *at != '\n')
+      ++at;
+    std::string_view line((const char *)start, at - start);
+    if (at != end)
+      ++at;
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    return line;
+  }
+
+  // A binary AND delta
+  bool Delta(uint64_t &v) {
+    v = 0;
+    for (int shift = 0; at != end && shift < 35; shift += 7) {
+      uint8_t byte = *at++;
+      v |= (uint64_t)(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        return v <= UINT32_MAX;
+    }
+    return false;
+  }
+
+private:
+  const uint8_t *at, *end;
+};
+
+bool Checkpoint(LoadProgress *progress, size_t done, size_t total,
+                std::string &error) {
+  if (!progress || done % GatesPerReport != 0)
+    return true;
+  progress->Report(ReadShare, 1, done, total);
+  if (!progress->cancelled)
+    return true;
+  error = "cancelled";
+  return false;
+}
+
+// ASCII gates can be listed in any order and use any variable numbers.
+// Inputs keep their order and the gates are renumbered so every gate comes
+// after its inputs.
+bool ReadAsciiBody(TextReader &in, uint32_t maxVariable, uint32_t inputCount,
+                   uint32_t outputCount, uint32_t andCount, AigerGraph &aig,
+                   std::string &error, LoadProgress *progress) {
+  // Variable in the file -> literal in 'aig', or UINT32_MAX while unknown
+  std::vector<uint32_t> mapped(maxVariable + 1, UINT32_MAX);
+  mapped[0] = AigerGraph::False;
+  auto literal = [&](uint64_t &v, bool definition) {
+    if (!in.Number(v) || v / 2 > maxVariable)
+      return false;
+    return !definition || v % 2 == 0;
+  };
+
+  for (uint32_t i = 0; i < inputCount; ++i) {
+    uint64_t lit;
+    if (!literal(lit, true) || !in.Newline() || lit == 0 ||
+        mapped[lit / 2] != UINT32_MAX) {
+      error = "input " + std::to_string(i) + " is malformed";
+      return false;
+    }
+    mapped[lit / 2] = aig.AddInput();
+  }
+
+  std::vector<uint32_t> outputs(outputCount);
+  for (uint32_t i = 0; i < outputCount; ++i) {
+    uint64_t lit;
+    if (!literal(lit, false) || !in.Newline()) {
+      error = "output " + std::to_string(i) + " is malformed";
+      return false;
+    }
+    outputs[i] = (uint32_t)lit;
+  }
+
+  struct Gate {
+    uint32_t lhs, rhs[2];
+  };
+  std::vector<Gate> gates(andCount);
+  std::vector<uint32_t> gateOf(maxVariable + 1, UINT32_MAX);
+  for (uint32_t i = 0; i < andCount; ++i) {
+    uint64_t lhs, rhs0, rhs1;
+    if (!literal(lhs, true) || !literal(rhs0, false) ||
+        !literal(rhs1, false) || !in.Newline() || lhs == 0 ||
+        mapped[lhs / 2] != UINT32_MAX || gateOf[lhs / 2] != UINT32_MAX) {
+      error = "AND gate " + std::to_string(i) + " is malformed";
+      return false;
+    }
+    gates[i] = {(uint32_t)lhs, {(uint32_t)rhs0, (uint32_t)rhs1}};
+    gateOf[lhs / 2] = i;
+  }
+
+  // Depth-first from every gate, emitting a gate once both its inputs are
+  // mapped. 'state' is 1 while a gate is on the stack, to catch loops.
+  std::vector<uint8_t> state(andCount, 0);
+  std::vector<uint32_t> stack;
+  aig.ands.reserve(andCount);
+  for (uint32_t root = 0; root < andCount; ++root) {
+    if (state[root])
+      continue;
+    stack.push_back(root);
+    state[root] = 1;
+    while (!stack.empty()) {
+      Gate &gate = gates[stack.back()];
+      bool ready = true;
+      for (uint32_t rhs : gate.rhs) {
+        if (mapped[rhs / 2] != UINT32_MAX)
+          continue;
+        uint32_t next = gateOf[rhs / 2];
+        if (next == UINT32_MAX) {
+          error = "literal " + std::to_string(rhs) + " is never defined";
+          return false;
+        }
+        if (state[next] == 1) {
+          error = "the AND gates form a loop";
+          return false;
+        }
+        stack.push_back(next);
+        state[next] = 1;
+        ready = false;
+        break;
+      }
+      if (!ready)
+        continue;
+      uint32_t left = mapped[gate.rhs[0] / 2] ^ (gate.rhs[0] & 1);
+      uint32_t right = mapped[gate.rhs[1] / 2] ^ (gate.rhs[1] & 1);
+      aig.ands.push_back({left, right});
+      mapped[gate.lhs / 2] = 2 * aig.VariableCount();
+      state[stack.back()] = 2;
+      stack.pop_back();
+      if (!Checkpoint(progress, aig.ands.size(), andCount, error))
+        return false;
+    }
+  }
+
+  for (uint32_t lit : outputs) {
+    if (mapped[lit / 2] == UINT32_MAX) {
+      error = "literal " + std::to_string(lit) + " is never defined";
+      return false;
+    }
+    aig.AddOutput(mapped[lit / 2] ^ (lit & 1));
+  }
+  return true;
+}
+
+bool ReadBinaryBody(TextReader &in, uint32_t inputCount, uint32_t outputCount,
+                    uint32_t andCount, AigerGraph &aig, std::string &error,
+                    LoadProgress *progress) {
+  for (uint32_t i = 0; i < inputCount; ++i)
+    aig.AddInput();
+
+  const uint32_t maxLiteral = 2 * (inputCount + andCount) + 1;
+  for (uint32_t i = 0; i < outputCount; ++i) {
+    uint64_t lit;
+    if (!in.Number(lit) || !in.Newline() || lit > maxLiteral) {
+      error = "output " + std::to_string(i) + " is malformed";
+      return false;
+    }
+    aig.AddOutput((uint32_t)lit);
+  }
+
+  aig.ands.reserve(andCount);
+  for (uint32_t i = 0; i < andCount; ++i) {
+    uint64_t lhs = 2 * (uint64_t)(inputCount + i + 1), delta0, delta1;
+    if (!in.Delta(delta0) || !in.Delta(delta1) || delta0 == 0 ||
+        delta0 > lhs || delta1 > lhs - delta0) {
+      error = "AND gate " + std::to_string(i) + " is malformed";
+      return false;
+    }
+    uint32_t left = (uint32_t)(lhs - delta0);
+    aig.ands.push_back({left, (uint32_t)(left - delta1)});
+    if (!Checkpoint(progress, i + 1, andCount, error))
+      return false;
+  }
+  return true;
+}
+
+// Names from the symbol table. Unknown kinds and positions are skipped, and
+// so is everything after the comment marker.
+void ReadSymbols(TextReader &in, AigerGraph &aig) {
+  while (!in.AtEnd()) {
+    std::string_view line = in.Line();
+    if (line.empty() || line == "c")
+      break;
+    std::vector<std::string> *names = line[0] == 'i'   ? &aig.inputNames
+                                      : line[0] == 'o' ? &aig.outputNames
+                                                       : nullptr;
+    size_t space = line.find(' ');
+    if (!names || space == std::string_view::npos || space == 1)
+      continue;
+    size_t position = 0;
+    bool digits = true;
+    for (char c : line.substr(1, space - 1)) {
+      digits &= c >= '0' && c <= '9';
+      position = position * 10 + (c - '0');
+      if (position > names->size())
+        break;
+    }
+    if (digits && position < names->size())
+      (*names)[position] = std::string(line.substr(space + 1));
+  }
+}
+
+void AppendNumber(std::vector<uint8_t> &out, uint64_t v, char after) {
+  char buffer[24];
+  int n = snprintf(buffer, sizeof(buffer), "%llu%c", (unsigned long long)v,
+                   after);
+  out.insert(out.end(), buffer, buffer + n);
+}
+
+void AppendText(std::vector<uint8_t> &out, const std::string &s) {
+  out.insert(out.end(), s.begin(), s.end());
+}
+} // namespace
+
+uint32_t AigerGraph::AddInput(std::string name) {
+  inputNames.push_back(std::move(name));
+  return 2 * ++inputCount;
+}
+
+uint32_t AigerGraph::AddAnd(uint32_t left, uint32_t right) {
+  if (left == False || right == False || left == Not(right))
+    return False;
+  if (left == True || left == right)
+    return right;
+  if (right == True)
+    return left;
+  if (left > right)
+    std::swap(left, right);
+  uint32_t &literal = hashed[(uint64_t)left << 32 | right];
+  if (!literal)
+    literal = AddGate(left, right);
+  return literal;
+}
+
+uint32_t AigerGraph::AddGate(uint32_t left, uint32_t right) {
+  ands.push_back({left, right});
+  return 2 * VariableCount();
+}
+
+void AigerGraph::AddOutput(uint32_t literal, std::string name) {
+  outputs.push_back(literal);
+  outputNames.push_back(std::move(name));
+}
+
+bool ReadAiger(const std::string &path, AigerGraph &aig, std::string &error,
+               LoadProgress *progress) {
+  std::vector<uint8_t> bytes;
+  if (!ReadWholeFile(path, bytes, progress, ReadShare)) {
+    error = progress && progress->cancelled ? "cancelled"
+                                            : "the file can't be read";
+    return false;
+  }
+  aig = AigerGraph();
+
+  TextReader in(bytes.data(), bytes.size());
+  bool ascii = bytes.size() >= 4 && memcmp(bytes.data(), "aag ", 4) == 0;
+  bool binary = bytes.size() >= 4 && memcmp(bytes.data(), "aig ", 4) == 0;
+  if (!ascii && !binary) {
+    error = "not an AIGER file";
+    return false;
+  }
+  in.Seek(bytes.data() + 3);
+
+  // M I L O A, then B C J F in AIGER 1.9
+  uint64_t fields[9] = {};
+  int fieldCount = 0;
+  while (fieldCount < 9 && in.Number(fields[fieldCount]))
+    ++fieldCount;
+  if (fieldCount < 5 || !in.Newline()) {
+    error = "the header is malformed";
+    return false;
+  }
+  uint64_t maxVariable = fields[0], inputCount = fields[1],
+           latchCount = fields[2], outputCount = fields[3],
+           andCount = fields[4];
+  if (latchCount) {
+    error = "the circuit has latches; only combinational circuits can be "
+            "imported";
+    return false;
+  }
+  for (int i = 5; i < fieldCount; ++i) {
+    if (fields[i]) {
+      error = "bad state, constraint, justice and fairness properties "
+              "aren't supported";
+      return false;
+    }
+  }
+  // Every input, output and gate takes at least two bytes. Variables may
+  // go unused, but not so many that their tables dwarf the file.
+  if (maxVariable < inputCount + andCount ||
+      (binary && maxVariable != inputCount + andCount) ||
+      maxVariable > 8 * bytes.size() ||
+      inputCount + outputCount + andCount > bytes.size()) {
+    error = "the header doesn't match the file";
+    return false;
+  }
+
+  aig.inputNames.reserve(inputCount);
+  bool ok =
+      ascii ? ReadAsciiBody(in, (uint32_t)maxVariable, (uint32_t)inputCount,
+                            (uint32_t)outputCount, (uint32_t)andCount, aig,
+                            error, progress)
+            : ReadBinaryBody(in, (uint32_t)inputCount, (uint32_t)outputCount,
+                             (uint32_t)andCount, aig, error, progress);
+  if (!ok)
+    return false;
+  ReadSymbols(in, aig);
+  return true;
+}
+
+std::vector<uint8_t> EncodeAiger(const AigerGraph &aig, bool ascii) {
+  std::vector<uint8_t> out;
+  out.reserve(32 + aig.outputs.size() * 8 +
+              aig.ands.size() * (ascii ? 24 : 4));
+
+  AppendText(out, ascii ? "aag " : "aig ");
+  AppendNumber(out, aig.VariableCount(), ' ');
+  AppendNumber(out, aig.inputCount, ' ');
+  AppendNumber(out, 0, ' ');
+  AppendNumber(out, aig.outputs.size(), ' ');
+  AppendNumber(out, aig.ands.size(), '\n');
+
+  if (ascii)
+    for (uint32_t i = 1; i <= aig.inputCount; ++i)
+      AppendNumber(out, 2 * i, '\n');
+  for (uint32_t lit : aig.outputs)
+    AppendNumber(out, lit, '\n');
+
+  uint32_t lhs = 2 * aig.inputCount;
+  for (const auto &gate : aig.ands) {
+    lhs += 2;
+    uint32_t rhs0 = std::max(gate.left, gate.right);
+    uint32_t rhs1 = std::min(gate.left, gate.right);
+    if (ascii) {
+      AppendNumber(out, lhs, ' ');
+      AppendNumber(out, rhs0, ' ');
+      AppendNumber(out, rhs1, '\n');
+      continue;
+    }
+    for (uint32_t delta : {lhs - rhs0, rhs0 - rhs1}) {
+      for (; delta >= 0x80; delta >>= 7)
+        out.push_back((uint8_t)(delta | 0x80));
+      out.push_back((uint8_t)delta);
+    }
+  }
+
+  const std::vector<std::string> *tables[2] = {&aig.inputNames,
+                                               &aig.outputNames};
+  for (int kind = 0; kind < 2; ++kind) {
+    const auto &names = *tables[kind];
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (names[i].empty())
+        continue;
+      out.push_back(kind == 0 ? 'i' : 'o');
+      AppendNumber(out, i, ' ');
+      AppendText(out, names[i]);
+      out.push_back('\n');
+    }
+  }
+  return out;
+}
+
+bool WriteAiger(const std::string &path, const AigerGraph &aig) {
+  bool ascii =
+      path.size() >= 4 && path.compare(path.size() - 4, 4, ".aag") == 0;
+  std::vector<uint8_t> bytes = EncodeAiger(aig, ascii);
+  return WriteFileAtomically(path, {&bytes});
+}
+} // namespace Billyprints
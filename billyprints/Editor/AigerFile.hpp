@@ -0,0 +1,63 @@
+#pragma once
+
+#include "BinaryIO.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Billyprints {
+// A combinational And-Inverter Graph as stored in an AIGER file. Signals
+// are literals, 2 * variable + 1 when inverted: variable 0 is the constant
+// (literal 0 is false, 1 is true), inputs are variables 1 to 'inputCount'
+// and the AND gates follow in order, each using only earlier variables.
+struct AigerGraph {
+  struct And {
+    uint32_t left, right;
+  };
+
+  uint32_t inputCount = 0;
+  std::vector<And> ands;
+  std::vector<uint32_t> outputs;
+  // Symbol names, empty where the file has none
+  std::vector<std::string> inputNames, outputNames;
+
+  static constexpr uint32_t False = 0, True = 1;
+  static uint32_t Not(uint32_t literal) { return literal ^ 1; }
+
+  uint32_t VariableCount() const {
+    return inputCount + (uint32_t)ands.size();
+  }
+  // Literal of a new input. Inputs must all be added before the first AND.
+  uint32_t AddInput(std::string name = {});
+  // Literal of 'left' AND 'right'. Constants and repeated or opposite
+  // inputs fold away instead of adding a gate, and the AND of two literals
+  // already ANDed by this function is the earlier gate (structural hashing).
+  // Double inversions cancel out by themselves, since Not() of an inverted
+  // literal is the plain one.
+  uint32_t AddAnd(uint32_t left, uint32_t right);
+  // Literal of a new gate exactly as given, for a circuit that is reduced
+  // afterwards (see CompiledCircuit)
+  uint32_t AddGate(uint32_t left, uint32_t right);
+  void AddOutput(uint32_t literal, std::string name = {});
+
+private:
+  // Gates made by AddAnd(), keyed by their inputs, smaller literal first
+  std::unordered_map<uint64_t, uint32_t> hashed;
+};
+
+// Reads an ASCII ("aag") or binary ("aig") AIGER file. ASCII gates may come
+// in any order and are renumbered into the layout above. Returns false with
+// 'error' set if the file can't be read or is malformed, or if it holds
+// latches or properties, which have no counterpart in a Billyprints circuit.
+bool ReadAiger(const std::string &path, AigerGraph &aig, std::string &error,
+               LoadProgress *progress = nullptr);
+
+// 'aig' as a whole file: binary, or ASCII with 'ascii'
+std::vector<uint8_t> EncodeAiger(const AigerGraph &aig, bool ascii);
+
+// Writes 'aig' to 'path', in ASCII when the extension is ".aag" and in
+// binary otherwise, replacing the file only once it is fully written.
+// Safe to call from any thread.
+bool WriteAiger(const std::string &path, const AigerGraph &aig);
+} // namespace Billyprints
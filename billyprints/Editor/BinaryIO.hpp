@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Billyprints {
+// Little endian integers, LEB128 varints and CRC-32 shared by the binary
+// scene and gate library formats.
+
+// Shared with a thread that reads a file, so the UI can show how far it got
+// and stop it. 'fraction' runs from 0 to 1.
+struct LoadProgress {
+  std::atomic<float> fraction{0};
+  std::atomic<bool> cancelled{false};
+
+  // Reports 'done' of 'total' for the step that runs from 'begin' to 'end'
+  void Report(float begin, float end, size_t done, size_t total) {
+    fraction = total ? begin + (end - begin) * ((float)done / total) : end;
+  }
+};
+
+// CRC-32 (IEEE), eight bytes per step using the slicing-by-8 tables
+inline uint32_t Crc32(const uint8_t *data, size_t size) {
+  static const auto tables = [] {
+    std::vector<uint32_t> t(8 * 256);
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i)
+      for (int k = 1; k < 8; ++k)
+        t[k * 256 + i] =
+            (t[(k - 1) * 256 + i] >> 8) ^ t[t[(k - 1) * 256 + i] & 0xFF];
+    return t;
+  }();
+  const uint32_t *t = tables.data();
+  uint32_t crc = 0xFFFFFFFFu;
+  for (; size >= 8; data += 8, size -= 8) {
+    uint32_t lo = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) |
+                         ((uint32_t)data[3] << 24));
+    uint32_t hi = data[4] | (data[5] << 8) | (data[6] << 16) |
+                  ((uint32_t)data[7] << 24);
+    crc = t[7 * 256 + (lo & 0xFF)] ^ t[6 * 256 + ((lo >> 8) & 0xFF)] ^
+          t[5 * 256 + ((lo >> 16) & 0xFF)] ^ t[4 * 256 + (lo >> 24)] ^
+          t[3 * 256 + (hi & 0xFF)] ^ t[2 * 256 + ((hi >> 8) & 0xFF)] ^
+          t[1 * 256 + ((hi >> 16) & 0xFF)] ^ t[hi >> 24];
+  }
+  for (; size > 0; ++data, --size)
+    crc = t[(crc ^ *data) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFFu;
+}
+
+inline uint64_t ZigZag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+inline int64_t UnZigZag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// Node positions are almost always whole numbers close to the previous
+// node's, so they are stored as a tagged varint: an even value is the
+// zigzag delta from the previous coordinate shifted left, and 1 is followed
+// by the raw float.
+inline bool IsWhole(float v) {
+  return v >= -2147483648.0f && v < 2147483648.0f && v == (float)(int32_t)v;
+}
+
+class ByteWriter {
+public:
+  std::vector<uint8_t> bytes;
+
+  void U32(uint32_t v) {
+    for (int i = 0; i < 4; ++i)
+      bytes.push_back((uint8_t)(v >> (8 * i)));
+  }
+  void Varint(uint64_t v) {
+    while (v >= 0x80) {
+      bytes.push_back((uint8_t)(v | 0x80));
+      v >>= 7;
+    }
+    bytes.push_back((uint8_t)v);
+  }
+  void Float(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    U32(bits);
+  }
+  void Bytes(const void *data, size_t size) {
+    bytes.insert(bytes.end(), (const uint8_t *)data,
+                 (const uint8_t *)data + size);
+  }
+  void Coordinate(float v, float &previous) {
+    if (IsWhole(v) && IsWhole(previous)) {
+      Varint(ZigZag((int64_t)v - (int64_t)previous) << 1);
+    } else {
+      Varint(1);
+      Float(v);
+    }
+    previous = v;
+  }
+};
+
+// Bounds checked decoding from memory. Every read fails once the data
+// runs out, so callers can check once at the end of a record.
+class ByteReader {
+public:
+  ByteReader(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+  bool Ok() const { return ok; }
+  void Fail() { ok = false; }
+  size_t Remaining() const { return size - pos; }
+
+  bool Raw(void *out, size_t n) {
+    if (!ok || n > size - pos)
+      return ok = false;
+    memcpy(out, data + pos, n);
+    pos += n;
+    return true;
+  }
+  uint32_t U32() {
+    uint8_t b[4] = {};
+    Raw(b, 4);
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+  }
+  uint64_t Varint() {
+    if (pos < size && data[pos] < 0x80)
+      return data[pos++]; // Most values fit in one byte
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64 && ok; shift += 7) {
+      if (pos >= size)
+        break;
+      uint8_t b = data[pos++];
+      v |= (uint64_t)(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        return v;
+    }
+    ok = false;
+    return 0;
+  }
+  float Float() {
+    uint32_t bits = U32();
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+  }
+  float Coordinate(float &previous) {
+    uint64_t tag = Varint();
+    previous = tag == 1 ? Float()
+                        : (float)((int64_t)previous + UnZigZag(tag >> 1));
+    return previous;
+  }
+  // A count of records that take at least 'minSize' bytes each; larger
+  // counts can only come from a damaged file
+  size_t Count(size_t minSize = 1) {
+    uint64_t n = Varint();
+    if (n > Remaining() / minSize)
+      ok = false;
+    return ok ? (size_t)n : 0;
+  }
+  std::string_view String(size_t length) {
+    if (!ok || length > size - pos) {
+      ok = false;
+      return {};
+    }
+    std::string_view s((const char *)data + pos, length);
+    pos += length;
+    return s;
+  }
+
+private:
+  const uint8_t *data;
+  size_t size;
+  size_t pos = 0;
+  bool ok = true;
+};
+
+// With 'progress' the file is read in chunks, reporting up to
+// 'progressEnd' and giving up early once cancelled
+inline bool ReadWholeFile(const std::string &path, std::vector<uint8_t> &bytes,
+                          LoadProgress *progress = nullptr,
+                          float progressEnd = 1) {
+  constexpr size_t ChunkSize = 4 << 20;
+  // Not ftell(), whose long is 32-bit on Windows
+  std::error_code error;
+  uintmax_t size = std::filesystem::file_size(path, error);
+  if (error || size > SIZE_MAX)
+    return false;
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  bytes.resize((size_t)size);
+  bool ok = true;
+  for (size_t done = 0; ok && done < bytes.size();) {
+    size_t n = progress ? std::min(ChunkSize, bytes.size() - done)
+                        : bytes.size();
+    ok = fread(bytes.data() + done, 1, n, f) == n;
+    done += n;
+    if (progress) {
+      progress->Report(0, progressEnd, done, bytes.size());
+      ok &= !progress->cancelled;
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+// Reads 'size' bytes at 'offset', for formats that index into a file
+// instead of reading all of it
+inline bool ReadFileRange(const std::string &path, uint64_t offset,
+                          size_t size, std::vector<uint8_t> &bytes) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+  bytes.resize(size);
+  // fseek() takes a long, which is 32-bit on Windows
+#ifdef _WIN32
+  bool ok = offset <= (uint64_t)INT64_MAX &&
+            _fseeki64(f, (__int64)offset, SEEK_SET) == 0;
+#else
+  bool ok = offset <= (uint64_t)INT64_MAX &&
+            fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+  ok = ok && fread(bytes.data(), 1, size, f) == size;
+  fclose(f);
+  return ok;
+}
+
+// Writes 'parts' back to back to a temporary file beside 'path', then
+// renames it over 'path', so readers see either the old file or the whole
+// new one, never a partly written file
+inline bool
+WriteFileAtomically(const std::string &path,
+                    std::initializer_list<const std::vector<uint8_t> *> parts) {
+  std::string temporary = path + ".tmp";
+  FILE *f = fopen(temporary.c_str(), "wb");
+  if (!f)
+    return false;
+  bool ok = true;
+  for (const auto *part : parts)
+    ok &= fwrite(part->data(), 1, part->size(), f) == part->size();
+  ok &= fclose(f) == 0;
+
+  std::error_code error;
+  if (ok)
+    std::filesystem::rename(temporary, path, error);
+  if (!ok || error) {
+    std::filesystem::remove(temporary, error);
+    return false;
+  }
+  return true;
+}
+} // namespace Billyprints
@@ -0,0 +1,105 @@
+#include "FileLoader.hpp"
+#include "AigerCircuit.hpp"
+#include <filesystem>
+
+namespace Billyprints {
+
+void FileLoader::Start(LoadedFile::Kind kind, std::string path) {
+  Cancel();
+  // A cancelled load gives up at its next chunk or checkpoint
+  if (thread.joinable())
+    thread.join();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  progress = std::make_shared<LoadProgress>();
+  busy = true;
+  thread = std::thread(&FileLoader::Run, this, kind, std::move(path),
+                       progress, generation);
+}
+
+void FileLoader::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (progress)
+    progress->cancelled = true;
+  ++generation;
+  busy = false;
+  hasResult = false;
+  result = LoadedFile();
+}
+
+bool FileLoader::TakeResult(LoadedFile &out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!hasResult)
+    return false;
+  out = std::move(result);
+  result = LoadedFile();
+  hasResult = false;
+  busy = false;
+  return true;
+}
+
+bool FileLoader::Busy() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return busy;
+}
+
+float FileLoader::Progress() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return progress ? progress->fraction.load() : 0.0f;
+}
+
+void FileLoader::Stop() {
+  Cancel();
+  if (thread.joinable())
+    thread.join();
+}
+
+void FileLoader::Run(LoadedFile::Kind kind, std::string path,
+                     std::shared_ptr<LoadProgress> progress, uint64_t job) {
+  LoadedFile file;
+  file.kind = kind;
+  file.path = std::move(path);
+  switch (kind) {
+  case LoadedFile::Kind::Scene:
+    file.ok = ReadSceneFile(file.path, file.scene, file.error, progress.get());
+    break;
+  case LoadedFile::Kind::Journal:
+    file.ok = ReadJournal(file.path, file.scene, file.definitions, file.error,
+                          progress.get());
+    break;
+  case LoadedFile::Kind::Library:
+    file.ok = file.library.Open(file.path, file.error);
+    // An empty error means the file predates BPL1
+    if (!file.ok && file.error.empty()) {
+      file.legacy = true;
+      file.ok = ReadLegacyGateLibrary(file.path, file.legacyLibrary,
+                                      file.error, progress.get());
+    }
+    break;
+  case LoadedFile::Kind::AigerScene:
+  case LoadedFile::Kind::AigerGate: {
+    AigerGraph aig;
+    file.ok = ReadAiger(file.path, aig, file.error, progress.get());
+    if (!file.ok)
+      break;
+    if (kind == LoadedFile::Kind::AigerScene)
+      file.scene = AigerToScene(aig);
+    else
+      file.definition = FinalizeGateDefinition(AigerToDefinition(
+          aig, std::filesystem::path(file.path).stem().string()));
+    break;
+  }
+  }
+  progress->fraction = 1;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (job != generation)
+      return; // Cancelled or superseded
+    result = std::move(file);
+    hasResult = true;
+  }
+  if (readyCallback)
+    readyCallback();
+}
+} // namespace Billyprints
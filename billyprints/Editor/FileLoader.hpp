@@ -0,0 +1,66 @@
+#pragma once
+
+#include "GateLibrary.hpp"
+#include "SceneFile.hpp"
+#include "SceneJournal.hpp"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Billyprints {
+// A scene, autosave journal, gate library or AIGER circuit read off the UI
+// thread, ready to be applied to the editor.
+struct LoadedFile {
+  enum class Kind { Scene, Journal, Library, AigerScene, AigerGate };
+  Kind kind = Kind::Scene;
+  std::string path;
+  bool ok = false;
+  std::string error; // Set when 'ok' is false
+  SceneData scene;         // Kind::Scene, Kind::Journal, Kind::AigerScene
+  std::string definitions; // Kind::Journal, the script's define blocks
+  GateLibrary library;     // Kind::Library, with only its index read
+  // Kind::Library in the older format, decoded in full instead of 'library'
+  bool legacy = false;
+  LegacyGateLibrary legacyLibrary;
+  // Kind::AigerGate, laid out and named after the file
+  GateDefinitionRef definition;
+};
+
+// Reads one file at a time on a background thread. Starting a load cancels
+// the one in flight, and a cancelled load never delivers a result.
+class FileLoader {
+public:
+  ~FileLoader() { Stop(); }
+
+  // Called on the loader thread whenever a result becomes ready
+  void SetReadyCallback(std::function<void()> callback) {
+    readyCallback = std::move(callback);
+  }
+
+  void Start(LoadedFile::Kind kind, std::string path);
+  void Cancel();
+  // Moves the finished load into 'out'. Returns false if none is ready.
+  bool TakeResult(LoadedFile &out);
+  // True from Start() until the result is taken or the load cancelled
+  bool Busy() const;
+  // How far the current load got, from 0 to 1
+  float Progress() const;
+  void Stop();
+
+private:
+  void Run(LoadedFile::Kind kind, std::string path,
+           std::shared_ptr<LoadProgress> progress, uint64_t job);
+
+  mutable std::mutex mutex;
+  std::thread thread;
+  std::function<void()> readyCallback;
+
+  // Each load has its own progress, so cancelling one can't stop the next
+  std::shared_ptr<LoadProgress> progress;
+  uint64_t generation = 0; // Bumped by Start() and Cancel()
+  bool busy = false;
+  LoadedFile result;
+  bool hasResult = false;
+};
+} // namespace Billyprints
@@ -0,0 +1,401 @@
+#include "GateLibrary.hpp"
+#include "BinaryIO.hpp"
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+namespace Billyprints {
+
+// BPL1 layout, all integers little endian:
+//   Header   "BPL1", u32 entry count, u32 index size, u32 CRC-32 of the index
+//   Index    per gate: name, u32 color, input and output counts, record
+//            offset from the end of the index and size, u32 CRC-32 of the
+//            record
+//   Records  one per gate, back to back after the index
+// Counts, indices and lengths are LEB128 varints. A record has its own
+// table of node type names so it can be decoded on its own. Pin names
+// trail the record when the gate has them; older readers stop before.
+namespace {
+constexpr size_t HeaderSize = 16;
+// Share of a legacy library's progress spent reading the file
+constexpr float LegacyReadShare = 0.5f;
+
+void EncodeDefinition(ByteWriter &out, const GateDefinition &def) {
+  std::vector<uint32_t> types; // Type ids in the order first used
+  std::unordered_map<uint32_t, uint32_t> typeIndex;
+  for (const auto &node : def.nodes)
+    if (typeIndex.emplace(node.type, (uint32_t)types.size()).second)
+      types.push_back(node.type);
+
+  out.Varint(types.size());
+  for (uint32_t type : types) {
+    const std::string &name = GateTypeName(type);
+    out.Varint(name.size());
+    out.Bytes(name.data(), name.size());
+  }
+
+  out.Varint(def.nodes.size());
+  float x = 0, y = 0;
+  for (const auto &node : def.nodes) {
+    out.Varint(typeIndex[node.type]);
+    out.Coordinate(node.pos.x, x);
+    out.Coordinate(node.pos.y, y);
+    out.Varint(node.width);
+  }
+
+  out.Varint(def.connections.size());
+  for (const auto &conn : def.connections) {
+    out.Varint(conn.outputNodeId);
+    out.Varint(conn.outputSlot);
+    out.Varint(conn.inputNodeId);
+    out.Varint(conn.inputSlot);
+  }
+
+  out.Varint(def.inputPinIndices.size());
+  for (uint32_t index : def.inputPinIndices)
+    out.Varint(index);
+  out.Varint(def.outputPinIndices.size());
+  for (uint32_t index : def.outputPinIndices)
+    out.Varint(index);
+
+  if (def.inputNames.empty() && def.outputNames.empty())
+    return;
+  for (auto *names : {&def.inputNames, &def.outputNames}) {
+    out.Varint(names->size());
+    for (const auto &name : *names) {
+      out.Varint(name.size());
+      out.Bytes(name.data(), name.size());
+    }
+  }
+}
+
+bool DecodeDefinition(ByteReader &in, GateDefinition &def) {
+  std::vector<uint32_t> types(in.Count());
+  for (auto &type : types)
+    type = InternGateType(std::string(in.String(in.Count())));
+
+  size_t nodeCount = in.Count(4);
+  def.nodes.resize(nodeCount);
+  float x = 0, y = 0;
+  for (auto &node : def.nodes) {
+    uint64_t type = in.Varint();
+    node.pos.x = in.Coordinate(x);
+    node.pos.y = in.Coordinate(y);
+    uint64_t width = in.Varint();
+    if (type >= types.size() || width < 1 || width > MaxBusWidth)
+      return false;
+    node.type = types[type];
+    node.width = (uint8_t)width;
+  }
+
+  def.connections.resize(in.Count(4));
+  for (auto &conn : def.connections) {
+    uint64_t outputNode = in.Varint(), outputSlot = in.Varint();
+    uint64_t inputNode = in.Varint(), inputSlot = in.Varint();
+    if (outputNode >= nodeCount || inputNode >= nodeCount ||
+        outputSlot > UINT16_MAX || inputSlot > UINT16_MAX)
+      return false;
+    conn.outputNodeId = (uint32_t)outputNode;
+    conn.outputSlot = (uint16_t)outputSlot;
+    conn.inputNodeId = (uint32_t)inputNode;
+    conn.inputSlot = (uint16_t)inputSlot;
+  }
+
+  for (auto *pins : {&def.inputPinIndices, &def.outputPinIndices}) {
+    pins->resize(in.Count());
+    for (auto &index : *pins) {
+      uint64_t v = in.Varint();
+      if (v >= nodeCount)
+        return false;
+      index = (uint32_t)v;
+    }
+  }
+
+  if (in.Remaining() > 0) {
+    for (auto *names : {&def.inputNames, &def.outputNames}) {
+      names->resize(in.Count());
+      for (auto &name : *names)
+        name = std::string(in.String(in.Count()));
+    }
+    if ((!def.inputNames.empty() &&
+         def.inputNames.size() != def.inputPinIndices.size()) ||
+        (!def.outputNames.empty() &&
+         def.outputNames.size() != def.outputPinIndices.size()))
+      return false;
+  }
+  return in.Ok();
+}
+} // namespace
+
+bool GateLibrary::Open(const std::string &path, std::string &error) {
+  this->path = path;
+  entries.clear();
+  entryIndex.clear();
+  error.clear();
+
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) {
+    error = "the file can't be read";
+    return false;
+  }
+  uint8_t header[HeaderSize];
+  bool isLibrary = fread(header, 1, HeaderSize, f) == HeaderSize &&
+                   memcmp(header, "BPL1", 4) == 0;
+  if (!isLibrary) {
+    fclose(f);
+    return false;
+  }
+
+  ByteReader fields(header + 4, HeaderSize - 4);
+  uint32_t entryCount = fields.U32();
+  uint32_t indexSize = fields.U32();
+  uint32_t indexChecksum = fields.U32();
+
+  // Only the index is read; records are fetched by Load()
+  std::error_code sizeError;
+  uintmax_t fileSize = std::filesystem::file_size(path, sizeError);
+  std::vector<uint8_t> index;
+  bool ok = !sizeError && fileSize >= HeaderSize &&
+            indexSize <= fileSize - HeaderSize;
+  if (ok) {
+    index.resize(indexSize);
+    ok = fread(index.data(), 1, indexSize, f) == indexSize;
+  }
+  fclose(f);
+  if (!ok) {
+    error = "the file is truncated";
+    return false;
+  }
+  if (Crc32(index.data(), index.size()) != indexChecksum) {
+    error = "the index checksum doesn't match; the file is damaged";
+    return false;
+  }
+
+  ByteReader in(index.data(), index.size());
+  if (entryCount > in.Remaining() / 8) {
+    error = "the index is damaged";
+    return false;
+  }
+  entries.resize(entryCount);
+  for (auto &entry : entries) {
+    entry.name = std::string(in.String(in.Count()));
+    entry.color = in.U32();
+    entry.inputCount = (uint32_t)in.Varint();
+    entry.outputCount = (uint32_t)in.Varint();
+    uint64_t offset = in.Varint(), size = in.Varint();
+    entry.checksum = in.U32();
+    entry.offset = HeaderSize + indexSize + offset;
+    entry.size = (uint32_t)size;
+    if (offset > (uint64_t)fileSize || size > (uint64_t)fileSize ||
+        entry.offset + size > (uint64_t)fileSize)
+      in.Fail();
+  }
+  if (!in.Ok()) {
+    entries.clear();
+    error = "the index is damaged";
+    return false;
+  }
+
+  // Later entries win, like registering the same name twice
+  for (size_t i = 0; i < entries.size(); ++i)
+    entryIndex[entries[i].name] = i;
+  return true;
+}
+
+GateLibrary::Entry *GateLibrary::Find(const std::string &name) {
+  auto it = entryIndex.find(name);
+  return it != entryIndex.end() ? &entries[it->second] : nullptr;
+}
+
+GateDefinitionRef GateLibrary::Load(Entry &entry, std::string &error) {
+  if (entry.definition)
+    return entry.definition;
+
+  std::vector<uint8_t> record;
+  if (!ReadFileRange(path, entry.offset, entry.size, record)) {
+    error = "the file can't be read";
+    return nullptr;
+  }
+  if (Crc32(record.data(), record.size()) != entry.checksum) {
+    error = "the checksum doesn't match; the file is damaged";
+    return nullptr;
+  }
+
+  GateDefinition def;
+  def.name = entry.name;
+  def.color = entry.color;
+  ByteReader in(record.data(), record.size());
+  if (!DecodeDefinition(in, def)) {
+    error = "the definition is damaged";
+    return nullptr;
+  }
+  entry.definition = FinalizeGateDefinition(std::move(def));
+  return entry.definition;
+}
+
+// The older format is a size_t gate count, then per gate: name, u32
+// color, nodes (type name, ImVec2 position and an int id), connections (int
+// node id and slot name per end) and the ids of its input and output pins.
+// Strings are a size_t length and bytes, lists a size_t count. Bus widths
+// may follow under the "BUSW" tag, one byte per node of every gate in order.
+bool ReadLegacyGateLibrary(const std::string &path, LegacyGateLibrary &library,
+                           std::string &error, LoadProgress *progress) {
+  std::vector<uint8_t> bytes;
+  if (!ReadWholeFile(path, bytes, progress, LegacyReadShare)) {
+    error = progress && progress->cancelled ? "cancelled"
+                                            : "the file can't be read";
+    return false;
+  }
+
+  ByteReader in(bytes.data(), bytes.size());
+  auto size = [&] {
+    size_t v = 0;
+    in.Raw(&v, sizeof(v));
+    return v;
+  };
+  auto string = [&] { return std::string(in.String(size())); };
+  auto integer = [&] {
+    int v = 0;
+    in.Raw(&v, sizeof(v));
+    return v;
+  };
+  // Counts of records that take at least 'minSize' bytes each
+  auto count = [&](size_t minSize) {
+    size_t n = size();
+    if (n > in.Remaining() / minSize)
+      in.Fail();
+    return in.Ok() ? n : 0;
+  };
+  std::unordered_map<std::string, uint32_t> typeIndex;
+
+  // A gate takes at least its name length, color and four counts
+  size_t gateCount = count(5 * sizeof(size_t) + sizeof(ImU32));
+  library.definitions.resize(gateCount);
+  for (size_t i = 0; i < gateCount && in.Ok(); ++i) {
+    if (progress) {
+      if (progress->cancelled) {
+        error = "cancelled";
+        return false;
+      }
+      progress->Report(LegacyReadShare, 1, i, gateCount);
+    }
+    GateDefinition &def = library.definitions[i];
+    def.name = string();
+    in.Raw(&def.color, sizeof(ImU32));
+
+    // Files store an explicit ID per node; remap those to indices
+    std::map<int, uint32_t> fileIdToIndex;
+    size_t nodeCount = count(sizeof(size_t) + sizeof(ImVec2) + sizeof(int));
+    def.nodes.resize(nodeCount);
+    for (size_t j = 0; j < nodeCount && in.Ok(); ++j) {
+      NodeDefinition &node = def.nodes[j];
+      auto type = typeIndex.emplace(string(),
+                                    (uint32_t)library.typeNames.size());
+      if (type.second)
+        library.typeNames.push_back(type.first->first);
+      node.type = type.first->second;
+      in.Raw(&node.pos, sizeof(ImVec2));
+      fileIdToIndex[integer()] = (uint32_t)j;
+    }
+
+    size_t connCount = count(2 * (sizeof(int) + sizeof(size_t)));
+    def.connections.reserve(connCount);
+    for (size_t j = 0; j < connCount && in.Ok(); ++j) {
+      int inputNodeId = integer();
+      int inputSlot = SlotIndexFromName(string());
+      int outputNodeId = integer();
+      int outputSlot = SlotIndexFromName(string());
+      auto input = fileIdToIndex.find(inputNodeId);
+      auto output = fileIdToIndex.find(outputNodeId);
+      // Old writers could leave out a connection's node; skip those
+      if (input == fileIdToIndex.end() || output == fileIdToIndex.end() ||
+          inputSlot < 0 || outputSlot < 0)
+        continue;
+      if (inputSlot > UINT16_MAX || outputSlot > UINT16_MAX) {
+        in.Fail();
+        break;
+      }
+      ConnectionDefinition conn;
+      conn.inputNodeId = input->second;
+      conn.inputSlot = (uint16_t)inputSlot;
+      conn.outputNodeId = output->second;
+      conn.outputSlot = (uint16_t)outputSlot;
+      def.connections.push_back(conn);
+    }
+
+    for (auto *pins : {&def.inputPinIndices, &def.outputPinIndices}) {
+      size_t pinCount = count(sizeof(int));
+      for (size_t j = 0; j < pinCount && in.Ok(); ++j) {
+        auto pin = fileIdToIndex.find(integer());
+        if (pin != fileIdToIndex.end())
+          pins->push_back(pin->second);
+      }
+    }
+  }
+  if (!in.Ok()) {
+    error = "the file is truncated";
+    return false;
+  }
+
+  char tag[4];
+  if (in.Remaining() >= 4 && in.Raw(tag, 4) && memcmp(tag, "BUSW", 4) == 0) {
+    for (auto &def : library.definitions) {
+      for (auto &node : def.nodes) {
+        in.Raw(&node.width, 1);
+        if (node.width < 1 || node.width > MaxBusWidth)
+          in.Fail();
+      }
+    }
+    if (!in.Ok()) {
+      error = "the bus widths are damaged";
+      return false;
+    }
+  }
+  return true;
+}
+
+void LegacyGateLibrary::InternTypes() {
+  std::vector<uint32_t> ids;
+  ids.reserve(typeNames.size());
+  for (const auto &name : typeNames)
+    ids.push_back(InternGateType(name));
+  for (auto &def : definitions)
+    for (auto &node : def.nodes)
+      node.type = ids[node.type];
+}
+
+bool WriteGateLibrary(const std::string &path,
+                      const std::vector<GateDefinitionRef> &definitions) {
+  ByteWriter records;
+  std::vector<size_t> recordStarts;
+  recordStarts.reserve(definitions.size() + 1);
+  for (const auto &def : definitions) {
+    recordStarts.push_back(records.bytes.size());
+    EncodeDefinition(records, *def);
+  }
+  recordStarts.push_back(records.bytes.size());
+
+  ByteWriter index;
+  for (size_t i = 0; i < definitions.size(); ++i) {
+    const GateDefinition &def = *definitions[i];
+    size_t start = recordStarts[i], size = recordStarts[i + 1] - start;
+    index.Varint(def.name.size());
+    index.Bytes(def.name.data(), def.name.size());
+    index.U32(def.color);
+    index.Varint(def.inputPinIndices.size());
+    index.Varint(def.outputPinIndices.size());
+    index.Varint(start);
+    index.Varint(size);
+    index.U32(Crc32(records.bytes.data() + start, size));
+  }
+
+  ByteWriter header;
+  header.Bytes("BPL1", 4);
+  header.U32((uint32_t)definitions.size());
+  header.U32((uint32_t)index.bytes.size());
+  header.U32(Crc32(index.bytes.data(), index.bytes.size()));
+
+  return WriteFileAtomically(path,
+                             {&header.bytes, &index.bytes, &records.bytes});
+}
+} // namespace Billyprints
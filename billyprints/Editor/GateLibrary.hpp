@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../Nodes/Gates/CustomGate.hpp"
+#include "BinaryIO.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Billyprints {
+// A BPL1 gate library opened for lazy loading. Opening reads only the
+// header and the name index; each definition is decoded from the file the
+// first time it is asked for.
+class GateLibrary {
+public:
+  struct Entry {
+    std::string name;
+    // Enough to show the gate in the palette before it is decoded
+    ImU32 color;
+    uint32_t inputCount, outputCount;
+    uint64_t offset; // Of the record, from the start of the file
+    uint32_t size;
+    uint32_t checksum;            // CRC-32 of the record
+    GateDefinitionRef definition; // Set once decoded
+  };
+
+  // Reads the index of 'path'. Returns false with 'error' set if the index
+  // is damaged, or with 'error' empty if the file isn't a BPL1 library at
+  // all, so callers can fall back to the older format.
+  bool Open(const std::string &path, std::string &error);
+
+  const std::vector<Entry> &Entries() const { return entries; }
+  Entry *Find(const std::string &name);
+
+  // Decodes 'entry' on first use and returns the same definition after
+  // that. Returns nullptr with 'error' set if the record can't be read or
+  // is damaged.
+  GateDefinitionRef Load(Entry &entry, std::string &error);
+
+private:
+  std::string path;
+  std::vector<Entry> entries;
+  std::unordered_map<std::string, size_t> entryIndex;
+};
+
+// A library in the format before BPL1, which holds every definition in full.
+// It is decoded off the UI thread, where gate types can't be interned, so
+// node types index 'typeNames' until InternTypes() is called on the UI
+// thread.
+struct LegacyGateLibrary {
+  std::vector<std::string> typeNames;
+  std::vector<GateDefinition> definitions;
+  void InternTypes();
+};
+
+// Decodes the whole of a pre-BPL1 library. Returns false with 'error' set if
+// the file is damaged, in which case 'library' is left partly filled.
+bool ReadLegacyGateLibrary(const std::string &path, LegacyGateLibrary &library,
+                           std::string &error,
+                           LoadProgress *progress = nullptr);
+
+// Writes 'definitions' as a BPL1 library, replacing 'path' only once the
+// whole file is written. Returns false if the file can't be written.
+bool WriteGateLibrary(const std::string &path,
+                      const std::vector<GateDefinitionRef> &definitions);
+} // namespace Billyprints
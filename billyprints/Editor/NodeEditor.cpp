@@ -2,9 +2,12 @@
 #define IMGUI_DEFINE_MATH_OPERATORS
 #endif
 
+#include "../Simulation/CompiledCircuit.hpp"
 #include "NodeEditor.hpp"
+#include <algorithm>
 #include <imgui_internal.h>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -17,6 +20,71 @@ Node *nodeToEdit = nullptr;
 Node *nodeToDelete = nullptr;
 bool nodeHoveredForContextMenu = false;
 
+void NodeEditor::RefreshPalette() {
+  if (!paletteDirty && paletteNodeSourceCount == availableNodes.size() &&
+      paletteGateSourceCount == availableGates.size())
+    return;
+
+  auto shortLabel = [](const std::string &name) {
+    return name.size() > 4 ? name.substr(0, 3) + "." : name;
+  };
+  auto describe = [&](const std::function<Node *()> &factory) {
+    Node *tmp = factory();
+    PaletteEntry entry;
+    entry.name = tmp->title;
+    entry.shortLabel = shortLabel(entry.name);
+    entry.color = tmp->GetColor();
+    entry.inputSlotCount = tmp->inputSlotCount;
+    entry.outputSlotCount = tmp->outputSlotCount;
+    entry.factory = factory;
+    delete tmp;
+    return entry;
+  };
+
+  paletteNodes.clear();
+  for (auto &f : availableNodes)
+    paletteNodes.push_back(describe(f));
+
+  paletteGates.clear();
+  for (auto &f : availableGates)
+    paletteGates.push_back(
+        describe([f]() -> Node * { return f(); }));
+
+  // Library gates are described from the index so that listing them
+  // doesn't decode every definition. Each name is listed once: gates loaded
+  // after a library replace its gates of the same name (see ForgetGate()),
+  // and so does a later library.
+  std::set<std::string> listed;
+  for (const auto &entry : paletteGates)
+    listed.insert(entry.name);
+  for (auto library = gateLibraries.begin(); library != gateLibraries.end();
+       ++library) {
+    for (const auto &gate : library->Entries()) {
+      auto replaces = [&](GateLibrary &later) {
+        return later.Find(gate.name) != nullptr;
+      };
+      if (listed.count(gate.name) ||
+          std::any_of(library + 1, gateLibraries.end(), replaces))
+        continue;
+      PaletteEntry entry;
+      entry.name = gate.name;
+      entry.shortLabel = shortLabel(gate.name);
+      entry.color = gate.color;
+      entry.inputSlotCount = (int)gate.inputCount;
+      entry.outputSlotCount = (int)gate.outputCount;
+      entry.factory = [name = gate.name, in = entry.inputSlotCount,
+                       out = entry.outputSlotCount]() {
+        return CreateNodeByTypeOrPlaceholder(name, in, out);
+      };
+      paletteGates.push_back(std::move(entry));
+    }
+  }
+
+  paletteNodeSourceCount = availableNodes.size();
+  paletteGateSourceCount = availableGates.size();
+  paletteDirty = false;
+}
+
 void NodeEditor::RenderDock() {
   if (!showDock)
     return;
@@ -29,7 +97,7 @@ void NodeEditor::RenderDock() {
   ImVec2 workPos = viewport->WorkPos;
   ImVec2 workSize = viewport->WorkSize;
 
-  size_t totalIcons = availableNodes.size() + availableGates.size();
+  size_t totalIcons = paletteNodes.size() + paletteGates.size();
   float totalWidth = totalIcons * (iconSize + iconPadding) + iconPadding;
 
   ImVec2 dockPos = ImVec2(workPos.x + (workSize.x - totalWidth) * 0.5f,
@@ -58,8 +126,7 @@ void NodeEditor::RenderDock() {
   float xOffset = iconPadding;
   ImVec2 mousePos = ImGui::GetMousePos();
 
-  auto renderIcon = [&](const char *label, std::function<Node *()> factory,
-                        ImU32 color) {
+  auto renderIcon = [&](const PaletteEntry &entry) {
     ImVec2 center = ImVec2(dockPos.x + xOffset + iconSize * 0.5f,
                            dockPos.y + dockHeight * 0.5f);
     bool hovered = (mousePos.x >= dockPos.x + xOffset &&
@@ -76,16 +143,15 @@ void NodeEditor::RenderDock() {
     // Icon Circle
     drawList->AddCircleFilled(
         animatedCenter, currentSize * 0.5f,
-        (color & 0x00FFFFFF) | ((int)(0xDD * dockAlphaMultiplier) << 24), 32);
+        (entry.color & 0x00FFFFFF) | ((int)(0xDD * dockAlphaMultiplier) << 24),
+        32);
     drawList->AddCircle(
         animatedCenter, currentSize * 0.5f,
         IM_COL32(255, 255, 255, (int)(80 * dockAlphaMultiplier)), 32, 1.5f);
 
     // Symbol/Label in center
     ImGui::PushFont(ImGui::GetIO().Fonts->Fonts[0]); // Use default font
-    std::string shortLabel = label;
-    if (shortLabel.size() > 4)
-      shortLabel = shortLabel.substr(0, 3) + ".";
+    const std::string &shortLabel = entry.shortLabel;
 
     float fontSize = 14.0f * scale;
     ImVec2 textSize = ImGui::CalcTextSize(shortLabel.c_str());
@@ -102,12 +168,26 @@ void NodeEditor::RenderDock() {
     // Full Label Tooltip or hint
     if (hovered) {
       ImGui::BeginTooltip();
-      ImGui::Text("%s", label);
+      ImGui::Text("%s", entry.name.c_str());
+      // What compiling a loaded custom gate saved, once an instance has
+      // been compiled; drawing never compiles
+      auto def = CustomGate::GateRegistry.find(entry.name);
+      CompiledCircuitRef circuit;
+      if (def != CustomGate::GateRegistry.end())
+        circuit = FindCompiledCircuit(def->second);
+      if (circuit) {
+        ImGui::TextDisabled("%zu gates compiled to %zu ANDs",
+                            circuit->sourceGates, circuit->ands.size());
+        for (const auto &pass : circuit->passes)
+          ImGui::TextDisabled("  %s: -%zu", pass.name, pass.removed);
+      }
       ImGui::EndTooltip();
 
       if (ImGui::IsMouseClicked(0)) {
-        Node *newNode = factory();
+        Node *newNode = entry.factory();
         nodes.push_back(newNode);
+        journal.Added(newNode);
+        NodeAdded(newNode);
         ImNodes::AutoPositionNode(newNode);
         // Attempt to make the node active immediately for dragging
         ImGui::SetActiveID(ImGui::GetID(newNode), ImGui::GetCurrentWindow());
@@ -117,17 +197,55 @@ void NodeEditor::RenderDock() {
     xOffset += iconSize + iconPadding;
   };
 
-  for (auto &f : availableNodes) {
-    Node *tmp = f();
-    renderIcon(tmp->title, f, tmp->GetColor());
-    delete tmp;
+  for (const auto &entry : paletteNodes)
+    renderIcon(entry);
+
+  for (const auto &entry : paletteGates)
+    renderIcon(entry);
+}
+
+void NodeEditor::RenderLoadingBanner() {
+  if (!Loading())
+    return;
+
+  // Reading happens on the loader thread, building on this one
+  float fraction = fileLoader.Progress();
+  const char *stage = "Reading";
+  if (sceneBuild) {
+    const SceneData &scene = sceneBuild->scene;
+    size_t total = scene.nodes.size() + scene.connections.size();
+    size_t done = sceneBuild->nextNode + sceneBuild->nextConnection;
+    fraction = total ? (float)done / total : 1.0f;
+    stage = "Building";
   }
 
-  for (auto &f : availableGates) {
-    Node *tmp = f();
-    renderIcon(tmp->title, f, tmp->GetColor());
-    delete tmp;
+  ImGui::PushStyleColor(ImGuiCol_ChildBg, IM_COL32(40, 70, 120, 220));
+  ImGui::BeginChild("LoadingBanner", ImVec2(0, 40), true,
+                    ImGuiWindowFlags_NoScrollbar |
+                        ImGuiWindowFlags_NoScrollWithMouse);
+  ImGui::Text("%s...", stage);
+  ImGui::SameLine();
+  ImGui::ProgressBar(fraction,
+                     ImVec2(ImGui::GetContentRegionAvail().x - 90, 0));
+  ImGui::SameLine();
+  if (ImGui::Button("Cancel", ImVec2(80, 0))) {
+    CancelLoad();
+    debugMsg = "Loading cancelled";
   }
+  ImGui::EndChild();
+  ImGui::PopStyleColor();
+}
+
+void NodeEditor::DropNodeReferences() {
+  showConnectionDropMenu = false;
+  dropSourceNode = nullptr;
+  // The payload points at the old node's slot position
+  ImGui::ClearDragDrop();
+  showCodeEditor = false;
+  gateBeingEdited = nullptr;
+  nodeToDuplicate = nullptr;
+  nodeToEdit = nullptr;
+  nodeToDelete = nullptr;
 }
 
 void NodeEditor::DuplicateNode(Node *node) {
@@ -135,8 +253,11 @@ void NodeEditor::DuplicateNode(Node *node) {
     return;
   Node *newNode = CreateNodeByType(node->title);
   if (newNode) {
+    newNode->SetWidth(node->width);
     newNode->pos = ImVec2(node->pos.x + 30.0f, node->pos.y + 30.0f);
     nodes.push_back(newNode);
+    journal.Added(newNode);
+    NodeAdded(newNode);
     ImNodes::AutoPositionNode(newNode);
   }
 }
@@ -144,6 +265,7 @@ void NodeEditor::DuplicateNode(Node *node) {
 void NodeEditor::SelectAllNodes() {
   for (auto *node : nodes) {
     node->selected = true;
+    selectedNodes.insert(node);
   }
 }
 
@@ -151,6 +273,7 @@ void NodeEditor::DeselectAllNodes() {
   for (auto *node : nodes) {
     node->selected = false;
   }
+  selectedNodes.clear();
 }
 
 void NodeEditor::DuplicateSelectedNodes() {
@@ -169,9 +292,11 @@ void NodeEditor::DuplicateSelectedNodes() {
     node->selected = false;
     Node *newNode = CreateNodeByType(node->title);
     if (newNode) {
+      newNode->SetWidth(node->width);
       newNode->pos = ImVec2(node->pos.x + 30.0f, node->pos.y + 30.0f);
       newNode->selected = true;
       nodes.push_back(newNode);
+      journal.Added(newNode);
       originalToDuplicate[node] = newNode;
     }
   }
@@ -196,9 +321,12 @@ void NodeEditor::DuplicateSelectedNodes() {
 
         ((Node *)newConn.inputNode)->connections.push_back(newConn);
         ((Node *)newConn.outputNode)->connections.push_back(newConn);
+        journal.Connected(newConn);
       }
     }
   }
+  for (const auto &duplicate : originalToDuplicate)
+    NodeAdded(duplicate.second);
 }
 
 void NodeEditor::FrameSelectedNodes() {
@@ -331,7 +459,7 @@ void NodeEditor::HandleKeyBindings() {
   // -: Zoom out
   if (ImGui::IsKeyPressed(ImGuiKey_Minus) || ImGui::IsKeyPressed(ImGuiKey_KeypadSubtract)) {
     if (canvas) {
-      canvas->Zoom = ImMax(canvas->Zoom / 1.2f, 0.25f);
+      canvas->Zoom = ImMax(canvas->Zoom / 1.2f, MinZoom);
     }
   }
 
@@ -375,44 +503,18 @@ void NodeEditor::HandleKeyBindings() {
 }
 
 void NodeEditor::UpdateGateDefinitionFromCurrentScene(const std::string &name) {
-  for (auto &def : customGateDefinitions) {
-    if (def.name == name) {
-      def.nodes.clear();
-      def.connections.clear();
-      def.inputPinIndices.clear();
-      def.outputPinIndices.clear();
-
-      std::map<Node *, int> nodeToId;
-      int idCounter = 0;
-
-      for (auto *n : nodes) {
-        NodeDefinition nDef;
-        nDef.type = n->title;
-        nDef.pos = n->pos;
-        nDef.id = idCounter++;
-        def.nodes.push_back(nDef);
-        nodeToId[n] = nDef.id;
-
-        if (nDef.type == "In")
-          def.inputPinIndices.push_back(nDef.id);
-        else if (nDef.type == "Out")
-          def.outputPinIndices.push_back(nDef.id);
-      }
+  // Decodes a library gate nothing has used yet into customGateDefinitions
+  CustomGate::FindDefinition(name);
+  for (auto &defRef : customGateDefinitions) {
+    if (defRef->name == name) {
+      // Definitions are immutable; build a replacement and swap it in.
+      // Existing instances keep the definition they were created from.
+      GateDefinition def = BuildGateDefinition(name, nodes);
+      def.color = defRef->color;
+      defRef = FinalizeGateDefinition(std::move(def));
 
-      for (auto *n : nodes) {
-        for (const auto &conn : n->connections) {
-          if (conn.outputNode == n) {
-            ConnectionDefinition cDef;
-            cDef.outputNodeId = nodeToId[n];
-            cDef.outputSlot = conn.outputSlot;
-            cDef.inputNodeId = nodeToId[(Node *)conn.inputNode];
-            cDef.inputSlot = conn.inputSlot;
-            def.connections.push_back(cDef);
-          }
-        }
-      }
       // Update the global registry as well
-      CustomGate::GateRegistry[name] = def;
+      CustomGate::RegisterDefinition(defRef);
       break;
     }
   }
@@ -420,29 +522,104 @@ void NodeEditor::UpdateGateDefinitionFromCurrentScene(const std::string &name) {
 
 inline void NodeEditor::RenderNodes() {
   anyNodeDragged = false;
-  for (auto it = nodes.begin(); it != nodes.end();) {
-    Node *node = *it;
+
+  if (spatialIndexDirty || nodeIndex.Size() != nodes.size())
+    RebuildSpatialIndex();
+
+  // Only nodes overlapping the view are submitted. Selected nodes are always
+  // rendered so dragging and selection keep working past the view edges, and
+  // a freshly placed node must render once to be auto-positioned.
+  ImRect view = GetVisibleCanvasRect();
+  visibleNodes.clear();
+  nodeIndex.Query(view, visibleNodes);
+  auto addOffscreen = [&](Node *node) {
+    const ImRect *bounds = nodeIndex.GetBounds(node);
+    if (bounds && !bounds->Overlaps(view))
+      visibleNodes.push_back(node);
+  };
+  for (Node *node : selectedNodes)
+    addOffscreen(node);
+  Node *autoPositioned = (Node *)ImNodes::GetAutoPositionNode();
+  if (autoPositioned && !selectedNodes.count(autoPositioned))
+    addOffscreen(autoPositioned);
+
+  auto *canvas = ImNodes::GetCurrentCanvas();
+  bool deletePressed =
+      ImGui::IsKeyPressedMap(ImGuiKey_Delete) && ImGui::IsWindowFocused();
+  std::vector<Node *> deleted;
+
+  bool overview = canvas->Zoom < OverviewZoom;
+  overviewNodes.clear();
+
+  for (Node *node : visibleNodes) {
+    // Selected nodes stay interactive so they can still be dragged or deleted
+    if (overview && !node->selected && node != autoPositioned) {
+      overviewNodes.push_back(node);
+      continue;
+    }
+
+    ImVec2 prevPos = node->pos;
+    ImVec2 prevSize = node->size;
 
     RenderNode(node);
 
+    node->size = ImGui::GetItemRectSize() / canvas->Zoom;
+    bool moved = node->pos.x != prevPos.x || node->pos.y != prevPos.y;
+    if (moved || node->size.x != prevSize.x || node->size.y != prevSize.y) {
+      nodeIndex.Update(node, NodeBounds(node));
+      InvalidateWires(node);
+      journal.Touched(node);
+    }
+    // Only positions appear in the script, not the measured size
+    nodesMoved |= moved;
+    if (node->scriptEdited) {
+      node->scriptEdited = false;
+      ++sceneRevision;
+    }
+    if (node->selected)
+      selectedNodes.insert(node);
+    else
+      selectedNodes.erase(node);
+
     if (ImGui::IsItemActive() && ImGui::IsMouseDragging(0))
       anyNodeDragged = true;
 
-    if (node->selected && ImGui::IsKeyPressedMap(ImGuiKey_Delete) &&
-        ImGui::IsWindowFocused()) {
-      for (auto &connection : node->connections) {
-        if (connection.outputNode == node) {
-          ((Node *)connection.inputNode)->DeleteConnection(connection);
-        } else {
-          ((Node *)connection.outputNode)->DeleteConnection(connection);
-        }
-      }
-      node->connections.clear();
+    if (node->selected && deletePressed)
+      deleted.push_back(node);
+  }
+
+  // A drag is written to the script once, when it ends
+  if (nodesMoved && !anyNodeDragged) {
+    nodesMoved = false;
+    ++sceneRevision;
+  }
+
+  RenderWires(view);
+  RenderOverviewNodes();
+  HandleNewConnection();
+
+  if (deleted.empty())
+    return;
 
-      delete node;
-      it = nodes.erase(it);
-    } else
-      ++it;
+  for (Node *node : deleted)
+    NodeRemoved(node);
+  for (Node *node : deleted) {
+    for (auto &connection : node->connections) {
+      if (connection.outputNode == node) {
+        ((Node *)connection.inputNode)->DeleteConnection(connection);
+      } else {
+        ((Node *)connection.outputNode)->DeleteConnection(connection);
+      }
+    }
+    node->connections.clear();
+  }
+  std::unordered_set<Node *> deletedSet(deleted.begin(), deleted.end());
+  nodes.erase(std::remove_if(nodes.begin(), nodes.end(),
+                             [&](Node *n) { return deletedSet.count(n) != 0; }),
+              nodes.end());
+  for (Node *node : deleted) {
+    journal.Removed(node);
+    delete node;
   }
 }
 
@@ -451,19 +628,21 @@ inline void NodeEditor::RenderContextMenu() {
       ImGui::BeginPopupContextWindow("NodesContextMenu",
                                      ImGuiPopupFlags_MouseButtonRight |
                                          ImGuiPopupFlags_NoOpenOverItems)) {
-    for (const auto &desc : availableNodes) {
-      auto item = desc();
-      if (ImGui::MenuItem(item->title)) {
-        nodes.push_back(item);
+    for (const auto &entry : paletteNodes) {
+      if (ImGui::MenuItem(entry.name.c_str())) {
+        nodes.push_back(entry.factory());
+        journal.Added(nodes.back());
+        NodeAdded(nodes.back());
         ImNodes::AutoPositionNode(nodes.back());
       }
     }
     ImGui::Separator();
     if (ImGui::BeginMenu("Gates")) {
-      for (const auto &desc : availableGates) {
-        auto item = desc();
-        if (ImGui::MenuItem(item->title)) {
-          nodes.push_back(item);
+      for (const auto &entry : paletteGates) {
+        if (ImGui::MenuItem(entry.name.c_str())) {
+          nodes.push_back(entry.factory());
+          journal.Added(nodes.back());
+          NodeAdded(nodes.back());
           ImNodes::AutoPositionNode(nodes.back());
         }
       }
@@ -479,6 +658,20 @@ inline void NodeEditor::RenderContextMenu() {
 
 void NodeEditor::Redraw() {
   nodeHoveredForContextMenu = false;
+  RefreshPalette();
+
+  // Scripts are parsed in the background while the user types. Once the
+  // editor loses focus a pending parse is finished here, before anything
+  // can edit the graph it would replace.
+  if (scriptEditor.IsActive())
+    PollScriptParse();
+  else
+    FlushScriptParse();
+
+  // Scenes and libraries arrive from the loader thread
+  PollFileLoad();
+  PollSceneSaves();
+  Autosave();
 
   // Handle global interaction requests
   if (nodeToDuplicate) {
@@ -487,47 +680,67 @@ void NodeEditor::Redraw() {
   }
   if (nodeToEdit) {
     // Check if it's a custom gate or a standard gate
-    bool isCustom = CustomGate::GateRegistry.count(nodeToEdit->title);
-
-    if (isCustom) {
+    bool isCustom = CustomGate::FindDefinition(nodeToEdit->title) != nullptr;
+
+    if (isCustom && Loading()) {
+      // The loaded scene would replace the gate's internals, and leaving
+      // edit mode would restore the old script over it
+      debugMsg = "Finish or cancel the current load before editing " +
+                 std::string(nodeToEdit->title);
+    } else if (isCustom) {
+      SyncScriptText();
       originalSceneScript = currentScript;
       editingGateName = nodeToEdit->title;
 
       // Find the definition
-      for (const auto &def : customGateDefinitions) {
+      for (const auto &defRef : customGateDefinitions) {
+        const GateDefinition &def = *defRef;
         if (def.name == editingGateName) {
           // Clear current nodes
+          journal.Invalidate();
           for (auto *n : nodes)
             delete n;
           nodes.clear();
+          MarkSceneChanged();
 
-          // Map for ID reconstruction
-          std::map<int, Node *> idToNode;
+          // Definition nodes are addressed by index
+          std::vector<Node *> idToNode(def.nodes.size(), nullptr);
 
           // 1. Create nodes
-          for (const auto &nodeDef : def.nodes) {
-            Node *n = CreateNodeByType(nodeDef.type);
+          for (size_t i = 0; i < def.nodes.size(); ++i) {
+            const auto &nodeDef = def.nodes[i];
+            Node *n = CreateNodeByType(GateTypeName(nodeDef.type));
             if (n) {
+              n->SetWidth(nodeDef.width);
               n->pos = nodeDef.pos;
-              n->id = "n" + std::to_string(nodeDef.id);
+              n->id = "n" + std::to_string(i);
               nodes.push_back(n);
-              idToNode[nodeDef.id] = n;
+              idToNode[i] = n;
             }
           }
 
           // 2. Create connections
           for (const auto &connDef : def.connections) {
-            if (idToNode.count(connDef.inputNodeId) &&
-                idToNode.count(connDef.outputNodeId)) {
+            Node *inputNode = connDef.inputNodeId < idToNode.size()
+                                  ? idToNode[connDef.inputNodeId]
+                                  : nullptr;
+            Node *outputNode = connDef.outputNodeId < idToNode.size()
+                                   ? idToNode[connDef.outputNodeId]
+                                   : nullptr;
+            if (inputNode && outputNode &&
+                connDef.inputSlot < inputNode->inputSlotCount &&
+                connDef.outputSlot < outputNode->outputSlotCount) {
               Connection conn;
-              conn.inputNode = idToNode[connDef.inputNodeId];
-              conn.inputSlot = connDef.inputSlot;
-              conn.outputNode = idToNode[connDef.outputNodeId];
-              conn.outputSlot = connDef.outputSlot;
+              conn.inputNode = inputNode;
+              conn.inputSlot = inputNode->inputSlots[connDef.inputSlot].title;
+              conn.outputNode = outputNode;
+              conn.outputSlot =
+                  outputNode->outputSlots[connDef.outputSlot].title;
               ((Node *)conn.inputNode)->connections.push_back(conn);
               ((Node *)conn.outputNode)->connections.push_back(conn);
             }
           }
+          scriptWorker.Cancel();
           UpdateScriptFromNodes();
           lastParsedScript = currentScript;
           break;
@@ -544,6 +757,7 @@ void NodeEditor::Redraw() {
   if (nodeToDelete) {
     for (auto it = nodes.begin(); it != nodes.end(); ++it) {
       if (*it == nodeToDelete) {
+        NodeRemoved(*it);
         // Handle connections
         for (auto &connection : (*it)->connections) {
           if (connection.outputNode == *it) {
@@ -552,6 +766,7 @@ void NodeEditor::Redraw() {
             ((Node *)connection.outputNode)->DeleteConnection(connection);
           }
         }
+        journal.Removed(*it);
         delete *it;
         nodes.erase(it);
         break;
@@ -561,8 +776,10 @@ void NodeEditor::Redraw() {
   }
 
   Node::GlobalFrameCount++;
-  auto context = ImNodes::Ez::CreateContext();
-  IM_UNUSED(context);
+  SimulateNodes();
+  if (!nodesContext)
+    nodesContext = ImNodes::Ez::CreateContext();
+  ImNodes::Ez::SetContext(nodesContext);
 
   // --- REMOVED REDUNDANT MENU BAR BLOCK ---
 
@@ -641,11 +858,14 @@ void NodeEditor::Redraw() {
     RenderFilePicker();
     ImGui::Separator();
 
+    // One load at a time, see CanStartLoad()
+    ImGui::BeginDisabled(Loading());
     if (ImGui::Button("Load", ImVec2(120, 0))) {
       std::filesystem::path fullPath = currentPath / currentFilename;
       LoadGates(fullPath.string());
       ImGui::CloseCurrentPopup();
     }
+    ImGui::EndDisabled();
     ImGui::SameLine();
     if (ImGui::Button("Cancel", ImVec2(120, 0))) {
       ImGui::CloseCurrentPopup();
@@ -728,11 +948,13 @@ void NodeEditor::Redraw() {
     RenderSceneFilePicker();
     ImGui::Separator();
 
+    ImGui::BeginDisabled(Loading());
     if (ImGui::Button("Load##SceneLoad", ImVec2(120, 0))) {
       std::filesystem::path fullPath = currentPath / sceneFilename;
       LoadScene(fullPath.string());
       ImGui::CloseCurrentPopup();
     }
+    ImGui::EndDisabled();
     ImGui::SameLine();
     if (ImGui::Button("Cancel##SceneLoad", ImVec2(120, 0))) {
       ImGui::CloseCurrentPopup();
@@ -740,6 +962,150 @@ void NodeEditor::Redraw() {
     ImGui::EndPopup();
   }
 
+  // Export File Picker Helper (filters by extension, fills 'filename')
+  auto RenderExportFilePicker =
+      [&](char *filename, std::initializer_list<const char *> extensions) {
+        ImGui::TextWrapped("Path: %s", currentPath.string().c_str());
+        if (ImGui::Button("Up##Export")) {
+          if (currentPath.has_parent_path())
+            currentPath = currentPath.parent_path();
+        }
+
+        ImGui::Separator();
+        ImGui::BeginChild("ExportFileList", ImVec2(400, 200), true);
+
+        std::vector<std::filesystem::directory_entry> dirs, files;
+        try {
+          for (const auto &entry :
+               std::filesystem::directory_iterator(currentPath)) {
+            if (entry.is_directory()) {
+              dirs.push_back(entry);
+              continue;
+            }
+            for (const char *extension : extensions)
+              if (entry.path().extension() == extension)
+                files.push_back(entry);
+          }
+        } catch (...) {
+        }
+
+        for (const auto &dir : dirs) {
+          std::string dirName = "[DIR] " + dir.path().filename().string();
+          if (ImGui::Selectable(dirName.c_str())) {
+            currentPath = dir.path();
+          }
+        }
+
+        for (const auto &file : files) {
+          if (ImGui::Selectable(file.path().filename().string().c_str())) {
+            strncpy(filename, file.path().filename().string().c_str(), 128);
+          }
+        }
+
+        ImGui::EndChild();
+      };
+
+  // Picks the scene or a gate for an export. Library gates that haven't
+  // been decoded yet are listed too; the export loads them.
+  auto RenderExportCircuitCombo = [&](const char *label) {
+    const char *circuit = exportGate.empty() ? "Scene" : exportGate.c_str();
+    if (ImGui::BeginCombo(label, circuit)) {
+      if (ImGui::Selectable("Scene", exportGate.empty()))
+        exportGate.clear();
+      std::set<std::string> names;
+      for (const auto &entry : CustomGate::GateRegistry)
+        names.insert(entry.first);
+      for (const auto &library : gateLibraries)
+        for (const auto &gate : library.Entries())
+          names.insert(gate.name);
+      for (const auto &name : names)
+        if (ImGui::Selectable(name.c_str(), exportGate == name))
+          exportGate = name;
+      ImGui::EndCombo();
+    }
+  };
+
+  // Import AIGER Popup
+  if (openImportAigerPopup) {
+    ImGui::OpenPopup("ImportAigerPopup");
+    openImportAigerPopup = false;
+  }
+  if (ImGui::BeginPopupModal("ImportAigerPopup", NULL,
+                             ImGuiWindowFlags_AlwaysAutoResize)) {
+    ImGui::InputText("Filename##AigerImport", aigerFilename, 128);
+
+    RenderExportFilePicker(aigerFilename, {".aag", ".aig"});
+    ImGui::Separator();
+
+    std::filesystem::path fullPath = currentPath / aigerFilename;
+    ImGui::BeginDisabled(Loading());
+    if (ImGui::Button("Open as Scene", ImVec2(120, 0))) {
+      ImportAiger(fullPath.string(), false);
+      ImGui::CloseCurrentPopup();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Add as Gate", ImVec2(120, 0))) {
+      ImportAiger(fullPath.string(), true);
+      ImGui::CloseCurrentPopup();
+    }
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    if (ImGui::Button("Cancel##AigerImport", ImVec2(120, 0))) {
+      ImGui::CloseCurrentPopup();
+    }
+    ImGui::EndPopup();
+  }
+
+  // Export AIGER Popup. A name ending in .aag is written as text.
+  if (openExportAigerPopup) {
+    ImGui::OpenPopup("ExportAigerPopup");
+    openExportAigerPopup = false;
+  }
+  if (ImGui::BeginPopupModal("ExportAigerPopup", NULL,
+                             ImGuiWindowFlags_AlwaysAutoResize)) {
+    ImGui::InputText("Filename##AigerExport", aigerFilename, 128);
+    RenderExportCircuitCombo("Circuit##AigerExport");
+
+    RenderExportFilePicker(aigerFilename, {".aag", ".aig"});
+    ImGui::Separator();
+
+    if (ImGui::Button("Export##Aiger", ImVec2(120, 0))) {
+      std::filesystem::path fullPath = currentPath / aigerFilename;
+      ExportAiger(fullPath.string(), exportGate);
+      ImGui::CloseCurrentPopup();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Cancel##AigerExport", ImVec2(120, 0))) {
+      ImGui::CloseCurrentPopup();
+    }
+    ImGui::EndPopup();
+  }
+
+  // Export Verilog Popup
+  if (openExportVerilogPopup) {
+    ImGui::OpenPopup("ExportVerilogPopup");
+    openExportVerilogPopup = false;
+  }
+  if (ImGui::BeginPopupModal("ExportVerilogPopup", NULL,
+                             ImGuiWindowFlags_AlwaysAutoResize)) {
+    ImGui::InputText("Filename##VerilogExport", verilogFilename, 128);
+    RenderExportCircuitCombo("Circuit##VerilogExport");
+
+    RenderExportFilePicker(verilogFilename, {".v"});
+    ImGui::Separator();
+
+    if (ImGui::Button("Export##Verilog", ImVec2(120, 0))) {
+      std::filesystem::path fullPath = currentPath / verilogFilename;
+      ExportVerilog(fullPath.string(), exportGate);
+      ImGui::CloseCurrentPopup();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Cancel##VerilogExport", ImVec2(120, 0))) {
+      ImGui::CloseCurrentPopup();
+    }
+    ImGui::EndPopup();
+  }
+
   ImGuiViewport *viewport = ImGui::GetMainViewport();
   ImGui::SetNextWindowPos(viewport->WorkPos);
   ImGui::SetNextWindowSize(viewport->WorkSize);
@@ -773,6 +1139,16 @@ void NodeEditor::Redraw() {
           openLoadGatePopup = true;
         }
         ImGui::Separator();
+        if (ImGui::MenuItem("Import AIGER...")) {
+          openImportAigerPopup = true;
+        }
+        if (ImGui::MenuItem("Export AIGER...")) {
+          openExportAigerPopup = true;
+        }
+        if (ImGui::MenuItem("Export Verilog...")) {
+          openExportVerilogPopup = true;
+        }
+        ImGui::Separator();
         if (ImGui::MenuItem("Create Gate..")) {
           openCreateGatePopup = true;
         }
@@ -805,12 +1181,14 @@ void NodeEditor::Redraw() {
         UpdateGateDefinitionFromCurrentScene(editingGateName);
         currentScript = originalSceneScript;
         UpdateNodesFromScript();
+        FlushScriptParse();
         editingGateName = "";
       }
       ImGui::SameLine();
       if (ImGui::Button("Discard", ImVec2(80, 0))) {
         currentScript = originalSceneScript;
         UpdateNodesFromScript();
+        FlushScriptParse();
         editingGateName = "";
       }
       ImGui::EndChild();
@@ -859,6 +1237,8 @@ void NodeEditor::Redraw() {
       ImGui::PopStyleColor();
     }
 
+    RenderLoadingBanner();
+
     if (openCreateGatePopup) {
       ImGui::OpenPopup("CreateGatePopup");
       openCreateGatePopup = false;
@@ -924,24 +1304,28 @@ void NodeEditor::Redraw() {
 
   ImColor gridColor = IM_COL32(50, 60, 70, 40); // Faint hex lines
 
-  for (int y = startY; y < endY; ++y) {
-    for (int x = startX; x < endX; ++x) {
-      float xPos = x * HEX_X_SPACING;
-      float yPos = y * HEX_Y_SPACING;
-      if (y % 2 != 0)
-        xPos += HEX_X_SPACING * 0.5f;
-
-      ImVec2 center =
-          ImVec2(canvasPos.x + offset.x + xPos, canvasPos.y + offset.y + yPos);
-
-      // Draw Hexagon
-      ImVec2 verts[6];
-      for (int i = 0; i < 6; ++i) {
-        float angle = 3.14159f / 3.0f * (i + 0.5f);
-        verts[i] = ImVec2(center.x + cos(angle) * HEX_SIZE * 0.5f,
-                          center.y + sin(angle) * HEX_SIZE * 0.5f);
+  // Cells shrink to a few pixels in the overview zoom levels, where the
+  // thousands of polylines would cost more than the nodes themselves.
+  if (HEX_SIZE >= 12.0f) {
+    for (int y = startY; y < endY; ++y) {
+      for (int x = startX; x < endX; ++x) {
+        float xPos = x * HEX_X_SPACING;
+        float yPos = y * HEX_Y_SPACING;
+        if (y % 2 != 0)
+          xPos += HEX_X_SPACING * 0.5f;
+
+        ImVec2 center = ImVec2(canvasPos.x + offset.x + xPos,
+                               canvasPos.y + offset.y + yPos);
+
+        // Draw Hexagon
+        ImVec2 verts[6];
+        for (int i = 0; i < 6; ++i) {
+          float angle = 3.14159f / 3.0f * (i + 0.5f);
+          verts[i] = ImVec2(center.x + cos(angle) * HEX_SIZE * 0.5f,
+                            center.y + sin(angle) * HEX_SIZE * 0.5f);
+        }
+        drawList->AddPolyline(verts, 6, gridColor, true, 1.5f);
       }
-      drawList->AddPolyline(verts, 6, gridColor, true, 1.5f);
     }
   }
 
@@ -956,6 +1340,7 @@ void NodeEditor::Redraw() {
       IM_COL32(0, 0, 0, 0); // Hide default grid
   canvas->Colors[ImNodes::ColNodeBorder] =
       IM_COL32(100, 200, 255, 150); // Cyan glass border
+  canvas->Style.MinZoom = MinZoom;
 
   ImGui::Text("Debug: %s", debugMsg.c_str());
 
@@ -977,8 +1362,11 @@ void NodeEditor::Redraw() {
         connectionDropPos = ImGui::GetMousePos();
 
         bool isInput = ImNodes::IsInputSlotKind(srcKind);
-        ImNodes::GetSlotPosition(srcNode, srcSlot, isInput,
-                                 &connectionSourceSlotPos);
+        Node *source = (Node *)srcNode;
+        int index = isInput ? source->InputSlotIndex(srcSlot)
+                            : source->OutputSlotIndex(srcSlot);
+        if (ImVec2 *slotPos = SlotPosition(source, index, isInput))
+          connectionSourceSlotPos = ImNodes::CanvasToScreen(*slotPos);
 
         showConnectionDropMenu = true;
         ImGui::OpenPopup("ConnectionDropMenu");
@@ -1009,35 +1397,34 @@ void NodeEditor::Redraw() {
     ImGui::SameLine();
     if (ImGui::SmallButton("Apply")) {
       UpdateNodesFromScript();
+      FlushScriptParse();
     }
     ImGui::PopStyleVar(); // FramePadding
 
     // Only update script from nodes if the user isn't currently typing in the
-    // editor
-    static bool scriptActive = false;
-
-    if (!scriptActive) {
+    // editor and the typed text has been applied
+    if (!scriptEditor.IsActive() && !scriptWorker.Pending() &&
+        scriptRevision != sceneRevision) {
       UpdateScriptFromNodes();
     }
 
-    static char scriptBuf[8192];
-    static bool bufferInitialized = false;
-    if (!scriptActive || !bufferInitialized) {
-      strncpy(scriptBuf, currentScript.c_str(), 8191);
-      bufferInitialized = true;
-    }
-
     ImGui::PushStyleVar(ImGuiStyleVar_FrameRounding, 5.0f);
-    if (ImGui::InputTextMultiline(
-            "##script", scriptBuf, 8192,
+    if (scriptEditor.Render(
+            "##script",
             ImVec2(-1, -ImGui::GetTextLineHeightWithSpacing() * 8))) {
-      currentScript = scriptBuf;
-      UpdateNodesFromScript();
+      // Only the edited lines are handed to the worker; the whole text is
+      // joined once the user stops typing, see SyncScriptText()
+      ScriptEditor::LineChange edit =
+          ScriptEditor::MergeChanges(scriptEditor.TakeChanges());
+      std::vector<std::string> inserted;
+      inserted.reserve(edit.inserted);
+      for (int i = 0; i < edit.inserted; ++i)
+        inserted.push_back(scriptEditor.Line(edit.first + i));
+      scriptWorker.SubmitEdit(edit, std::move(inserted));
+      scriptTextEdited = true;
     }
     ImGui::PopStyleVar();
 
-    scriptActive = ImGui::IsItemActive();
-
     if (!scriptError.empty()) {
       ImGui::Separator();
       if (ImGui::Selectable(errorPanelCollapsed ? "> Show Errors"
@@ -1147,98 +1534,80 @@ void NodeEditor::RenderConnectionDropMenu() {
   if (ImGui::BeginPopup("ConnectionDropMenu")) {
     bool fromOutput = ImNodes::IsOutputSlotKind(dropSourceSlotKind);
 
-    for (const auto &desc : availableNodes) {
-      auto item = desc();
+    auto renderItem = [&](const PaletteEntry &entry) {
       // Filter: if dragging from output, only show nodes with inputs
       // If dragging from input, only show nodes with outputs
-      bool compatible =
-          fromOutput ? (item->inputSlotCount > 0) : (item->outputSlotCount > 0);
-      if (compatible && ImGui::MenuItem(item->title)) {
-        Node *newNode = desc();
-
-        // Position node at drop location (canvas coordinates)
-        newNode->pos = (connectionDropPos - canvasWindowPos) / canvas->Zoom -
-                       canvas->Offset;
-        nodes.push_back(newNode);
+      bool compatible = fromOutput ? (entry.inputSlotCount > 0)
+                                   : (entry.outputSlotCount > 0);
+      if (!compatible || !ImGui::MenuItem(entry.name.c_str()))
+        return;
 
-        // Create connection
-        Connection conn;
-        if (fromOutput) {
-          conn.outputNode = dropSourceNode;
-          conn.outputSlot = dropSourceSlot;
-          conn.inputNode = newNode;
-          conn.inputSlot = newNode->inputSlots[0].title;
-        } else {
-          // Input pins only accept single connection - remove existing one
-          Node *inputNode = (Node *)dropSourceNode;
-          for (auto it = inputNode->connections.begin();
-               it != inputNode->connections.end(); ++it) {
-            if (it->inputNode == dropSourceNode &&
-                it->inputSlot == dropSourceSlot) {
-              ((Node *)it->outputNode)->DeleteConnection(*it);
-              inputNode->connections.erase(it);
-              break;
-            }
-          }
+      Node *newNode = entry.factory();
 
-          conn.inputNode = dropSourceNode;
-          conn.inputSlot = dropSourceSlot;
-          conn.outputNode = newNode;
-          conn.outputSlot = newNode->outputSlots[0].title;
-        }
+      // Position node at drop location (canvas coordinates)
+      newNode->pos = (connectionDropPos - canvasWindowPos) / canvas->Zoom -
+                     canvas->Offset;
+      nodes.push_back(newNode);
+      journal.Added(newNode);
+      NodeAdded(newNode);
+
+      // Size bus-capable nodes to the dragged wire; leave the new node
+      // unconnected if the widths still differ
+      Node *source = (Node *)dropSourceNode;
+      int sourceWidth = source->SlotWidth(
+          fromOutput ? source->OutputSlotIndex(dropSourceSlot)
+                     : source->InputSlotIndex(dropSourceSlot),
+          !fromOutput);
+      if (newNode->SlotWidth(0, fromOutput) != sourceWidth)
+        newNode->SetWidth(sourceWidth);
+      if (newNode->SlotWidth(0, fromOutput) != sourceWidth) {
+        showConnectionDropMenu = false;
+        return;
+      }
 
-        ((Node *)conn.inputNode)->connections.push_back(conn);
-        ((Node *)conn.outputNode)->connections.push_back(conn);
+      // Create connection
+      Connection conn;
+      if (fromOutput) {
+        conn.outputNode = dropSourceNode;
+        conn.outputSlot = dropSourceSlot;
+        conn.inputNode = newNode;
+        conn.inputSlot = newNode->inputSlots[0].title;
+      } else {
+        // Input pins only accept single connection - remove existing one
+        Node *inputNode = (Node *)dropSourceNode;
+        for (auto it = inputNode->connections.begin();
+             it != inputNode->connections.end(); ++it) {
+          if (it->inputNode == dropSourceNode &&
+              it->inputSlot == dropSourceSlot) {
+            ((Node *)it->outputNode)->DeleteConnection(*it);
+            MarkWiresChanged((Node *)it->outputNode);
+            journal.Disconnected(*it);
+            inputNode->connections.erase(it);
+            break;
+          }
+        }
 
-        showConnectionDropMenu = false;
+        conn.inputNode = dropSourceNode;
+        conn.inputSlot = dropSourceSlot;
+        conn.outputNode = newNode;
+        conn.outputSlot = newNode->outputSlots[0].title;
       }
-      delete item;
-    }
 
-    ImGui::Separator();
-    if (ImGui::BeginMenu("Gates")) {
-      for (const auto &desc : availableGates) {
-        auto item = desc();
-        bool compatible = fromOutput ? (item->inputSlotCount > 0)
-                                     : (item->outputSlotCount > 0);
-        if (compatible && ImGui::MenuItem(item->title)) {
-          Node *newNode = desc();
-          newNode->pos = (connectionDropPos - canvasWindowPos) / canvas->Zoom -
-                         canvas->Offset;
-          nodes.push_back(newNode);
-
-          Connection conn;
-          if (fromOutput) {
-            conn.outputNode = dropSourceNode;
-            conn.outputSlot = dropSourceSlot;
-            conn.inputNode = newNode;
-            conn.inputSlot = newNode->inputSlots[0].title;
-          } else {
-            // Input pins only accept single connection - remove existing one
-            Node *inputNode = (Node *)dropSourceNode;
-            for (auto it = inputNode->connections.begin();
-                 it != inputNode->connections.end(); ++it) {
-              if (it->inputNode == dropSourceNode &&
-                  it->inputSlot == dropSourceSlot) {
-                ((Node *)it->outputNode)->DeleteConnection(*it);
-                inputNode->connections.erase(it);
-                break;
-              }
-            }
+      ((Node *)conn.inputNode)->connections.push_back(conn);
+      ((Node *)conn.outputNode)->connections.push_back(conn);
+      MarkWiresChanged((Node *)conn.outputNode);
+      journal.Connected(conn);
 
-            conn.inputNode = dropSourceNode;
-            conn.inputSlot = dropSourceSlot;
-            conn.outputNode = newNode;
-            conn.outputSlot = newNode->outputSlots[0].title;
-          }
+      showConnectionDropMenu = false;
+    };
 
-          ((Node *)conn.inputNode)->connections.push_back(conn);
-          ((Node *)conn.outputNode)->connections.push_back(conn);
+    for (const auto &entry : paletteNodes)
+      renderItem(entry);
 
-          showConnectionDropMenu = false;
-        }
-        delete item;
-      }
+    ImGui::Separator();
+    if (ImGui::BeginMenu("Gates")) {
+      for (const auto &entry : paletteGates)
+        renderItem(entry);
       ImGui::EndMenu();
     }
 
@@ -1249,5 +1618,46 @@ void NodeEditor::RenderConnectionDropMenu() {
   }
 }
 
-NodeEditor::NodeEditor() {}
+NodeEditor::NodeEditor() {
+  scriptWorker.SetReadyCallback([this] { Wake(); });
+  fileLoader.SetReadyCallback([this] { Wake(); });
+  sceneSaver.SetDoneCallback([this] { Wake(); });
+  CustomGate::DefinitionLoader = [this](const std::string &name) {
+    return LoadLibraryGate(name);
+  };
+
+  // The journal is only left behind when the last session didn't exit
+  // cleanly
+  std::error_code error;
+  if (std::filesystem::exists(journal.Path(), error)) {
+    unrecoveredJournal = true;
+    fileLoader.Start(LoadedFile::Kind::Journal, journal.Path());
+  }
+}
+
+NodeEditor::~NodeEditor() {
+  scriptWorker.Stop(); // Its callback calls Wake()
+  fileLoader.Stop();
+  CancelLoad();
+  journal.Discard();
+  sceneSaver.Stop(); // Finishes queued saves
+  CustomGate::DefinitionLoader = nullptr;
+  for (Node *node : nodes)
+    delete node;
+  if (nodesContext)
+    ImNodes::Ez::FreeContext(nodesContext);
+}
+
+bool NodeEditor::WantsRedraw() const {
+  // A circuit that is still settling or oscillating keeps changing on its own
+  if (simulationChanged)
+    return true;
+  // Loading progress and scenes being built a slice per frame
+  if (Loading())
+    return true;
+  // Drags, held buttons and connections in progress track the mouse
+  if (ImGui::IsAnyMouseDown() || ImGui::GetDragDropPayload())
+    return true;
+  return ImGui::IsAnyItemActive() && !ImGui::GetIO().WantTextInput;
+}
 } // namespace Billyprints
@@ -1,10 +1,23 @@
 #pragma once
 
 #include "Connection.hpp"
+#include "FileLoader.hpp"
+#include "GateLibrary.hpp"
 #include "Gates.hpp"
 #include "Nodes.hpp"
+#include "SceneDescription.hpp"
+#include "SceneJournal.hpp"
+#include "SceneSaver.hpp"
+#include "ScriptEditor.hpp"
+#include "ScriptWorker.hpp"
+#include "SpatialIndex.hpp"
+#include <chrono>
 #include <filesystem>
+#include <map>
+#include <memory>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace Billyprints {
 class NodeEditor {
@@ -14,13 +27,75 @@ class NodeEditor {
   std::string debugMsg = "Ready";
   bool openCreateGatePopup = false;
   bool anyNodeDragged = false;
+  bool nodesMoved = false; // Not yet counted in sceneRevision
 
   void RenderNode(Node *node);
   void RenderNodes();
+  void RenderWires(const ImRect &view);
+  void HandleNewConnection();
+  void SimulateNodes();
+
+  // Viewport culling. Nodes and the outgoing wires of each node are indexed in
+  // canvas space so only what overlaps the view is submitted to ImNodes.
+  SpatialIndex nodeIndex;
+  SpatialIndex wireIndex; // Keyed by the wire's output (source) node
+  bool spatialIndexDirty = true;
+  std::unordered_set<Node *> dirtyWireSources;
+  std::unordered_set<Node *> selectedNodes; // Rendered even when off-screen
+  std::vector<Node *> visibleNodes;
+  std::vector<Node *> visibleWireSources;
+  // Rebuilds the indexes from scratch, for loads and other edits that
+  // replace the whole scene
+  void MarkSceneChanged() {
+    spatialIndexDirty = true;
+    ++sceneRevision;
+  }
+  // Index a node just added to 'nodes', and its wires
+  void NodeAdded(Node *node);
+  // Drops a node from the indexes. Called while its wires are still
+  // attached, so the wires of its neighbours are re-measured.
+  void NodeRemoved(Node *node);
+  void MarkWiresChanged(Node *source) {
+    dirtyWireSources.insert(source);
+    ++sceneRevision;
+  }
+  // Re-measures the wires of a node that moved or resized. Doesn't touch
+  // sceneRevision: a size change alone leaves the script as it is.
+  void InvalidateWires(Node *node);
+  void RebuildSpatialIndex();
+  void UpdateWireBounds(Node *source);
+  // Canvas-space slot position, estimated for nodes never rendered
+  ImVec2 *SlotPosition(Node *node, int index, bool isInput);
+  ImRect NodeBounds(const Node *node) const;
+  ImRect GetVisibleCanvasRect() const;
+
+  // Overview level of detail. Below OverviewZoom unselected nodes are drawn
+  // as plain rects straight into the draw list instead of ImGui widgets.
+  static constexpr float OverviewZoom = 0.4f;
+  static constexpr float MinZoom = 0.05f;
+  std::vector<Node *> overviewNodes;
+  void RenderOverviewNodes();
   void RenderContextMenu();
   void RenderDock();
   void RenderConnectionDropMenu();
 
+  // Cached description of a placeable node type. Built once per registered
+  // type so the dock and menus never have to instantiate nodes to draw.
+  struct PaletteEntry {
+    std::string name;
+    std::string shortLabel; // Dock icon label
+    ImU32 color;
+    int inputSlotCount;
+    int outputSlotCount;
+    std::function<Node *()> factory;
+  };
+  std::vector<PaletteEntry> paletteNodes; // From availableNodes
+  std::vector<PaletteEntry> paletteGates; // availableGates, gateLibraries
+  bool paletteDirty = true;
+  size_t paletteNodeSourceCount = 0;
+  size_t paletteGateSourceCount = 0;
+  void RefreshPalette();
+
   // Connection drop menu state
   bool showConnectionDropMenu = false;
   ImVec2 connectionDropPos;
@@ -31,13 +106,81 @@ class NodeEditor {
   ImVec2 canvasWindowPos;
   void CreateGate();
 
-  std::vector<GateDefinition> customGateDefinitions;
+  std::vector<GateDefinitionRef> customGateDefinitions;
   void SaveGates(const std::string &filename);
   void LoadGates(const std::string &filename);
+  void ApplyGateLibrary(LoadedFile &file);
+  // Registers the gates of a library in the older format
+  void ApplyLegacyGates(LegacyGateLibrary &library);
+  // Libraries opened by LoadGates(). Their gates are listed in the palette
+  // from the index and decoded on first use, see LoadLibraryGate().
+  std::vector<GateLibrary> gateLibraries;
+  GateDefinitionRef LoadLibraryGate(const std::string &name);
+  // Drops every definition of 'name' from the registry, the palette and
+  // customGateDefinitions, before a newly loaded gate of that name replaces
+  // it
+  void ForgetGate(const std::string &name);
 
-  // Scene save/load
+  // Scene save/load. Saves write a snapshot on 'sceneSaver'. Files are
+  // read on 'fileLoader' and applied by PollFileLoad(); a scene is then
+  // built a slice per frame and replaces 'nodes' only once it is complete.
   void SaveScene(const std::string &filename);
   void LoadScene(const std::string &filename);
+  SceneData CaptureScene() const;
+  SceneSaver sceneSaver;
+  void PollSceneSaves();
+
+  // AIGER interchange. Imports are read and laid out on 'fileLoader', as a
+  // scene or as a new gate. Exports flatten the scene or a gate here, where
+  // definitions can be loaded, and write the file on 'sceneSaver'.
+  void ImportAiger(const std::string &filename, bool asGate);
+  void ExportAiger(const std::string &filename, const std::string &gate);
+  void AddImportedGate(const GateDefinitionRef &def);
+  // Structural Verilog export, gathered here and written on 'sceneSaver'
+  void ExportVerilog(const std::string &filename, const std::string &gate);
+
+  // Crash recovery. Edits are recorded in 'journal' as they happen and
+  // written every AutosaveInterval; the file is removed on a clean exit, so
+  // one found at startup is replayed.
+  SceneJournal journal{
+      sceneSaver, (std::filesystem::current_path() / "autosave.bpj").string()};
+  static constexpr std::chrono::seconds AutosaveInterval{1};
+  std::chrono::steady_clock::time_point nextAutosave;
+  // Set while the last session's journal is on disk but not yet recovered.
+  // If its recovery fails or is cancelled, it is moved aside rather than
+  // started over, see SetAsideJournal().
+  bool unrecoveredJournal = false;
+  void Autosave();
+  // Renames the unrecovered journal to "<path>.bak" and tells the user why,
+  // starting with 'reason'. Returns false if it couldn't be moved, in which
+  // case autosaving waits.
+  bool SetAsideJournal(const std::string &reason);
+  FileLoader fileLoader;
+  struct SceneBuild {
+    std::string path;
+    SceneData scene;
+    // File index -> node, null where a type couldn't be created
+    std::vector<Node *> byIndex;
+    std::set<PlaceholderGate *> placeholders;
+    size_t nextNode = 0, nextConnection = 0;
+    bool recovery = false; // Replaying the last session's journal
+  };
+  std::unique_ptr<SceneBuild> sceneBuild;
+  static constexpr std::chrono::milliseconds SceneBuildSlice{8};
+  void PollFileLoad();
+  void ContinueSceneBuild();
+  // Forgets every pointer into 'nodes' that outlives a frame: the
+  // connection drop menu, a wire being dragged, the code editor and the
+  // pending node requests. Called before the scene's nodes are deleted.
+  void DropNodeReferences();
+  // Stops a load in flight and drops a scene that is being built
+  void CancelLoad();
+  bool Loading() const { return fileLoader.Busy() || sceneBuild != nullptr; }
+  // LoadGates(), LoadScene() and ImportAiger() wait their turn: while
+  // another load runs they only tell the user, so a recovery or a scene
+  // being built is never dropped unannounced. Returns false then.
+  bool CanStartLoad(const std::string &filename);
+  void RenderLoadingBanner();
 
   // Missing gate tracking (for custom gates not loaded)
   std::vector<std::string> missingGateTypes;
@@ -52,12 +195,33 @@ class NodeEditor {
 
   std::string currentScript;
   std::string lastParsedScript;
+  // Typing goes straight to 'scriptWorker' line by line, leaving
+  // currentScript behind until SyncScriptText() catches it up
+  bool scriptTextEdited = false;
+  void SyncScriptText();
   std::string scriptError;
   std::string scriptDefinitions; // Stores define...end blocks for preservation
+  ScriptEditor scriptEditor;
+  // Content hash of a define block -> definition it registered, so
+  // unchanged blocks aren't rebuilt. See RegisterScriptGates().
+  std::unordered_map<uint64_t, GateDefinitionRef> parsedDefineBlocks;
   bool showScriptEditor = true;
   bool errorPanelCollapsed = false;
+  // Bumped by every edit that shows up in the script, so the text is only
+  // regenerated after the graph actually changed
+  uint64_t sceneRevision = 0;
+  uint64_t scriptRevision = UINT64_MAX; // sceneRevision the text reflects
   void UpdateScriptFromNodes();
+  // Queues the text for parsing on 'scriptWorker'. The result is applied by
+  // PollScriptParse() once it arrives, or right away by FlushScriptParse().
   void UpdateNodesFromScript();
+  void PollScriptParse();
+  void FlushScriptParse();
+  void ApplyParsedScript(const ParsedScript &parsed);
+  void ApplySceneDescription(const SceneDescription &scene);
+  // Registers the define blocks of a recovered journal
+  void RestoreScriptDefinitions(const std::string &definitions);
+  ScriptWorker scriptWorker;
 
   bool openSaveGatePopup = false;
   bool openLoadGatePopup = false;
@@ -65,6 +229,12 @@ class NodeEditor {
   bool openLoadScenePopup = false;
   char currentFilename[128] = "custom_gates.bin";
   char sceneFilename[128] = "scene.bps";
+  bool openImportAigerPopup = false;
+  bool openExportAigerPopup = false;
+  char aigerFilename[128] = "circuit.aag";
+  bool openExportVerilogPopup = false;
+  char verilogFilename[128] = "circuit.v";
+  std::string exportGate; // Empty for the scene
   std::filesystem::path currentPath = std::filesystem::current_path();
 
   bool showCodeEditor = false;
@@ -79,8 +249,27 @@ class NodeEditor {
   void FrameSelectedNodes();
   void ResetView();
 
+  ImNodes::Ez::Context *nodesContext = nullptr;
+
+  // Idle rendering. The main loop stops drawing when nothing changes; work
+  // finishing off the UI thread, and each simulation step that changes the
+  // snapshot, calls Wake() to break its wait.
+  Simulator simulator;
+  bool simulationChanged = false;
+  std::function<void()> wakeCallback;
+
 public:
   NodeEditor();
+  ~NodeEditor();
   void Redraw();
+  // True when the next frame may differ even without new input
+  bool WantsRedraw() const;
+  void SetWakeCallback(std::function<void()> callback) {
+    wakeCallback = std::move(callback);
+  }
+  void Wake() const {
+    if (wakeCallback)
+      wakeCallback();
+  }
 };
 } // namespace Billyprints
\ No newline at end of file
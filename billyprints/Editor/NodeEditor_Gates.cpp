@@ -1,13 +1,19 @@
 #include "../Nodes/Gates/CustomGate.hpp"
 #include "../Nodes/Gates/PlaceholderGate.hpp"
+#include "AigerCircuit.hpp"
+#include "GateLibrary.hpp"
 #include "NodeEditor.hpp"
+#include "SceneFile.hpp"
+#include "VerilogFile.hpp"
 #include <ImNodes.h>
 #include <algorithm>
+#include <chrono>
 #include <functional>
 #include <imgui.h>
-#include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace Billyprints {
@@ -16,47 +22,35 @@ namespace Billyprints {
 static bool IsBuiltInType(const std::string &type) {
   // Only types that CreateNodeByType can actually create without the registry
   return type == "AND" || type == "NOT" || type == "In" || type == "Out" ||
-         type == "Input" || type == "Output";
+         type == "Split" || type == "Merge" || type == "Input" ||
+         type == "Output";
 }
 
-void NodeEditor::CreateGate() {
-  GateDefinition def;
-  def.name = std::string(gateName);
-
-  std::map<Node *, int> nodePtrToId;
-  int idCounter = 0;
-
-  // 1. Collect Nodes
-  for (auto *node : nodes) {
-    NodeDefinition nd;
-    nd.id = idCounter++;
-    nodePtrToId[node] = nd.id;
-    nd.pos = node->pos;
-
-    nd.type = node->title;
-
-    def.nodes.push_back(nd);
-
-    std::string titleStr = node->title;
-    if (titleStr == "Input" || titleStr == "In")
-      def.inputPinIndices.push_back(nd.id);
-    else if (titleStr == "Output" || titleStr == "Out")
-      def.outputPinIndices.push_back(nd.id);
+// Palette factory for a custom gate. The definition is looked up when the
+// gate is placed, so an edited or reloaded gate places its latest version.
+// A named type so ForgetGate() can tell which gate a factory places.
+struct CustomGateFactory {
+  explicit CustomGateFactory(const GateDefinitionRef &def)
+      : type(InternGateType(def->name)) {}
+  Gate *operator()() const {
+    return new CustomGate(CustomGate::FindDefinition(GateTypeName(type)));
   }
+  uint32_t type;
+};
+
+// Lists the custom gate types the nodes of 'scene' use in 'customTypes'
+static void ListCustomTypes(SceneData &scene) {
+  std::vector<bool> used(scene.strings.size(), false);
+  for (const auto &node : scene.nodes)
+    used[node.type] = true;
+  scene.customTypes.clear();
+  for (uint32_t type = 0; type < (uint32_t)used.size(); ++type)
+    if (used[type] && !IsBuiltInType(scene.strings[type]))
+      scene.customTypes.push_back(type);
+}
 
-  // 2. Collect Connections
-  for (auto *node : nodes) {
-    for (const auto &conn : node->connections) {
-      if (conn.outputNode == node) {
-        ConnectionDefinition cd;
-        cd.inputNodeId = nodePtrToId[(Node *)conn.inputNode];
-        cd.inputSlot = conn.inputSlot;
-        cd.outputNodeId = nodePtrToId[(Node *)conn.outputNode];
-        cd.outputSlot = conn.outputSlot;
-        def.connections.push_back(cd);
-      }
-    }
-  }
+void NodeEditor::CreateGate() {
+  GateDefinition def = BuildGateDefinition(std::string(gateName), nodes);
 
   // 3. Register
   FILE *f = fopen("debug.txt", "a");
@@ -71,146 +65,110 @@ void NodeEditor::CreateGate() {
       IM_COL32((int)(newGateColor[0] * 255), (int)(newGateColor[1] * 255),
                (int)(newGateColor[2] * 255), 200);
 
-  customGateDefinitions.push_back(def);
-  CustomGate::GateRegistry[def.name] = def;
+  GateDefinitionRef ref = FinalizeGateDefinition(std::move(def));
+  customGateDefinitions.push_back(ref);
+  CustomGate::RegisterDefinition(ref);
 
-  availableGates.push_back([def]() -> Gate * { return new CustomGate(def); });
+  availableGates.push_back(CustomGateFactory(ref));
+  paletteDirty = true;
 }
 
 void NodeEditor::SaveGates(const std::string &filename) {
-  FILE *f = fopen(filename.c_str(), "wb");
-  if (!f)
-    return;
-
-  size_t count = customGateDefinitions.size();
-  fwrite(&count, sizeof(size_t), 1, f);
-
-  for (const auto &def : customGateDefinitions) {
-    // Name
-    size_t nameLen = def.name.size();
-    fwrite(&nameLen, sizeof(size_t), 1, f);
-    fwrite(def.name.c_str(), 1, nameLen, f);
-
-    // Color
-    fwrite(&def.color, sizeof(ImU32), 1, f);
-
-    // Nodes
-    size_t nodeCount = def.nodes.size();
-    fwrite(&nodeCount, sizeof(size_t), 1, f);
-    for (const auto &node : def.nodes) {
-      size_t typeLen = node.type.size();
-      fwrite(&typeLen, sizeof(size_t), 1, f);
-      fwrite(node.type.c_str(), 1, typeLen, f);
-      fwrite(&node.pos, sizeof(ImVec2), 1, f);
-      fwrite(&node.id, sizeof(int), 1, f);
-    }
-
-    // Connections
-    size_t connCount = def.connections.size();
-    fwrite(&connCount, sizeof(size_t), 1, f);
-    for (const auto &conn : def.connections) {
-      fwrite(&conn.inputNodeId, sizeof(int), 1, f);
-
-      size_t inSlotLen = conn.inputSlot.size();
-      fwrite(&inSlotLen, sizeof(size_t), 1, f);
-      fwrite(conn.inputSlot.c_str(), 1, inSlotLen, f);
-
-      fwrite(&conn.outputNodeId, sizeof(int), 1, f);
-
-      size_t outSlotLen = conn.outputSlot.size();
-      fwrite(&outSlotLen, sizeof(size_t), 1, f);
-      fwrite(conn.outputSlot.c_str(), 1, outSlotLen, f);
-    }
-
-    // Pin Indices
-    size_t inPinCount = def.inputPinIndices.size();
-    fwrite(&inPinCount, sizeof(size_t), 1, f);
-    fwrite(def.inputPinIndices.data(), sizeof(int), inPinCount, f);
+  // Library gates that were never used still belong in the file. One that
+  // can't be decoded would be left out of it for good, so nothing is saved.
+  for (auto &library : gateLibraries)
+    for (const auto &entry : library.Entries())
+      if (!CustomGate::FindDefinition(entry.name)) {
+        debugMsg = "Couldn't save " + filename + ": the gate " + entry.name +
+                   " couldn't be read from its library";
+        return;
+      }
 
-    size_t outPinCount = def.outputPinIndices.size();
-    fwrite(&outPinCount, sizeof(size_t), 1, f);
-    fwrite(def.outputPinIndices.data(), sizeof(int), outPinCount, f);
-  }
-  fclose(f);
+  if (!WriteGateLibrary(filename, customGateDefinitions))
+    debugMsg = "Couldn't save " + filename;
 }
 
 void NodeEditor::LoadGates(const std::string &filename) {
-  FILE *f = fopen(filename.c_str(), "rb");
-  if (!f)
+  if (!CanStartLoad(filename))
     return;
+  // The index is read on 'fileLoader', see ApplyGateLibrary()
+  fileLoader.Start(LoadedFile::Kind::Library, filename);
+}
 
-  customGateDefinitions.clear();
-
-  size_t count = 0;
-  fread(&count, sizeof(size_t), 1, f);
-
-  for (size_t i = 0; i < count; i++) {
-    GateDefinition def;
-
-    // Name
-    size_t nameLen = 0;
-    fread(&nameLen, sizeof(size_t), 1, f);
-    def.name.resize(nameLen);
-    fread(&def.name[0], 1, nameLen, f);
-
-    // Color
-    fread(&def.color, sizeof(ImU32), 1, f);
-
-    // Nodes
-    size_t nodeCount = 0;
-    fread(&nodeCount, sizeof(size_t), 1, f);
-    for (size_t j = 0; j < nodeCount; j++) {
-      NodeDefinition nd;
-      size_t typeLen = 0;
-      fread(&typeLen, sizeof(size_t), 1, f);
-      nd.type.resize(typeLen);
-      fread(&nd.type[0], 1, typeLen, f);
-      fread(&nd.pos, sizeof(ImVec2), 1, f);
-      fread(&nd.id, sizeof(int), 1, f);
-      def.nodes.push_back(nd);
-    }
-
-    // Connections
-    size_t connCount = 0;
-    fread(&connCount, sizeof(size_t), 1, f);
-    for (size_t j = 0; j < connCount; j++) {
-      ConnectionDefinition cd;
-      fread(&cd.inputNodeId, sizeof(int), 1, f);
+void NodeEditor::ApplyGateLibrary(LoadedFile &file) {
+  if (file.ok && file.legacy) {
+    ApplyLegacyGates(file.legacyLibrary);
+  } else if (file.ok) {
+    // Only the index has been read; LoadLibraryGate() decodes each
+    // definition the first time something asks for it
+    // The new library replaces gates of the same name; the rest stay
+    for (const auto &entry : file.library.Entries())
+      ForgetGate(entry.name);
+    gateLibraries.push_back(std::move(file.library));
+    paletteDirty = true;
+    TryUpgradePlaceholders();
+  } else {
+    // Nothing is registered from a damaged file
+    debugMsg = "Couldn't load " + file.path + ": " + file.error;
+  }
+}
 
-      size_t inSlotLen = 0;
-      fread(&inSlotLen, sizeof(size_t), 1, f);
-      cd.inputSlot.resize(inSlotLen);
-      fread(&cd.inputSlot[0], 1, inSlotLen, f);
+void NodeEditor::ApplyLegacyGates(LegacyGateLibrary &library) {
+  // Decoded in full on 'fileLoader'; only registering is left
+  library.InternTypes();
+  for (auto &def : library.definitions) {
+    ForgetGate(def.name);
+    GateDefinitionRef ref = FinalizeGateDefinition(std::move(def));
+    customGateDefinitions.push_back(ref);
+    CustomGate::RegisterDefinition(ref);
+    availableGates.push_back(CustomGateFactory(ref));
+  }
+  paletteDirty = true;
 
-      fread(&cd.outputNodeId, sizeof(int), 1, f);
+  // Try to upgrade any placeholder nodes that may now have their definitions
+  TryUpgradePlaceholders();
+}
 
-      size_t outSlotLen = 0;
-      fread(&outSlotLen, sizeof(size_t), 1, f);
-      cd.outputSlot.resize(outSlotLen);
-      fread(&cd.outputSlot[0], 1, outSlotLen, f);
+void NodeEditor::ForgetGate(const std::string &name) {
+  // Placed gates keep the definition they were created from
+  CustomGate::GateRegistry.erase(name);
+  customGateDefinitions.erase(
+      std::remove_if(customGateDefinitions.begin(),
+                     customGateDefinitions.end(),
+                     [&](const GateDefinitionRef &def) {
+                       return def->name == name;
+                     }),
+      customGateDefinitions.end());
+  uint32_t type = InternGateType(name);
+  availableGates.erase(
+      std::remove_if(availableGates.begin(), availableGates.end(),
+                     [type](const std::function<Gate *()> &factory) {
+                       auto *custom = factory.target<CustomGateFactory>();
+                       return custom && custom->type == type;
+                     }),
+      availableGates.end());
+  paletteDirty = true;
+}
 
-      def.connections.push_back(cd);
+GateDefinitionRef NodeEditor::LoadLibraryGate(const std::string &name) {
+  // The newest library wins, as when the same gate is loaded twice
+  for (auto library = gateLibraries.rbegin(); library != gateLibraries.rend();
+       ++library) {
+    GateLibrary::Entry *entry = library->Find(name);
+    if (!entry)
+      continue;
+    bool decoded = entry->definition != nullptr;
+    std::string error;
+    GateDefinitionRef def = library->Load(*entry, error);
+    if (!def) {
+      debugMsg = "Couldn't load gate " + name + ": " + error;
+      return nullptr;
     }
-
-    // Pin Indices
-    size_t inPinCount = 0;
-    fread(&inPinCount, sizeof(size_t), 1, f);
-    def.inputPinIndices.resize(inPinCount);
-    fread(def.inputPinIndices.data(), sizeof(int), inPinCount, f);
-
-    size_t outPinCount = 0;
-    fread(&outPinCount, sizeof(size_t), 1, f);
-    def.outputPinIndices.resize(outPinCount);
-    fread(def.outputPinIndices.data(), sizeof(int), outPinCount, f);
-
-    customGateDefinitions.push_back(def);
-    CustomGate::GateRegistry[def.name] = def;
-    availableGates.push_back([def]() -> Gate * { return new CustomGate(def); });
+    if (!decoded)
+      customGateDefinitions.push_back(def);
+    return def;
   }
-  fclose(f);
-
-  // Try to upgrade any placeholder nodes that may now have their definitions
-  TryUpgradePlaceholders();
+  return nullptr;
 }
 
 void NodeEditor::TryUpgradePlaceholders() {
@@ -221,10 +179,14 @@ void NodeEditor::TryUpgradePlaceholders() {
 
   for (auto *placeholder : placeholderNodes) {
     // Check if the gate definition is now available
-    if (CustomGate::GateRegistry.count(placeholder->missingTypeName)) {
+    if (GateDefinitionRef def =
+            CustomGate::FindDefinition(placeholder->missingTypeName)) {
       // Create the real gate
-      auto *realGate =
-          new CustomGate(CustomGate::GateRegistry[placeholder->missingTypeName]);
+      auto *realGate = new CustomGate(std::move(def));
+      // Placeholders of a scene still being built aren't in 'nodes' yet
+      auto it = std::find(nodes.begin(), nodes.end(), (Node *)placeholder);
+      if (it != nodes.end())
+        NodeRemoved(placeholder);
 
       // Copy position and ID
       realGate->pos = placeholder->pos;
@@ -260,10 +222,11 @@ void NodeEditor::TryUpgradePlaceholders() {
       }
 
       // Replace in nodes list
-      auto it = std::find(nodes.begin(), nodes.end(), (Node *)placeholder);
       if (it != nodes.end()) {
         *it = realGate;
+        NodeAdded(realGate);
       }
+      journal.Replaced(placeholder, realGate);
 
       upgraded.push_back(placeholder);
     }
@@ -292,244 +255,351 @@ void NodeEditor::TryUpgradePlaceholders() {
 }
 
 void NodeEditor::SaveScene(const std::string &filename) {
-  FILE *f = fopen(filename.c_str(), "wb");
-  if (!f)
-    return;
-
-  // Build node ID map
-  std::map<Node *, int> nodePtrToId;
-  int idCounter = 0;
-
-  // Write magic number for scene files (BPS2 format)
-  const char magic[4] = {'B', 'P', 'S', '2'}; // Billyprints Scene v2
-  fwrite(magic, 1, 4, f);
+  // Only the snapshot is taken here; encoding and writing happen on
+  // 'sceneSaver' while editing and simulation carry on
+  sceneSaver.Save(filename, CaptureScene());
+}
 
-  // Collect custom gate types used in the scene
-  std::set<std::string> customTypesUsed;
-  for (auto *node : nodes) {
-    std::string type = node->title;
-    // For PlaceholderGate, use the original missing type name
-    if (auto *placeholder = dynamic_cast<PlaceholderGate *>(node)) {
-      type = placeholder->missingTypeName;
-    }
-    if (!IsBuiltInType(type)) {
-      customTypesUsed.insert(type);
+// Node pointer -> position in the scene, for numbering nodes while saving.
+// Open addressing keeps it to one allocation where a node-based map
+// allocates per entry.
+class NodeNumbering {
+public:
+  explicit NodeNumbering(const std::vector<Node *> &nodes) {
+    size_t capacity = 16;
+    while (capacity < nodes.size() * 2)
+      capacity <<= 1;
+    mask = capacity - 1;
+    slots.assign(capacity, {nullptr, 0});
+    for (uint32_t i = 0; i < (uint32_t)nodes.size(); ++i) {
+      size_t slot = Hash(nodes[i]);
+      while (slots[slot].first)
+        slot = (slot + 1) & mask;
+      slots[slot] = {nodes[i], i};
     }
   }
 
-  // Write custom gate dependency section
-  size_t customTypeCount = customTypesUsed.size();
-  fwrite(&customTypeCount, sizeof(size_t), 1, f);
-  for (const auto &typeName : customTypesUsed) {
-    size_t len = typeName.size();
-    fwrite(&len, sizeof(size_t), 1, f);
-    fwrite(typeName.c_str(), 1, len, f);
+  // UINT32_MAX for a node that isn't in the scene
+  uint32_t operator[](const void *node) const {
+    for (size_t slot = Hash(node);; slot = (slot + 1) & mask) {
+      if (slots[slot].first == node)
+        return slots[slot].second;
+      if (!slots[slot].first)
+        return UINT32_MAX;
+    }
   }
 
-  // Write node count
-  size_t nodeCount = nodes.size();
-  fwrite(&nodeCount, sizeof(size_t), 1, f);
+private:
+  // Nodes created together sit close in memory and are usually wired to
+  // each other, so keeping nearby addresses in nearby slots keeps lookups
+  // in cache
+  size_t Hash(const void *node) const {
+    uintptr_t address = (uintptr_t)node;
+    return (size_t)((address >> 4) ^ (address >> 24)) & mask;
+  }
 
-  // Write nodes
-  for (auto *node : nodes) {
-    nodePtrToId[node] = idCounter++;
+  std::vector<std::pair<const void *, uint32_t>> slots;
+  size_t mask;
+};
 
-    // Node type (use original type name for placeholders)
-    std::string type = node->title;
-    if (auto *placeholder = dynamic_cast<PlaceholderGate *>(node)) {
-      type = placeholder->missingTypeName;
-    }
-    size_t typeLen = type.size();
-    fwrite(&typeLen, sizeof(size_t), 1, f);
-    fwrite(type.c_str(), 1, typeLen, f);
-
-    // Node position
-    fwrite(&node->pos, sizeof(ImVec2), 1, f);
-
-    // Slot counts (new in BPS2 - needed for placeholder reconstruction)
-    int inputCount = node->inputSlotCount;
-    int outputCount = node->outputSlotCount;
-    fwrite(&inputCount, sizeof(int), 1, f);
-    fwrite(&outputCount, sizeof(int), 1, f);
-  }
+// A compact copy of the graph taken in one pass, which the saver thread
+// can encode while the live nodes keep changing. Names are interned through
+// small caches, since runs of one type and of the same slots are the norm.
+SceneData NodeEditor::CaptureScene() const {
+  SceneData scene;
+  scene.nodes.reserve(nodes.size());
+  NodeNumbering numbering(nodes);
+  std::unordered_map<const char *, uint32_t> titleTypes;
 
-  // Collect unique connections (only from output side to avoid duplicates)
-  std::vector<ConnectionDefinition> connections;
   for (auto *node : nodes) {
-    for (const auto &conn : node->connections) {
-      if (conn.outputNode == node) {
-        ConnectionDefinition cd;
-        cd.inputNodeId = nodePtrToId[(Node *)conn.inputNode];
-        cd.inputSlot = conn.inputSlot;
-        cd.outputNodeId = nodePtrToId[(Node *)conn.outputNode];
-        cd.outputSlot = conn.outputSlot;
-        connections.push_back(cd);
+    // A placeholder's title is the name of the gate it stands in for, so
+    // the title alone gives every node's type
+    SceneData::Node record;
+    auto known = titleTypes.find(node->title);
+    record.type = known != titleTypes.end()
+                      ? known->second
+                      : titleTypes[node->title] = scene.Intern(node->title);
+    record.pos = node->pos;
+    record.inputCount = (uint32_t)node->inputSlotCount;
+    record.outputCount = (uint32_t)node->outputSlotCount;
+    record.width = (uint32_t)node->width;
+    scene.nodes.push_back(record);
+  }
+  ListCustomTypes(scene);
+
+  // Each connection is listed on both of its nodes; keep the output side
+  scene.connections.reserve(nodes.size());
+  struct SlotCache {
+    std::string name;
+    uint32_t index = UINT32_MAX;
+    uint32_t Intern(SceneData &scene, const std::string &slot) {
+      if (index == UINT32_MAX || name != slot) {
+        index = scene.Intern(slot);
+        name = slot;
       }
+      return index;
+    }
+  } outputSlots, inputSlots;
+  for (uint32_t i = 0; i < (uint32_t)nodes.size(); ++i) {
+    for (const auto &conn : nodes[i]->connections) {
+      if (conn.outputNode != nodes[i])
+        continue;
+      uint32_t inputNode = numbering[conn.inputNode];
+      if (inputNode == UINT32_MAX)
+        continue;
+      scene.connections.push_back(
+          {i, outputSlots.Intern(scene, conn.outputSlot), inputNode,
+           inputSlots.Intern(scene, conn.inputSlot)});
     }
   }
+  return scene;
+}
 
-  // Write connection count
-  size_t connCount = connections.size();
-  fwrite(&connCount, sizeof(size_t), 1, f);
-
-  // Write connections
-  for (const auto &conn : connections) {
-    fwrite(&conn.inputNodeId, sizeof(int), 1, f);
-
-    size_t inSlotLen = conn.inputSlot.size();
-    fwrite(&inSlotLen, sizeof(size_t), 1, f);
-    fwrite(conn.inputSlot.c_str(), 1, inSlotLen, f);
+void NodeEditor::PollSceneSaves() {
+  SceneSaver::Result result;
+  while (sceneSaver.TakeResult(result))
+    if (!result.ok)
+      debugMsg = "Couldn't save " + result.path;
+}
 
-    fwrite(&conn.outputNodeId, sizeof(int), 1, f);
+void NodeEditor::Autosave() {
+  // Edits wait in the journal meanwhile; a journal being recovered must be
+  // read before it is started over
+  if (Loading())
+    return;
+  auto now = std::chrono::steady_clock::now();
+  if (now < nextAutosave)
+    return;
+  nextAutosave = now + AutosaveInterval;
+  if (!journal.Flush())
+    return;
+  // The recovery was cancelled; the file may be the only copy of that work
+  if (unrecoveredJournal && !SetAsideJournal("The last session's autosave "
+                                             "wasn't recovered"))
+    return;
+  journal.Reset(nodes, CaptureScene(), scriptDefinitions);
+}
 
-    size_t outSlotLen = conn.outputSlot.size();
-    fwrite(&outSlotLen, sizeof(size_t), 1, f);
-    fwrite(conn.outputSlot.c_str(), 1, outSlotLen, f);
+bool NodeEditor::SetAsideJournal(const std::string &reason) {
+  std::string backup = journal.Path() + ".bak";
+  std::error_code error;
+  std::filesystem::rename(journal.Path(), backup, error);
+  if (error) {
+    debugMsg = reason + ". Autosave is paused: couldn't move it to " + backup;
+    return false;
   }
-
-  fclose(f);
+  unrecoveredJournal = false;
+  debugMsg = reason + ". It was kept as " + backup;
+  return true;
 }
 
 void NodeEditor::LoadScene(const std::string &filename) {
-  FILE *f = fopen(filename.c_str(), "rb");
-  if (!f)
+  if (!CanStartLoad(filename))
     return;
+  // The file is read and decoded on 'fileLoader'; PollFileLoad() builds it
+  fileLoader.Start(LoadedFile::Kind::Scene, filename);
+}
 
-  // Verify magic number
-  char magic[4];
-  fread(magic, 1, 4, f);
+void NodeEditor::ImportAiger(const std::string &filename, bool asGate) {
+  if (!CanStartLoad(filename))
+    return;
+  fileLoader.Start(asGate ? LoadedFile::Kind::AigerGate
+                          : LoadedFile::Kind::AigerScene,
+                   filename);
+}
 
-  bool isV1 =
-      (magic[0] == 'B' && magic[1] == 'P' && magic[2] == 'S' && magic[3] == '1');
-  bool isV2 =
-      (magic[0] == 'B' && magic[1] == 'P' && magic[2] == 'S' && magic[3] == '2');
+void NodeEditor::AddImportedGate(const GateDefinitionRef &def) {
+  ForgetGate(def->name);
+  customGateDefinitions.push_back(def);
+  CustomGate::RegisterDefinition(def);
+  availableGates.push_back(CustomGateFactory(def));
+  paletteDirty = true;
+  TryUpgradePlaceholders();
+  debugMsg = "Imported gate " + def->name;
+}
 
-  if (!isV1 && !isV2) {
-    fclose(f);
-    return; // Invalid file format
+void NodeEditor::ExportAiger(const std::string &filename,
+                             const std::string &gate) {
+  auto aig = std::make_shared<AigerGraph>();
+  std::string error;
+  bool ok = false;
+  if (gate.empty()) {
+    ok = SceneToAiger(CaptureScene(), *aig, error);
+  } else if (GateDefinitionRef def = CustomGate::FindDefinition(gate)) {
+    ok = DefinitionToAiger(*def, *aig, error);
+  } else {
+    error = "the gate " + gate + " isn't loaded";
   }
+  if (!ok) {
+    debugMsg = "Couldn't export " + filename + ": " + error;
+    return;
+  }
+  debugMsg = "Exported " + std::to_string(aig->ands.size()) +
+             " AND gates to " + filename;
+  sceneSaver.Queue(filename,
+                   [filename, aig] { return WriteAiger(filename, *aig); });
+}
 
-  // Clear existing nodes and state
-  for (auto *node : nodes) {
-    delete node;
+void NodeEditor::ExportVerilog(const std::string &filename,
+                               const std::string &gate) {
+  GateDefinitionRef top;
+  if (gate.empty()) {
+    std::string name = std::filesystem::path(filename).stem().string();
+    top = FinalizeGateDefinition(BuildGateDefinition(name, nodes));
+  } else {
+    top = CustomGate::FindDefinition(gate);
   }
-  nodes.clear();
-  missingGateTypes.clear();
-  placeholderNodes.clear();
-  showMissingGatesBanner = false;
+  auto design = std::make_shared<VerilogDesign>();
+  std::string error;
+  if (!top)
+    error = "the gate " + gate + " isn't loaded";
+  if (!top || !CollectVerilogDesign(top, *design, error)) {
+    debugMsg = "Couldn't export " + filename + ": " + error;
+    return;
+  }
+  debugMsg = "Exported " + std::to_string(design->gates.size() + 1) +
+             " modules to " + filename;
+  sceneSaver.Queue(filename, [filename, design] {
+    return WriteVerilog(filename, *design);
+  });
+}
 
-  // Read custom gate dependency section (BPS2 only)
-  if (isV2) {
-    size_t customTypeCount = 0;
-    fread(&customTypeCount, sizeof(size_t), 1, f);
-
-    for (size_t i = 0; i < customTypeCount; i++) {
-      size_t len = 0;
-      fread(&len, sizeof(size_t), 1, f);
-      std::string typeName;
-      typeName.resize(len);
-      fread(&typeName[0], 1, len, f);
-
-      // Check if this custom type is available
-      if (!CustomGate::GateRegistry.count(typeName)) {
-        // Type is missing - add to missing list if not already there
-        if (std::find(missingGateTypes.begin(), missingGateTypes.end(),
-                      typeName) == missingGateTypes.end()) {
-          missingGateTypes.push_back(typeName);
-        }
-      }
-    }
+bool NodeEditor::CanStartLoad(const std::string &filename) {
+  if (!Loading())
+    return true;
+  debugMsg = "Finish or cancel the current load before opening " + filename;
+  return false;
+}
 
-    if (!missingGateTypes.empty()) {
-      showMissingGatesBanner = true;
-      debugMsg = "Missing gates detected: " + std::to_string(missingGateTypes.size());
-    }
+void NodeEditor::CancelLoad() {
+  fileLoader.Cancel();
+  if (sceneBuild) {
+    for (Node *node : sceneBuild->byIndex)
+      delete node;
+    sceneBuild.reset();
   }
+}
 
-  // Read node count
-  size_t nodeCount = 0;
-  fread(&nodeCount, sizeof(size_t), 1, f);
-
-  // Map for ID to node pointer
-  std::map<int, Node *> idToNode;
-
-  // Read nodes
-  for (size_t i = 0; i < nodeCount; i++) {
-    // Node type
-    size_t typeLen = 0;
-    fread(&typeLen, sizeof(size_t), 1, f);
-    std::string type;
-    type.resize(typeLen);
-    fread(&type[0], 1, typeLen, f);
-
-    // Node position
-    ImVec2 pos;
-    fread(&pos, sizeof(ImVec2), 1, f);
-
-    // Slot counts (BPS2 only)
-    int inputCount = 1;
-    int outputCount = 1;
-    if (isV2) {
-      fread(&inputCount, sizeof(int), 1, f);
-      fread(&outputCount, sizeof(int), 1, f);
+void NodeEditor::PollFileLoad() {
+  LoadedFile file;
+  if (fileLoader.TakeResult(file)) {
+    if (file.kind == LoadedFile::Kind::Library) {
+      ApplyGateLibrary(file);
+    } else if (!file.ok && file.kind == LoadedFile::Kind::Journal) {
+      SetAsideJournal("Couldn't recover " + file.path + ": " + file.error);
+    } else if (!file.ok) {
+      // Nothing was touched, so a damaged file leaves the scene in place
+      debugMsg = "Couldn't load " + file.path + ": " + file.error;
+    } else if (file.kind == LoadedFile::Kind::AigerGate) {
+      AddImportedGate(file.definition);
+    } else {
+      if (file.kind == LoadedFile::Kind::Journal) {
+        // Gates defined in the script come first, so its nodes can use them
+        RestoreScriptDefinitions(file.definitions);
+        ListCustomTypes(file.scene);
+        debugMsg = "Recovered unsaved work from the last session";
+      }
+      CancelLoad();
+      sceneBuild = std::make_unique<SceneBuild>();
+      sceneBuild->path = std::move(file.path);
+      sceneBuild->recovery = file.kind == LoadedFile::Kind::Journal;
+      sceneBuild->scene = std::move(file.scene);
+      sceneBuild->byIndex.resize(sceneBuild->scene.nodes.size(), nullptr);
     }
+  }
+  if (sceneBuild)
+    ContinueSceneBuild();
+}
+
+// Builds a slice of 'sceneBuild' per frame. Nodes are made on the UI thread
+// because creating a custom gate may load its definition; the finished
+// scene replaces 'nodes' in one step.
+void NodeEditor::ContinueSceneBuild() {
+  using Clock = std::chrono::steady_clock;
+  const Clock::time_point deadline = Clock::now() + SceneBuildSlice;
+  SceneBuild &build = *sceneBuild;
+  const SceneData &scene = build.scene;
+  auto outOfTime = [&](size_t i) {
+    return (i & 255) == 255 && Clock::now() >= deadline;
+  };
+
+  for (; build.nextNode < scene.nodes.size(); ++build.nextNode) {
+    if (outOfTime(build.nextNode))
+      return;
+    size_t i = build.nextNode;
+    const SceneData::Node &record = scene.nodes[i];
+    const std::string &type = scene.strings[record.type];
 
     // Create node (use placeholder for missing custom gates)
     Node *node = CreateNodeByType(type);
     if (!node && !IsBuiltInType(type)) {
-      // Missing custom gate - create placeholder
-      node = new PlaceholderGate(type, inputCount, outputCount);
-      placeholderNodes.insert(static_cast<PlaceholderGate *>(node));
+      node = new PlaceholderGate(type, (int)record.inputCount,
+                                 (int)record.outputCount);
+      build.placeholders.insert(static_cast<PlaceholderGate *>(node));
     }
 
     if (node) {
-      node->pos = pos;
+      node->pos = record.pos;
       node->id = "n" + std::to_string(i);
-      nodes.push_back(node);
-      idToNode[(int)i] = node;
+      if ((int)record.width != node->width)
+        node->SetWidth((int)record.width);
+      build.byIndex[i] = node;
     }
   }
 
-  // Read connection count
-  size_t connCount = 0;
-  fread(&connCount, sizeof(size_t), 1, f);
-
-  // Read connections
-  for (size_t i = 0; i < connCount; i++) {
-    int inputNodeId;
-    fread(&inputNodeId, sizeof(int), 1, f);
-
-    size_t inSlotLen = 0;
-    fread(&inSlotLen, sizeof(size_t), 1, f);
-    std::string inputSlot;
-    inputSlot.resize(inSlotLen);
-    fread(&inputSlot[0], 1, inSlotLen, f);
-
-    int outputNodeId;
-    fread(&outputNodeId, sizeof(int), 1, f);
-
-    size_t outSlotLen = 0;
-    fread(&outSlotLen, sizeof(size_t), 1, f);
-    std::string outputSlot;
-    outputSlot.resize(outSlotLen);
-    fread(&outputSlot[0], 1, outSlotLen, f);
-
-    // Create connection if both nodes exist
-    if (idToNode.count(inputNodeId) && idToNode.count(outputNodeId)) {
-      Connection conn;
-      conn.inputNode = idToNode[inputNodeId];
-      conn.inputSlot = inputSlot;
-      conn.outputNode = idToNode[outputNodeId];
-      conn.outputSlot = outputSlot;
-
-      ((Node *)conn.inputNode)->connections.push_back(conn);
-      ((Node *)conn.outputNode)->connections.push_back(conn);
-    }
+  for (; build.nextConnection < scene.connections.size();
+       ++build.nextConnection) {
+    if (outOfTime(build.nextConnection))
+      return;
+    const auto &record = scene.connections[build.nextConnection];
+    Node *inputNode = build.byIndex[record.inputNode];
+    Node *outputNode = build.byIndex[record.outputNode];
+    if (!inputNode || !outputNode)
+      continue;
+    Connection conn;
+    conn.inputNode = inputNode;
+    conn.inputSlot = scene.strings[record.inputSlot];
+    conn.outputNode = outputNode;
+    conn.outputSlot = scene.strings[record.outputSlot];
+    inputNode->connections.push_back(conn);
+    outputNode->connections.push_back(std::move(conn));
   }
 
-  fclose(f);
+  // Complete: swap it in. The journal starts over from the new scene.
+  journal.Invalidate();
+  if (build.recovery)
+    unrecoveredJournal = false;
+  DropNodeReferences();
+  for (auto *node : nodes)
+    delete node;
+  nodes.clear();
+  nodes.reserve(build.byIndex.size());
+  for (Node *node : build.byIndex)
+    if (node)
+      nodes.push_back(node);
+  MarkSceneChanged();
+  placeholderNodes = std::move(build.placeholders);
+  missingGateTypes.clear();
+  showMissingGatesBanner = false;
+
+  for (uint32_t type : scene.customTypes) {
+    const std::string &typeName = scene.strings[type];
+    if (!CustomGate::FindDefinition(typeName) &&
+        std::find(missingGateTypes.begin(), missingGateTypes.end(),
+                  typeName) == missingGateTypes.end())
+      missingGateTypes.push_back(typeName);
+  }
+  if (!missingGateTypes.empty()) {
+    showMissingGatesBanner = true;
+    debugMsg = "Missing gates detected: " + std::to_string(missingGateTypes.size());
+  }
+  sceneBuild.reset();
+  // For libraries that finished loading while the scene was being built
+  TryUpgradePlaceholders();
 
-  // Update script from loaded nodes
+  // Update script from loaded nodes. A parse still queued from the old
+  // script would undo the load.
+  scriptWorker.Cancel();
   UpdateScriptFromNodes();
   lastParsedScript = currentScript;
 }
@@ -1,557 +1,670 @@
 #include "../Nodes/Gates/CustomGate.hpp"
+#include "../Nodes/Gates/PlaceholderGate.hpp"
 #include "../Nodes/Special/PinIn.hpp"
 #include "NodeEditor.hpp"
-#include <iostream>
+#include "ScriptParser.hpp"
+#include "ScriptWorker.hpp"
+#include <algorithm>
+#include <deque>
 #include <map>
-#include <regex>
-#include <sstream>
+#include <set>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace Billyprints {
 
-// Helper to trim whitespace
-static void trimStr(std::string &s) {
-  if (s.empty())
-    return;
-  s.erase(0, s.find_first_not_of(" \t\n\r"));
-  size_t last = s.find_last_not_of(" \t\n\r");
-  if (last != std::string::npos)
-    s.erase(last + 1);
-}
+namespace {
+// Lowers the expressions of a define block onto AND / NOT nodes and calls of
+// other gates. Operators without a primitive (OR, XOR, ...) expand into
+// AND / NOT networks.
+class GateLowering {
+public:
+  GateLowering(const ScriptAst &ast, GateDefinition &def) : ast(ast), def(def) {}
+
+  // An output slot of a definition node
+  struct Ref {
+    uint32_t node;
+    uint16_t slot = 0;
+  };
+  static constexpr Ref Invalid = {UINT32_MAX, 0};
 
-// Helper to split string by delimiter
-static std::vector<std::string> splitStr(const std::string &s, char delim) {
-  std::vector<std::string> result;
-  std::stringstream ss(s);
-  std::string item;
-  while (std::getline(ss, item, delim)) {
-    trimStr(item);
-    if (!item.empty())
-      result.push_back(item);
-  }
-  return result;
-}
+  std::unordered_map<std::string_view, Ref> signals; // Name -> driver
+  std::unordered_set<std::string_view> buses; // Bus ports, used by bit only
+  ScriptAst::Error error;
 
-// Parse and register a custom gate definition from script
-// Syntax: define Name(in1, in2) -> (out1, out2):
-//           out1 = in1 OP in2
-//         end
-static bool ParseGateDefinition(const std::string &defBlock,
-                                std::string &errorOut) {
-  std::stringstream ss(defBlock);
-  std::string line;
-  std::string gateName;
-  std::vector<std::string> inputs;
-  std::vector<std::string> outputs;
-  std::vector<std::pair<std::string, std::string>> assignments; // output = expr
-
-  // Parse first line: define Name(in1, in2) -> (out1, out2):
-  if (!std::getline(ss, line)) {
-    errorOut = "Empty define block";
-    return false;
+  uint32_t AddNode(uint32_t type, float x, float y, int width = 1) {
+    NodeDefinition nd;
+    nd.type = type;
+    nd.pos = ImVec2(x, y);
+    nd.width = (uint8_t)width;
+    def.nodes.push_back(nd);
+    return (uint32_t)def.nodes.size() - 1;
   }
-  trimStr(line);
 
-  // Remove "define " prefix
-  if (line.substr(0, 7) != "define ") {
-    errorOut = "Block must start with 'define'";
-    return false;
+  void Connect(Ref from, uint32_t toNode, uint16_t toSlot) {
+    ConnectionDefinition cd;
+    cd.outputNodeId = from.node;
+    cd.outputSlot = from.slot;
+    cd.inputNodeId = toNode;
+    cd.inputSlot = toSlot;
+    def.connections.push_back(cd);
   }
-  line = line.substr(7);
-  trimStr(line);
 
-  // Extract gate name
-  size_t parenPos = line.find('(');
-  if (parenPos == std::string::npos) {
-    errorOut = "Missing '(' in define";
-    return false;
+  // Slot whose output carries the expression, or Invalid on error
+  Ref Build(uint32_t index) {
+    const ScriptAst::Expr &expr = ast.exprs[index];
+    switch (expr.kind) {
+    case ScriptAst::Expr::Signal: {
+      auto it = signals.find(expr.name);
+      if (it != signals.end())
+        return it->second;
+      if (buses.count(expr.name))
+        return Fail(expr, std::string(expr.name) +
+                              " is a bus; pick a bit with " +
+                              std::string(expr.name) + "[i]");
+      return Fail(expr, "Unknown signal: " + std::string(expr.name));
+    }
+    case ScriptAst::Expr::Not: {
+      Ref operand = Build(expr.lhs);
+      return IsInvalid(operand) ? Invalid : Not(operand);
+    }
+    case ScriptAst::Expr::Call:
+      return BuildCall(expr);
+    default: {
+      Ref lhs = Build(expr.lhs);
+      Ref rhs = IsInvalid(lhs) ? Invalid : Build(expr.rhs);
+      return IsInvalid(rhs) ? Invalid : Binary(expr.kind, lhs, rhs);
+    }
+    }
   }
-  gateName = line.substr(0, parenPos);
-  trimStr(gateName);
 
-  // Extract inputs: between ( and )
-  size_t closeParenPos = line.find(')');
-  if (closeParenPos == std::string::npos || closeParenPos <= parenPos) {
-    errorOut = "Missing ')' for inputs";
-    return false;
-  }
-  std::string inputsStr = line.substr(parenPos + 1, closeParenPos - parenPos - 1);
-  inputs = splitStr(inputsStr, ',');
+  static bool IsInvalid(Ref ref) { return ref.node == Invalid.node; }
 
-  // Find -> and outputs
-  size_t arrowPos = line.find("->");
-  if (arrowPos == std::string::npos) {
-    errorOut = "Missing '->' in define";
-    return false;
-  }
+private:
+  const ScriptAst &ast;
+  GateDefinition &def;
+  float gateY = 0;
 
-  std::string afterArrow = line.substr(arrowPos + 2);
-  trimStr(afterArrow);
+  Ref Fail(const ScriptAst::Expr &expr, std::string message) {
+    error = {expr.span, std::move(message)};
+    return Invalid;
+  }
 
-  // Extract outputs: between ( and ):
-  size_t outOpenParen = afterArrow.find('(');
-  size_t outCloseParen = afterArrow.find(')');
-  if (outOpenParen == std::string::npos || outCloseParen == std::string::npos) {
-    errorOut = "Missing output parentheses";
-    return false;
+  Ref Gate(uint32_t type) {
+    uint32_t node = AddNode(type, 150, gateY);
+    gateY += 50;
+    return {node};
+  }
+  Ref Not(Ref a) {
+    Ref node = Gate(GateType_NOT);
+    Connect(a, node.node, 0);
+    return node;
+  }
+  Ref And(Ref a, Ref b) {
+    Ref node = Gate(GateType_AND);
+    Connect(a, node.node, 0);
+    Connect(b, node.node, 1);
+    return node;
   }
-  std::string outputsStr =
-      afterArrow.substr(outOpenParen + 1, outCloseParen - outOpenParen - 1);
-  outputs = splitStr(outputsStr, ',');
 
-  if (gateName.empty() || inputs.empty() || outputs.empty()) {
-    errorOut = "Gate must have name, inputs, and outputs";
-    return false;
+  Ref Binary(ScriptAst::Expr::Kind kind, Ref a, Ref b) {
+    switch (kind) {
+    case ScriptAst::Expr::And:
+      return And(a, b);
+    case ScriptAst::Expr::Nand:
+      return Not(And(a, b));
+    case ScriptAst::Expr::Or:
+      return Not(And(Not(a), Not(b)));
+    case ScriptAst::Expr::Nor:
+      return And(Not(a), Not(b));
+    case ScriptAst::Expr::Xor:
+      return And(Not(And(a, b)), Not(And(Not(a), Not(b))));
+    default: // Xnor
+      return Not(Binary(ScriptAst::Expr::Xor, a, b));
+    }
   }
 
-  // Parse body: assignments like "out = in1 OP in2" or "out = NOT in1"
-  while (std::getline(ss, line)) {
-    trimStr(line);
-    if (line.empty() || line == "end")
-      continue;
-    if (line[0] == '/' && line.size() > 1 && line[1] == '/')
-      continue;
+  Ref BuildCall(const ScriptAst::Expr &expr) {
+    std::string name(expr.name);
+    GateDefinitionRef gateDef =
+        name == "AND" ? nullptr : CustomGate::FindDefinition(name);
+
+    // Operator names work as calls unless a gate of that name is loaded
+    static const std::map<std::string, ScriptAst::Expr::Kind> builtins = {
+        {"AND", ScriptAst::Expr::And},   {"OR", ScriptAst::Expr::Or},
+        {"XOR", ScriptAst::Expr::Xor},   {"NAND", ScriptAst::Expr::Nand},
+        {"NOR", ScriptAst::Expr::Nor},   {"XNOR", ScriptAst::Expr::Xnor}};
+    auto builtin = builtins.find(name);
+    if (!gateDef && builtin != builtins.end()) {
+      if (expr.argCount != 2)
+        return Fail(expr, name + " takes 2 inputs");
+      Ref a = Build(ast.args[expr.firstArg]);
+      Ref b = IsInvalid(a) ? Invalid : Build(ast.args[expr.firstArg + 1]);
+      return IsInvalid(b) ? Invalid : Binary(builtin->second, a, b);
+    }
 
-    size_t eqPos = line.find('=');
-    if (eqPos == std::string::npos) {
-      errorOut = "Invalid assignment: " + line;
-      return false;
+    if (!gateDef)
+      return Fail(expr, "Unknown gate type: " + name +
+                            " (make sure to load the gate library first, or "
+                            "define it earlier in the script)");
+    if (expr.argCount > gateDef->inputPinIndices.size())
+      return Fail(expr, name + " takes " +
+                            std::to_string(gateDef->inputPinIndices.size()) +
+                            " inputs");
+    // Arguments are single signals, so bus pins can't be fed from a call
+    for (size_t i = 0; i < expr.argCount; ++i)
+      if (gateDef->nodes[gateDef->inputPinIndices[i]].width != 1)
+        return Fail(expr, name + " input " + std::to_string(i) +
+                              " is a bus and can't be passed a signal");
+
+    std::vector<Ref> argRefs;
+    for (uint32_t i = 0; i < expr.argCount; ++i) {
+      Ref arg = Build(ast.args[expr.firstArg + i]);
+      if (IsInvalid(arg))
+        return Invalid;
+      argRefs.push_back(arg);
     }
-    std::string lhs = line.substr(0, eqPos);
-    std::string rhs = line.substr(eqPos + 1);
-    trimStr(lhs);
-    trimStr(rhs);
-    assignments.push_back({lhs, rhs});
+    uint32_t node = AddNode(InternGateType(name), 150, gateY);
+    gateY += 60;
+    for (size_t i = 0; i < argRefs.size(); ++i)
+      Connect(argRefs[i], node, (uint16_t)i);
+    return {node};
+  }
+};
+} // namespace
+
+// Build and register a custom gate from a parsed define block
+// Syntax: define Name(in1, in2) -> (out1, out2):
+//           out1 = expression
+//         end
+// A bus port such as a[8] is one pin of that width; its bits a[0] to a[7]
+// come from a Split behind the pin or go into a Merge in front of it.
+// Returns the registered definition, or nullptr with 'errorOut' set.
+static GateDefinitionRef BuildScriptGate(const ScriptAst &ast,
+                                         const ScriptAst::GateDecl &gate,
+                                         ScriptAst::Error &errorOut) {
+  if (gate.inputCount == 0 || gate.outputCount == 0) {
+    errorOut = {gate.span, "Gate must have name, inputs, and outputs"};
+    return nullptr;
   }
 
-  // Now build the GateDefinition
   GateDefinition def;
-  def.name = gateName;
+  def.name = std::string(gate.name);
   def.color = IM_COL32(60, 80, 120, 200); // Default blue-ish color
-
-  std::map<std::string, int> signalToNodeId; // Maps signal name to node ID
-  int nodeIdCounter = 0;
-  float yPos = 0;
+  GateLowering lowering(ast, def);
+  std::deque<std::string> bitNames; // Keys of bus bits in 'signals'
+  auto bitName = [&](const ScriptAst::Port &port, int bit) {
+    bitNames.push_back(std::string(port.name) + "[" + std::to_string(bit) +
+                       "]");
+    return std::string_view(bitNames.back());
+  };
 
   // Create PinIn nodes for each input
-  for (const auto &inputName : inputs) {
-    NodeDefinition nd;
-    nd.type = "In";
-    nd.id = nodeIdCounter;
-    nd.pos = ImVec2(0, yPos);
-    yPos += 60;
-    def.nodes.push_back(nd);
-    def.inputPinIndices.push_back(nodeIdCounter);
-    signalToNodeId[inputName] = nodeIdCounter;
-    nodeIdCounter++;
+  for (uint32_t i = 0; i < gate.inputCount; ++i) {
+    const ScriptAst::Port &port = ast.ports[gate.firstInput + i];
+    uint32_t pin = lowering.AddNode(GateType_In, 0, i * 60.0f, port.width);
+    def.inputPinIndices.push_back(pin);
+    def.inputNames.emplace_back(port.name);
+    if (!port.bus) {
+      lowering.signals[port.name] = {pin};
+      continue;
+    }
+    lowering.buses.insert(port.name);
+    if (port.width == 1) {
+      lowering.signals[bitName(port, 0)] = {pin};
+      continue;
+    }
+    uint32_t split =
+        lowering.AddNode(GateType_Split, 60, i * 60.0f, port.width);
+    lowering.Connect({pin}, split, 0);
+    for (int bit = 0; bit < port.width; ++bit)
+      lowering.signals[bitName(port, bit)] = {split, (uint16_t)bit};
   }
 
-  // Helper lambdas for creating nodes and connections
-  auto createNode = [&](const std::string &type, float x, float y) -> int {
-    NodeDefinition nd;
-    nd.type = type;
-    nd.id = nodeIdCounter;
-    nd.pos = ImVec2(x, y);
-    def.nodes.push_back(nd);
-    return nodeIdCounter++;
-  };
-
-  auto connect = [&](int fromNode, const std::string &fromSlot, int toNode,
-                     const std::string &toSlot) {
-    ConnectionDefinition cd;
-    cd.outputNodeId = fromNode;
-    cd.outputSlot = fromSlot;
-    cd.inputNodeId = toNode;
-    cd.inputSlot = toSlot;
-    def.connections.push_back(cd);
-  };
-
-  // Process each assignment to create gate nodes
-  float gateX = 150;
-  float gateY = 0;
-
-  for (const auto &[outSignal, expr] : assignments) {
-    // Parse expression: "in1 OP in2", "NOT in1", or "CustomGate(in1, in2)"
-    std::string gateType;
-    std::string operand1, operand2;
-    std::vector<std::string> callArgs;
-
-    // Check for NOT (unary)
-    if (expr.substr(0, 4) == "NOT ") {
-      gateType = "NOT";
-      operand1 = expr.substr(4);
-      trimStr(operand1);
-    }
-    // Check for AND (binary)
-    else if (expr.find(" AND ") != std::string::npos) {
-      size_t opPos = expr.find(" AND ");
-      gateType = "AND";
-      operand1 = expr.substr(0, opPos);
-      operand2 = expr.substr(opPos + 5);
-      trimStr(operand1);
-      trimStr(operand2);
+  // Each assignment names the slot driving its expression; a plain signal
+  // on the right is a passthrough
+  for (uint32_t i = 0; i < gate.assignmentCount; ++i) {
+    const auto &assignment = ast.assignments[gate.firstAssignment + i];
+    GateLowering::Ref driver = lowering.Build(assignment.expr);
+    if (GateLowering::IsInvalid(driver)) {
+      errorOut = lowering.error;
+      return nullptr;
     }
-    // Check for custom gate call: GateName(arg1, arg2, ...)
-    else if (expr.find('(') != std::string::npos) {
-      size_t parenPos = expr.find('(');
-      size_t closePos = expr.rfind(')'); // Use rfind to get the LAST closing paren
-      if (closePos != std::string::npos && closePos > parenPos) {
-        gateType = expr.substr(0, parenPos);
-        trimStr(gateType);
-        std::string argsStr = expr.substr(parenPos + 1, closePos - parenPos - 1);
-        // Note: nested calls like NAND(NAND(a,a), NAND(b,b)) are NOT supported
-        // Use intermediate signals instead
-        callArgs = splitStr(argsStr, ',');
+    lowering.signals[assignment.target] = driver;
+  }
+
+  // Create PinOut nodes for each output
+  for (uint32_t i = 0; i < gate.outputCount; ++i) {
+    const ScriptAst::Port &port = ast.ports[gate.firstOutput + i];
+    std::vector<GateLowering::Ref> drivers;
+    for (int bit = 0; bit < port.width; ++bit) {
+      std::string_view signalName = port.bus ? bitName(port, bit) : port.name;
+      auto signal = lowering.signals.find(signalName);
+      if (signal == lowering.signals.end()) {
+        errorOut = {gate.span, "Output signal not defined: " +
+                                   std::string(signalName)};
+        return nullptr;
       }
+      drivers.push_back(signal->second);
     }
-    // Check for passthrough (out = in)
-    else if (!expr.empty() && signalToNodeId.count(expr)) {
-      signalToNodeId[outSignal] = signalToNodeId[expr];
+    uint32_t pin = lowering.AddNode(GateType_Out, 300, i * 60.0f, port.width);
+    def.outputPinIndices.push_back(pin);
+    def.outputNames.emplace_back(port.name);
+    if (port.width == 1) {
+      lowering.Connect(drivers[0], pin, 0);
       continue;
-    } else {
-      errorOut = "Unknown expression: " + expr;
-      return false;
     }
+    uint32_t merge =
+        lowering.AddNode(GateType_Merge, 240, i * 60.0f, port.width);
+    for (int bit = 0; bit < port.width; ++bit)
+      lowering.Connect(drivers[bit], merge, (uint16_t)bit);
+    lowering.Connect({merge}, pin, 0);
+  }
 
-    int resultNodeId = -1;
-
-    if (gateType == "NOT") {
-      if (!signalToNodeId.count(operand1)) {
-        errorOut = "Unknown signal: " + operand1;
-        return false;
-      }
-      int notGate = createNode("NOT", gateX, gateY);
-      gateY += 50;
-      connect(signalToNodeId[operand1], "out", notGate, "in");
-      resultNodeId = notGate;
-
-    } else if (gateType == "AND") {
-      if (!signalToNodeId.count(operand1)) {
-        errorOut = "Unknown signal: " + operand1;
-        return false;
-      }
-      if (!signalToNodeId.count(operand2)) {
-        errorOut = "Unknown signal: " + operand2;
-        return false;
-      }
-      int andGate = createNode("AND", gateX, gateY);
-      gateY += 50;
-      connect(signalToNodeId[operand1], "out", andGate, "in0");
-      connect(signalToNodeId[operand2], "out", andGate, "in1");
-      resultNodeId = andGate;
-
-    } else if (!callArgs.empty()) {
-      // Custom gate call - check if gate exists in registry
-      if (!CustomGate::GateRegistry.count(gateType)) {
-        errorOut = "Unknown gate type: " + gateType +
-                   " (make sure to load the gate library first, or define it earlier in the script)";
-        return false;
-      }
-
-      // Validate arguments - no nested calls allowed
-      for (const auto &arg : callArgs) {
-        if (arg.find('(') != std::string::npos || arg.find(')') != std::string::npos) {
-          errorOut = "Nested gate calls not supported. Use intermediate signals instead. "
-                     "Example: t1 = NAND(a, a) then out = NAND(t1, t2)";
-          return false;
-        }
-      }
-
-      // Create the custom gate node
-      int customGate = createNode(gateType, gateX, gateY);
-      gateY += 60;
-
-      // Connect arguments to inputs
-      const auto &gateDef = CustomGate::GateRegistry[gateType];
-      for (size_t i = 0; i < callArgs.size() && i < gateDef.inputPinIndices.size(); ++i) {
-        if (!signalToNodeId.count(callArgs[i])) {
-          errorOut = "Unknown signal: " + callArgs[i] + " in call to " + gateType;
-          return false;
-        }
-        std::string inSlot = (gateDef.inputPinIndices.size() == 1) ? "in" : "in" + std::to_string(i);
-        connect(signalToNodeId[callArgs[i]], "out", customGate, inSlot);
-      }
-      resultNodeId = customGate;
+  // Register the gate
+  GateDefinitionRef registered = FinalizeGateDefinition(std::move(def));
+  CustomGate::RegisterDefinition(registered);
 
-    } else {
-      errorOut = "Invalid expression: " + expr;
-      return false;
-    }
+  return registered;
+}
 
-    signalToNodeId[outSignal] = resultNodeId;
+namespace {
+// Content hashes of the gates a define block calls. Gates built from the
+// script hash as their block; other registered gates hash their definition,
+// including the gates nested in it. Names that aren't registered hash as
+// just the name, so loading a gate of that name later changes the hash.
+class GateHasher {
+public:
+  void SetBlockHash(std::string_view name, uint64_t hash) {
+    blocks[std::string(name)] = hash;
   }
 
-  // Create PinOut nodes for each output
-  float outX = 300;
-  float outY = 0;
-  for (const auto &outputName : outputs) {
-    NodeDefinition nd;
-    nd.type = "Out";
-    nd.id = nodeIdCounter;
-    nd.pos = ImVec2(outX, outY);
-    outY += 60;
-    def.nodes.push_back(nd);
-    def.outputPinIndices.push_back(nodeIdCounter);
-
-    // Connect the signal to this output
-    if (signalToNodeId.count(outputName)) {
-      ConnectionDefinition cd;
-      cd.outputNodeId = signalToNodeId[outputName];
-      cd.outputSlot = "out";
-      cd.inputNodeId = nodeIdCounter;
-      cd.inputSlot = "in";
-      def.connections.push_back(cd);
-    } else {
-      errorOut = "Output signal not defined: " + outputName;
-      return false;
+  uint64_t Hash(const std::string &name) {
+    auto block = blocks.find(name);
+    if (block != blocks.end())
+      return block->second;
+    GateDefinitionRef def = CustomGate::FindDefinition(name);
+    if (!def)
+      return HashBytes(name);
+    auto known = definitions.find(def.get());
+    if (known != definitions.end())
+      return known->second;
+    definitions[def.get()] = 0; // In case a definition contains itself
+
+    uint64_t hash = HashCombine(HashBytes(def->name), def->color);
+    for (const auto &node : def->nodes) {
+      hash = HashCombine(hash, node.type < GateType_BuiltinCount
+                                   ? node.type
+                                   : Hash(GateTypeName(node.type)));
+      hash = HashCombine(hash, node.width);
+    }
+    for (const auto &conn : def->connections) {
+      hash = HashCombine(hash, conn.outputNodeId);
+      hash = HashCombine(hash, conn.inputNodeId);
+      hash = HashCombine(hash, ((uint64_t)conn.outputSlot << 16) |
+                                   conn.inputSlot);
     }
-    nodeIdCounter++;
+    for (uint32_t pin : def->inputPinIndices)
+      hash = HashCombine(hash, pin);
+    for (uint32_t pin : def->outputPinIndices)
+      hash = HashCombine(hash, ~(uint64_t)pin);
+    definitions[def.get()] = hash;
+    return hash;
   }
 
-  // Register the gate
-  CustomGate::GateRegistry[def.name] = def;
+private:
+  std::unordered_map<std::string, uint64_t> blocks;
+  // Registered definitions are kept alive by the registry meanwhile
+  std::unordered_map<const GateDefinition *, uint64_t> definitions;
+};
+} // namespace
+
+// Register the script's define blocks in order and return the text of the
+// ones that built, for preservation. A block is keyed by the hash of its
+// tokens and of the gates it calls; blocks whose key is in 'parsedBlocks'
+// and whose definition is still the registered one are not built again, so
+// their instances in the scene stay in place. The cache is pruned to the
+// blocks in this script.
+static std::string RegisterScriptGates(
+    const ScriptAst &ast, std::vector<ScriptAst::Error> &errors,
+    std::unordered_map<uint64_t, GateDefinitionRef> &parsedBlocks) {
+  std::unordered_map<uint64_t, GateDefinitionRef> stillPresent;
+  std::string definitions;
+  GateHasher hasher;
+
+  for (const auto &gate : ast.gates) {
+    if (!gate.valid)
+      continue; // Syntax errors were already reported
+    if (gate.isTemplate) {
+      // Only its instances are built, but the block itself is what's kept
+      definitions += std::string(gate.text) + "\n\n";
+      continue;
+    }
 
-  return true;
-}
+    uint64_t key = gate.sourceHash;
+    for (uint32_t i = 0; i < gate.callCount; ++i)
+      key = HashCombine(key,
+                        hasher.Hash(std::string(ast.calls[gate.firstCall + i])));
 
-// Extract all define...end blocks from script and parse them
-// Returns the define blocks in 'definitions' for preservation
-static std::string ExtractAndParseDefinitions(const std::string &script,
-                                              std::string &remaining,
-                                              std::string &definitions,
-                                              std::string &errorOut) {
-  remaining = "";
-  definitions = "";
-  std::stringstream ss(script);
-  std::string line;
-  bool inDefine = false;
-  std::string currentDefine;
-  std::string outsideDefine;
-  std::string allDefinitions;
-
-  while (std::getline(ss, line)) {
-    std::string trimmed = line;
-    trimStr(trimmed);
-
-    if (!inDefine && trimmed.substr(0, 7) == "define ") {
-      inDefine = true;
-      currentDefine = line + "\n";
-    } else if (inDefine) {
-      currentDefine += line + "\n";
-      if (trimmed == "end") {
-        // Parse this definition
-        std::string err;
-        if (!ParseGateDefinition(currentDefine, err)) {
-          errorOut += "Define error: " + err + "\n";
-        } else {
-          // Successfully parsed, preserve the block
-          allDefinitions += currentDefine + "\n";
-        }
-        inDefine = false;
-        currentDefine = "";
-      }
+    auto cached = parsedBlocks.find(key);
+    GateDefinitionRef def;
+    if (cached != parsedBlocks.end() && cached->second->name == gate.name &&
+        CustomGate::FindDefinition(cached->second->name) == cached->second) {
+      def = cached->second; // Unchanged and still registered
     } else {
-      outsideDefine += line + "\n";
+      // Failures are not cached since they may depend on a block that is
+      // fixed later
+      ScriptAst::Error error;
+      def = BuildScriptGate(ast, gate, error);
+      if (!def)
+        errors.push_back(
+            {error.span, "Define error: " +
+                             (gate.isInstance ? std::string(gate.name) + ": "
+                                              : std::string()) +
+                             error.message});
+    }
+    if (def) {
+      if (!gate.isInstance)
+        definitions += std::string(gate.text) + "\n\n";
+      hasher.SetBlockHash(gate.name, key);
+      stillPresent[key] = def;
     }
   }
 
-  if (inDefine) {
-    errorOut += "Unclosed define block\n";
-  }
+  parsedBlocks.swap(stillPresent);
+  return definitions;
+}
 
-  remaining = outsideDefine;
-  definitions = allDefinitions;
-  return errorOut;
+// Whether a live node can stay in place for a script node of 'type'
+static bool MatchesNodeType(Node *node, const std::string &type) {
+  if (type != node->title)
+    return false;
+  // Instances of a redefined gate are rebuilt from the new definition
+  if (auto *custom = dynamic_cast<CustomGate *>(node))
+    return custom->GetDefinition() == CustomGate::FindDefinition(type);
+  // Placeholders are replaced as soon as their gate becomes available
+  if (dynamic_cast<PlaceholderGate *>(node))
+    return CustomGate::FindDefinition(type) == nullptr;
+  return true;
 }
 
 void NodeEditor::UpdateScriptFromNodes() {
-  std::stringstream ss;
-  std::map<Node *, std::string> nodeToId;
-  int autoIdCounter = 0;
+  std::string script;
+  script.reserve(nodes.size() * 48);
 
   // Include any preserved gate definitions at the top
   if (!scriptDefinitions.empty()) {
-    ss << scriptDefinitions;
+    script += scriptDefinitions;
   }
 
   // First pass: Assign IDs
-  for (int i = 0; i < nodes.size(); ++i) {
-    if (nodes[i]->id.empty()) {
-      // Find a unique ID
-      while (true) {
-        std::string candidate = "n" + std::to_string(autoIdCounter++);
-        bool clash = false;
-        for (const auto &n : nodes) {
-          if (n->id == candidate) {
-            clash = true;
-            break;
-          }
-        }
-        if (!clash) {
-          nodes[i]->id = candidate;
-          break;
-        }
-      }
-    }
-    nodeToId[nodes[i]] = nodes[i]->id;
+  std::unordered_set<std::string> usedIds;
+  for (Node *node : nodes)
+    if (!node->id.empty())
+      usedIds.insert(node->id);
+  int autoIdCounter = 0;
+  for (Node *node : nodes) {
+    if (!node->id.empty())
+      continue;
+    // Find a unique ID
+    std::string candidate;
+    do {
+      candidate = "n" + std::to_string(autoIdCounter++);
+    } while (usedIds.count(candidate));
+    node->id = candidate;
+    usedIds.insert(candidate);
   }
 
-  for (int i = 0; i < nodes.size(); ++i) {
-    std::string type = nodes[i]->title;
-    ss << type << " " << nodes[i]->id << " @ " << (int)nodes[i]->pos.x << ", "
-       << (int)nodes[i]->pos.y;
+  for (Node *node : nodes) {
+    std::string type = node->title;
+    script += type + " " + node->id;
+    if (node->width > 1)
+      script += "[" + std::to_string(node->width - 1) + ":0]";
+    script += " @ " + std::to_string((int)node->pos.x) + ", " +
+              std::to_string((int)node->pos.y);
 
     if (type == "In") {
-      PinIn *pin = (PinIn *)nodes[i];
+      PinIn *pin = (PinIn *)node;
       if (pin->isMomentary)
-        ss << " momentary";
+        script += " momentary";
     }
 
-    ss << "\n";
+    script += "\n";
   }
-  ss << "\n";
-  for (auto *node : nodes) {
+  script += "\n";
+  for (Node *node : nodes) {
     for (const auto &conn : node->connections) {
       if (conn.outputNode == node) {
-        ss << nodeToId[(Node *)conn.outputNode] << "." << conn.outputSlot
-           << " -> " << nodeToId[(Node *)conn.inputNode] << "."
-           << conn.inputSlot << "\n";
+        script += node->id + "." + conn.outputSlot + " -> " +
+                  ((Node *)conn.inputNode)->id + "." + conn.inputSlot + "\n";
       }
     }
   }
-  currentScript = ss.str();
+  currentScript = std::move(script);
+  scriptEditor.SetText(currentScript);
+  scriptWorker.SetText(currentScript);
+  scriptTextEdited = false;
+  scriptRevision = sceneRevision;
+}
+
+void NodeEditor::SyncScriptText() {
+  if (!scriptTextEdited)
+    return;
+  scriptTextEdited = false;
+  // The worker already has these edits queued
+  currentScript = scriptEditor.GetText();
+  lastParsedScript = currentScript;
 }
 
 void NodeEditor::UpdateNodesFromScript() {
+  SyncScriptText();
   if (currentScript == lastParsedScript)
     return;
   lastParsedScript = currentScript;
-  scriptError = "";
+  scriptWorker.Submit(currentScript);
+}
 
-  auto trim = [](std::string &s) {
-    if (s.empty())
-      return;
-    s.erase(0, s.find_first_not_of(" \t\n\r"));
-    size_t last = s.find_last_not_of(" \t\n\r");
-    if (last != std::string::npos)
-      s.erase(last + 1);
-  };
+void NodeEditor::PollScriptParse() {
+  ParsedScript parsed;
+  if (scriptWorker.TakeResult(parsed))
+    ApplyParsedScript(parsed);
+}
 
-  for (auto *n : nodes)
-    delete n;
-  nodes.clear();
-
-  // First pass: Extract and parse custom gate definitions
-  std::string remainingScript;
-  std::string defErrors;
-  ExtractAndParseDefinitions(currentScript, remainingScript, scriptDefinitions,
-                             defErrors);
-  if (!defErrors.empty()) {
-    scriptError += defErrors;
+void NodeEditor::FlushScriptParse() {
+  SyncScriptText();
+  ParsedScript parsed;
+  if (scriptWorker.TakeResult(parsed)) {
+    ApplyParsedScript(parsed);
+  } else if (scriptWorker.Pending()) {
+    // Still debouncing or parsing; doing it here is quicker than waiting
+    scriptWorker.Cancel();
+    ApplyParsedScript(ParseSceneScript(lastParsedScript));
   }
+}
 
-  // Second pass: Parse nodes and connections from remaining script
-  std::stringstream ss(remainingScript);
-  std::string line;
-  std::map<std::string, Node *> idToNode;
-  int lineNum = 0;
+void NodeEditor::ApplyParsedScript(const ParsedScript &parsed) {
+  const ScriptAst &ast = parsed.ast;
+  scriptError = "";
 
-  while (std::getline(ss, line)) {
-    lineNum++;
-    trim(line);
-    if (line.empty() || (line.size() >= 2 && line[0] == '/' && line[1] == '/'))
-      continue;
+  // Custom gate definitions first, so nodes can use them. The text is only
+  // regenerated for what actually changed, which keeps the user's own
+  // comments and formatting otherwise.
+  std::vector<ScriptAst::Error> errors = ast.errors;
+  std::string definitions =
+      RegisterScriptGates(ast, errors, parsedDefineBlocks);
+  if (definitions != scriptDefinitions) {
+    scriptDefinitions = std::move(definitions);
+    journal.DefinitionsChanged(scriptDefinitions);
+    ++sceneRevision;
+  }
+  std::stable_sort(errors.begin(), errors.end(),
+                   [](const ScriptAst::Error &a, const ScriptAst::Error &b) {
+                     return a.span.line < b.span.line;
+                   });
+  for (const auto &error : errors)
+    scriptError +=
+        "Line " + std::to_string(error.span.line) + ": " + error.message + "\n";
+
+  // Then patch the live scene with the nodes and connections
+  ApplySceneDescription(parsed.scene);
+}
 
-    try {
-      if (line.find("->") != std::string::npos) {
-        size_t arrowPos = line.find("->");
-        std::string left = line.substr(0, arrowPos);
-        std::string right = line.substr(arrowPos + 2);
-        trim(left);
-        trim(right);
-
-        auto parseSlot =
-            [&](std::string s,
-                bool isOutput) -> std::pair<std::string, std::string> {
-          size_t dot = s.find('.');
-          if (dot == std::string::npos) {
-            return {s, isOutput ? "out" : "in"};
-          }
-          std::string nodePart = s.substr(0, dot);
-          std::string slotPart = s.substr(dot + 1);
-          trim(nodePart);
-          trim(slotPart);
-          return {nodePart, slotPart};
-        };
-
-        auto outS = parseSlot(left, true);
-        auto inS = parseSlot(right, false);
-
-        if (outS.first.empty() || inS.first.empty() || outS.second.empty() ||
-            inS.second.empty())
-          continue;
-
-        if (idToNode.count(outS.first) && idToNode.count(inS.first)) {
-          Node *outNode = idToNode[outS.first];
-          Node *inNode = idToNode[inS.first];
-
-          bool outSlotValid = false;
-          if (outS.second == "out" && std::string(outNode->title) == "In")
-            outSlotValid = true;
-          else {
-            for (int i = 0; i < outNode->outputSlotCount; ++i)
-              if (std::string(outNode->outputSlots[i].title) == outS.second)
-                outSlotValid = true;
-          }
-
-          bool inSlotValid = false;
-          if (inS.second == "in" && std::string(inNode->title) == "Out")
-            inSlotValid = true;
-          else {
-            for (int i = 0; i < inNode->inputSlotCount; ++i)
-              if (std::string(inNode->inputSlots[i].title) == inS.second)
-                inSlotValid = true;
-          }
-
-          if (outSlotValid && inSlotValid) {
-            Connection conn;
-            conn.outputNode = outNode;
-            conn.outputSlot = outS.second;
-            conn.inputNode = inNode;
-            conn.inputSlot = inS.second;
-            outNode->connections.push_back(conn);
-            inNode->connections.push_back(conn);
-          }
-        }
-      } else if (line.find("@") != std::string::npos) {
-        std::stringstream lss(line);
-        std::string type, id, at;
-        int x, y;
-        char comma;
-        if (!(lss >> type >> id >> at >> x >> comma >> y)) {
-          scriptError +=
-              "Line " + std::to_string(lineNum) + ": Invalid node format\n";
-          continue;
-        }
+void NodeEditor::RestoreScriptDefinitions(const std::string &definitions) {
+  ParsedScript parsed = ParseSceneScript(definitions);
+  std::vector<ScriptAst::Error> errors = parsed.ast.errors;
+  scriptDefinitions =
+      RegisterScriptGates(parsed.ast, errors, parsedDefineBlocks);
+}
 
-        Node *n = CreateNodeByType(type);
-        if (n) {
-          n->pos = {(float)x, (float)y};
-          n->id = id;
-          if (type == "In" && line.find("momentary") != std::string::npos) {
-            ((PinIn *)n)->isMomentary = true;
-          }
-          nodes.push_back(n);
-          idToNode[id] = n;
-        } else {
-          scriptError += "Line " + std::to_string(lineNum) + ": Unknown type " +
-                         type + "\n";
+void NodeEditor::ApplySceneDescription(const SceneDescription &scene) {
+  std::unordered_map<std::string, Node *> liveById;
+  for (Node *node : nodes)
+    if (!node->id.empty())
+      liveById.emplace(node->id, node);
+
+  // 1. Match script nodes to live nodes by id; create what is missing
+  std::vector<Node *> ordered;
+  ordered.reserve(scene.nodes.size());
+  std::unordered_map<std::string, Node *> idToNode;
+  std::unordered_set<Node *> kept;
+  std::vector<Node *> added;
+
+  for (const auto &decl : scene.nodes) {
+    if (idToNode.count(decl.id)) {
+      scriptError += "Line " + std::to_string(decl.line) +
+                     ": Duplicate node id " + decl.id + "\n";
+      continue;
+    }
+
+    Node *node = nullptr;
+    auto live = liveById.find(decl.id);
+    if (live != liveById.end() && MatchesNodeType(live->second, decl.type) &&
+        live->second->width == decl.width) {
+      node = live->second;
+      kept.insert(node);
+      if (node->pos.x != decl.pos.x || node->pos.y != decl.pos.y) {
+        node->pos = decl.pos;
+        journal.Touched(node);
+        if (!spatialIndexDirty) {
+          nodeIndex.Update(node, NodeBounds(node));
+          InvalidateWires(node);
         }
       }
-    } catch (...) {
-      scriptError += "Line " + std::to_string(lineNum) + ": Unexpected error\n";
+    } else {
+      node = CreateNodeByType(decl.type);
+      if (!node) {
+        scriptError += "Line " + std::to_string(decl.line) +
+                       ": Unknown type " + decl.type + "\n";
+        continue;
+      }
+      if (!node->SetWidth(decl.width)) {
+        scriptError += "Line " + std::to_string(decl.line) + ": " +
+                       decl.type + " can't be a bus\n";
+        delete node;
+        continue;
+      }
+      node->pos = decl.pos;
+      node->id = decl.id;
+      journal.Added(node);
+      added.push_back(node);
+    }
+
+    if (decl.type == "In")
+      ((PinIn *)node)->isMomentary = decl.momentary;
+    ordered.push_back(node);
+    idToNode[decl.id] = node;
+  }
+
+  // 2. Delete live nodes the script no longer mentions. Wires to surviving
+  // nodes are detached first so no node is touched after deletion.
+  std::vector<Node *> removed;
+  for (Node *node : nodes)
+    if (!kept.count(node))
+      removed.push_back(node);
+  for (Node *node : removed)
+    NodeRemoved(node);
+  for (Node *node : removed) {
+    for (const Connection &connection : node->connections) {
+      Node *other = (Node *)(connection.outputNode == node
+                                 ? connection.inputNode
+                                 : connection.outputNode);
+      if (other != node && kept.count(other))
+        other->DeleteConnection(connection);
+    }
+  }
+  for (Node *node : removed) {
+    if (auto *placeholder = dynamic_cast<PlaceholderGate *>(node))
+      placeholderNodes.erase(placeholder);
+    journal.Removed(node);
+    delete node;
+  }
+  nodes.swap(ordered);
+
+  // 3. Rewire: drop wires that are gone and add the new ones
+  using WireKey = std::tuple<Node *, std::string, Node *, std::string>;
+  std::set<WireKey> wanted;
+  for (const auto &wire : scene.wires) {
+    auto outNode = idToNode.find(wire.outputNode);
+    auto inNode = idToNode.find(wire.inputNode);
+    if (outNode == idToNode.end() || inNode == idToNode.end())
+      continue;
+    int outputSlot = outNode->second->OutputSlotIndex(wire.outputSlot);
+    int inputSlot = inNode->second->InputSlotIndex(wire.inputSlot);
+    if (outputSlot < 0 || inputSlot < 0)
+      continue;
+    int outputWidth = outNode->second->SlotWidth(outputSlot, false);
+    int inputWidth = inNode->second->SlotWidth(inputSlot, true);
+    if (outputWidth != inputWidth) {
+      scriptError += "Line " + std::to_string(wire.line) + ": " +
+                     wire.outputNode + "." + wire.outputSlot + " is " +
+                     std::to_string(outputWidth) + " bits wide but " +
+                     wire.inputNode + "." + wire.inputSlot + " is " +
+                     std::to_string(inputWidth) + "\n";
+      continue;
     }
+    wanted.emplace(outNode->second, wire.outputSlot, inNode->second,
+                   wire.inputSlot);
   }
+
+  std::set<WireKey> existing;
+  for (Node *node : nodes)
+    for (const Connection &connection : node->connections)
+      if (connection.outputNode == node)
+        existing.emplace(node, connection.outputSlot,
+                         (Node *)connection.inputNode, connection.inputSlot);
+
+  auto toConnection = [](const WireKey &key) {
+    Connection connection;
+    connection.outputNode = std::get<0>(key);
+    connection.outputSlot = std::get<1>(key);
+    connection.inputNode = std::get<2>(key);
+    connection.inputSlot = std::get<3>(key);
+    return connection;
+  };
+  for (const WireKey &key : existing) {
+    if (wanted.count(key))
+      continue;
+    Connection connection = toConnection(key);
+    std::get<0>(key)->DeleteConnection(connection);
+    std::get<2>(key)->DeleteConnection(connection);
+    MarkWiresChanged(std::get<0>(key));
+    journal.Disconnected(connection);
+  }
+  for (const WireKey &key : wanted) {
+    if (existing.count(key))
+      continue;
+    Connection connection = toConnection(key);
+    std::get<0>(key)->connections.push_back(connection);
+    std::get<2>(key)->connections.push_back(connection);
+    MarkWiresChanged(std::get<0>(key));
+    journal.Connected(connection);
+  }
+
+  for (Node *node : added)
+    NodeAdded(node);
 }
 } // namespace Billyprints
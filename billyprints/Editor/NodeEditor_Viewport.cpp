@@ -0,0 +1,236 @@
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+
+#include "NodeEditor.hpp"
+#include <ImNodes.h>
+#include <cfloat>
+#include <imgui_internal.h>
+#include <string>
+#include <vector>
+
+namespace Billyprints {
+
+// Used until a node has been rendered once and its real size is known
+static const ImVec2 DefaultNodeSize(150.0f, 80.0f);
+// Extra canvas-space border around the view so nodes don't pop at the edges
+static const float ViewMargin = 32.0f;
+
+ImRect NodeEditor::NodeBounds(const Node *node) const {
+  ImVec2 size = node->size.x > 0 ? node->size : DefaultNodeSize;
+  return ImRect(node->pos, node->pos + size);
+}
+
+ImRect NodeEditor::GetVisibleCanvasRect() const {
+  auto *canvas = ImNodes::GetCurrentCanvas();
+  ImGuiWindow *window = ImGui::GetCurrentWindow();
+  ImVec2 origin = window->Pos + canvas->Offset;
+  ImRect view((window->ClipRect.Min - origin) / canvas->Zoom,
+              (window->ClipRect.Max - origin) / canvas->Zoom);
+  view.Expand(ViewMargin);
+  return view;
+}
+
+void NodeEditor::RebuildSpatialIndex() {
+  nodeIndex.Clear();
+  wireIndex.Clear();
+  dirtyWireSources.clear();
+  selectedNodes.clear();
+
+  for (Node *node : nodes) {
+    nodeIndex.Insert(node, NodeBounds(node));
+    if (node->selected)
+      selectedNodes.insert(node);
+  }
+  for (Node *node : nodes)
+    UpdateWireBounds(node);
+
+  spatialIndexDirty = false;
+}
+
+void NodeEditor::NodeAdded(Node *node) {
+  ++sceneRevision;
+  if (spatialIndexDirty)
+    return; // Indexed by the rebuild
+  nodeIndex.Insert(node, NodeBounds(node));
+  if (node->selected)
+    selectedNodes.insert(node);
+  InvalidateWires(node);
+}
+
+void NodeEditor::NodeRemoved(Node *node) {
+  ++sceneRevision;
+  selectedNodes.erase(node);
+  if (spatialIndexDirty)
+    return;
+  InvalidateWires(node);
+  dirtyWireSources.erase(node);
+  nodeIndex.Remove(node);
+  wireIndex.Remove(node);
+}
+
+void NodeEditor::UpdateWireBounds(Node *source) {
+  if (!nodeIndex.Contains(source))
+    return; // Deleted since it was marked
+
+  bool hasWires = false;
+  ImRect bounds = NodeBounds(source);
+  for (const Connection &connection : source->connections) {
+    if (connection.outputNode != source)
+      continue;
+    bounds.Add(NodeBounds((Node *)connection.inputNode));
+    hasWires = true;
+  }
+
+  if (!hasWires) {
+    wireIndex.Remove(source);
+    return;
+  }
+
+  // Curves bulge horizontally past their end points by up to CurveStrength
+  bounds.Expand(ImVec2(ImNodes::Ez::GetState().Style.CurveStrength, 0.0f));
+  wireIndex.Update(source, bounds);
+}
+
+void NodeEditor::InvalidateWires(Node *node) {
+  dirtyWireSources.insert(node);
+  for (const Connection &connection : node->connections)
+    dirtyWireSources.insert((Node *)connection.outputNode);
+}
+
+ImVec2 *NodeEditor::SlotPosition(Node *node, int index, bool isInput) {
+  auto &slots = isInput ? node->inputSlots : node->outputSlots;
+  if (index < 0 || index >= (int)slots.size())
+    return nullptr;
+
+  ImVec2 &pos = slots[index].pos;
+  if (pos.x == FLT_MAX) {
+    // The node has never been rendered; spread the slots along its edge.
+    ImRect bounds = NodeBounds(node);
+    pos = ImVec2(isInput ? bounds.Min.x : bounds.Max.x,
+                 bounds.Min.y + bounds.GetHeight() * (index + 1) /
+                                    (float)(slots.size() + 1));
+  }
+  return &pos;
+}
+
+void NodeEditor::RenderWires(const ImRect &view) {
+  for (Node *source : dirtyWireSources)
+    UpdateWireBounds(source);
+  dirtyWireSources.clear();
+
+  visibleWireSources.clear();
+  wireIndex.Query(view, visibleWireSources);
+
+  std::vector<Connection> deleted;
+
+  ImNodes::Ez::BeginConnections();
+  for (Node *source : visibleWireSources) {
+    for (const Connection &connection : source->connections) {
+      if (connection.outputNode != source)
+        continue;
+      Node *target = (Node *)connection.inputNode;
+
+      ImVec2 *inputPos = SlotPosition(
+          target, target->InputSlotIndex(connection.inputSlot), true);
+      int outputSlot = source->OutputSlotIndex(connection.outputSlot);
+      ImVec2 *outputPos = SlotPosition(source, outputSlot, false);
+      if (!inputPos || !outputPos)
+        continue; // Slot no longer exists on a reshaped node
+      // Each output slot has its own net, e.g. one bit of a Split
+      ImU32 signalColor = source->GetConnectionColor(outputSlot);
+
+      // Check if both nodes are selected for connection highlighting
+      bool bothSelected = source->selected && target->selected;
+      if (!ImNodes::BatchConnection(
+              target, inputPos, source, outputPos,
+              bothSelected ? IM_COL32(0, 200, 255, 255) : signalColor))
+        deleted.push_back(connection);
+    }
+  }
+  ImNodes::Ez::EndConnections();
+
+  for (const Connection &connection : deleted) {
+    ((Node *)connection.inputNode)->DeleteConnection(connection);
+    ((Node *)connection.outputNode)->DeleteConnection(connection);
+    MarkWiresChanged((Node *)connection.outputNode);
+    journal.Disconnected(connection);
+  }
+}
+
+static ImU32 OverviewColor(Node *node) {
+  ImU32 color = node->GetColor() | IM_COL32_A_MASK;
+  // Tint nodes whose output is high so signal flow reads at a glance
+  if (node->Signal())
+    color = ImAlphaBlendColors(color, IM_COL32(50, 255, 150, 110));
+  return color;
+}
+
+void NodeEditor::RenderOverviewNodes() {
+  if (overviewNodes.empty())
+    return;
+
+  // Drawn right after the wires, so they land on top of them in the same
+  // channel and below any fully rendered (selected) node.
+  ImDrawList *drawList = ImGui::GetWindowDrawList();
+  const ImVec2 onePixel(1.0f, 1.0f);
+  const size_t maxRectsPerReserve = 8192; // Stays within 16-bit indices
+
+  for (size_t first = 0; first < overviewNodes.size();
+       first += maxRectsPerReserve) {
+    size_t count = ImMin(overviewNodes.size() - first, maxRectsPerReserve);
+    drawList->PrimReserve((int)count * 6, (int)count * 4);
+    for (size_t i = first; i < first + count; ++i) {
+      Node *node = overviewNodes[i];
+      ImRect bounds = NodeBounds(node);
+      ImVec2 min = ImNodes::CanvasToScreen(bounds.Min);
+      ImVec2 max = ImMax(ImNodes::CanvasToScreen(bounds.Max), min + onePixel);
+      drawList->PrimRect(min, max, OverviewColor(node));
+    }
+  }
+}
+
+void NodeEditor::HandleNewConnection() {
+  void *inNode, *outNode;
+  const char *inSlot, *outSlot;
+  if (!ImNodes::GetNewConnection(&inNode, &inSlot, &outNode, &outSlot))
+    return;
+
+  Connection new_connection;
+  new_connection.inputNode = inNode;
+  new_connection.inputSlot = inSlot;
+  new_connection.outputNode = outNode;
+  new_connection.outputSlot = outSlot;
+
+  // Input slots accept a single connection; replace the existing one
+  Node *inputNode = (Node *)new_connection.inputNode;
+  for (const auto &conn : inputNode->connections) {
+    if (conn.inputNode == inputNode &&
+        conn.inputSlot == new_connection.inputSlot) {
+      Connection existing = conn;
+      ((Node *)existing.outputNode)->DeleteConnection(existing);
+      inputNode->DeleteConnection(existing);
+      MarkWiresChanged((Node *)existing.outputNode);
+      journal.Disconnected(existing);
+      break;
+    }
+  }
+
+  inputNode->connections.push_back(new_connection);
+  ((Node *)new_connection.outputNode)->connections.push_back(new_connection);
+  MarkWiresChanged((Node *)new_connection.outputNode);
+  journal.Connected(new_connection);
+}
+
+// Evaluate the whole scene once per frame into a snapshot. Rendering only
+// reads the snapshot, so culled nodes keep simulating and draw order never
+// affects evaluation. A snapshot that differs from the last one wakes the
+// main loop like any other finished work, so a settling circuit is drawn
+// through to its final state.
+void NodeEditor::SimulateNodes() {
+  simulationChanged = simulator.Step(nodes);
+  Node::Snapshot = &simulator.GetSnapshot();
+  if (simulationChanged)
+    Wake();
+}
+} // namespace Billyprints
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "pch.hpp"
+#include <string>
+#include <vector>
+
+namespace Billyprints {
+// Scene as written in the script (everything outside define blocks). It is
+// diffed against the live nodes by id, so applying an edit only touches the
+// nodes and wires that actually changed.
+struct SceneDescription {
+  struct NodeDecl {
+    std::string type;
+    std::string id;
+    ImVec2 pos;
+    int width = 1;
+    bool momentary = false; // "In" nodes only
+    int line = 0;
+  };
+  struct WireDecl {
+    std::string outputNode;
+    std::string outputSlot;
+    std::string inputNode;
+    std::string inputSlot;
+    int line = 0;
+  };
+
+  std::vector<NodeDecl> nodes;
+  std::vector<WireDecl> wires;
+};
+} // namespace Billyprints
@@ -0,0 +1,342 @@
+#include "SceneFile.hpp"
+#include "BinaryIO.hpp"
+#include <cstdio>
+#include <cstring>
+
+namespace Billyprints {
+
+// BPS3 layout, all integers little endian:
+//   Header        "BPS3", u32 section count, u32 CRC-32 of everything after
+//                 the header, u32 reserved
+//   Section table per section: char id[4], u32 offset, u32 size
+//   Sections      STRS strings, GATE custom types used, NODE nodes, CONN
+//                 connections; readers skip ids they don't know
+// Counts, indices and lengths inside sections are LEB128 varints.
+namespace {
+constexpr size_t HeaderSize = 16;
+constexpr size_t SectionEntrySize = 12;
+constexpr size_t RecordsPerReport = 1 << 16;
+
+// Reports decoding progress every RecordsPerReport records. Returns false
+// once the load was cancelled.
+bool Checkpoint(LoadProgress *progress, float begin, float end, size_t done,
+                size_t total, std::string &error) {
+  if (!progress || done % RecordsPerReport != 0)
+    return true;
+  progress->Report(begin, end, done, total);
+  if (!progress->cancelled)
+    return true;
+  error = "cancelled";
+  return false;
+}
+
+// BPS1 and BPS2 store native size_t lengths and ints, one field at a time.
+// BPS2 adds the custom types used, slot counts and optional bus widths.
+bool ReadLegacyScene(ByteReader &in, bool isV2, SceneData &scene,
+                     std::string &error) {
+  auto size = [&] {
+    size_t v = 0;
+    in.Raw(&v, sizeof(v));
+    return v;
+  };
+  auto string = [&] { return std::string(in.String(size())); };
+  auto integer = [&] {
+    int v = 0;
+    in.Raw(&v, sizeof(v));
+    return v;
+  };
+
+  if (isV2) {
+    size_t customCount = size();
+    for (size_t i = 0; i < customCount && in.Ok(); ++i)
+      scene.customTypes.push_back(scene.Intern(string()));
+  }
+
+  // A node takes at least its type length and position
+  size_t nodeCount = size();
+  if (nodeCount > in.Remaining() / (sizeof(size_t) + sizeof(ImVec2)))
+    in.Fail();
+  for (size_t i = 0; i < nodeCount && in.Ok(); ++i) {
+    SceneData::Node node;
+    node.type = scene.Intern(string());
+    in.Raw(&node.pos, sizeof(ImVec2));
+    if (isV2) {
+      node.inputCount = (uint32_t)integer();
+      node.outputCount = (uint32_t)integer();
+    }
+    scene.nodes.push_back(node);
+  }
+
+  size_t connCount = size();
+  if (connCount > in.Remaining() / (2 * (sizeof(int) + sizeof(size_t))))
+    in.Fail();
+  for (size_t i = 0; i < connCount && in.Ok(); ++i) {
+    SceneData::Connection conn;
+    conn.inputNode = (uint32_t)integer();
+    conn.inputSlot = scene.Intern(string());
+    conn.outputNode = (uint32_t)integer();
+    conn.outputSlot = scene.Intern(string());
+    // Old writers could leave out a connection's node; skip those
+    if (in.Ok() && conn.inputNode < nodeCount && conn.outputNode < nodeCount)
+      scene.connections.push_back(conn);
+  }
+  if (!in.Ok()) {
+    error = "the file is truncated";
+    return false;
+  }
+
+  char tag[4];
+  if (isV2 && in.Remaining() >= 4 && in.Raw(tag, 4) &&
+      memcmp(tag, "BUSW", 4) == 0) {
+    for (auto &node : scene.nodes) {
+      uint8_t width = 1;
+      in.Raw(&width, 1);
+      node.width = width;
+    }
+  }
+  return true;
+}
+
+bool ReadSections(const uint8_t *data, size_t size, SceneData &scene,
+                  std::string &error, LoadProgress *progress) {
+  ByteReader header(data, size);
+  header.U32(); // Magic, checked by the caller
+  uint32_t sectionCount = header.U32();
+  uint32_t checksum = header.U32();
+  header.U32(); // Reserved
+  if (!header.Ok() ||
+      sectionCount > (size - HeaderSize) / SectionEntrySize) {
+    error = "the file is truncated";
+    return false;
+  }
+  if (Crc32(data + HeaderSize, size - HeaderSize) != checksum) {
+    error = "the checksum doesn't match; the file is damaged";
+    return false;
+  }
+
+  struct Section {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+  };
+  Section strs, gate, node, conn;
+  for (uint32_t i = 0; i < sectionCount; ++i) {
+    char id[4];
+    header.Raw(id, 4);
+    uint32_t offset = header.U32();
+    uint32_t length = header.U32();
+    if (!header.Ok() || offset > size || length > size - offset) {
+      error = "a section lies outside the file";
+      return false;
+    }
+    Section section{data + offset, length};
+    if (memcmp(id, "STRS", 4) == 0)
+      strs = section;
+    else if (memcmp(id, "GATE", 4) == 0)
+      gate = section;
+    else if (memcmp(id, "NODE", 4) == 0)
+      node = section;
+    else if (memcmp(id, "CONN", 4) == 0)
+      conn = section;
+  }
+
+  ByteReader in(strs.data, strs.size);
+  size_t stringCount = in.Count();
+  scene.strings.reserve(stringCount);
+  for (size_t i = 0; i < stringCount && in.Ok(); ++i)
+    scene.strings.emplace_back(in.String(in.Varint()));
+  if (!in.Ok()) {
+    error = "the string table is damaged";
+    return false;
+  }
+  const size_t strings = scene.strings.size();
+
+  in = ByteReader(gate.data, gate.size);
+  size_t customCount = in.Count();
+  for (size_t i = 0; i < customCount && in.Ok(); ++i) {
+    uint64_t type = in.Varint();
+    if (type < strings)
+      scene.customTypes.push_back((uint32_t)type);
+  }
+
+  // Nodes and connections share what is left of the progress bar
+  const size_t recordBytes = std::max<size_t>(node.size + conn.size, 1);
+  const float nodeEnd =
+      SceneReadShare + (1 - SceneReadShare) * node.size / recordBytes;
+
+  // Type, x, y, slot counts and width
+  in = ByteReader(node.data, node.size);
+  size_t nodeCount = in.Count(6);
+  scene.nodes.resize(nodeCount);
+  float x = 0, y = 0;
+  for (size_t i = 0; i < nodeCount; ++i) {
+    if (!Checkpoint(progress, SceneReadShare, nodeEnd, i, nodeCount, error))
+      return false;
+    SceneData::Node &n = scene.nodes[i];
+    uint64_t type = in.Varint();
+    n.pos.x = in.Coordinate(x);
+    n.pos.y = in.Coordinate(y);
+    n.inputCount = (uint32_t)in.Varint();
+    n.outputCount = (uint32_t)in.Varint();
+    n.width = (uint32_t)in.Varint();
+    if (!in.Ok() || type >= strings) {
+      error = "a node record is damaged";
+      return false;
+    }
+    n.type = (uint32_t)type;
+  }
+
+  // Output nodes are stored as deltas from the previous connection and input
+  // nodes as deltas from their output node, so nearby nodes take a byte
+  in = ByteReader(conn.data, conn.size);
+  size_t connCount = in.Count(4);
+  scene.connections.resize(connCount);
+  int64_t previous = 0;
+  for (size_t i = 0; i < connCount; ++i) {
+    if (!Checkpoint(progress, nodeEnd, 1, i, connCount, error))
+      return false;
+    SceneData::Connection &c = scene.connections[i];
+    int64_t output = previous + UnZigZag(in.Varint());
+    uint64_t outputSlot = in.Varint();
+    int64_t input = output + UnZigZag(in.Varint());
+    uint64_t inputSlot = in.Varint();
+    if (!in.Ok() || output < 0 || (uint64_t)output >= nodeCount ||
+        input < 0 || (uint64_t)input >= nodeCount || outputSlot >= strings ||
+        inputSlot >= strings) {
+      error = "a connection record is damaged";
+      return false;
+    }
+    c = {(uint32_t)output, (uint32_t)outputSlot, (uint32_t)input,
+         (uint32_t)inputSlot};
+    previous = output;
+  }
+  return true;
+}
+} // namespace
+
+uint32_t SceneData::Intern(std::string_view s) {
+  auto it = stringIndex.find(std::string(s));
+  if (it != stringIndex.end())
+    return it->second;
+  uint32_t index = (uint32_t)strings.size();
+  strings.emplace_back(s);
+  stringIndex.emplace(strings.back(), index);
+  return index;
+}
+
+bool EncodeSceneFile(const SceneData &scene, std::vector<uint8_t> &bytes) {
+  struct Section {
+    const char *id;
+    ByteWriter data;
+  };
+  Section sections[4] = {
+      {"STRS", {}}, {"GATE", {}}, {"NODE", {}}, {"CONN", {}}};
+
+  ByteWriter &strs = sections[0].data;
+  strs.Varint(scene.strings.size());
+  for (const auto &s : scene.strings) {
+    strs.Varint(s.size());
+    strs.Bytes(s.data(), s.size());
+  }
+
+  ByteWriter &gate = sections[1].data;
+  gate.Varint(scene.customTypes.size());
+  for (uint32_t type : scene.customTypes)
+    gate.Varint(type);
+
+  ByteWriter &node = sections[2].data;
+  node.bytes.reserve(scene.nodes.size() * 8);
+  node.Varint(scene.nodes.size());
+  float x = 0, y = 0;
+  for (const auto &n : scene.nodes) {
+    node.Varint(n.type);
+    node.Coordinate(n.pos.x, x);
+    node.Coordinate(n.pos.y, y);
+    node.Varint(n.inputCount);
+    node.Varint(n.outputCount);
+    node.Varint(n.width);
+  }
+
+  ByteWriter &conn = sections[3].data;
+  conn.bytes.reserve(scene.connections.size() * 5);
+  conn.Varint(scene.connections.size());
+  int64_t previous = 0;
+  for (const auto &c : scene.connections) {
+    conn.Varint(ZigZag((int64_t)c.outputNode - previous));
+    conn.Varint(c.outputSlot);
+    conn.Varint(ZigZag((int64_t)c.inputNode - (int64_t)c.outputNode));
+    conn.Varint(c.inputSlot);
+    previous = c.outputNode;
+  }
+
+  // Header and section table, then the sections back to back
+  ByteWriter file;
+  size_t offset = HeaderSize + SectionEntrySize * 4;
+  size_t total = offset;
+  for (const auto &section : sections)
+    total += section.data.bytes.size();
+  // Every offset and size in the table is below the total
+  if (total > UINT32_MAX)
+    return false;
+  file.bytes.reserve(total);
+  file.Bytes("BPS3", 4);
+  file.U32(4);
+  file.U32(0); // Checksum, filled in below
+  file.U32(0);
+  for (const auto &section : sections) {
+    file.Bytes(section.id, 4);
+    file.U32((uint32_t)offset);
+    file.U32((uint32_t)section.data.bytes.size());
+    offset += section.data.bytes.size();
+  }
+  for (const auto &section : sections)
+    file.Bytes(section.data.bytes.data(), section.data.bytes.size());
+  uint32_t checksum =
+      Crc32(file.bytes.data() + HeaderSize, file.bytes.size() - HeaderSize);
+  for (int i = 0; i < 4; ++i)
+    file.bytes[8 + i] = (uint8_t)(checksum >> (8 * i));
+
+  bytes = std::move(file.bytes);
+  return true;
+}
+
+bool WriteSceneFile(const std::string &path, const SceneData &scene) {
+  std::vector<uint8_t> bytes;
+  return EncodeSceneFile(scene, bytes) && WriteFileAtomically(path, {&bytes});
+}
+
+bool DecodeSceneFile(const uint8_t *data, size_t size, SceneData &scene,
+                     std::string &error, LoadProgress *progress) {
+  if (size < 4 || memcmp(data, "BPS", 3) != 0) {
+    error = "not a scene file";
+    return false;
+  }
+
+  switch (data[3]) {
+  case '1':
+  case '2': {
+    ByteReader in(data + 4, size - 4);
+    return ReadLegacyScene(in, data[3] == '2', scene, error);
+  }
+  case '3':
+    if (size < HeaderSize) {
+      error = "the file is truncated";
+      return false;
+    }
+    return ReadSections(data, size, scene, error, progress);
+  default:
+    error = "the file was saved by a newer version";
+    return false;
+  }
+}
+
+bool ReadSceneFile(const std::string &path, SceneData &scene,
+                   std::string &error, LoadProgress *progress) {
+  std::vector<uint8_t> bytes;
+  if (!ReadWholeFile(path, bytes, progress, SceneReadShare)) {
+    error = progress && progress->cancelled ? "cancelled"
+                                            : "the file can't be read";
+    return false;
+  }
+  return DecodeSceneFile(bytes.data(), bytes.size(), scene, error, progress);
+}
+} // namespace Billyprints
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "BinaryIO.hpp"
+#include <imgui.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Billyprints {
+// A scene as stored in a .bps file, detached from the live nodes. Node
+// types and slot names are indices into 'strings', and connections refer to
+// nodes by index.
+struct SceneData {
+  struct Node {
+    uint32_t type;
+    ImVec2 pos;
+    // Slot counts, so a placeholder can stand in for a missing gate
+    uint32_t inputCount = 1, outputCount = 1;
+    uint32_t width = 1;
+  };
+  struct Connection {
+    uint32_t outputNode, outputSlot;
+    uint32_t inputNode, inputSlot;
+  };
+
+  std::vector<std::string> strings;
+  std::vector<uint32_t> customTypes; // Custom gate types used, in 'strings'
+  std::vector<Node> nodes;
+  std::vector<Connection> connections;
+
+  // Index of 's' in 'strings', adding it if needed
+  uint32_t Intern(std::string_view s);
+
+private:
+  std::unordered_map<std::string, uint32_t> stringIndex;
+};
+
+// Share of a load's progress spent reading the file, before decoding
+constexpr float SceneReadShare = 0.5f;
+
+// 'scene' as a whole BPS3 file, for writers that store it themselves.
+// Returns false if the file would pass 4 GB, more than its section table
+// can address.
+bool EncodeSceneFile(const SceneData &scene, std::vector<uint8_t> &bytes);
+
+// Writes 'scene' in the BPS3 format, replacing 'path' only once the whole
+// file is written. Returns false if the file can't be written or is too
+// large for the format. Safe to call from any thread.
+bool WriteSceneFile(const std::string &path, const SceneData &scene);
+
+// Reads a BPS1, BPS2 or BPS3 file into memory and decodes it. Returns false
+// with 'error' set if the file can't be read, is truncated or fails its
+// checksum, or with 'error' "cancelled" once 'progress' is cancelled;
+// 'scene' is then left incomplete.
+bool ReadSceneFile(const std::string &path, SceneData &scene,
+                   std::string &error, LoadProgress *progress = nullptr);
+
+// ReadSceneFile() for a file already in memory. Progress is reported from
+// SceneReadShare on.
+bool DecodeSceneFile(const uint8_t *data, size_t size, SceneData &scene,
+                     std::string &error, LoadProgress *progress = nullptr);
+} // namespace Billyprints
@@ -0,0 +1,454 @@
+#include "SceneJournal.hpp"
+#include "Node.hpp"
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+namespace Billyprints {
+
+// Journal layout, all integers little endian:
+//   Header   "BPJ1", u32 epoch, u32 snapshot size, then the snapshot as a
+//            whole BPS3 file
+//   Frames   u32 payload size, u32 epoch, u32 CRC-32 of the payload, then
+//            the payload: records back to back
+// A record is its kind followed by its fields, as LEB128 varints. Nodes are
+// numbered as in the snapshot, and each added node takes the next number.
+// Strings are numbered the same way, continuing the snapshot's table.
+namespace {
+constexpr size_t HeaderSize = 12;
+constexpr size_t FrameHeaderSize = 12;
+// Smallest journal worth replacing with a new snapshot
+constexpr size_t MinCompactSize = 1 << 20;
+
+enum Record : uint8_t {
+  RecordString = 1,  // length, bytes
+  RecordAddNode,     // type, x, y, input count, output count, width
+  RecordRemoveNode,  // node; its wires go with it
+  RecordConnect,     // output node, output slot, input node, input slot
+  RecordDisconnect,  // as RecordConnect
+  RecordMove,        // node, x, y
+  RecordResize,      // node, width
+  RecordDefinitions, // length, the script's define blocks
+};
+
+void Position(ByteWriter &out, ImVec2 pos) {
+  float previous = 0;
+  out.Coordinate(pos.x, previous);
+  previous = 0;
+  out.Coordinate(pos.y, previous);
+}
+
+ImVec2 Position(ByteReader &in) {
+  float x = 0, y = 0;
+  in.Coordinate(x);
+  in.Coordinate(y);
+  return ImVec2(x, y);
+}
+
+std::vector<uint8_t> Frame(uint32_t epoch,
+                           const std::vector<uint8_t> &payload) {
+  ByteWriter frame;
+  frame.bytes.reserve(FrameHeaderSize + payload.size());
+  frame.U32((uint32_t)payload.size());
+  frame.U32(epoch);
+  frame.U32(Crc32(payload.data(), payload.size()));
+  frame.Bytes(payload.data(), payload.size());
+  return std::move(frame.bytes);
+}
+
+uint32_t NewEpoch() {
+  static uint32_t counter = 0;
+  uint64_t ticks =
+      (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+  return (uint32_t)((ticks ^ ++counter) * 0x9E3779B97F4A7C15ull >> 32);
+}
+
+// Fails if the file is gone rather than starting one without a header
+bool AppendToFile(const std::string &path, const std::vector<uint8_t> &bytes) {
+  FILE *f = fopen(path.c_str(), "r+b");
+  if (!f)
+    return false;
+  bool ok = fseek(f, 0, SEEK_END) == 0 &&
+            fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+  return (fclose(f) == 0) && ok;
+}
+
+// Applies records to the snapshot. Removed nodes and wires are only marked
+// until Finish(), so the numbers in later records stay valid.
+class Replay {
+public:
+  explicit Replay(SceneData &scene)
+      : scene(scene), nodeAlive(scene.nodes.size(), true),
+        wireAlive(scene.connections.size(), true) {
+    wires.reserve(scene.connections.size());
+    for (size_t i = 0; i < scene.connections.size(); ++i)
+      wires.emplace(Key(scene.connections[i]), i);
+  }
+
+  // Returns false at the first record that doesn't make sense
+  bool Apply(const uint8_t *data, size_t size, std::string &definitions) {
+    ByteReader in(data, size);
+    while (in.Ok() && in.Remaining() > 0) {
+      uint64_t record = in.Varint();
+      switch (record) {
+      case RecordString:
+        scene.strings.emplace_back(in.String(in.Count()));
+        break;
+      case RecordAddNode: {
+        SceneData::Node node;
+        uint64_t type = in.Varint();
+        node.pos = Position(in);
+        node.inputCount = (uint32_t)in.Varint();
+        node.outputCount = (uint32_t)in.Varint();
+        node.width = (uint32_t)in.Varint();
+        if (type >= scene.strings.size())
+          return false;
+        node.type = (uint32_t)type;
+        scene.nodes.push_back(node);
+        nodeAlive.push_back(true);
+        break;
+      }
+      case RecordRemoveNode: {
+        uint64_t id = in.Varint();
+        if (id >= scene.nodes.size())
+          return false;
+        nodeAlive[id] = false;
+        break;
+      }
+      case RecordConnect:
+      case RecordDisconnect: {
+        uint64_t outputNode = in.Varint(), outputSlot = in.Varint();
+        uint64_t inputNode = in.Varint(), inputSlot = in.Varint();
+        if (outputNode >= scene.nodes.size() ||
+            inputNode >= scene.nodes.size() ||
+            outputSlot >= scene.strings.size() ||
+            inputSlot >= scene.strings.size())
+          return false;
+        SceneData::Connection c = {(uint32_t)outputNode, (uint32_t)outputSlot,
+                                   (uint32_t)inputNode, (uint32_t)inputSlot};
+        auto it = wires.find(Key(c));
+        if (it != wires.end()) {
+          wireAlive[it->second] = record == RecordConnect;
+        } else if (record == RecordConnect) {
+          wires.emplace(Key(c), scene.connections.size());
+          scene.connections.push_back(c);
+          wireAlive.push_back(true);
+        }
+        break;
+      }
+      case RecordMove: {
+        uint64_t id = in.Varint();
+        ImVec2 pos = Position(in);
+        if (id >= scene.nodes.size())
+          return false;
+        scene.nodes[id].pos = pos;
+        break;
+      }
+      case RecordResize: {
+        uint64_t id = in.Varint(), width = in.Varint();
+        if (id >= scene.nodes.size())
+          return false;
+        scene.nodes[id].width = (uint32_t)width;
+        break;
+      }
+      case RecordDefinitions:
+        definitions = std::string(in.String(in.Count()));
+        break;
+      default:
+        return false;
+      }
+    }
+    return in.Ok();
+  }
+
+  // Drops what was removed and renumbers the rest
+  void Finish() {
+    std::vector<uint32_t> renumbered(scene.nodes.size(), UINT32_MAX);
+    size_t kept = 0;
+    for (size_t i = 0; i < scene.nodes.size(); ++i) {
+      if (!nodeAlive[i])
+        continue;
+      renumbered[i] = (uint32_t)kept;
+      scene.nodes[kept++] = scene.nodes[i];
+    }
+    scene.nodes.resize(kept);
+
+    kept = 0;
+    for (size_t i = 0; i < scene.connections.size(); ++i) {
+      SceneData::Connection c = scene.connections[i];
+      if (!wireAlive[i] || renumbered[c.outputNode] == UINT32_MAX ||
+          renumbered[c.inputNode] == UINT32_MAX)
+        continue;
+      c.outputNode = renumbered[c.outputNode];
+      c.inputNode = renumbered[c.inputNode];
+      scene.connections[kept++] = c;
+    }
+    scene.connections.resize(kept);
+    scene.customTypes.clear();
+  }
+
+private:
+  struct WireKey {
+    uint64_t nodes, slots;
+    bool operator==(const WireKey &other) const {
+      return nodes == other.nodes && slots == other.slots;
+    }
+  };
+  struct WireHash {
+    size_t operator()(const WireKey &key) const {
+      return (size_t)((key.nodes * 0x9E3779B97F4A7C15ull) ^ key.slots);
+    }
+  };
+  static WireKey Key(const SceneData::Connection &c) {
+    return {(uint64_t)c.outputNode << 32 | c.inputNode,
+            (uint64_t)c.outputSlot << 32 | c.inputSlot};
+  }
+
+  SceneData &scene;
+  std::vector<bool> nodeAlive;
+  std::vector<bool> wireAlive;
+  std::unordered_map<WireKey, size_t, WireHash> wires;
+};
+} // namespace
+
+void SceneJournal::Reset(const std::vector<Node *> &nodes, SceneData scene,
+                         const std::string &definitions) {
+  started = true;
+  invalid = false;
+  epoch = NewEpoch();
+  touched.clear();
+  records.bytes.clear();
+  written = 0;
+
+  known.clear();
+  known.reserve(nodes.size());
+  for (uint32_t i = 0; i < (uint32_t)nodes.size(); ++i)
+    known[nodes[i]] = {i, nodes[i]->pos, nodes[i]->width};
+  nextId = (uint32_t)nodes.size();
+  strings.clear();
+  for (uint32_t i = 0; i < (uint32_t)scene.strings.size(); ++i)
+    strings.emplace(scene.strings[i], i);
+  // Roughly what the snapshot takes encoded
+  snapshotSize = scene.nodes.size() * 8 + scene.connections.size() * 5;
+
+  // The define blocks open the first frame, which is written with the
+  // snapshot
+  this->definitions.clear();
+  DefinitionsChanged(definitions);
+  std::vector<uint8_t> first = Frame(epoch, records.bytes);
+  records.bytes.clear();
+
+  // Encoding the snapshot is left to the writer thread
+  auto snapshot = std::make_shared<SceneData>(std::move(scene));
+  writer.Queue(path, [path = path, epoch = epoch, snapshot,
+                      first = std::move(first)] {
+    std::vector<uint8_t> file;
+    if (!EncodeSceneFile(*snapshot, file))
+      return false;
+    ByteWriter header;
+    header.Bytes("BPJ1", 4);
+    header.U32(epoch);
+    header.U32((uint32_t)file.size());
+    return WriteFileAtomically(path, {&header.bytes, &file, &first});
+  });
+}
+
+void SceneJournal::Invalidate() {
+  invalid = true;
+  // The nodes may be gone; Reset() starts from the live ones
+  known.clear();
+  touched.clear();
+  records.bytes.clear();
+}
+
+uint32_t SceneJournal::String(const std::string &s) {
+  auto it = strings.find(s);
+  if (it != strings.end())
+    return it->second;
+  uint32_t index = (uint32_t)strings.size();
+  strings.emplace(s, index);
+  records.Varint(RecordString);
+  records.Varint(s.size());
+  records.Bytes(s.data(), s.size());
+  return index;
+}
+
+bool SceneJournal::Find(const void *node, uint32_t &id) {
+  auto it = known.find(node);
+  if (it == known.end()) {
+    // An edit that wasn't recorded; only a new snapshot can catch up
+    invalid = true;
+    return false;
+  }
+  id = it->second.id;
+  return true;
+}
+
+void SceneJournal::Added(const Node *node) {
+  if (!started || invalid)
+    return;
+  uint32_t type = String(node->title);
+  known[node] = {nextId++, node->pos, node->width};
+  records.Varint(RecordAddNode);
+  records.Varint(type);
+  Position(records, node->pos);
+  records.Varint((uint32_t)node->inputSlotCount);
+  records.Varint((uint32_t)node->outputSlotCount);
+  records.Varint((uint32_t)node->width);
+  // Usually placed or resized right after being created
+  touched.insert(node);
+}
+
+void SceneJournal::Removed(const Node *node) {
+  touched.erase(node);
+  uint32_t id;
+  if (!started || invalid || !Find(node, id))
+    return;
+  known.erase(node);
+  records.Varint(RecordRemoveNode);
+  records.Varint(id);
+}
+
+void SceneJournal::Wire(uint8_t record, const Connection &connection) {
+  uint32_t outputNode, inputNode;
+  if (!started || invalid || !Find(connection.outputNode, outputNode) ||
+      !Find(connection.inputNode, inputNode))
+    return;
+  uint32_t outputSlot = String(connection.outputSlot);
+  uint32_t inputSlot = String(connection.inputSlot);
+  records.Varint(record);
+  records.Varint(outputNode);
+  records.Varint(outputSlot);
+  records.Varint(inputNode);
+  records.Varint(inputSlot);
+}
+
+void SceneJournal::Connected(const Connection &connection) {
+  Wire(RecordConnect, connection);
+}
+
+void SceneJournal::Disconnected(const Connection &connection) {
+  Wire(RecordDisconnect, connection);
+}
+
+void SceneJournal::Touched(const Node *node) {
+  if (started && !invalid)
+    touched.insert(node);
+}
+
+void SceneJournal::Replaced(const Node *old, const Node *node) {
+  touched.erase(old);
+  auto it = known.find(old);
+  if (it == known.end())
+    return;
+  NodeState state = it->second;
+  known.erase(it);
+  known[node] = state;
+}
+
+void SceneJournal::DefinitionsChanged(const std::string &text) {
+  if (!started || invalid || text == definitions)
+    return;
+  definitions = text;
+  records.Varint(RecordDefinitions);
+  records.Varint(text.size());
+  records.Bytes(text.data(), text.size());
+}
+
+bool SceneJournal::Flush() {
+  if (!started || invalid)
+    return true;
+
+  for (const Node *node : touched) {
+    auto it = known.find(node);
+    if (it == known.end())
+      continue;
+    NodeState &state = it->second;
+    if (node->pos.x != state.pos.x || node->pos.y != state.pos.y) {
+      state.pos = node->pos;
+      records.Varint(RecordMove);
+      records.Varint(state.id);
+      Position(records, node->pos);
+    }
+    if (node->width != state.width) {
+      state.width = node->width;
+      records.Varint(RecordResize);
+      records.Varint(state.id);
+      records.Varint((uint32_t)node->width);
+    }
+  }
+  touched.clear();
+
+  if (!records.bytes.empty()) {
+    written += records.bytes.size();
+    Queue(Frame(epoch, records.bytes));
+    records.bytes.clear();
+  }
+  return written > std::max(MinCompactSize, snapshotSize);
+}
+
+void SceneJournal::Queue(std::vector<uint8_t> frame) {
+  writer.Queue(path, [path = path, frame = std::move(frame)] {
+    return AppendToFile(path, frame);
+  });
+}
+
+void SceneJournal::Discard() {
+  // A journal from an earlier session that was never recovered is kept
+  if (!started)
+    return;
+  started = false;
+  Invalidate();
+  writer.Queue(path, [path = path] {
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    return true;
+  });
+}
+
+bool ReadJournal(const std::string &path, SceneData &scene,
+                 std::string &definitions, std::string &error,
+                 LoadProgress *progress) {
+  std::vector<uint8_t> bytes;
+  if (!ReadWholeFile(path, bytes, progress, SceneReadShare)) {
+    error = progress && progress->cancelled ? "cancelled"
+                                            : "the file can't be read";
+    return false;
+  }
+
+  ByteReader header(bytes.data(), bytes.size());
+  char magic[4] = {};
+  header.Raw(magic, 4);
+  uint32_t epoch = header.U32();
+  uint32_t snapshotSize = header.U32();
+  if (!header.Ok() || memcmp(magic, "BPJ1", 4) != 0) {
+    error = "not an autosave journal";
+    return false;
+  }
+  if (snapshotSize > header.Remaining()) {
+    error = "the file is truncated";
+    return false;
+  }
+  if (!DecodeSceneFile(bytes.data() + HeaderSize, snapshotSize, scene, error,
+                       progress))
+    return false;
+
+  Replay replay(scene);
+  definitions.clear();
+  size_t pos = HeaderSize + snapshotSize;
+  while (bytes.size() - pos >= FrameHeaderSize) {
+    ByteReader frame(bytes.data() + pos, FrameHeaderSize);
+    uint32_t size = frame.U32();
+    uint32_t frameEpoch = frame.U32();
+    uint32_t checksum = frame.U32();
+    const uint8_t *payload = bytes.data() + pos + FrameHeaderSize;
+    if (frameEpoch != epoch || size > bytes.size() - pos - FrameHeaderSize ||
+        Crc32(payload, size) != checksum ||
+        !replay.Apply(payload, size, definitions))
+      break;
+    pos += FrameHeaderSize + size;
+  }
+  replay.Finish();
+  return true;
+}
+} // namespace Billyprints
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "BinaryIO.hpp"
+#include "Connection.hpp"
+#include "SceneSaver.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Billyprints {
+class Node;
+
+// Crash recovery for the open scene. The journal file starts with a full
+// snapshot of the scene and grows by small records of the edits made since,
+// so autosaving writes in proportion to what changed, not to the size of
+// the scene. Once the records outgrow the snapshot the file is started over
+// from a new one. All writes go through 'writer', in order.
+class SceneJournal {
+public:
+  SceneJournal(SceneSaver &writer, std::string path)
+      : writer(writer), path(std::move(path)) {}
+
+  const std::string &Path() const { return path; }
+
+  // Starts the file over from a snapshot of the scene. 'nodes' must be in
+  // the order 'scene' numbers them, as NodeEditor::CaptureScene() does.
+  void Reset(const std::vector<Node *> &nodes, SceneData scene,
+             const std::string &definitions);
+  // Asks for a Reset() at the next Flush(), for changes too broad to
+  // record one by one, such as loading a scene
+  void Invalidate();
+
+  // Edits, recorded as they happen. Nodes must be reported before they are
+  // deleted. Positions and widths are only compared at Flush(), so a drag
+  // costs one record per flush rather than one per frame.
+  void Added(const Node *node);
+  void Removed(const Node *node);
+  void Connected(const Connection &connection);
+  void Disconnected(const Connection &connection);
+  void Touched(const Node *node);
+  // 'node' took the place of 'old' without changing the scene, as when a
+  // placeholder is upgraded
+  void Replaced(const Node *old, const Node *node);
+  void DefinitionsChanged(const std::string &definitions);
+
+  // Records what touched nodes moved or resized and queues the records for
+  // writing. Returns true when a Reset() is due: before the first one,
+  // after Invalidate() and once the records outgrow the snapshot.
+  bool Flush();
+
+  // Removes the file once everything queued is written, on a clean exit.
+  // Does nothing before the first Reset().
+  void Discard();
+
+private:
+  struct NodeState {
+    uint32_t id;
+    ImVec2 pos;
+    int width;
+  };
+  // Index of 's' in the journal's string table, recording it if it is new
+  uint32_t String(const std::string &s);
+  bool Find(const void *node, uint32_t &id);
+  void Wire(uint8_t record, const Connection &connection);
+  void Queue(std::vector<uint8_t> frame);
+
+  SceneSaver &writer;
+  std::string path;
+  bool started = false;
+  bool invalid = false;
+  // Written to the header and to every frame, so frames queued after a
+  // failed Reset() can't be replayed on top of the older snapshot
+  uint32_t epoch = 0;
+
+  std::unordered_map<const void *, NodeState> known;
+  uint32_t nextId = 0;
+  std::unordered_map<std::string, uint32_t> strings;
+  std::string definitions;
+  std::unordered_set<const Node *> touched;
+  ByteWriter records; // Not yet flushed
+  size_t written = 0; // Record bytes since the last Reset()
+  size_t snapshotSize = 0;
+};
+
+// Rebuilds the scene a journal describes: its snapshot with the recorded
+// edits replayed in order. A frame cut short by a crash ends the replay.
+// 'scene.customTypes' is left empty. Returns false with 'error' set if the
+// file can't be read or its snapshot is damaged.
+bool ReadJournal(const std::string &path, SceneData &scene,
+                 std::string &definitions, std::string &error,
+                 LoadProgress *progress = nullptr);
+} // namespace Billyprints
@@ -0,0 +1,73 @@
+#include "SceneSaver.hpp"
+#include <memory>
+
+namespace Billyprints {
+
+void SceneSaver::Save(std::string path, SceneData scene) {
+  auto snapshot = std::make_shared<SceneData>(std::move(scene));
+  Queue(path, [path, snapshot] { return WriteSceneFile(path, *snapshot); });
+}
+
+void SceneSaver::Queue(std::string path, std::function<bool()> write) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back({std::move(path), std::move(write)});
+    if (!thread.joinable()) {
+      stopping = false;
+      thread = std::thread(&SceneSaver::Run, this);
+    }
+  }
+  wakeup.notify_one();
+}
+
+bool SceneSaver::TakeResult(Result &out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (results.empty())
+    return false;
+  out = std::move(results.front());
+  results.pop_front();
+  return true;
+}
+
+bool SceneSaver::Busy() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return writing || !queue.empty();
+}
+
+void SceneSaver::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeup.notify_one();
+  if (thread.joinable())
+    thread.join();
+}
+
+void SceneSaver::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    // Queued saves are still written when stopping, so nothing is lost on
+    // exit
+    wakeup.wait(lock, [this] { return stopping || !queue.empty(); });
+    if (queue.empty())
+      return;
+
+    Job job = std::move(queue.front());
+    queue.pop_front();
+    writing = true;
+    lock.unlock();
+    bool ok = job.write();
+    job.write = nullptr; // Free its data before taking the lock again
+    lock.lock();
+    writing = false;
+    results.push_back({std::move(job.path), ok});
+
+    if (doneCallback) {
+      lock.unlock();
+      doneCallback();
+      lock.lock();
+    }
+  }
+}
+} // namespace Billyprints
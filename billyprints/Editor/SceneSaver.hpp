@@ -0,0 +1,57 @@
+#pragma once
+
+#include "SceneFile.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Billyprints {
+// Writes scene snapshots on a background thread, in the order they were
+// queued, so saving only costs the UI thread the snapshot itself. The
+// autosave journal queues its writes here too, see SceneJournal. The
+// thread is started by the first write queued.
+class SceneSaver {
+public:
+  struct Result {
+    std::string path;
+    bool ok;
+  };
+
+  ~SceneSaver() { Stop(); }
+
+  // Called on the saver thread whenever a save finishes
+  void SetDoneCallback(std::function<void()> callback) {
+    doneCallback = std::move(callback);
+  }
+
+  void Save(std::string path, SceneData scene);
+  // Runs 'write' after everything queued before it; its result is reported
+  // like a save of 'path'
+  void Queue(std::string path, std::function<bool()> write);
+  // Moves the oldest finished save into 'out'. Returns false if none.
+  bool TakeResult(Result &out);
+  // True while saves are queued or being written
+  bool Busy() const;
+  // Finishes every queued save, then stops the thread
+  void Stop();
+
+private:
+  struct Job {
+    std::string path;
+    std::function<bool()> write;
+  };
+  void Run();
+
+  mutable std::mutex mutex;
+  std::condition_variable wakeup;
+  std::thread thread;
+  std::function<void()> doneCallback;
+
+  std::deque<Job> queue;
+  bool writing = false;
+  std::deque<Result> results;
+  bool stopping = false;
+};
+} // namespace Billyprints
@@ -0,0 +1,520 @@
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+
+#include "ScriptEditor.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <imgui_internal.h>
+#include <iterator>
+
+namespace Billyprints {
+
+static bool IsWordChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_' || (unsigned char)c >= 0x80;
+}
+
+static bool IsContinuationByte(char c) {
+  return ((unsigned char)c & 0xC0) == 0x80;
+}
+
+void SplitLines(const std::string &text, std::vector<std::string> &out) {
+  out.clear();
+  out.emplace_back();
+  for (char c : text) {
+    if (c == '\n')
+      out.emplace_back();
+    else if (c != '\r')
+      out.back() += c;
+  }
+}
+
+void ScriptEditor::SetText(const std::string &text) {
+  std::vector<std::string> newLines;
+  SplitLines(text, newLines);
+
+  bool changed = newLines.size() != lines.size();
+  lines.resize(newLines.size());
+  widestLine = 0;
+  for (size_t i = 0; i < newLines.size(); ++i) {
+    if (lines[i] != newLines[i]) {
+      lines[i].swap(newLines[i]);
+      changed = true;
+    }
+    widestLine = std::max(widestLine, lines[i].size());
+  }
+
+  cursor = Clamp(cursor);
+  anchor = Clamp(anchor);
+  if (changed) {
+    undoStack.clear();
+    redoStack.clear();
+  }
+}
+
+std::string ScriptEditor::GetText() const {
+  size_t total = 0;
+  for (const auto &line : lines)
+    total += line.size() + 1;
+
+  std::string text;
+  text.reserve(total);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    if (i > 0)
+      text += '\n';
+    text += lines[i];
+  }
+  return text;
+}
+
+std::vector<ScriptEditor::LineChange> ScriptEditor::TakeChanges() {
+  std::vector<LineChange> taken;
+  taken.swap(changes);
+  return taken;
+}
+
+ScriptEditor::LineChange
+ScriptEditor::MergeChanges(const std::vector<LineChange> &changes) {
+  if (changes.empty())
+    return {0, 0, 0};
+  LineChange merged = changes.front();
+  for (size_t i = 1; i < changes.size(); ++i) {
+    const LineChange &change = changes[i];
+    // Lines before both ranges keep their index; lines past the end of the
+    // merged range are shifted by it
+    int first = std::min(merged.first, change.first);
+    int end = std::max(merged.first + merged.inserted,
+                       change.first + change.removed);
+    int originalEnd = end - merged.inserted + merged.removed;
+    merged = {first, originalEnd - first,
+              end - change.removed + change.inserted - first};
+  }
+  return merged;
+}
+
+std::string ScriptEditor::GetRange(Position from, Position to) const {
+  if (from.line == to.line)
+    return lines[from.line].substr(from.column, to.column - from.column);
+
+  std::string text = lines[from.line].substr(from.column);
+  for (int i = from.line + 1; i < to.line; ++i)
+    text += "\n" + lines[i];
+  text += "\n" + lines[to.line].substr(0, to.column);
+  return text;
+}
+
+// Line on which 'text' ends when inserted on 'line'
+static int EndLine(int line, const std::string &text) {
+  return line + (int)std::count(text.begin(), text.end(), '\n');
+}
+
+ScriptEditor::Position ScriptEditor::Replace(Position from, Position to,
+                                             const std::string &text) {
+  // Typing within one line doesn't need to split anything
+  if (from.line == to.line && text.find('\n') == std::string::npos) {
+    std::string &line = lines[from.line];
+    line.replace(from.column, to.column - from.column, text);
+    widestLine = std::max(widestLine, line.size());
+    changes.push_back({from.line, 1, 1});
+    return {from.line, from.column + (int)text.size()};
+  }
+
+  std::vector<std::string> parts;
+  SplitLines(text, parts);
+  parts.front().insert(0, lines[from.line], 0, from.column);
+  Position end{from.line + (int)parts.size() - 1, (int)parts.back().size()};
+  parts.back() += lines[to.line].substr(to.column);
+  for (const auto &part : parts)
+    widestLine = std::max(widestLine, part.size());
+
+  int removed = to.line - from.line + 1;
+  int inserted = (int)parts.size();
+  int common = std::min(removed, inserted);
+  for (int i = 0; i < common; ++i)
+    lines[from.line + i].swap(parts[i]);
+  if (removed > inserted)
+    lines.erase(lines.begin() + from.line + inserted,
+                lines.begin() + from.line + removed);
+  else if (inserted > removed)
+    lines.insert(lines.begin() + from.line + removed,
+                 std::make_move_iterator(parts.begin() + removed),
+                 std::make_move_iterator(parts.end()));
+
+  changes.push_back({from.line, removed, inserted});
+  return end;
+}
+
+void ScriptEditor::Edit(const std::string &text, bool mergeable) {
+  Position from = std::min(cursor, anchor);
+  Position to = std::max(cursor, anchor);
+  if (from == to && text.empty())
+    return;
+
+  UndoRecord record{from, GetRange(from, to), text};
+  Position end = Replace(from, to, text);
+
+  // Consecutive typing on one line is undone as a single step
+  UndoRecord *last = undoStack.empty() ? nullptr : &undoStack.back();
+  if (mergeable && last && last->removed.empty() && record.removed.empty() &&
+      last->inserted.find('\n') == std::string::npos &&
+      from.line == last->from.line &&
+      from.column == last->from.column + (int)last->inserted.size()) {
+    last->inserted += text;
+  } else {
+    undoStack.push_back(std::move(record));
+    if (undoStack.size() > MaxUndoRecords)
+      undoStack.erase(undoStack.begin());
+  }
+  redoStack.clear();
+
+  cursor = anchor = end;
+  preferredX = -1.0f;
+  scrollToCursor = true;
+}
+
+void ScriptEditor::Undo(std::vector<UndoRecord> &from,
+                        std::vector<UndoRecord> &to) {
+  if (from.empty())
+    return;
+  UndoRecord record = std::move(from.back());
+  from.pop_back();
+
+  // Swap the inserted text back for what it replaced
+  Position insertedEnd{EndLine(record.from.line, record.inserted), 0};
+  size_t lastBreak = record.inserted.rfind('\n');
+  insertedEnd.column =
+      lastBreak == std::string::npos
+          ? record.from.column + (int)record.inserted.size()
+          : (int)(record.inserted.size() - lastBreak - 1);
+  Position end = Replace(record.from, insertedEnd, record.removed);
+
+  std::swap(record.removed, record.inserted);
+  to.push_back(std::move(record));
+
+  cursor = anchor = end;
+  preferredX = -1.0f;
+  scrollToCursor = true;
+}
+
+ScriptEditor::Position ScriptEditor::Clamp(Position pos) const {
+  pos.line = ImClamp(pos.line, 0, (int)lines.size() - 1);
+  pos.column = ImClamp(pos.column, 0, (int)lines[pos.line].size());
+  return pos;
+}
+
+ScriptEditor::Position ScriptEditor::Left(Position pos, bool word) const {
+  if (pos.column == 0)
+    return pos.line > 0
+               ? Position{pos.line - 1, (int)lines[pos.line - 1].size()}
+               : pos;
+
+  const std::string &line = lines[pos.line];
+  if (!word) {
+    do
+      pos.column--;
+    while (pos.column > 0 && IsContinuationByte(line[pos.column]));
+    return pos;
+  }
+  while (pos.column > 0 && !IsWordChar(line[pos.column - 1]))
+    pos.column--;
+  while (pos.column > 0 && IsWordChar(line[pos.column - 1]))
+    pos.column--;
+  return pos;
+}
+
+ScriptEditor::Position ScriptEditor::Right(Position pos, bool word) const {
+  const std::string &line = lines[pos.line];
+  int size = (int)line.size();
+  if (pos.column == size)
+    return pos.line + 1 < (int)lines.size() ? Position{pos.line + 1, 0} : pos;
+
+  if (!word) {
+    do
+      pos.column++;
+    while (pos.column < size && IsContinuationByte(line[pos.column]));
+    return pos;
+  }
+  while (pos.column < size && !IsWordChar(line[pos.column]))
+    pos.column++;
+  while (pos.column < size && IsWordChar(line[pos.column]))
+    pos.column++;
+  return pos;
+}
+
+void ScriptEditor::MoveTo(Position pos, bool select) {
+  cursor = Clamp(pos);
+  if (!select)
+    anchor = cursor;
+  scrollToCursor = true;
+}
+
+float ScriptEditor::ColumnX(int line, int column) const {
+  const std::string &text = lines[line];
+  ImFont *font = ImGui::GetFont();
+  return font
+      ->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, 0.0f, text.data(),
+                      text.data() + column)
+      .x;
+}
+
+int ScriptEditor::ColumnAt(int line, float x) const {
+  const std::string &text = lines[line];
+  ImFont *font = ImGui::GetFont();
+  float scale = ImGui::GetFontSize() / font->FontSize;
+  const char *begin = text.data();
+  const char *end = begin + text.size();
+
+  float lineX = 0.0f;
+  for (const char *s = begin; s < end;) {
+    unsigned int c;
+    int length = ImTextCharFromUtf8(&c, s, end);
+    float advance = font->GetCharAdvance((ImWchar)c) * scale;
+    if (x < lineX + advance * 0.5f)
+      return (int)(s - begin);
+    lineX += advance;
+    s += length > 0 ? length : 1;
+  }
+  return (int)text.size();
+}
+
+void ScriptEditor::HandleKeyboard(int pageLines) {
+  ImGuiIO &io = ImGui::GetIO();
+  bool ctrl = io.KeyCtrl;
+  bool shift = io.KeyShift;
+  Position selStart = std::min(cursor, anchor);
+  Position selEnd = std::max(cursor, anchor);
+
+  auto moveVertical = [&](int delta) {
+    if (preferredX < 0.0f)
+      preferredX = ColumnX(cursor.line, cursor.column);
+    int line = ImClamp(cursor.line + delta, 0, (int)lines.size() - 1);
+    float x = preferredX;
+    MoveTo({line, ColumnAt(line, x)}, shift);
+    preferredX = x;
+  };
+
+  if (ImGui::IsKeyPressed(ImGuiKey_LeftArrow)) {
+    preferredX = -1.0f;
+    MoveTo(HasSelection() && !shift ? selStart : Left(cursor, ctrl), shift);
+  } else if (ImGui::IsKeyPressed(ImGuiKey_RightArrow)) {
+    preferredX = -1.0f;
+    MoveTo(HasSelection() && !shift ? selEnd : Right(cursor, ctrl), shift);
+  } else if (ImGui::IsKeyPressed(ImGuiKey_UpArrow)) {
+    moveVertical(-1);
+  } else if (ImGui::IsKeyPressed(ImGuiKey_DownArrow)) {
+    moveVertical(1);
+  } else if (ImGui::IsKeyPressed(ImGuiKey_PageUp)) {
+    moveVertical(-pageLines);
+  } else if (ImGui::IsKeyPressed(ImGuiKey_PageDown)) {
+    moveVertical(pageLines);
+  } else if (ImGui::IsKeyPressed(ImGuiKey_Home)) {
+    preferredX = -1.0f;
+    MoveTo(ctrl ? Position{} : Position{cursor.line, 0}, shift);
+  } else if (ImGui::IsKeyPressed(ImGuiKey_End)) {
+    preferredX = -1.0f;
+    int line = ctrl ? (int)lines.size() - 1 : cursor.line;
+    MoveTo({line, (int)lines[line].size()}, shift);
+  } else if (ctrl && ImGui::IsKeyPressed(ImGuiKey_A)) {
+    anchor = {};
+    cursor = {(int)lines.size() - 1, (int)lines.back().size()};
+  } else if (ctrl && (ImGui::IsKeyPressed(ImGuiKey_C) ||
+                      ImGui::IsKeyPressed(ImGuiKey_X))) {
+    if (HasSelection()) {
+      ImGui::SetClipboardText(GetRange(selStart, selEnd).c_str());
+      if (ImGui::IsKeyPressed(ImGuiKey_X))
+        Edit("");
+    }
+  } else if (ctrl && ImGui::IsKeyPressed(ImGuiKey_V)) {
+    if (const char *clipboard = ImGui::GetClipboardText())
+      Edit(clipboard);
+  } else if (ctrl && ImGui::IsKeyPressed(ImGuiKey_Z)) {
+    if (shift)
+      Undo(redoStack, undoStack);
+    else
+      Undo(undoStack, redoStack);
+  } else if (ctrl && ImGui::IsKeyPressed(ImGuiKey_Y)) {
+    Undo(redoStack, undoStack);
+  } else if (ImGui::IsKeyPressed(ImGuiKey_Enter) ||
+             ImGui::IsKeyPressed(ImGuiKey_KeypadEnter)) {
+    // Keep the indentation of the current line
+    const std::string &line = lines[cursor.line];
+    size_t indent = line.find_first_not_of(" \t");
+    indent = std::min(indent == std::string::npos ? line.size() : indent,
+                      (size_t)selStart.column);
+    Edit("\n" + line.substr(0, indent));
+  } else if (ImGui::IsKeyPressed(ImGuiKey_Tab)) {
+    Edit("  ");
+  } else if (ImGui::IsKeyPressed(ImGuiKey_Backspace)) {
+    if (!HasSelection())
+      anchor = Left(cursor, ctrl);
+    Edit("");
+  } else if (ImGui::IsKeyPressed(ImGuiKey_Delete)) {
+    if (!HasSelection())
+      anchor = Right(cursor, ctrl);
+    Edit("");
+  }
+
+  // Typed characters. Ctrl shortcuts are not text.
+  if (!(ctrl && !io.KeyAlt)) {
+    std::string typed;
+    for (ImWchar c : io.InputQueueCharacters) {
+      if (c < 32 || c == 127)
+        continue;
+      char buf[5];
+      typed += ImTextCharToUtf8(buf, c);
+    }
+    if (!typed.empty())
+      Edit(typed, true);
+  }
+  io.InputQueueCharacters.resize(0);
+}
+
+bool ScriptEditor::Render(const char *id, const ImVec2 &size) {
+  ImGuiContext &g = *GImGui;
+  ImGuiIO &io = ImGui::GetIO();
+  const ImGuiStyle &style = ImGui::GetStyle();
+  size_t changesBefore = changes.size();
+
+  ImGui::PushStyleColor(ImGuiCol_ChildBg, style.Colors[ImGuiCol_FrameBg]);
+  ImGui::PushStyleVar(ImGuiStyleVar_ChildRounding, style.FrameRounding);
+  ImGui::BeginChild(id, size, false,
+                    ImGuiWindowFlags_HorizontalScrollbar |
+                        ImGuiWindowFlags_NoMove);
+  ImGuiWindow *window = ImGui::GetCurrentWindow();
+  ImGuiID textId = window->GetID("##text");
+
+  const float lineHeight = ImGui::GetTextLineHeight();
+  const float charWidth = ImGui::CalcTextSize("0").x;
+  char lineNumber[16];
+  int digits = snprintf(lineNumber, sizeof(lineNumber), "%d", LineCount());
+  const float gutterWidth = charWidth * (digits + 2);
+
+  // Content extents drive the scrollbars; nothing outside the view is laid out
+  ImVec2 origin = ImGui::GetCursorScreenPos();
+  ImVec2 textOrigin = origin + ImVec2(gutterWidth, 0.0f);
+  ImGui::ItemSize(ImVec2(gutterWidth + (widestLine + 2) * charWidth,
+                         LineCount() * lineHeight));
+  ImRect area = window->InnerRect;
+  ImGui::ItemAdd(area, textId);
+  bool hovered = ImGui::IsWindowHovered() && area.Contains(io.MousePos);
+  if (hovered)
+    ImGui::SetMouseCursor(ImGuiMouseCursor_TextInput);
+
+  auto positionAt = [&](const ImVec2 &mouse) {
+    int line = (int)ImFloor((mouse.y - origin.y) / lineHeight);
+    line = ImClamp(line, 0, LineCount() - 1);
+    return Position{line, ColumnAt(line, mouse.x - textOrigin.x)};
+  };
+
+  // Focus follows clicks, like InputText
+  if (hovered && ImGui::IsMouseClicked(0)) {
+    if (g.ActiveId != textId) {
+      ImGui::SetActiveID(textId, window);
+      ImGui::SetFocusID(textId, window);
+      ImGui::FocusWindow(window);
+      g.ActiveIdUsingNavDirMask |= (1 << ImGuiDir_Left) | (1 << ImGuiDir_Right) |
+                                   (1 << ImGuiDir_Up) | (1 << ImGuiDir_Down);
+      for (ImGuiKey key : {ImGuiKey_Escape, ImGuiKey_Home, ImGuiKey_End,
+                           ImGuiKey_PageUp, ImGuiKey_PageDown, ImGuiKey_Tab})
+        ImGui::SetActiveIdUsingKey(key);
+    }
+    active = true;
+    selecting = true;
+    preferredX = -1.0f;
+    Position pos = positionAt(io.MousePos);
+    if (ImGui::IsMouseDoubleClicked(0)) {
+      const std::string &line = lines[pos.line];
+      anchor = cursor = pos;
+      while (anchor.column > 0 && IsWordChar(line[anchor.column - 1]))
+        anchor.column--;
+      while (cursor.column < (int)line.size() && IsWordChar(line[cursor.column]))
+        cursor.column++;
+    } else {
+      MoveTo(pos, io.KeyShift);
+    }
+  } else if (active && (ImGui::IsMouseClicked(0) || g.ActiveId != textId ||
+                        ImGui::IsKeyPressed(ImGuiKey_Escape))) {
+    if (g.ActiveId == textId)
+      ImGui::ClearActiveID();
+    active = false;
+  }
+
+  if (active) {
+    g.ActiveIdAllowOverlap = !io.MouseDown[0];
+    g.WantTextInputNextFrame = 1;
+    // Drag selection keeps going when the mouse leaves the editor
+    if (!io.MouseDown[0])
+      selecting = false;
+    else if (selecting && ImGui::IsMouseDragging(0))
+      MoveTo(positionAt(io.MousePos), true);
+    HandleKeyboard(ImMax(1, (int)(area.GetHeight() / lineHeight) - 1));
+  }
+
+  float scrollX = ImGui::GetScrollX();
+  float scrollY = ImGui::GetScrollY();
+  if (scrollToCursor) {
+    scrollToCursor = false;
+    float cursorY = cursor.line * lineHeight;
+    if (cursorY < scrollY)
+      ImGui::SetScrollY(cursorY);
+    else if (cursorY + lineHeight > scrollY + area.GetHeight())
+      ImGui::SetScrollY(cursorY + lineHeight - area.GetHeight());
+    float cursorX = gutterWidth + ColumnX(cursor.line, cursor.column);
+    if (cursorX - gutterWidth < scrollX)
+      ImGui::SetScrollX(ImMax(0.0f, cursorX - gutterWidth - charWidth * 4));
+    else if (cursorX + charWidth > scrollX + area.GetWidth())
+      ImGui::SetScrollX(cursorX + charWidth * 4 - area.GetWidth());
+  }
+
+  // Only the visible lines are measured and drawn
+  int first = ImClamp((int)(scrollY / lineHeight), 0, LineCount());
+  int last = ImMin(LineCount(),
+                   first + (int)(area.GetHeight() / lineHeight) + 2);
+  ImDrawList *drawList = window->DrawList;
+  ImU32 textColor = ImGui::GetColorU32(ImGuiCol_Text);
+  ImU32 numberColor = ImGui::GetColorU32(ImGuiCol_TextDisabled);
+  ImU32 selectionColor = ImGui::GetColorU32(ImGuiCol_TextSelectedBg);
+  Position selStart = std::min(cursor, anchor);
+  Position selEnd = std::max(cursor, anchor);
+
+  for (int i = first; i < last; ++i) {
+    float y = origin.y + i * lineHeight;
+    int length = snprintf(lineNumber, sizeof(lineNumber), "%d", i + 1);
+    drawList->AddText(ImVec2(area.Min.x + charWidth * (digits - length), y),
+                      numberColor, lineNumber);
+  }
+
+  // Text scrolls horizontally underneath the line numbers
+  drawList->PushClipRect(ImVec2(area.Min.x + gutterWidth, area.Min.y),
+                         area.Max, true);
+  for (int i = first; i < last; ++i) {
+    const std::string &line = lines[i];
+    ImVec2 linePos = textOrigin + ImVec2(0.0f, i * lineHeight);
+
+    if (HasSelection() && i >= selStart.line && i <= selEnd.line) {
+      float x0 = i == selStart.line ? ColumnX(i, selStart.column) : 0.0f;
+      float x1 = i == selEnd.line ? ColumnX(i, selEnd.column)
+                                  : ColumnX(i, (int)line.size()) + charWidth;
+      drawList->AddRectFilled(linePos + ImVec2(x0, 0.0f),
+                              linePos + ImVec2(x1, lineHeight),
+                              selectionColor);
+    }
+
+    drawList->AddText(linePos, textColor, line.data(),
+                      line.data() + line.size());
+  }
+
+  if (active && cursor.line >= first && cursor.line < last) {
+    ImVec2 top = textOrigin + ImVec2(ColumnX(cursor.line, cursor.column),
+                                     cursor.line * lineHeight);
+    drawList->AddLine(top, top + ImVec2(0.0f, lineHeight), textColor);
+  }
+  drawList->PopClipRect();
+
+  ImGui::EndChild();
+  ImGui::PopStyleVar();
+  ImGui::PopStyleColor();
+  return changes.size() != changesBefore;
+}
+} // namespace Billyprints
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "pch.hpp"
+#include <string>
+#include <vector>
+
+namespace Billyprints {
+// Splits 'text' into 'out' at each '\n', dropping '\r'
+void SplitLines(const std::string &text, std::vector<std::string> &out);
+
+// Multi-line text editor for the scene script. The text is kept as an array
+// of lines so an edit only touches the lines it changes, and only the lines
+// inside the view are laid out and drawn. There is no size limit.
+class ScriptEditor {
+public:
+  // Lines [first, first + removed) were replaced by 'inserted' new lines
+  struct LineChange {
+    int first;
+    int removed;
+    int inserted;
+  };
+
+  // Replaces the text without reporting changes or keeping undo history.
+  // Lines that are already equal are left alone.
+  void SetText(const std::string &text);
+  std::string GetText() const;
+  int LineCount() const { return (int)lines.size(); }
+  const std::string &Line(int index) const { return lines[index]; }
+
+  // Draws the editor filling 'size'. Returns true when the text was edited.
+  bool Render(const char *id, const ImVec2 &size);
+  // True while the editor has keyboard focus
+  bool IsActive() const { return active; }
+
+  // Line ranges edited since the last call, oldest first
+  std::vector<LineChange> TakeChanges();
+  // One change with the same effect as 'changes' applied in order
+  static LineChange MergeChanges(const std::vector<LineChange> &changes);
+
+private:
+  struct Position {
+    int line = 0;
+    int column = 0; // Byte offset into the line
+    bool operator==(const Position &o) const {
+      return line == o.line && column == o.column;
+    }
+    bool operator<(const Position &o) const {
+      return line < o.line || (line == o.line && column < o.column);
+    }
+  };
+  struct UndoRecord {
+    Position from;
+    std::string removed;
+    std::string inserted;
+  };
+
+  static constexpr size_t MaxUndoRecords = 1000;
+
+  std::vector<std::string> lines{std::string()};
+  Position cursor;
+  Position anchor; // Other end of the selection, equal to cursor if none
+  float preferredX = -1.0f; // Kept while moving up and down
+  bool active = false;
+  bool selecting = false; // Mouse pressed in the text and not released yet
+  bool scrollToCursor = false;
+  size_t widestLine = 0; // Bytes; only grows until the next SetText()
+  std::vector<LineChange> changes;
+  std::vector<UndoRecord> undoStack;
+  std::vector<UndoRecord> redoStack;
+
+  bool HasSelection() const { return !(cursor == anchor); }
+  std::string GetRange(Position from, Position to) const;
+  // Replaces [from, to) with 'text' and returns the end of the new text
+  Position Replace(Position from, Position to, const std::string &text);
+  void Edit(const std::string &text, bool mergeable = false);
+  void Undo(std::vector<UndoRecord> &from, std::vector<UndoRecord> &to);
+
+  Position Clamp(Position pos) const;
+  Position Left(Position pos, bool word) const;
+  Position Right(Position pos, bool word) const;
+  void MoveTo(Position pos, bool select);
+  float ColumnX(int line, int column) const;
+  int ColumnAt(int line, float x) const;
+
+  void HandleKeyboard(int pageLines);
+};
+} // namespace Billyprints
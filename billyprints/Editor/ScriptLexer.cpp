@@ -0,0 +1,116 @@
+#include "ScriptLexer.hpp"
+
+namespace Billyprints {
+
+// Identifiers are permissive so gate names like "4bit-Adder" keep working.
+// A '-' only ends one when it starts an arrow.
+static bool IsIdentifierChar(std::string_view source, uint32_t pos) {
+  unsigned char c = (unsigned char)source[pos];
+  if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+      (c >= '0' && c <= '9') || c == '_' || c == '#' || c == '$' ||
+      c == '\'' || c == '+' || c >= 0x80)
+    return true;
+  return c == '-' && (pos + 1 >= source.size() || source[pos + 1] != '>');
+}
+
+Token ScriptLexer::Next() {
+  const uint32_t size = (uint32_t)source.size();
+
+  // Skip blanks and comments
+  while (pos < size) {
+    char c = source[pos];
+    if (c == ' ' || c == '\t' || c == '\r') {
+      pos++;
+    } else if (c == '/' && pos + 1 < size && source[pos + 1] == '/') {
+      while (pos < size && source[pos] != '\n')
+        pos++;
+    } else {
+      break;
+    }
+  }
+
+  Token token;
+  token.span.offset = pos;
+  token.span.line = line;
+  token.span.column = pos - lineStart + 1;
+  if (pos >= size) {
+    token.kind = TokenKind::EndOfFile;
+    return token;
+  }
+
+  char c = source[pos];
+  auto single = [&](TokenKind kind, uint32_t length = 1) {
+    token.kind = kind;
+    token.span.length = length;
+    pos += length;
+    return token;
+  };
+  auto doubled = [&](TokenKind kind) {
+    return single(kind, pos + 1 < size && source[pos + 1] == c ? 2 : 1);
+  };
+
+  switch (c) {
+  case '\n':
+    single(TokenKind::Newline);
+    line++;
+    lineStart = pos;
+    return token;
+  case '.':
+    return single(TokenKind::Dot);
+  case ',':
+    return single(TokenKind::Comma);
+  case ':':
+    return single(TokenKind::Colon);
+  case '@':
+    return single(TokenKind::At);
+  case '=':
+    return single(TokenKind::Equals);
+  case '(':
+    return single(TokenKind::LParen);
+  case ')':
+    return single(TokenKind::RParen);
+  case '[':
+    return single(TokenKind::LBracket);
+  case ']':
+    return single(TokenKind::RBracket);
+  case '<':
+    return single(TokenKind::Less);
+  case '>':
+    return single(TokenKind::Greater);
+  case '!':
+  case '~':
+    return single(TokenKind::Not);
+  case '&':
+    return doubled(TokenKind::And);
+  case '|':
+    return doubled(TokenKind::Or);
+  case '^':
+    return single(TokenKind::Xor);
+  case '-':
+    if (pos + 1 < size && source[pos + 1] == '>')
+      return single(TokenKind::Arrow, 2);
+    break;
+  default:
+    break;
+  }
+
+  if (!IsIdentifierChar(source, pos))
+    return single(TokenKind::Invalid);
+
+  // A word made only of digits (with an optional sign) is a number
+  uint32_t start = pos;
+  bool digits = true;
+  while (pos < size && IsIdentifierChar(source, pos)) {
+    char d = source[pos];
+    if (!(d >= '0' && d <= '9') && !(d == '-' && pos == start))
+      digits = false;
+    pos++;
+  }
+  if (pos - start == 1 && source[start] == '-')
+    digits = false;
+
+  token.kind = digits ? TokenKind::Number : TokenKind::Identifier;
+  token.span.length = pos - start;
+  return token;
+}
+} // namespace Billyprints
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace Billyprints {
+enum class TokenKind : uint8_t {
+  Identifier,
+  Number,
+  Arrow,    // ->
+  Dot,      // .
+  Comma,    // ,
+  Colon,    // :
+  At,       // @
+  Equals,   // =
+  LParen,   // (
+  RParen,   // )
+  LBracket, // [
+  RBracket, // ]
+  Less,     // <
+  Greater,  // >
+  Not,      // ! or ~
+  And,      // & or &&
+  Or,       // | or ||
+  Xor,      // ^
+  Newline,
+  EndOfFile,
+  Invalid
+};
+
+// Location of a token or syntax element in the script. Lines and columns
+// are 1-based.
+struct SourceSpan {
+  uint32_t offset = 0;
+  uint32_t length = 0;
+  uint32_t line = 0;
+  uint32_t column = 0;
+};
+
+struct Token {
+  TokenKind kind = TokenKind::Invalid;
+  SourceSpan span;
+};
+
+// Single pass tokenizer for the scene script. Tokens refer back into the
+// source by offset, so lexing never allocates. Comments ("//" to the end of
+// the line) and blank space other than newlines are skipped.
+class ScriptLexer {
+public:
+  explicit ScriptLexer(std::string_view source) : source(source) {}
+
+  Token Next();
+  std::string_view Text(const Token &token) const {
+    return source.substr(token.span.offset, token.span.length);
+  }
+  std::string_view Source() const { return source; }
+
+private:
+  std::string_view source;
+  uint32_t pos = 0;
+  uint32_t line = 1;
+  uint32_t lineStart = 0;
+};
+} // namespace Billyprints
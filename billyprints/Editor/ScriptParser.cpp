@@ -0,0 +1,1200 @@
+#include "ScriptParser.hpp"
+#include <algorithm>
+#include <charconv>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Billyprints {
+
+namespace {
+constexpr uint32_t InvalidExpr = UINT32_MAX;
+constexpr uint32_t NoInt = UINT32_MAX;
+
+// Limits on what a define block may expand to, so a runaway loop or a
+// template that instantiates itself reports an error instead of hanging.
+// Loop passes are counted apart from assignments so that loops with empty
+// bodies are bounded too.
+constexpr size_t MaxExpandedAssignments = 100000;
+constexpr uint64_t MaxLoopIterations = 1000000;
+constexpr int MaxInstanceDepth = 32;
+
+bool IsOperatorWord(std::string_view word) {
+  return word == "AND" || word == "OR" || word == "NOT" || word == "XOR" ||
+         word == "NAND" || word == "NOR" || word == "XNOR";
+}
+
+SourceSpan Join(const SourceSpan &first, const SourceSpan &last) {
+  SourceSpan span = first;
+  span.length = last.offset + last.length - first.offset;
+  return span;
+}
+
+// Hashes the tokens of 'text'. Blank lines, spacing and comments don't
+// change the result.
+uint64_t HashTokens(std::string_view text) {
+  ScriptLexer lexer(text);
+  uint64_t hash = HashBytes({});
+  bool lineStart = true;
+  for (Token token = lexer.Next(); token.kind != TokenKind::EndOfFile;
+       token = lexer.Next()) {
+    bool newline = token.kind == TokenKind::Newline;
+    if (newline && lineStart)
+      continue;
+    lineStart = newline;
+    hash = HashCombine(hash, (uint64_t)token.kind);
+    hash = HashBytes(lexer.Text(token), hash);
+  }
+  return hash;
+}
+
+// Define blocks as written, before parameters and loops are expanded
+struct RawScript {
+  // Integer expression: a bus width, bit index, loop bound or parameter
+  struct IntExpr {
+    enum Kind : uint8_t { Number, Name, Add, Sub, Mul, Div, Mod, Negate };
+    Kind kind;
+    SourceSpan span;
+    int value = 0;
+    std::string_view name;
+    uint32_t lhs = 0, rhs = 0;
+  };
+  struct Term {
+    ScriptAst::Expr expr;   // Arguments are in 'termArgs'
+    uint32_t index = NoInt; // Bit of a bus signal, s[i]
+    uint32_t firstParam = 0, paramCount = 0; // Gate<N>(...), in 'intArgs'
+  };
+  struct Statement {
+    enum Kind : uint8_t { Assign, For };
+    Kind kind;
+    SourceSpan span;
+    std::string_view name;   // Target or loop variable
+    uint32_t index = NoInt;  // Bit of the target
+    uint32_t term = 0;       // Assigned expression
+    uint32_t from = 0, to = 0;               // Loop bounds, both inclusive
+    uint32_t firstChild = 0, childCount = 0; // Loop body, in 'children'
+  };
+  struct Port {
+    std::string_view name;
+    uint32_t width = NoInt; // Set for name[width]
+  };
+  struct Define {
+    std::string_view name, text;
+    SourceSpan span;
+    uint32_t firstParam = 0, paramCount = 0;   // In 'paramNames'
+    uint32_t firstInput = 0, inputCount = 0;   // In 'ports'
+    uint32_t firstOutput = 0, outputCount = 0; // In 'ports'
+    uint32_t firstStatement = 0, statementCount = 0; // In 'children'
+    uint64_t sourceHash = 0; // See HashTokens()
+    bool valid = true;
+  };
+  // A scene node whose type has parameters, as in "Adder<8> add @ 0, 0"
+  struct NodeUse {
+    uint32_t node;
+    std::string_view gate;
+    SourceSpan span;
+    uint32_t firstParam = 0, paramCount = 0; // In 'intArgs'
+  };
+
+  std::vector<IntExpr> ints;
+  std::vector<Term> terms;
+  std::vector<uint32_t> termArgs;
+  std::vector<uint32_t> intArgs;
+  std::vector<Statement> statements;
+  std::vector<uint32_t> children;
+  std::vector<Port> ports;
+  std::vector<std::string_view> paramNames;
+  std::vector<Define> defines;
+  std::vector<NodeUse> nodeUses;
+};
+
+// Recursive descent over the token stream. Statements are line based;
+// expressions inside define blocks use the usual precedence
+// NOT > AND/NAND > XOR/XNOR > OR/NOR, all left associative.
+class Parser {
+public:
+  Parser(ScriptAst &ast, RawScript &raw)
+      : ast(ast), raw(raw), lexer(*ast.source) {
+    Advance();
+  }
+
+  void ParseAll() {
+    while (true) {
+      while (At(TokenKind::Newline))
+        Advance();
+      if (At(TokenKind::EndOfFile))
+        break;
+      if (AtWord("define"))
+        ParseDefine(); // Consumes its own lines
+      else if (!ParseStatement() || !ExpectLineEnd())
+        SkipLine();
+    }
+  }
+
+private:
+  ScriptAst &ast;
+  RawScript &raw;
+  ScriptLexer lexer;
+  Token current;
+  std::vector<uint32_t> argStack; // Reused while collecting call arguments
+
+  void Advance() { current = lexer.Next(); }
+  std::string_view Text(const Token &token) const { return lexer.Text(token); }
+  bool At(TokenKind kind) const { return current.kind == kind; }
+  bool AtWord(std::string_view word) const {
+    return At(TokenKind::Identifier) && Text(current) == word;
+  }
+
+  void Error(const SourceSpan &span, std::string message) {
+    ast.errors.push_back({span, std::move(message)});
+  }
+  std::string Describe(const Token &token) const {
+    switch (token.kind) {
+    case TokenKind::Newline:
+      return "end of line";
+    case TokenKind::EndOfFile:
+      return "end of script";
+    default:
+      return "'" + std::string(Text(token)) + "'";
+    }
+  }
+  bool Expect(TokenKind kind, const char *what, Token *out = nullptr) {
+    if (!At(kind)) {
+      Error(current.span, std::string("Expected ") + what + ", found " +
+                              Describe(current));
+      return false;
+    }
+    if (out)
+      *out = current;
+    Advance();
+    return true;
+  }
+  bool ExpectLineEnd() {
+    if (At(TokenKind::Newline) || At(TokenKind::EndOfFile))
+      return true;
+    Error(current.span, "Unexpected " + Describe(current));
+    return false;
+  }
+  void SkipLine() {
+    while (!At(TokenKind::Newline) && !At(TokenKind::EndOfFile))
+      Advance();
+  }
+
+  bool ParseStatement() {
+    if (AtWord("end")) {
+      Error(current.span, "'end' without a matching 'define'");
+      return false;
+    }
+
+    Token first;
+    if (!Expect(TokenKind::Identifier, "a node declaration or connection",
+                &first))
+      return false;
+    if (At(TokenKind::Less)) {
+      // Type<params> id ...; the type is named once the block is expanded
+      RawScript::NodeUse use;
+      use.node = (uint32_t)ast.nodes.size();
+      use.gate = Text(first);
+      use.span = first.span;
+      Token close;
+      if (!ParseIntArgs(use.firstParam, use.paramCount, &close))
+        return false;
+      use.span = Join(first.span, close.span);
+      if (!ParseNode(first))
+        return false;
+      raw.nodeUses.push_back(use);
+      return true;
+    }
+    if (At(TokenKind::Dot) || At(TokenKind::Arrow))
+      return ParseWire(first);
+    if (At(TokenKind::Identifier))
+      return ParseNode(first);
+    Error(current.span, "Expected a node id or '->', found " +
+                            Describe(current));
+    return false;
+  }
+
+  // Type id[hi:lo] @ x, y [momentary], the range being optional
+  bool ParseNode(const Token &type) {
+    ScriptAst::NodeDecl node;
+    Token id, x, y;
+    if (!Expect(TokenKind::Identifier, "a node id", &id))
+      return false;
+    if (At(TokenKind::LBracket) && !ParseBusRange(node.width))
+      return false;
+    if (!Expect(TokenKind::At, "'@'") ||
+        !Expect(TokenKind::Number, "an x position", &x) ||
+        !Expect(TokenKind::Comma, "','") ||
+        !Expect(TokenKind::Number, "a y position", &y))
+      return false;
+
+    node.type = Text(type);
+    node.id = Text(id);
+    node.x = ParseInt(x);
+    node.y = ParseInt(y);
+    node.span = Join(type.span, y.span);
+    if (AtWord("momentary")) {
+      node.momentary = true;
+      node.span = Join(type.span, current.span);
+      Advance();
+    }
+    ast.nodes.push_back(node);
+    return true;
+  }
+
+  // [hi:lo]. Buses are numbered from bit 0 and fit in one 64-bit word.
+  bool ParseBusRange(int &width) {
+    Token open = current, hi, lo, close;
+    Advance();
+    if (!Expect(TokenKind::Number, "a bus range", &hi) ||
+        !Expect(TokenKind::Colon, "':'") ||
+        !Expect(TokenKind::Number, "the low bit of the range", &lo) ||
+        !Expect(TokenKind::RBracket, "']'", &close))
+      return false;
+    SourceSpan span = Join(open.span, close.span);
+    if (ParseInt(lo) != 0) {
+      Error(span, "Bus ranges must end at bit 0");
+      return false;
+    }
+    int high = ParseInt(hi);
+    if (high < 0 || high >= 64) {
+      Error(span, "Buses are 1 to 64 bits wide");
+      return false;
+    }
+    width = high + 1;
+    return true;
+  }
+
+  int ParseInt(const Token &token) const {
+    std::string_view text = Text(token);
+    int value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+  }
+
+  // node[.slot] -> node[.slot]
+  bool ParseWire(const Token &first) {
+    ScriptAst::WireDecl wire;
+    wire.outputNode = Text(first);
+    wire.outputSlot = "out";
+    wire.inputSlot = "in";
+
+    Token slot, target, last;
+    if (At(TokenKind::Dot)) {
+      Advance();
+      if (!Expect(TokenKind::Identifier, "an output slot", &slot))
+        return false;
+      wire.outputSlot = Text(slot);
+    }
+    if (!Expect(TokenKind::Arrow, "'->'") ||
+        !Expect(TokenKind::Identifier, "a target node", &target))
+      return false;
+    wire.inputNode = Text(target);
+    last = target;
+    if (At(TokenKind::Dot)) {
+      Advance();
+      if (!Expect(TokenKind::Identifier, "an input slot", &slot))
+        return false;
+      wire.inputSlot = Text(slot);
+      last = slot;
+    }
+    wire.span = Join(first.span, last.span);
+    ast.wires.push_back(wire);
+    return true;
+  }
+
+  // Integer expression, read up to the first token that can't be part of
+  // one. The lexer reads "N-1" as a single word, so the text is scanned
+  // again character by character.
+  uint32_t ParseIntExpr(const char *what) {
+    Token first = current, last = current;
+    int depth = 0;
+    bool any = false;
+    while (true) {
+      if (At(TokenKind::LParen)) {
+        depth++;
+      } else if (At(TokenKind::RParen)) {
+        if (depth == 0)
+          break;
+        depth--;
+      } else if (!At(TokenKind::Number) && !At(TokenKind::Invalid) &&
+                 !(At(TokenKind::Identifier) && !AtWord("to"))) {
+        break;
+      }
+      last = current;
+      any = true;
+      Advance();
+    }
+    if (!any) {
+      Error(current.span, std::string("Expected ") + what + ", found " +
+                              Describe(current));
+      return NoInt;
+    }
+
+    IntScanner scanner{lexer.Source(), Join(first.span, last.span),
+                       first.span.offset};
+    uint32_t expr = ScanSum(scanner);
+    if (expr != NoInt && scanner.pos != scanner.End()) {
+      Error(scanner.Here(), "Unexpected '" +
+                                std::string(1, lexer.Source()[scanner.pos]) +
+                                "' in " + what);
+      return NoInt;
+    }
+    return expr;
+  }
+
+  struct IntScanner {
+    std::string_view source;
+    SourceSpan span; // Whole expression
+    uint32_t pos;
+
+    uint32_t End() const { return span.offset + span.length; }
+    void SkipBlanks() {
+      while (pos < End() && (source[pos] == ' ' || source[pos] == '\t'))
+        pos++;
+    }
+    bool Take(char c) {
+      SkipBlanks();
+      if (pos >= End() || source[pos] != c)
+        return false;
+      pos++;
+      return true;
+    }
+    SourceSpan Here(uint32_t length = 1) const {
+      SourceSpan here = span;
+      here.offset = pos;
+      here.column = span.column + (pos - span.offset);
+      here.length = length;
+      return here;
+    }
+  };
+
+  uint32_t AddInt(RawScript::IntExpr expr) {
+    raw.ints.push_back(expr);
+    return (uint32_t)raw.ints.size() - 1;
+  }
+
+  uint32_t ScanSum(IntScanner &in) {
+    uint32_t lhs = ScanProduct(in);
+    while (lhs != NoInt) {
+      RawScript::IntExpr expr;
+      if (in.Take('+'))
+        expr.kind = RawScript::IntExpr::Add;
+      else if (in.Take('-'))
+        expr.kind = RawScript::IntExpr::Sub;
+      else
+        break;
+      uint32_t rhs = ScanProduct(in);
+      if (rhs == NoInt)
+        return NoInt;
+      expr.span = Join(raw.ints[lhs].span, raw.ints[rhs].span);
+      expr.lhs = lhs;
+      expr.rhs = rhs;
+      lhs = AddInt(expr);
+    }
+    return lhs;
+  }
+
+  uint32_t ScanProduct(IntScanner &in) {
+    uint32_t lhs = ScanUnary(in);
+    while (lhs != NoInt) {
+      RawScript::IntExpr expr;
+      if (in.Take('*'))
+        expr.kind = RawScript::IntExpr::Mul;
+      else if (in.Take('/'))
+        expr.kind = RawScript::IntExpr::Div;
+      else if (in.Take('%'))
+        expr.kind = RawScript::IntExpr::Mod;
+      else
+        break;
+      uint32_t rhs = ScanUnary(in);
+      if (rhs == NoInt)
+        return NoInt;
+      expr.span = Join(raw.ints[lhs].span, raw.ints[rhs].span);
+      expr.lhs = lhs;
+      expr.rhs = rhs;
+      lhs = AddInt(expr);
+    }
+    return lhs;
+  }
+
+  uint32_t ScanUnary(IntScanner &in) {
+    in.SkipBlanks();
+    SourceSpan start = in.Here();
+    if (in.Take('-')) {
+      uint32_t operand = ScanUnary(in);
+      if (operand == NoInt)
+        return NoInt;
+      RawScript::IntExpr expr;
+      expr.kind = RawScript::IntExpr::Negate;
+      expr.span = Join(start, raw.ints[operand].span);
+      expr.lhs = operand;
+      return AddInt(expr);
+    }
+    if (in.Take('(')) {
+      uint32_t inner = ScanSum(in);
+      if (inner != NoInt && !in.Take(')')) {
+        Error(in.Here(), "Expected ')'");
+        return NoInt;
+      }
+      return inner;
+    }
+
+    auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+    auto isWord = [&](char c) {
+      return isDigit(c) || c == '_' || (c >= 'a' && c <= 'z') ||
+             (c >= 'A' && c <= 'Z');
+    };
+    uint32_t begin = in.pos;
+    RawScript::IntExpr expr;
+    if (in.pos < in.End() && isDigit(in.source[in.pos])) {
+      while (in.pos < in.End() && isDigit(in.source[in.pos]))
+        in.pos++;
+      expr.kind = RawScript::IntExpr::Number;
+      std::from_chars(in.source.data() + begin, in.source.data() + in.pos,
+                      expr.value);
+    } else if (in.pos < in.End() && isWord(in.source[in.pos])) {
+      while (in.pos < in.End() && isWord(in.source[in.pos]))
+        in.pos++;
+      expr.kind = RawScript::IntExpr::Name;
+      expr.name = in.source.substr(begin, in.pos - begin);
+    } else {
+      Error(start, "Expected a number or parameter");
+      return NoInt;
+    }
+    expr.span = start;
+    expr.span.length = in.pos - begin;
+    return AddInt(expr);
+  }
+
+  // <expr, expr, ...> after a gate name
+  bool ParseIntArgs(uint32_t &first, uint32_t &count, Token *close) {
+    Advance(); // '<'
+    std::vector<uint32_t> values;
+    while (true) {
+      uint32_t value = ParseIntExpr("a parameter value");
+      if (value == NoInt)
+        return false;
+      values.push_back(value);
+      if (!At(TokenKind::Comma))
+        break;
+      Advance();
+    }
+    if (!Expect(TokenKind::Greater, "'>'", close))
+      return false;
+    first = (uint32_t)raw.intArgs.size();
+    count = (uint32_t)values.size();
+    raw.intArgs.insert(raw.intArgs.end(), values.begin(), values.end());
+    return true;
+  }
+
+  // <N, M> after a define name
+  bool ParseParamNames(RawScript::Define &define) {
+    define.firstParam = (uint32_t)raw.paramNames.size();
+    Advance(); // '<'
+    while (true) {
+      Token name;
+      if (!Expect(TokenKind::Identifier, "a parameter name", &name))
+        return false;
+      raw.paramNames.push_back(Text(name));
+      define.paramCount++;
+      if (!At(TokenKind::Comma))
+        break;
+      Advance();
+    }
+    return Expect(TokenKind::Greater, "'>'");
+  }
+
+  // (name, name[width], ...)
+  bool ParsePorts(uint32_t &first, uint32_t &count) {
+    first = (uint32_t)raw.ports.size();
+    count = 0;
+    if (!Expect(TokenKind::LParen, "'('"))
+      return false;
+    while (!At(TokenKind::RParen)) {
+      Token name;
+      if (!Expect(TokenKind::Identifier, "a pin name", &name))
+        return false;
+      RawScript::Port port;
+      port.name = Text(name);
+      if (At(TokenKind::LBracket)) {
+        Advance();
+        port.width = ParseIntExpr("a bus width");
+        if (port.width == NoInt || !Expect(TokenKind::RBracket, "']'"))
+          return false;
+      }
+      raw.ports.push_back(port);
+      count++;
+      if (!At(TokenKind::Comma))
+        break;
+      Advance();
+    }
+    return Expect(TokenKind::RParen, "')'");
+  }
+
+  // define Name<params>(in, ...) -> (out, ...):
+  //   signal = expression
+  //   for i = first to last:
+  //     signal[i] = expression
+  //   end
+  // end
+  void ParseDefine() {
+    RawScript::Define gate;
+    Token define = current;
+    Advance();
+
+    Token name;
+    bool header =
+        Expect(TokenKind::Identifier, "a gate name", &name) &&
+        (!At(TokenKind::Less) || ParseParamNames(gate)) &&
+        ParsePorts(gate.firstInput, gate.inputCount) &&
+        Expect(TokenKind::Arrow, "'->'") &&
+        ParsePorts(gate.firstOutput, gate.outputCount) &&
+        Expect(TokenKind::Colon, "':'") && ExpectLineEnd();
+    if (!header) {
+      gate.valid = false;
+      SkipLine();
+    }
+    gate.name = header ? Text(name) : std::string_view();
+    gate.span = Join(define.span, name.span.length ? name.span : define.span);
+
+    Token end = define;
+    if (!ParseBody(gate.firstStatement, gate.statementCount, gate.valid,
+                   &end)) {
+      Error(define.span, "Unclosed define block");
+      gate.valid = false;
+    }
+
+    // The block text runs from the start of the define line to the end of
+    // the "end" line, comments included
+    std::string_view source = lexer.Source();
+    size_t start = define.span.offset - (define.span.column - 1);
+    size_t stop = source.find('\n', end.span.offset);
+    if (stop == std::string_view::npos)
+      stop = source.size();
+    gate.text = source.substr(start, stop - start);
+    gate.sourceHash = HashTokens(gate.text);
+
+    raw.defines.push_back(gate);
+  }
+
+  // Statements up to and including the matching "end". Returns false, with
+  // 'end' at the offending token, if the script or a new define block
+  // comes first.
+  bool ParseBody(uint32_t &first, uint32_t &count, bool &valid, Token *end) {
+    std::vector<uint32_t> body;
+    bool closed = true;
+    while (true) {
+      while (At(TokenKind::Newline))
+        Advance();
+      if (At(TokenKind::EndOfFile) || AtWord("define")) {
+        *end = current;
+        closed = false;
+        break;
+      }
+      if (AtWord("end")) {
+        *end = current;
+        Advance();
+        if (!ExpectLineEnd())
+          SkipLine();
+        break;
+      }
+      bool ok = AtWord("for") ? ParseFor(body, valid)
+                              : ParseAssignment(body) && ExpectLineEnd();
+      if (!ok) {
+        valid = false;
+        SkipLine();
+      }
+    }
+    first = (uint32_t)raw.children.size();
+    count = (uint32_t)body.size();
+    raw.children.insert(raw.children.end(), body.begin(), body.end());
+    return closed;
+  }
+
+  // for i = first to last: ... end
+  bool ParseFor(std::vector<uint32_t> &body, bool &valid) {
+    RawScript::Statement loop;
+    loop.kind = RawScript::Statement::For;
+    Token keyword = current, var, colon;
+    Advance();
+    if (!Expect(TokenKind::Identifier, "a loop variable", &var) ||
+        !Expect(TokenKind::Equals, "'='") ||
+        (loop.from = ParseIntExpr("the first loop value")) == NoInt)
+      return false;
+    if (!AtWord("to")) {
+      Error(current.span, "Expected 'to', found " + Describe(current));
+      return false;
+    }
+    Advance();
+    if ((loop.to = ParseIntExpr("the last loop value")) == NoInt ||
+        !Expect(TokenKind::Colon, "':'", &colon) || !ExpectLineEnd())
+      return false;
+    loop.name = Text(var);
+    loop.span = Join(keyword.span, colon.span);
+
+    Token end;
+    if (!ParseBody(loop.firstChild, loop.childCount, valid, &end)) {
+      Error(keyword.span, "Unclosed for loop");
+      valid = false;
+    }
+    raw.statements.push_back(loop);
+    body.push_back((uint32_t)raw.statements.size() - 1);
+    return true;
+  }
+
+  // signal = expression, or signal[i] = expression
+  bool ParseAssignment(std::vector<uint32_t> &body) {
+    RawScript::Statement assignment;
+    assignment.kind = RawScript::Statement::Assign;
+    Token target;
+    if (!Expect(TokenKind::Identifier, "an assignment", &target))
+      return false;
+    if (At(TokenKind::LBracket)) {
+      Advance();
+      assignment.index = ParseIntExpr("a bit index");
+      if (assignment.index == NoInt || !Expect(TokenKind::RBracket, "']'"))
+        return false;
+    }
+    if (!Expect(TokenKind::Equals, "'='"))
+      return false;
+    uint32_t expr = ParseOr();
+    if (expr == InvalidExpr)
+      return false;
+    assignment.name = Text(target);
+    assignment.term = expr;
+    assignment.span = Join(target.span, raw.terms[expr].expr.span);
+    raw.statements.push_back(assignment);
+    body.push_back((uint32_t)raw.statements.size() - 1);
+    return true;
+  }
+
+  uint32_t AddExpr(RawScript::Term term) {
+    raw.terms.push_back(term);
+    return (uint32_t)raw.terms.size() - 1;
+  }
+
+  uint32_t AddBinary(ScriptAst::Expr::Kind kind, uint32_t lhs, uint32_t rhs) {
+    RawScript::Term term;
+    term.expr.kind = kind;
+    term.expr.span = Join(raw.terms[lhs].expr.span, raw.terms[rhs].expr.span);
+    term.expr.lhs = lhs;
+    term.expr.rhs = rhs;
+    return AddExpr(term);
+  }
+
+  // Parses one precedence level: operand { op operand }
+  template <typename Operand, typename Match>
+  uint32_t ParseBinary(Operand operand, Match match) {
+    uint32_t lhs = (this->*operand)();
+    ScriptAst::Expr::Kind kind;
+    while (lhs != InvalidExpr && match(kind)) {
+      Advance();
+      uint32_t rhs = (this->*operand)();
+      if (rhs == InvalidExpr)
+        return InvalidExpr;
+      lhs = AddBinary(kind, lhs, rhs);
+    }
+    return lhs;
+  }
+
+  uint32_t ParseOr() {
+    return ParseBinary(&Parser::ParseXor, [this](ScriptAst::Expr::Kind &kind) {
+      if (At(TokenKind::Or) || AtWord("OR"))
+        kind = ScriptAst::Expr::Or;
+      else if (AtWord("NOR"))
+        kind = ScriptAst::Expr::Nor;
+      else
+        return false;
+      return true;
+    });
+  }
+
+  uint32_t ParseXor() {
+    return ParseBinary(&Parser::ParseAnd, [this](ScriptAst::Expr::Kind &kind) {
+      if (At(TokenKind::Xor) || AtWord("XOR"))
+        kind = ScriptAst::Expr::Xor;
+      else if (AtWord("XNOR"))
+        kind = ScriptAst::Expr::Xnor;
+      else
+        return false;
+      return true;
+    });
+  }
+
+  uint32_t ParseAnd() {
+    return ParseBinary(&Parser::ParseUnary, [this](ScriptAst::Expr::Kind &kind) {
+      if (At(TokenKind::And) || AtWord("AND"))
+        kind = ScriptAst::Expr::And;
+      else if (AtWord("NAND"))
+        kind = ScriptAst::Expr::Nand;
+      else
+        return false;
+      return true;
+    });
+  }
+
+  uint32_t ParseUnary() {
+    if (!At(TokenKind::Not) && !AtWord("NOT"))
+      return ParsePrimary();
+
+    Token op = current;
+    Advance();
+    uint32_t operand = ParseUnary();
+    if (operand == InvalidExpr)
+      return InvalidExpr;
+    RawScript::Term term;
+    term.expr.kind = ScriptAst::Expr::Not;
+    term.expr.span = Join(op.span, raw.terms[operand].expr.span);
+    term.expr.lhs = operand;
+    return AddExpr(term);
+  }
+
+  uint32_t ParsePrimary() {
+    if (At(TokenKind::LParen)) {
+      Advance();
+      uint32_t inner = ParseOr();
+      if (inner == InvalidExpr || !Expect(TokenKind::RParen, "')'"))
+        return InvalidExpr;
+      return inner;
+    }
+
+    Token name;
+    if (!Expect(TokenKind::Identifier, "a signal or expression", &name))
+      return InvalidExpr;
+
+    RawScript::Term term;
+    ScriptAst::Expr &expr = term.expr;
+    expr.name = Text(name);
+    expr.span = name.span;
+    if (At(TokenKind::Less)) {
+      Token close;
+      if (!ParseIntArgs(term.firstParam, term.paramCount, &close))
+        return InvalidExpr;
+      if (!At(TokenKind::LParen)) {
+        Error(current.span,
+              "Expected '(' after the parameters of " + std::string(expr.name));
+        return InvalidExpr;
+      }
+    }
+    if (!At(TokenKind::LParen)) {
+      if (IsOperatorWord(expr.name)) {
+        Error(name.span, "'" + std::string(expr.name) +
+                             "' is an operator, not a signal");
+        return InvalidExpr;
+      }
+      expr.kind = ScriptAst::Expr::Signal;
+      if (At(TokenKind::LBracket)) {
+        Advance();
+        term.index = ParseIntExpr("a bit index");
+        Token close;
+        if (term.index == NoInt ||
+            !Expect(TokenKind::RBracket, "']'", &close))
+          return InvalidExpr;
+        expr.span = Join(name.span, close.span);
+      }
+      return AddExpr(term);
+    }
+
+    // Gate call; arguments may be full expressions, including other calls
+    Advance();
+    size_t stackBase = argStack.size();
+    while (!At(TokenKind::RParen)) {
+      uint32_t arg = ParseOr();
+      if (arg == InvalidExpr) {
+        argStack.resize(stackBase);
+        return InvalidExpr;
+      }
+      argStack.push_back(arg);
+      if (!At(TokenKind::Comma))
+        break;
+      Advance();
+    }
+    Token close;
+    if (!Expect(TokenKind::RParen, "')'", &close)) {
+      argStack.resize(stackBase);
+      return InvalidExpr;
+    }
+
+    expr.kind = ScriptAst::Expr::Call;
+    expr.span = Join(name.span, close.span);
+    expr.firstArg = (uint32_t)raw.termArgs.size();
+    expr.argCount = (uint32_t)(argStack.size() - stackBase);
+    raw.termArgs.insert(raw.termArgs.end(), argStack.begin() + stackBase,
+                        argStack.end());
+    argStack.resize(stackBase);
+    return AddExpr(term);
+  }
+};
+
+// Turns the raw define blocks into plain gates: parameters and loop
+// variables are substituted, loops unrolled and every distinct use of a
+// parameterized block, such as Adder<8>, becomes a gate of its own. An
+// instance is expanded just before the first block that calls it, so the
+// gates stay in build order.
+class Expander {
+public:
+  Expander(ScriptAst &ast, const RawScript &raw) : ast(ast), raw(raw) {}
+
+  void Run() {
+    // Later blocks replace earlier ones of the same name, like they do
+    // when registered
+    for (uint32_t i = 0; i < raw.defines.size(); ++i)
+      if (!raw.defines[i].name.empty())
+        byName[raw.defines[i].name] = i;
+
+    for (const auto &define : raw.defines) {
+      if (define.paramCount == 0) {
+        Expand(define, define.name, false);
+        continue;
+      }
+      ScriptAst::GateDecl gate;
+      gate.name = define.name;
+      gate.text = define.text;
+      gate.span = define.span;
+      gate.valid = define.valid;
+      gate.isTemplate = true;
+      gate.sourceHash = define.sourceHash;
+      ast.gates.push_back(gate);
+    }
+
+    inInstance = false;
+    for (const auto &use : raw.nodeUses) {
+      std::string_view type = Instantiate(use.gate, use.span, use.firstParam,
+                                          use.paramCount);
+      if (!type.empty())
+        ast.nodes[use.node].type = type;
+    }
+  }
+
+private:
+  using Scope = std::vector<std::pair<std::string_view, int>>;
+
+  ScriptAst &ast;
+  const RawScript &raw;
+  std::unordered_map<std::string_view, uint32_t> byName; // Into 'defines'
+  std::unordered_set<std::string_view> names;            // In 'generated'
+  std::unordered_set<std::string_view> instances; // Expanded or in progress
+  std::unordered_set<std::string_view> failed;    // Instances that didn't
+  Scope scope; // Parameters and loop variables, innermost last
+  std::string_view gateName; // Gate being expanded, for error messages
+  bool inInstance = false;
+  std::vector<std::string_view> *calls = nullptr; // Of the gate being expanded
+  int depth = 0;
+  uint64_t loopIterations = 0; // Of the gate being expanded
+
+  std::string_view Keep(std::string name) {
+    auto found = names.find(name);
+    if (found != names.end())
+      return *found;
+    ast.generated->push_back(std::move(name));
+    return *names.insert(ast.generated->back()).first;
+  }
+
+  void Error(const SourceSpan &span, std::string message) {
+    if (inInstance)
+      message = std::string(gateName) + ": " + message;
+    ast.errors.push_back({span, std::move(message)});
+  }
+
+  bool Evaluate(uint32_t index, int &out) {
+    const RawScript::IntExpr &expr = raw.ints[index];
+    if (expr.kind == RawScript::IntExpr::Number) {
+      out = expr.value;
+      return true;
+    }
+    if (expr.kind == RawScript::IntExpr::Name) {
+      for (auto it = scope.rbegin(); it != scope.rend(); ++it)
+        if (it->first == expr.name) {
+          out = it->second;
+          return true;
+        }
+      Error(expr.span, "Unknown parameter: " + std::string(expr.name));
+      return false;
+    }
+
+    int lhs = 0, rhs = 0;
+    if (!Evaluate(expr.lhs, lhs) ||
+        (expr.kind != RawScript::IntExpr::Negate && !Evaluate(expr.rhs, rhs)))
+      return false;
+    long long value = 0;
+    switch (expr.kind) {
+    case RawScript::IntExpr::Add:
+      value = (long long)lhs + rhs;
+      break;
+    case RawScript::IntExpr::Sub:
+      value = (long long)lhs - rhs;
+      break;
+    case RawScript::IntExpr::Mul:
+      value = (long long)lhs * rhs;
+      break;
+    case RawScript::IntExpr::Negate:
+      value = -(long long)lhs;
+      break;
+    default: // Div, Mod
+      if (rhs == 0) {
+        Error(expr.span, "Division by zero");
+        return false;
+      }
+      value = expr.kind == RawScript::IntExpr::Div ? (long long)lhs / rhs
+                                                   : (long long)lhs % rhs;
+      break;
+    }
+    if (value < INT32_MIN || value > INT32_MAX) {
+      Error(expr.span, "Value out of range");
+      return false;
+    }
+    out = (int)value;
+    return true;
+  }
+
+  // Canonical name of Gate<args>, expanding the instance on first use.
+  // Names of gates that aren't parameterized blocks of this script are
+  // passed through, since the gate library may provide them.
+  std::string_view Instantiate(std::string_view gate, const SourceSpan &span,
+                               uint32_t firstParam, uint32_t paramCount) {
+    std::vector<int> values(paramCount);
+    std::string name = std::string(gate) + "<";
+    for (uint32_t i = 0; i < paramCount; ++i) {
+      if (!Evaluate(raw.intArgs[firstParam + i], values[i]))
+        return std::string_view();
+      name += (i ? "," : "") + std::to_string(values[i]);
+    }
+    name += ">";
+    std::string_view kept = Keep(std::move(name));
+
+    auto found = byName.find(gate);
+    if (found == byName.end())
+      return kept;
+    const RawScript::Define &define = raw.defines[found->second];
+    if (define.paramCount != paramCount) {
+      Error(span, std::string(gate) + " takes " +
+                      std::to_string(define.paramCount) + " parameter" +
+                      (define.paramCount == 1 ? "" : "s"));
+      return kept;
+    }
+    if (failed.count(kept))
+      return std::string_view();
+    if (!instances.insert(kept).second)
+      return kept; // Already expanded, or it calls itself and fails to build
+    if (depth >= MaxInstanceDepth) {
+      Error(span, "Instances of " + std::string(gate) + " nest too deeply");
+      failed.insert(kept);
+      return std::string_view();
+    }
+
+    // Instances start from a scope of their own parameters
+    Scope outer;
+    outer.swap(scope);
+    for (uint32_t i = 0; i < paramCount; ++i)
+      scope.emplace_back(raw.paramNames[define.firstParam + i], values[i]);
+    std::string_view outerName = gateName;
+    bool outerInstance = inInstance;
+    ++depth;
+    bool expanded = Expand(define, kept, true);
+    --depth;
+    gateName = outerName;
+    inInstance = outerInstance;
+    scope.swap(outer);
+    if (!expanded) {
+      // Its errors are reported; callers fail without adding their own
+      failed.insert(kept);
+      return std::string_view();
+    }
+    return kept;
+  }
+
+  // Returns false if the gate is invalid
+  bool Expand(const RawScript::Define &define, std::string_view name,
+              bool isInstance) {
+    ScriptAst::GateDecl gate;
+    gate.name = name;
+    gate.text = define.text;
+    gate.span = define.span;
+    gate.valid = define.valid; // Syntax errors were already reported
+    gate.isInstance = isInstance;
+    gate.sourceHash = isInstance ? HashBytes(name, define.sourceHash)
+                                 : define.sourceHash;
+    gateName = name;
+    inInstance = isInstance;
+    std::vector<std::string_view> gateCalls;
+    std::vector<std::string_view> *outerCalls = calls;
+    calls = &gateCalls;
+    uint64_t outerIterations = loopIterations;
+    loopIterations = 0;
+
+    // Called instances are pushed while the body expands, so this gate's
+    // own ports and assignments are collected first and appended at the end
+    std::vector<ScriptAst::Port> ports;
+    std::vector<ScriptAst::Assignment> assignments;
+    if (gate.valid) {
+      uint32_t portCount = define.inputCount + define.outputCount;
+      for (uint32_t i = 0; i < portCount && gate.valid; ++i) {
+        const RawScript::Port &declared =
+            raw.ports[i < define.inputCount
+                          ? define.firstInput + i
+                          : define.firstOutput + i - define.inputCount];
+        ScriptAst::Port port;
+        port.name = declared.name;
+        if (declared.width != NoInt) {
+          port.bus = true;
+          gate.valid = Evaluate(declared.width, port.width);
+          if (gate.valid && (port.width < 1 || port.width > 64)) {
+            Error(raw.ints[declared.width].span,
+                  "Buses are 1 to 64 bits wide");
+            gate.valid = false;
+          }
+        }
+        ports.push_back(port);
+      }
+      gate.valid = gate.valid &&
+                   ExpandBody(define.firstStatement, define.statementCount,
+                              assignments);
+    }
+
+    gate.firstInput = (uint32_t)ast.ports.size();
+    gate.inputCount = gate.valid ? define.inputCount : 0;
+    gate.firstOutput = gate.firstInput + gate.inputCount;
+    gate.outputCount = gate.valid ? define.outputCount : 0;
+    if (gate.valid)
+      ast.ports.insert(ast.ports.end(), ports.begin(), ports.end());
+    gate.firstAssignment = (uint32_t)ast.assignments.size();
+    gate.assignmentCount = (uint32_t)assignments.size();
+    ast.assignments.insert(ast.assignments.end(), assignments.begin(),
+                           assignments.end());
+    std::sort(gateCalls.begin(), gateCalls.end());
+    gateCalls.erase(std::unique(gateCalls.begin(), gateCalls.end()),
+                    gateCalls.end());
+    gate.firstCall = (uint32_t)ast.calls.size();
+    gate.callCount = (uint32_t)gateCalls.size();
+    ast.calls.insert(ast.calls.end(), gateCalls.begin(), gateCalls.end());
+    calls = outerCalls;
+    loopIterations = outerIterations;
+    ast.gates.push_back(gate);
+    return gate.valid;
+  }
+
+  bool ExpandBody(uint32_t first, uint32_t count,
+                  std::vector<ScriptAst::Assignment> &out) {
+    for (uint32_t i = 0; i < count; ++i) {
+      const RawScript::Statement &statement =
+          raw.statements[raw.children[first + i]];
+      if (statement.kind == RawScript::Statement::Assign) {
+        std::string_view target =
+            SignalName(statement.name, statement.index);
+        if (target.empty())
+          return false;
+        uint32_t expr = ExpandExpr(statement.term);
+        if (expr == InvalidExpr)
+          return false;
+        if (out.size() >= MaxExpandedAssignments) {
+          Error(statement.span, "Define block expands to too many signals");
+          return false;
+        }
+        out.push_back({target, expr, statement.span});
+        continue;
+      }
+
+      int from = 0, to = 0;
+      if (!Evaluate(statement.from, from) || !Evaluate(statement.to, to))
+        return false;
+      for (const auto &entry : scope)
+        if (entry.first == statement.name) {
+          Error(statement.span,
+                std::string(statement.name) + " is already defined");
+          return false;
+        }
+      bool ok = true;
+      // 64-bit so that a loop up to INT_MAX ends
+      for (int64_t value = from; value <= to && ok; ++value) {
+        if (++loopIterations > MaxLoopIterations) {
+          Error(statement.span, "Define block loops too many times");
+          return false;
+        }
+        scope.emplace_back(statement.name, (int)value);
+        ok = ExpandBody(statement.firstChild, statement.childCount, out);
+        scope.pop_back();
+      }
+      if (!ok)
+        return false;
+    }
+    return true;
+  }
+
+  // "name" or, for a bit of a bus, "name[i]"
+  std::string_view SignalName(std::string_view name, uint32_t index) {
+    if (index == NoInt)
+      return name;
+    int bit = 0;
+    if (!Evaluate(index, bit))
+      return std::string_view();
+    if (bit < 0) {
+      Error(raw.ints[index].span, "Bit index " + std::to_string(bit) +
+                                      " is out of range");
+      return std::string_view();
+    }
+    return Keep(std::string(name) + "[" + std::to_string(bit) + "]");
+  }
+
+  uint32_t ExpandExpr(uint32_t index) {
+    const RawScript::Term &term = raw.terms[index];
+    ScriptAst::Expr expr = term.expr;
+    switch (expr.kind) {
+    case ScriptAst::Expr::Signal:
+      expr.name = SignalName(expr.name, term.index);
+      if (expr.name.empty())
+        return InvalidExpr;
+      break;
+    case ScriptAst::Expr::Not:
+      expr.lhs = ExpandExpr(expr.lhs);
+      if (expr.lhs == InvalidExpr)
+        return InvalidExpr;
+      break;
+    case ScriptAst::Expr::Call: {
+      auto found = byName.find(expr.name);
+      if (term.paramCount > 0) {
+        expr.name = Instantiate(expr.name, expr.span, term.firstParam,
+                                term.paramCount);
+        if (expr.name.empty())
+          return InvalidExpr;
+      } else if (found != byName.end() &&
+                 raw.defines[found->second].paramCount > 0) {
+        Error(expr.span, std::string(expr.name) +
+                             " needs parameters, as in " +
+                             std::string(expr.name) + "<...>(...)");
+        return InvalidExpr;
+      }
+      calls->push_back(expr.name);
+      std::vector<uint32_t> args;
+      for (uint32_t i = 0; i < expr.argCount; ++i) {
+        uint32_t arg = ExpandExpr(raw.termArgs[expr.firstArg + i]);
+        if (arg == InvalidExpr)
+          return InvalidExpr;
+        args.push_back(arg);
+      }
+      expr.firstArg = (uint32_t)ast.args.size();
+      ast.args.insert(ast.args.end(), args.begin(), args.end());
+      break;
+    }
+    default:
+      expr.lhs = ExpandExpr(expr.lhs);
+      expr.rhs = expr.lhs == InvalidExpr ? InvalidExpr : ExpandExpr(expr.rhs);
+      if (expr.rhs == InvalidExpr)
+        return InvalidExpr;
+      break;
+    }
+    ast.exprs.push_back(expr);
+    return (uint32_t)ast.exprs.size() - 1;
+  }
+};
+} // namespace
+
+ScriptAst ParseScript(std::string source) {
+  ScriptAst ast;
+  ast.source = std::make_shared<const std::string>(std::move(source));
+  ast.generated = std::make_shared<std::deque<std::string>>();
+  RawScript raw;
+  Parser(ast, raw).ParseAll();
+  Expander(ast, raw).Run();
+  return ast;
+}
+} // namespace Billyprints
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ScriptLexer.hpp"
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Billyprints {
+// Syntax tree of a scene script. Names are views into 'source' and child
+// links are indices into the flat arrays, so a parse costs a handful of
+// vector growths rather than an allocation per token. The source is held by
+// pointer so the views survive moving the tree around.
+//
+// Parameterized define blocks and for loops are expanded while parsing, so
+// the tree only holds plain gates. Names made up by the expansion, such as
+// "Adder<8>" or "s[3]", live in 'generated'.
+struct ScriptAst {
+  struct Expr {
+    enum Kind : uint8_t { Signal, Not, And, Or, Xor, Nand, Nor, Xnor, Call };
+    Kind kind;
+    SourceSpan span;
+    std::string_view name; // Signal name or called gate
+    uint32_t lhs = 0;      // Operand of Not, left operand of binary operators
+    uint32_t rhs = 0;      // Right operand of binary operators
+    uint32_t firstArg = 0; // Call arguments, in 'args'
+    uint32_t argCount = 0;
+  };
+  struct Assignment {
+    std::string_view target;
+    uint32_t expr; // Index into 'exprs'
+    SourceSpan span;
+  };
+  struct Port {
+    std::string_view name;
+    int width = 1;
+    bool bus = false; // Declared as name[width]; its bits are name[i]
+  };
+  struct GateDecl {
+    std::string_view name;
+    std::string_view text; // Whole block, "define" through "end"
+    SourceSpan span;
+    uint32_t firstInput = 0, inputCount = 0;   // In 'ports'
+    uint32_t firstOutput = 0, outputCount = 0; // In 'ports'
+    uint32_t firstAssignment = 0, assignmentCount = 0;
+    bool valid = true; // False if the block had syntax errors
+    // A block with parameters is only kept for its text; each distinct use
+    // such as Adder<8> follows as an instance named after it
+    bool isTemplate = false;
+    bool isInstance = false;
+    // Hash of the block's tokens, so layout and comments don't count.
+    // Instances also hash their name.
+    uint64_t sourceHash = 0;
+    uint32_t firstCall = 0, callCount = 0; // Gates it calls, in 'calls'
+  };
+  struct NodeDecl {
+    std::string_view type;
+    std::string_view id;
+    int x = 0, y = 0;
+    int width = 1; // From a bus range "[N-1:0]" after the id
+    bool momentary = false;
+    SourceSpan span;
+  };
+  struct WireDecl {
+    std::string_view outputNode, outputSlot; // Slot defaults to "out"
+    std::string_view inputNode, inputSlot;   // Slot defaults to "in"
+    SourceSpan span;
+  };
+  struct Error {
+    SourceSpan span;
+    std::string message;
+  };
+
+  std::shared_ptr<const std::string> source;
+  std::vector<GateDecl> gates;
+  std::vector<Port> ports;
+  std::vector<Assignment> assignments;
+  std::vector<Expr> exprs;
+  std::vector<uint32_t> args;
+  std::vector<std::string_view> calls; // Sorted and distinct per gate
+  std::vector<NodeDecl> nodes;
+  std::vector<WireDecl> wires;
+  std::vector<Error> errors;
+  std::shared_ptr<std::deque<std::string>> generated;
+};
+
+// 64-bit FNV-1a, used to key define blocks by their content
+inline uint64_t HashBytes(std::string_view bytes,
+                          uint64_t hash = 14695981039346656037ull) {
+  for (char c : bytes) {
+    hash ^= (unsigned char)c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+inline uint64_t HashCombine(uint64_t hash, uint64_t value) {
+  return HashBytes(std::string_view((const char *)&value, sizeof(value)),
+                   hash);
+}
+
+// Parses a whole script. Errors are collected per statement and parsing
+// resumes on the next line, so one bad line doesn't hide the rest.
+ScriptAst ParseScript(std::string source);
+} // namespace Billyprints
@@ -0,0 +1,164 @@
+#include "ScriptWorker.hpp"
+#include <algorithm>
+#include <iterator>
+
+namespace Billyprints {
+
+ParsedScript ParseSceneScript(std::string text) {
+  ParsedScript parsed;
+  parsed.ast = ParseScript(std::move(text));
+  const ScriptAst &ast = parsed.ast;
+  SceneDescription &scene = parsed.scene;
+
+  scene.nodes.reserve(ast.nodes.size());
+  for (const auto &node : ast.nodes) {
+    SceneDescription::NodeDecl decl;
+    decl.type = std::string(node.type);
+    decl.id = std::string(node.id);
+    decl.pos = ImVec2((float)node.x, (float)node.y);
+    decl.width = node.width;
+    decl.momentary = node.momentary && decl.type == "In";
+    decl.line = (int)node.span.line;
+    scene.nodes.push_back(std::move(decl));
+  }
+
+  scene.wires.reserve(ast.wires.size());
+  for (const auto &wire : ast.wires)
+    scene.wires.push_back(
+        {std::string(wire.outputNode), std::string(wire.outputSlot),
+         std::string(wire.inputNode), std::string(wire.inputSlot),
+         (int)wire.span.line});
+  return parsed;
+}
+
+void ScriptWorker::SetText(const std::string &text) {
+  std::vector<std::string> split;
+  SplitLines(text, split);
+  std::lock_guard<std::mutex> lock(mutex);
+  lines.swap(split);
+}
+
+void ScriptWorker::Submit(const std::string &text) {
+  std::vector<std::string> split;
+  SplitLines(text, split);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    lines.swap(split);
+    Queue();
+  }
+  wakeup.notify_one();
+}
+
+void ScriptWorker::SubmitEdit(const ScriptEditor::LineChange &change,
+                              std::vector<std::string> inserted) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t first = std::min((size_t)change.first, lines.size());
+    size_t removed = std::min((size_t)change.removed, lines.size() - first);
+    size_t common = std::min(removed, inserted.size());
+    for (size_t i = 0; i < common; ++i)
+      lines[first + i].swap(inserted[i]);
+    if (removed > common)
+      lines.erase(lines.begin() + first + common,
+                  lines.begin() + first + removed);
+    else
+      lines.insert(lines.begin() + first + common,
+                   std::make_move_iterator(inserted.begin() + common),
+                   std::make_move_iterator(inserted.end()));
+    Queue();
+  }
+  wakeup.notify_one();
+}
+
+void ScriptWorker::Queue() {
+  hasQueued = true;
+  queuedAt = Clock::now();
+  ++generation;
+  hasResult = false;
+  if (!thread.joinable()) {
+    stopping = false;
+    thread = std::thread(&ScriptWorker::Run, this);
+  }
+}
+
+void ScriptWorker::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex);
+  hasQueued = false;
+  ++generation;
+  hasResult = false;
+  result = ParsedScript();
+}
+
+bool ScriptWorker::TakeResult(ParsedScript &out) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!hasResult)
+    return false;
+  out = std::move(result);
+  result = ParsedScript();
+  hasResult = false;
+  return true;
+}
+
+bool ScriptWorker::Pending() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  // A parse that was superseded no longer counts
+  return hasQueued || hasResult ||
+         (parsing && parsingGeneration == generation);
+}
+
+void ScriptWorker::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeup.notify_one();
+  if (thread.joinable())
+    thread.join();
+}
+
+void ScriptWorker::Run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wakeup.wait(lock, [this] { return stopping || hasQueued; });
+    if (stopping)
+      return;
+
+    // Every Submit() pushes the deadline back
+    Clock::time_point deadline = queuedAt + DebounceDelay;
+    if (Clock::now() < deadline) {
+      wakeup.wait_until(lock, deadline);
+      continue;
+    }
+
+    // Joined as ScriptEditor::GetText() does
+    size_t total = 0;
+    for (const auto &line : lines)
+      total += line.size() + 1;
+    std::string text;
+    text.reserve(total);
+    for (size_t i = 0; i < lines.size(); ++i) {
+      if (i > 0)
+        text += '\n';
+      text += lines[i];
+    }
+    hasQueued = false;
+    parsingGeneration = generation;
+    parsing = true;
+    lock.unlock();
+    ParsedScript parsed = ParseSceneScript(std::move(text));
+    lock.lock();
+    parsing = false;
+
+    // Superseded or cancelled while parsing
+    if (parsingGeneration != generation)
+      continue;
+    result = std::move(parsed);
+    hasResult = true;
+    if (readyCallback) {
+      lock.unlock();
+      readyCallback();
+      lock.lock();
+    }
+  }
+}
+} // namespace Billyprints
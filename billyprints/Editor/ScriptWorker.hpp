@@ -0,0 +1,79 @@
+#pragma once
+
+#include "SceneDescription.hpp"
+#include "ScriptEditor.hpp"
+#include "ScriptParser.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Billyprints {
+// A script parsed up to the point where it needs the live editor. Define
+// blocks are left in the tree because building them registers gates, which
+// only the UI thread may do.
+struct ParsedScript {
+  ScriptAst ast;
+  SceneDescription scene;
+};
+
+// Parses and validates a script and describes the scene it declares. Safe
+// to call from any thread.
+ParsedScript ParseSceneScript(std::string text);
+
+// Parses the scene script on a background thread. Text is only parsed once
+// no newer text was submitted for DebounceDelay, so typing never queues up
+// parses, and a result is dropped when newer text arrives before it is
+// taken. The worker keeps its own copy of the text as lines, so a keystroke
+// only hands over the lines it changed and the text is joined here, once
+// per parse. The thread is started by the first submission.
+class ScriptWorker {
+public:
+  static constexpr std::chrono::milliseconds DebounceDelay{150};
+
+  ~ScriptWorker() { Stop(); }
+
+  // Called on the worker thread whenever a result becomes ready
+  void SetReadyCallback(std::function<void()> callback) {
+    readyCallback = std::move(callback);
+  }
+
+  // Replaces the text later edits apply to, without parsing it
+  void SetText(const std::string &text);
+  // Replaces the text and queues it, replacing anything not yet parsed
+  void Submit(const std::string &text);
+  // Applies an edit of the text, as reported by ScriptEditor, and queues
+  // the result. 'inserted' holds the new lines of the range.
+  void SubmitEdit(const ScriptEditor::LineChange &change,
+                  std::vector<std::string> inserted);
+  // Drops queued text and any parse in flight. The text is kept for later
+  // edits.
+  void Cancel();
+  // Moves the latest result into 'out'. Returns false if none is ready.
+  bool TakeResult(ParsedScript &out);
+  // True from Submit() until its result is taken or cancelled
+  bool Pending() const;
+  void Stop();
+
+private:
+  using Clock = std::chrono::steady_clock;
+  void Queue(); // Called with 'mutex' held
+  void Run();
+
+  mutable std::mutex mutex;
+  std::condition_variable wakeup;
+  std::thread thread;
+  std::function<void()> readyCallback;
+
+  std::vector<std::string> lines{std::string()}; // Latest text
+  bool hasQueued = false;
+  Clock::time_point queuedAt;
+  uint64_t generation = 0; // Bumped by Submit() and Cancel()
+  bool parsing = false;
+  uint64_t parsingGeneration = 0; // Generation of the text being parsed
+  ParsedScript result;
+  bool hasResult = false;
+  bool stopping = false;
+};
+} // namespace Billyprints
@@ -0,0 +1,168 @@
+#include "SpatialIndex.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace Billyprints {
+SpatialIndex::SpatialIndex(float _cellSize) : cellSize(_cellSize) {}
+
+void SpatialIndex::Clear() {
+  entries.clear();
+  cells.clear();
+  oversizedItems.clear();
+  nextOrder = 0;
+}
+
+SpatialIndex::CellRange SpatialIndex::CellsFor(const ImRect &bounds) const {
+  return {(int)std::floor(bounds.Min.x / cellSize),
+          (int)std::floor(bounds.Min.y / cellSize),
+          (int)std::floor(bounds.Max.x / cellSize),
+          (int)std::floor(bounds.Max.y / cellSize)};
+}
+
+uint64_t SpatialIndex::CellKey(int x, int y) {
+  return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+void SpatialIndex::Link(Node *item, const Entry &entry) {
+  if (entry.oversized) {
+    oversizedItems.push_back(item);
+    return;
+  }
+  for (int y = entry.cells.minY; y <= entry.cells.maxY; ++y)
+    for (int x = entry.cells.minX; x <= entry.cells.maxX; ++x)
+      cells[CellKey(x, y)].push_back(item);
+}
+
+void SpatialIndex::Unlink(Node *item, const Entry &entry) {
+  auto eraseFrom = [item](std::vector<Node *> &list) {
+    auto it = std::find(list.begin(), list.end(), item);
+    if (it != list.end()) {
+      *it = list.back();
+      list.pop_back();
+    }
+  };
+
+  if (entry.oversized) {
+    eraseFrom(oversizedItems);
+    return;
+  }
+  for (int y = entry.cells.minY; y <= entry.cells.maxY; ++y) {
+    for (int x = entry.cells.minX; x <= entry.cells.maxX; ++x) {
+      auto cell = cells.find(CellKey(x, y));
+      if (cell == cells.end())
+        continue;
+      eraseFrom(cell->second);
+      if (cell->second.empty())
+        cells.erase(cell);
+    }
+  }
+}
+
+void SpatialIndex::Insert(Node *item, const ImRect &bounds) {
+  if (entries.count(item)) {
+    Update(item, bounds);
+    return;
+  }
+
+  Entry entry;
+  entry.bounds = bounds;
+  entry.cells = CellsFor(bounds);
+  int64_t spanX = (int64_t)entry.cells.maxX - entry.cells.minX + 1;
+  int64_t spanY = (int64_t)entry.cells.maxY - entry.cells.minY + 1;
+  entry.oversized = spanX * spanY > MaxCellsPerItem;
+  entry.order = nextOrder++;
+  entry.queryStamp = 0;
+
+  Link(item, entry);
+  entries.emplace(item, entry);
+}
+
+void SpatialIndex::Update(Node *item, const ImRect &bounds) {
+  auto it = entries.find(item);
+  if (it == entries.end()) {
+    Insert(item, bounds);
+    return;
+  }
+
+  Entry &entry = it->second;
+  entry.bounds = bounds;
+  CellRange range = CellsFor(bounds);
+  if (range == entry.cells)
+    return;
+
+  Unlink(item, entry);
+  entry.cells = range;
+  int64_t spanX = (int64_t)range.maxX - range.minX + 1;
+  int64_t spanY = (int64_t)range.maxY - range.minY + 1;
+  entry.oversized = spanX * spanY > MaxCellsPerItem;
+  Link(item, entry);
+}
+
+void SpatialIndex::Remove(Node *item) {
+  auto it = entries.find(item);
+  if (it == entries.end())
+    return;
+  Unlink(item, it->second);
+  entries.erase(it);
+}
+
+bool SpatialIndex::Contains(Node *item) const {
+  return entries.count(item) != 0;
+}
+
+const ImRect *SpatialIndex::GetBounds(Node *item) const {
+  auto it = entries.find(item);
+  return it == entries.end() ? nullptr : &it->second.bounds;
+}
+
+void SpatialIndex::Query(const ImRect &area, std::vector<Node *> &out) const {
+  if (++queryStamp == 0) {
+    // Stamp wrapped around; reset so stale stamps can't match.
+    for (auto &kv : entries)
+      kv.second.queryStamp = 0;
+    queryStamp = 1;
+  }
+
+  size_t first = out.size();
+  auto consider = [&](Node *item) {
+    const Entry &entry = entries.find(item)->second;
+    if (entry.queryStamp == queryStamp)
+      return;
+    entry.queryStamp = queryStamp;
+    if (entry.bounds.Overlaps(area))
+      out.push_back(item);
+  };
+
+  CellRange range = CellsFor(area);
+  int64_t cellCount = ((int64_t)range.maxX - range.minX + 1) *
+                      ((int64_t)range.maxY - range.minY + 1);
+  if (cellCount > (int64_t)cells.size()) {
+    // Area covers more cells than are occupied; walk the occupied ones.
+    for (const auto &cell : cells) {
+      int x = (int)(int32_t)(cell.first >> 32);
+      int y = (int)(int32_t)(uint32_t)cell.first;
+      if (x < range.minX || x > range.maxX || y < range.minY ||
+          y > range.maxY)
+        continue;
+      for (Node *item : cell.second)
+        consider(item);
+    }
+    range = {0, 0, -1, -1};
+  }
+  for (int y = range.minY; y <= range.maxY; ++y) {
+    for (int x = range.minX; x <= range.maxX; ++x) {
+      auto cell = cells.find(CellKey(x, y));
+      if (cell == cells.end())
+        continue;
+      for (Node *item : cell->second)
+        consider(item);
+    }
+  }
+  for (Node *item : oversizedItems)
+    consider(item);
+
+  std::sort(out.begin() + first, out.end(), [this](Node *a, Node *b) {
+    return entries.find(a)->second.order < entries.find(b)->second.order;
+  });
+}
+} // namespace Billyprints
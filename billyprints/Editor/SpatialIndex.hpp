@@ -0,0 +1,61 @@
+#pragma once
+
+#include "pch.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Billyprints {
+class Node;
+
+// Uniform grid over canvas-space rectangles. Items are keyed by node pointer
+// and can be moved cheaply; re-bucketing only happens when the set of covered
+// cells changes. Query() returns items in insertion order so callers can keep
+// drawing back to front.
+class SpatialIndex {
+public:
+  explicit SpatialIndex(float cellSize = 256.0f);
+
+  void Clear();
+  void Insert(Node *item, const ImRect &bounds);
+  void Update(Node *item, const ImRect &bounds); // Inserts if missing
+  void Remove(Node *item);
+  bool Contains(Node *item) const;
+  const ImRect *GetBounds(Node *item) const;
+  size_t Size() const { return entries.size(); }
+
+  // Appends every item whose bounds overlap 'area' to 'out'.
+  void Query(const ImRect &area, std::vector<Node *> &out) const;
+
+private:
+  struct CellRange {
+    int minX, minY, maxX, maxY;
+    bool operator==(const CellRange &o) const {
+      return minX == o.minX && minY == o.minY && maxX == o.maxX &&
+             maxY == o.maxY;
+    }
+  };
+  struct Entry {
+    ImRect bounds;
+    CellRange cells;
+    bool oversized; // Spans too many cells, kept in 'oversizedItems' instead
+    uint64_t order;
+    mutable uint32_t queryStamp;
+  };
+
+  // Items covering more cells than this skip the grid entirely.
+  static constexpr int MaxCellsPerItem = 64;
+
+  float cellSize;
+  uint64_t nextOrder = 0;
+  mutable uint32_t queryStamp = 0;
+  std::unordered_map<Node *, Entry> entries;
+  std::unordered_map<uint64_t, std::vector<Node *>> cells;
+  std::vector<Node *> oversizedItems;
+
+  CellRange CellsFor(const ImRect &bounds) const;
+  static uint64_t CellKey(int x, int y);
+  void Link(Node *item, const Entry &entry);
+  void Unlink(Node *item, const Entry &entry);
+};
+} // namespace Billyprints
@@ -0,0 +1,369 @@
+#include "VerilogFile.hpp"
+#include "BinaryIO.hpp"
+#include <algorithm>
+#include <unordered_set>
+
+namespace Billyprints {
+
+namespace {
+constexpr uint32_t None = UINT32_MAX;
+
+bool IsKeyword(const std::string &name) {
+  static const std::unordered_set<std::string> keywords{
+      "always",     "and",        "assign",       "automatic",
+      "begin",      "buf",        "bufif0",       "bufif1",
+      "case",       "casex",      "casez",        "cell",
+      "cmos",       "config",     "deassign",     "default",
+      "defparam",   "design",     "disable",      "edge",
+      "else",       "end",        "endcase",      "endconfig",
+      "endfunction", "endgenerate", "endmodule",  "endprimitive",
+      "endspecify", "endtable",   "endtask",      "event",
+      "for",        "force",      "forever",      "fork",
+      "function",   "generate",   "genvar",       "highz0",
+      "highz1",     "if",         "ifnone",       "incdir",
+      "include",    "initial",    "inout",        "input",
+      "instance",   "integer",    "join",         "large",
+      "liblist",    "library",    "localparam",   "macromodule",
+      "medium",     "module",     "nand",         "negedge",
+      "nmos",       "nor",        "noshowcancelled", "not",
+      "notif0",     "notif1",     "or",           "output",
+      "parameter",  "pmos",       "posedge",      "primitive",
+      "pull0",      "pull1",      "pulldown",     "pullup",
+      "pulsestyle_onevent", "pulsestyle_ondetect", "rcmos", "real",
+      "realtime",   "reg",        "release",      "repeat",
+      "rnmos",      "rpmos",      "rtran",        "rtranif0",
+      "rtranif1",   "scalared",   "showcancelled", "signed",
+      "small",      "specify",    "specparam",    "strong0",
+      "strong1",    "supply0",    "supply1",      "table",
+      "task",       "time",       "tran",         "tranif0",
+      "tranif1",    "tri",        "tri0",         "tri1",
+      "triand",     "trior",      "trireg",       "unsigned",
+      "use",        "vectored",   "wait",         "wand",
+      "weak0",      "weak1",      "while",        "wire",
+      "wor",        "xnor",       "xor"};
+  return keywords.count(name) != 0;
+}
+
+// Hands out distinct Verilog identifiers. Names are kept where they are
+// legal; other characters become '_', and a clash gets a numeric suffix.
+class Identifiers {
+public:
+  std::string Claim(const std::string &wanted) {
+    std::string name;
+    for (char c : wanted)
+      name += isalnum((unsigned char)c) || c == '_' || c == '$' ? c : '_';
+    if (name.empty() || isdigit((unsigned char)name[0]) || name[0] == '$')
+      name.insert(name.begin(), '_');
+    if (IsKeyword(name))
+      name += '_';
+    std::string unique = name;
+    for (int n = 2; !used.insert(unique).second; ++n)
+      unique = name + "_" + std::to_string(n);
+    return unique;
+  }
+
+private:
+  std::unordered_set<std::string> used;
+};
+
+std::string Zero(int width) { return std::to_string(width) + "'b0"; }
+
+std::string Range(int width) {
+  return width > 1 ? "[" + std::to_string(width - 1) + ":0] " : "";
+}
+
+// The pin's own name, or its slot name on a CustomGate
+std::string PinName(const std::vector<std::string> &names, const char *prefix,
+                    size_t pin, size_t pins) {
+  if (pin < names.size() && !names[pin].empty())
+    return names[pin];
+  return pins > 1 ? prefix + std::to_string(pin) : prefix;
+}
+
+// A module's ports, in slot order
+struct Ports {
+  std::vector<std::string> inputs, outputs;
+};
+
+class ModuleWriter {
+public:
+  ModuleWriter(const VerilogDesign &design,
+               const std::vector<std::string> &moduleNames,
+               const std::vector<Ports> &gatePorts, std::string &out)
+      : design(design), moduleNames(moduleNames), gatePorts(gatePorts),
+        out(out) {}
+
+  void Write(const GateDefinition &def, const std::string &moduleName,
+             const Ports &ports) {
+    const uint32_t count = (uint32_t)def.nodes.size();
+    current = &def;
+
+    // Port names of the pin nodes
+    std::vector<const std::string *> pins(count, nullptr);
+    for (size_t pin = 0; pin < def.inputPinIndices.size(); ++pin)
+      if (def.inputPinIndices[pin] < count)
+        pins[def.inputPinIndices[pin]] = &ports.inputs[pin];
+    for (size_t pin = 0; pin < def.outputPinIndices.size(); ++pin)
+      if (def.outputPinIndices[pin] < count)
+        pins[def.outputPinIndices[pin]] = &ports.outputs[pin];
+
+    // The first wire into a slot drives it
+    inputs.assign(count, {});
+    for (const auto &conn : def.connections) {
+      if (conn.inputNodeId >= count || conn.outputNodeId >= count)
+        continue;
+      auto &slots = inputs[conn.inputNodeId];
+      if (slots.size() <= conn.inputSlot)
+        slots.resize(conn.inputSlot + 1);
+      if (slots[conn.inputSlot].node == None)
+        slots[conn.inputSlot] = {conn.outputNodeId, conn.outputSlot};
+    }
+
+    // Signals carried by each node's output slots
+    Identifiers names;
+    for (const auto &port : ports.inputs)
+      names.Claim(port);
+    for (const auto &port : ports.outputs)
+      names.Claim(port);
+    signals.assign(count, {});
+    std::string wires, body;
+    for (uint32_t i = 0; i < count; ++i) {
+      const NodeDefinition &nd = def.nodes[i];
+      auto &slots = signals[i];
+      auto wire = [&](const std::string &wanted, int width) {
+        std::string name = names.Claim(wanted);
+        wires += "  wire " + Range(width) + name + ";\n";
+        slots.push_back(name);
+      };
+      switch (nd.type) {
+      case GateType_In:
+        if (pins[i])
+          slots.push_back(*pins[i]);
+        break;
+      case GateType_Out:
+      case GateType_Split: // Bits of its input, see Read()
+        break;
+      case GateType_AND:
+      case GateType_NOT:
+      case GateType_Merge:
+        wire("n" + std::to_string(i), nd.width);
+        break;
+      default: {
+        auto gate = design.gateIndex.find(nd.type);
+        if (gate == design.gateIndex.end())
+          break;
+        const auto &outputs = gatePorts[gate->second].outputs;
+        const GateDefinition &callee = *design.gates[gate->second];
+        for (size_t pin = 0; pin < outputs.size(); ++pin)
+          wire(outputs.size() > 1 ? "n" + std::to_string(i) + "_" + outputs[pin]
+                                  : "n" + std::to_string(i),
+               callee.nodes[callee.outputPinIndices[pin]].width);
+      }
+      }
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+      const NodeDefinition &nd = def.nodes[i];
+      const int width = nd.width;
+      switch (nd.type) {
+      case GateType_In:
+      case GateType_Split:
+        break;
+      case GateType_Out:
+        if (pins[i])
+          body += "  assign " + *pins[i] + " = " + Read(i, 0, width) + ";\n";
+        break;
+      case GateType_AND:
+      case GateType_NOT: {
+        const bool isAnd = nd.type == GateType_AND;
+        body += std::string("  ") + (isAnd ? "and " : "not ") +
+                names.Claim("g" + std::to_string(i));
+        if (width > 1)
+          body += " [" + std::to_string(width - 1) + ":0]";
+        body += " (" + signals[i][0] + ", " + Read(i, 0, width);
+        if (isAnd)
+          body += ", " + Read(i, 1, width);
+        body += ");\n";
+        break;
+      }
+      case GateType_Merge: {
+        body += "  assign " + signals[i][0] + " = {";
+        for (int bit = width - 1; bit >= 0; --bit)
+          body += Read(i, bit, 1) + (bit ? ", " : "");
+        body += "};\n";
+        break;
+      }
+      default: {
+        auto gate = design.gateIndex.find(nd.type);
+        if (gate == design.gateIndex.end())
+          break;
+        const Ports &ports = gatePorts[gate->second];
+        const GateDefinition &callee = *design.gates[gate->second];
+        body += "  " + moduleNames[gate->second] + " " +
+                names.Claim("u" + std::to_string(i)) + " (";
+        const char *separator = "";
+        for (size_t pin = 0; pin < ports.inputs.size(); ++pin) {
+          int pinWidth = callee.nodes[callee.inputPinIndices[pin]].width;
+          body += separator;
+          body += "." + ports.inputs[pin] + "(" + Read(i, pin, pinWidth) + ")";
+          separator = ", ";
+        }
+        for (size_t pin = 0; pin < ports.outputs.size(); ++pin) {
+          body += separator;
+          body += "." + ports.outputs[pin] + "(" + signals[i][pin] + ")";
+          separator = ", ";
+        }
+        body += ");\n";
+      }
+      }
+    }
+
+    out += "module " + moduleName + " (";
+    const char *separator = "\n";
+    for (size_t pin = 0; pin < ports.inputs.size(); ++pin) {
+      int width = def.nodes[def.inputPinIndices[pin]].width;
+      out += separator + ("  input " + Range(width) + ports.inputs[pin]);
+      separator = ",\n";
+    }
+    for (size_t pin = 0; pin < ports.outputs.size(); ++pin) {
+      int width = def.nodes[def.outputPinIndices[pin]].width;
+      out += separator + ("  output " + Range(width) + ports.outputs[pin]);
+      separator = ",\n";
+    }
+    out += "\n);\n" + wires + body + "endmodule\n";
+  }
+
+private:
+  struct Source {
+    uint32_t node = None;
+    uint16_t slot = 0;
+  };
+
+  // The signal on an input slot of 'node', or 0 when it is unconnected
+  std::string Read(uint32_t node, size_t slot, int width) {
+    const auto &slots = inputs[node];
+    if (slot >= slots.size() || slots[slot].node == None)
+      return Zero(width);
+    Source source = slots[slot];
+    const NodeDefinition &from = current->nodes[source.node];
+    if (from.type == GateType_Split) {
+      // A Split picks one bit of whatever drives it
+      std::string bus = Read(source.node, 0, from.width);
+      if (isdigit((unsigned char)bus[0]))
+        return Zero(width); // Nothing drives the bus
+      return from.width > 1 ? bus + "[" + std::to_string(source.slot) + "]"
+                            : bus;
+    }
+    const auto &driven = signals[source.node];
+    return source.slot < driven.size() ? driven[source.slot] : Zero(width);
+  }
+
+  const VerilogDesign &design;
+  const std::vector<std::string> &moduleNames;
+  const std::vector<Ports> &gatePorts;
+  std::string &out;
+  const GateDefinition *current = nullptr;
+  std::vector<std::vector<Source>> inputs;   // Per node, per input slot
+  std::vector<std::vector<std::string>> signals; // Per node, per output slot
+};
+
+Ports PortsOf(const GateDefinition &def) {
+  Ports ports;
+  Identifiers names;
+  const size_t inputs = def.inputPinIndices.size();
+  const size_t outputs = def.outputPinIndices.size();
+  for (size_t pin = 0; pin < inputs; ++pin)
+    ports.inputs.push_back(
+        names.Claim(PinName(def.inputNames, "in", pin, inputs)));
+  for (size_t pin = 0; pin < outputs; ++pin)
+    ports.outputs.push_back(
+        names.Claim(PinName(def.outputNames, "out", pin, outputs)));
+  return ports;
+}
+} // namespace
+
+bool CollectVerilogDesign(GateDefinitionRef top, VerilogDesign &design,
+                          std::string &error) {
+  design = VerilogDesign();
+  // Depth first, adding each gate once the gates inside it are added
+  struct Frame {
+    GateDefinitionRef def;
+    size_t next = 0; // Node to look at next
+  };
+  std::vector<Frame> stack{{top}};
+  std::unordered_set<const GateDefinition *> open{top.get()};
+  std::unordered_map<uint32_t, const GateDefinition *> types;
+  while (!stack.empty()) {
+    Frame &frame = stack.back();
+    const GateDefinition &def = *frame.def;
+    if (frame.next == def.nodes.size()) {
+      open.erase(frame.def.get());
+      if (frame.def != top)
+        design.gates.push_back(std::move(frame.def));
+      stack.pop_back();
+      continue;
+    }
+    uint32_t type = def.nodes[frame.next++].type;
+    if (type < GateType_BuiltinCount)
+      continue;
+    const std::string &name = GateTypeName(type);
+    auto known = types.find(type);
+    if (known != types.end()) {
+      if (open.count(known->second)) {
+        error = "the gate " + name + " contains itself";
+        return false;
+      }
+      continue;
+    }
+    GateDefinitionRef gate = CustomGate::FindDefinition(name);
+    if (!gate) {
+      error = "the gate " + name + " isn't loaded";
+      return false;
+    }
+    if (open.count(gate.get())) {
+      error = "the gate " + name + " contains itself";
+      return false;
+    }
+    types[type] = gate.get();
+    open.insert(gate.get());
+    stack.push_back({std::move(gate)});
+  }
+
+  std::unordered_map<const GateDefinition *, size_t> positions;
+  for (size_t i = 0; i < design.gates.size(); ++i)
+    positions[design.gates[i].get()] = i;
+  for (const auto &entry : types)
+    design.gateIndex[entry.first] = positions[entry.second];
+  design.top = std::move(top);
+  return true;
+}
+
+std::string EncodeVerilog(const VerilogDesign &design) {
+  // Module names are unique across the file, as are port names within a
+  // module
+  Identifiers modules;
+  std::vector<std::string> moduleNames;
+  std::vector<Ports> gatePorts;
+  for (const auto &gate : design.gates) {
+    moduleNames.push_back(modules.Claim(gate->name));
+    gatePorts.push_back(PortsOf(*gate));
+  }
+
+  std::string out = "// Structural Verilog written by Billyprints\n";
+  ModuleWriter writer(design, moduleNames, gatePorts, out);
+  for (size_t i = 0; i < design.gates.size(); ++i) {
+    out += "\n";
+    writer.Write(*design.gates[i], moduleNames[i], gatePorts[i]);
+  }
+  out += "\n";
+  writer.Write(*design.top, modules.Claim(design.top->name),
+               PortsOf(*design.top));
+  return out;
+}
+
+bool WriteVerilog(const std::string &path, const VerilogDesign &design) {
+  std::string text = EncodeVerilog(design);
+  std::vector<uint8_t> bytes(text.begin(), text.end());
+  return WriteFileAtomically(path, {&bytes});
+}
+} // namespace Billyprints
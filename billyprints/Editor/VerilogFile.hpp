@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../Nodes/Gates/CustomGate.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Billyprints {
+// A circuit and the custom gates it uses, gathered on the UI thread so it
+// can be written anywhere. Definitions are immutable, so the design stays
+// as it was gathered however the registry changes meanwhile.
+struct VerilogDesign {
+  GateDefinitionRef top;
+  // Every custom gate 'top' uses, directly or inside other gates, each
+  // after the gates it uses
+  std::vector<GateDefinitionRef> gates;
+  std::unordered_map<uint32_t, size_t> gateIndex; // Type id -> 'gates'
+};
+
+// Gathers the gates 'top' depends on, loading them from libraries where
+// needed. Returns false with 'error' set if one isn't loaded or a gate
+// contains itself.
+bool CollectVerilogDesign(GateDefinitionRef top, VerilogDesign &design,
+                          std::string &error);
+
+// The design as structural Verilog-2001, one module per definition with
+// 'top' last. Ports are named after the pins, or else like the slots of a
+// CustomGate. AND and NOT become gate primitives (instance arrays for
+// buses), custom gates module instances, and Split and Merge bit selects
+// and concatenations. Unconnected inputs are tied to 0, as the simulator
+// reads them.
+std::string EncodeVerilog(const VerilogDesign &design);
+
+// Writes EncodeVerilog() to 'path', replacing the file only once it is
+// fully written. Safe to call from any thread.
+bool WriteVerilog(const std::string &path, const VerilogDesign &design);
+} // namespace Billyprints
@@ -4,5 +4,7 @@ namespace Billyprints {
 std::vector<std::function<Gate *()>> availableGates{
     []() -> Gate * { return new AND(); },
     []() -> Gate * { return new NOT(); },
+    []() -> Gate * { return new Split(8); },
+    []() -> Gate * { return new Merge(8); },
 };
 } // namespace Billyprints
\ No newline at end of file
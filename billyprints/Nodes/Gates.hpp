@@ -4,8 +4,10 @@
 
 #include "AND.hpp"
 #include "CustomGate.hpp"
+#include "Merge.hpp"
 #include "NOT.hpp"
 #include "PlaceholderGate.hpp"
+#include "Split.hpp"
 
 #include <functional>
 
@@ -18,6 +18,8 @@ bool AND::AND_F(const std::vector<bool> &input, const int &pinCount) {
 }
 
 bool AND::Evaluate() {
+  if (width > 1)
+    return EvaluateWord() != 0;
   if (isEvaluating || lastEvaluatedFrame == GlobalFrameCount)
     return value;
 
@@ -30,7 +32,7 @@ bool AND::Evaluate() {
     std::vector<bool> input;
     for (const auto &cn : connections)
       if (cn.inputNode == this)
-        input.push_back(((Node *)cn.outputNode)->Evaluate());
+        input.push_back(ReadInput(cn) != 0);
 
     value = AND_F(input, inputSlotCount);
   }
@@ -39,4 +41,23 @@ bool AND::Evaluate() {
   isEvaluating = false;
   return value;
 }
+
+// A bus AND is one machine AND per word. Edited logic code only applies to
+// single-bit gates.
+uint64_t AND::EvaluateWord() {
+  if (width == 1)
+    return Evaluate() ? 1 : 0;
+  if (isEvaluating || lastEvaluatedFrame == GlobalFrameCount)
+    return word;
+
+  isEvaluating = true;
+  uint64_t result = BusMask(width);
+  for (int i = 0; i < inputSlotCount; ++i)
+    result &= InputWord(i);
+  word = result;
+  value = word != 0;
+  lastEvaluatedFrame = GlobalFrameCount;
+  isEvaluating = false;
+  return word;
+}
 } // namespace Billyprints
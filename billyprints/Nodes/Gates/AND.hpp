@@ -10,5 +10,7 @@ namespace Billyprints {
 		static bool AND_F(const std::vector<bool>& input, const int& pinCount);
 
 		bool Evaluate() override;
+		uint64_t EvaluateWord() override;
+		bool SetWidth(int bits) override { return SetBusWidth(bits); }
 	};
 }
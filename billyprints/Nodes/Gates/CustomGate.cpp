@@ -1,13 +1,138 @@
 #include "CustomGate.hpp"
+#include "../../Simulation/CompiledCircuit.hpp"
 #include "../Special/PinIn.hpp"
 #include "../Special/PinOut.hpp"
 #include "AND.hpp"
+#include "Merge.hpp"
 #include "NOT.hpp"
 #include "PlaceholderGate.hpp"
+#include "Split.hpp"
+#include <deque>
+#include <unordered_map>
 
 namespace Billyprints {
 
-std::map<std::string, GateDefinition> CustomGate::GateRegistry;
+std::map<std::string, GateDefinitionRef> CustomGate::GateRegistry;
+std::function<GateDefinitionRef(const std::string &)>
+    CustomGate::DefinitionLoader;
+
+// Interned type names. A deque keeps references returned by GateTypeName()
+// stable while new names are appended.
+static std::deque<std::string> &GateTypeNames() {
+  static std::deque<std::string> names{"AND", "NOT",   "In",
+                                       "Out", "Split", "Merge"};
+  return names;
+}
+
+static std::unordered_map<std::string, uint32_t> &GateTypeIds() {
+  static std::unordered_map<std::string, uint32_t> ids{
+      {"AND", GateType_AND},
+      {"NOT", GateType_NOT},
+      {"In", GateType_In},
+      {"Out", GateType_Out},
+      {"Split", GateType_Split},
+      {"Merge", GateType_Merge}};
+  return ids;
+}
+
+uint32_t InternGateType(const std::string &name) {
+  auto &ids = GateTypeIds();
+  auto it = ids.find(name);
+  if (it != ids.end())
+    return it->second;
+
+  auto &names = GateTypeNames();
+  uint32_t id = (uint32_t)names.size();
+  names.push_back(name);
+  ids.emplace(name, id);
+  return id;
+}
+
+const std::string &GateTypeName(uint32_t typeId) {
+  static const std::string unknown;
+  auto &names = GateTypeNames();
+  return typeId < names.size() ? names[typeId] : unknown;
+}
+
+GateDefinitionRef FinalizeGateDefinition(GateDefinition &&def) {
+  def.nodes.shrink_to_fit();
+  def.connections.shrink_to_fit();
+  def.inputPinIndices.shrink_to_fit();
+  def.outputPinIndices.shrink_to_fit();
+  def.inputNames.shrink_to_fit();
+  def.outputNames.shrink_to_fit();
+  return std::make_shared<const GateDefinition>(std::move(def));
+}
+
+// Builds a definition from a set of live nodes. Node indices in the
+// definition follow the order of 'sourceNodes'.
+GateDefinition BuildGateDefinition(const std::string &name,
+                                   const std::vector<Node *> &sourceNodes) {
+  GateDefinition def;
+  def.name = name;
+
+  std::map<Node *, uint32_t> nodePtrToId;
+
+  // 1. Collect Nodes
+  def.nodes.reserve(sourceNodes.size());
+  for (auto *node : sourceNodes) {
+    NodeDefinition nd;
+    uint32_t id = (uint32_t)def.nodes.size();
+    nodePtrToId[node] = id;
+    nd.pos = node->pos;
+    nd.type = InternGateType(node->title);
+    nd.width = (uint8_t)node->width;
+
+    def.nodes.push_back(nd);
+
+    // The pins keep the names the script gives them
+    if (nd.type == GateType_In) {
+      def.inputPinIndices.push_back(id);
+      def.inputNames.push_back(node->id);
+    } else if (nd.type == GateType_Out) {
+      def.outputPinIndices.push_back(id);
+      def.outputNames.push_back(node->id);
+    }
+  }
+
+  // 2. Collect Connections
+  for (auto *node : sourceNodes) {
+    for (const auto &conn : node->connections) {
+      if (conn.outputNode != node)
+        continue;
+      Node *inputNode = (Node *)conn.inputNode;
+      auto inputIt = nodePtrToId.find(inputNode);
+      int inputSlot = inputNode->InputSlotIndex(conn.inputSlot);
+      int outputSlot = node->OutputSlotIndex(conn.outputSlot);
+      if (inputIt == nodePtrToId.end() || inputSlot < 0 || outputSlot < 0)
+        continue;
+
+      ConnectionDefinition cd;
+      cd.inputNodeId = inputIt->second;
+      cd.inputSlot = (uint16_t)inputSlot;
+      cd.outputNodeId = nodePtrToId[node];
+      cd.outputSlot = (uint16_t)outputSlot;
+      def.connections.push_back(cd);
+    }
+  }
+  return def;
+}
+
+GateDefinitionRef CustomGate::FindDefinition(const std::string &name) {
+  auto it = GateRegistry.find(name);
+  if (it != GateRegistry.end())
+    return it->second;
+  if (!DefinitionLoader)
+    return nullptr;
+  GateDefinitionRef def = DefinitionLoader(name);
+  if (def)
+    RegisterDefinition(def);
+  return def;
+}
+
+void CustomGate::RegisterDefinition(const GateDefinitionRef &def) {
+  GateRegistry[def->name] = def;
+}
 
 Node *CreateNodeByType(const std::string &type) {
   if (type == "AND")
@@ -18,10 +143,14 @@ Node *CreateNodeByType(const std::string &type) {
     return new PinIn();
   if (type == "Out")
     return new PinOut();
+  if (type == "Split")
+    return new Split();
+  if (type == "Merge")
+    return new Merge();
 
   // Check Custom Gate Registry
-  if (CustomGate::GateRegistry.count(type)) {
-    return new CustomGate(CustomGate::GateRegistry[type]);
+  if (GateDefinitionRef def = CustomGate::FindDefinition(type)) {
+    return new CustomGate(std::move(def));
   }
 
   return nullptr;
@@ -38,70 +167,84 @@ Node *CreateNodeByTypeOrPlaceholder(const std::string &type, int inputHint,
   return new PlaceholderGate(type, inputHint, outputHint);
 }
 
-CustomGate::CustomGate(const GateDefinition &def)
-    : Gate(def.name.c_str(), {}, {}), definition(def) {
-  title = _strdup(def.name.c_str()); // ImNodes needs a char*
+CustomGate::CustomGate(GateDefinitionRef def)
+    : Gate(def->name.c_str(), {}, {}), definition(std::move(def)) {
+  // The definition is shared and outlives this instance, so its name can be
+  // used as the title directly (ImNodes needs a char*)
+  title = definition->name.c_str();
 
+  // Combinational gates run compiled; the rest, such as latches, as a
+  // network of internal nodes
+  std::vector<int> inputWidths, outputWidths;
+  compiled = CompileCircuit(definition);
+  if (compiled) {
+    inputWidths = compiled->inputWidths;
+    outputWidths = compiled->outputWidths;
+    pinWords.resize(inputWidths.size() + outputWidths.size());
+  } else {
+    BuildInternalNodes();
+    for (auto *pin : internalInputs)
+      inputWidths.push_back(pin->width);
+    for (auto *pin : internalOutputs)
+      outputWidths.push_back(pin->width);
+  }
+
+  // Setup External Slots based on PinIn/PinOut counts, in definition order
+  inputSlotCount = (int)inputWidths.size();
+  outputSlotCount = (int)outputWidths.size();
+
+  inputSlots.resize(inputSlotCount);
+  outputSlots.resize(outputSlotCount);
+
+  for (int i = 0; i < inputSlotCount; ++i)
+    inputSlots[i] = {IndexedSlotName(true, i, inputSlotCount), inputWidths[i]};
+  for (int i = 0; i < outputSlotCount; ++i)
+    outputSlots[i] = {IndexedSlotName(false, i, outputSlotCount),
+                      outputWidths[i]};
+}
+
+void CustomGate::BuildInternalNodes() {
   // 1. Create Internal Nodes
-  std::map<int, Node *> nodeMap; // Map definition ID to actual Node*
+  // Definition nodes are addressed by index, so a flat vector is enough
+  std::vector<Node *> nodeMap(definition->nodes.size(), nullptr);
 
-  for (const auto &nodeDef : def.nodes) {
-    Node *newNode = CreateNodeByType(nodeDef.type);
+  for (size_t i = 0; i < definition->nodes.size(); ++i) {
+    const auto &nodeDef = definition->nodes[i];
+    Node *newNode = CreateNodeByType(GateTypeName(nodeDef.type));
     if (newNode) {
+      newNode->SetWidth(nodeDef.width);
       // newNode->pos = nodeDef.pos; // Position doesn't matter for logic, only
       // for editing if we allowed opening it
       internalNodes.push_back(newNode);
-      nodeMap[nodeDef.id] = newNode;
+      nodeMap[i] = newNode;
 
-      if (nodeDef.type == "In") {
+      if (nodeDef.type == GateType_In) {
         internalInputs.push_back((PinIn *)newNode);
-      } else if (nodeDef.type == "Out") {
+      } else if (nodeDef.type == GateType_Out) {
         internalOutputs.push_back((PinOut *)newNode);
       }
     }
   }
 
-  // 2. Setup External Slots based on PinIn/PinOut counts
-  // Sort internalInputs/Outputs based on some logic (e.g., Y position) if
-  // needed, but for now relying on definition order (which should be sorted by
-  // creation or position)
-
-  inputSlotCount = (int)internalInputs.size();
-  outputSlotCount = (int)internalOutputs.size();
-
-  inputSlots.resize(inputSlotCount);
-  outputSlots.resize(outputSlotCount);
-
-  for (int i = 0; i < inputSlotCount; ++i) {
-    char buf[16];
-    if (inputSlotCount == 1)
-      sprintf(buf, "in");
-    else
-      sprintf(buf, "in%d", i);
-    inputSlots[i] = {strdup(buf), 1};
-  }
-  for (int i = 0; i < outputSlotCount; ++i) {
-    char buf[16];
-    if (outputSlotCount == 1)
-      sprintf(buf, "out");
-    else
-      sprintf(buf, "out%d", i);
-    outputSlots[i] = {strdup(buf), 1};
-  }
-
-  // 3. Create Internal Connections
-  for (const auto &connDef : definition.connections) {
-    if (nodeMap.count(connDef.inputNodeId) &&
-        nodeMap.count(connDef.outputNodeId)) {
+  // 2. Create Internal Connections
+  for (const auto &connDef : definition->connections) {
+    Node *inputNode = connDef.inputNodeId < nodeMap.size()
+                          ? nodeMap[connDef.inputNodeId]
+                          : nullptr;
+    Node *outputNode = connDef.outputNodeId < nodeMap.size()
+                           ? nodeMap[connDef.outputNodeId]
+                           : nullptr;
+    if (inputNode && outputNode && connDef.inputSlot < inputNode->inputSlotCount &&
+        connDef.outputSlot < outputNode->outputSlotCount) {
       Connection conn;
-      conn.inputNode = nodeMap[connDef.inputNodeId];
-      conn.inputSlot = connDef.inputSlot.c_str();
-      conn.outputNode = nodeMap[connDef.outputNodeId];
-      conn.outputSlot = connDef.outputSlot.c_str();
+      conn.inputNode = inputNode;
+      conn.inputSlot = inputNode->inputSlots[connDef.inputSlot].title;
+      conn.outputNode = outputNode;
+      conn.outputSlot = outputNode->outputSlots[connDef.outputSlot].title;
 
       // Link them virtually
-      ((Node *)conn.inputNode)->connections.push_back(conn);
-      ((Node *)conn.outputNode)->connections.push_back(conn);
+      inputNode->connections.push_back(conn);
+      outputNode->connections.push_back(conn);
 
       internalConnections.push_back(conn);
     }
@@ -123,7 +266,7 @@ bool CustomGate::Evaluate() {
 
   // Step A: Update Internal PinIns
   for (int i = 0; i < inputSlots.size(); ++i) {
-    bool slotValue = false;
+    uint64_t slotValue = 0;
     char slotName[16];
     if (inputSlots.size() == 1)
       sprintf(slotName, "in");
@@ -133,37 +276,58 @@ bool CustomGate::Evaluate() {
     for (const auto &conn : connections) {
       if (conn.inputNode == this && !conn.inputSlot.empty() &&
           strcmp(conn.inputSlot.c_str(), slotName) == 0) {
-        Node *source = (Node *)conn.outputNode;
-        slotValue = source->Evaluate();
+        slotValue = ReadInput(conn);
         break;
       }
     }
 
-    if (i < internalInputs.size()) {
-      internalInputs[i]->value = slotValue;
+    if (compiled) {
+      pinWords[i] = slotValue;
+    } else if (i < (int)internalInputs.size()) {
+      internalInputs[i]->Drive(slotValue);
     }
   }
 
   // Step B: Propagate Internal
-  // Reduced passes + caching makes this much faster.
-  // 3 passes is enough to settle most combinatorial logic without complex
-  // feedback.
-  for (int pass = 0; pass < 3; ++pass) {
-    for (auto node : internalNodes) {
-      node->Evaluate();
+  if (compiled) {
+    // One pass over the AIG computes every output
+    uint64_t *outputs = pinWords.data() + inputSlotCount;
+    compiled->Evaluate(pinWords.data(), outputs, signals);
+    word = outputSlotCount == 0 ? 0 : outputs[0];
+  } else {
+    // Reduced passes + caching makes this much faster.
+    // 3 passes is enough to settle most combinatorial logic without complex
+    // feedback.
+    for (int pass = 0; pass < 3; ++pass) {
+      for (auto node : internalNodes) {
+        node->Evaluate();
+      }
     }
-  }
 
-  // Step C: Set Output
-  if (!internalOutputs.empty()) {
-    value = internalOutputs[0]->value;
-  } else {
-    value = false;
+    // Step C: Set Output
+    word = internalOutputs.empty() ? 0 : internalOutputs[0]->EvaluateWord();
   }
+  value = word != 0;
 
   lastEvaluatedFrame = Node::GlobalFrameCount;
   isEvaluating = false;
   return value;
 }
 
+uint64_t CustomGate::EvaluateWord() {
+  Evaluate();
+  return word;
+}
+
+// Each output slot reads its own internal pin or compiled output, evaluated
+// by Evaluate()
+uint64_t CustomGate::EvaluateSlot(int outputSlot) {
+  Evaluate();
+  if (outputSlot < 0 || outputSlot >= outputSlotCount)
+    return 0;
+  if (compiled)
+    return pinWords[inputSlotCount + outputSlot];
+  return internalOutputs[outputSlot]->EvaluateWord();
+}
+
 } // namespace Billyprints
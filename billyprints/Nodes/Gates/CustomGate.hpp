@@ -3,45 +3,88 @@
 #include "../Special/PinIn.hpp"
 #include "../Special/PinOut.hpp"
 #include "Gate.hpp"
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace Billyprints {
 
+// Node types inside a definition are stored as interned ids rather than
+// strings. The built-in types always occupy the first ids.
+enum BuiltinGateType : uint32_t {
+  GateType_AND = 0,
+  GateType_NOT,
+  GateType_In,
+  GateType_Out,
+  GateType_Split,
+  GateType_Merge,
+  GateType_BuiltinCount
+};
+
+struct CompiledCircuit;
+
+uint32_t InternGateType(const std::string &name);
+const std::string &GateTypeName(uint32_t typeId);
+
 struct NodeDefinition {
-  std::string type;
+  uint32_t type; // Interned type id, see InternGateType()
   ImVec2 pos;
-  int id; // Original ID in the definition
+  uint8_t width = 1; // Bus width, see Node::SetWidth()
 };
 
 struct ConnectionDefinition {
-  int inputNodeId;
-  std::string inputSlot;
-  int outputNodeId;
-  std::string outputSlot;
+  uint32_t inputNodeId;  // Index into GateDefinition::nodes
+  uint32_t outputNodeId; // Index into GateDefinition::nodes
+  uint16_t inputSlot;    // Input slot index on the input node
+  uint16_t outputSlot;   // Output slot index on the output node
 };
 
 struct GateDefinition {
   std::string name;
   std::vector<NodeDefinition> nodes;
   std::vector<ConnectionDefinition> connections;
-  std::vector<int> inputPinIndices;  // IDs of PinIn nodes in 'nodes' vector
-  std::vector<int> outputPinIndices; // IDs of PinOut nodes in 'nodes' vector
+  std::vector<uint32_t> inputPinIndices;  // Indices of PinIn nodes in 'nodes'
+  std::vector<uint32_t> outputPinIndices; // Indices of PinOut nodes in 'nodes'
+  // Pin names, such as the ports of a define block, in the order of the pin
+  // indices. Either empty or one per pin; a pin may have an empty name.
+  std::vector<std::string> inputNames, outputNames;
   ImU32 color = IM_COL32(50, 50, 50, 200); // Default dark grey
 };
 
+// Definitions are immutable once built and shared between the registry, the
+// editor, the gate palette and every CustomGate instance.
+using GateDefinitionRef = std::shared_ptr<const GateDefinition>;
+
+// Trims the definition's arrays and freezes it into a shared, immutable blob.
+GateDefinitionRef FinalizeGateDefinition(GateDefinition &&def);
+
+// Builds a definition from live nodes; node indices follow 'sourceNodes'.
+GateDefinition BuildGateDefinition(const std::string &name,
+                                   const std::vector<Node *> &sourceNodes);
+
 Node *CreateNodeByType(const std::string &type);
 Node *CreateNodeByTypeOrPlaceholder(const std::string &type, int inputHint = 1,
                                     int outputHint = 1);
 
 class CustomGate : public Gate {
 public:
-  CustomGate(const GateDefinition &def);
+  CustomGate(GateDefinitionRef def);
   ~CustomGate();
 
   bool Evaluate() override;
-  ImU32 GetColor() const override { return definition.color; }
+  uint64_t EvaluateWord() override;
+  uint64_t EvaluateSlot(int outputSlot) override;
+  ImU32 GetColor() const override { return definition->color; }
+
+  const GateDefinitionRef &GetDefinition() const { return definition; }
+  // Set when the gate runs as a compiled AIG (see CompileCircuit()), in
+  // which case it has no internal nodes
+  const std::shared_ptr<const CompiledCircuit> &GetCompiled() const {
+    return compiled;
+  }
 
   // Members to hold the internal state
   std::vector<Node *> internalNodes;
@@ -52,9 +95,21 @@ public:
   std::vector<PinOut *> internalOutputs;
 
   // Registry for all custom gates
-  static std::map<std::string, GateDefinition> GateRegistry;
+  static std::map<std::string, GateDefinitionRef> GateRegistry;
+  static GateDefinitionRef FindDefinition(const std::string &name);
+  static void RegisterDefinition(const GateDefinitionRef &def);
+  // Asked by FindDefinition() for names that aren't registered yet, so a
+  // definition can be loaded the first time it is used. Whatever it returns
+  // is registered.
+  static std::function<GateDefinitionRef(const std::string &)>
+      DefinitionLoader;
 
 private:
-  GateDefinition definition;
+  void BuildInternalNodes();
+
+  GateDefinitionRef definition;
+  std::shared_ptr<const CompiledCircuit> compiled;
+  std::vector<uint64_t> pinWords; // Compiled: input words, then outputs
+  std::vector<uint8_t> signals;   // Compiled: scratch for Evaluate()
 };
 } // namespace Billyprints
@@ -20,6 +20,8 @@ ImU32 Gate::GetColor() const {
     return IM_COL32(80, 20, 20, 255);
   if (t == "NAND")
     return IM_COL32(40, 10, 80, 255);
+  if (t == "Split" || t == "Merge")
+    return IM_COL32(20, 50, 70, 255);
   return Node::GetColor();
 }
 
@@ -28,7 +30,7 @@ void Gate::Render() {
   color = (color & 0x00FFFFFF) | 0xFF000000; // Force solid
 
   ImU32 borderColor =
-      Evaluate() ? IM_COL32(50, 255, 150, 255) : IM_COL32(50, 50, 50, 50);
+      Signal() ? IM_COL32(50, 255, 150, 255) : IM_COL32(50, 50, 50, 50);
 
   // Selection highlight - bright cyan border when selected
   if (selected) {
@@ -46,71 +48,9 @@ void Gate::Render() {
   bool open = ImNodes::Ez::BeginNode(this, title, &pos, &selected);
   if (open) {
     ImNodes::Ez::InputSlots(inputSlots.data(), (int)inputSlots.size());
+    if (width > 1)
+      ImGui::TextDisabled("%d bits", width);
     ImNodes::Ez::OutputSlots(outputSlots.data(), (int)outputSlots.size());
-
-    // Handle new connections
-    void *inNode, *outNode;
-    const char *inSlot, *outSlot;
-    if (ImNodes::GetNewConnection(&inNode, &inSlot, &outNode, &outSlot)) {
-      Connection new_connection;
-      new_connection.inputNode = inNode;
-      new_connection.inputSlot = inSlot;
-      new_connection.outputNode = outNode;
-      new_connection.outputSlot = outSlot;
-
-      Node *inputNode = (Node *)new_connection.inputNode;
-      Connection existingConnection = {};
-      bool foundExisting = false;
-
-      for (const auto &conn : inputNode->connections) {
-        if (conn.inputNode == inputNode &&
-            conn.inputSlot == new_connection.inputSlot) {
-          existingConnection = conn;
-          foundExisting = true;
-          break;
-        }
-      }
-
-      if (foundExisting) {
-        ((Node *)existingConnection.outputNode)
-            ->DeleteConnection(existingConnection);
-        inputNode->DeleteConnection(existingConnection);
-      }
-
-      ((Node *)new_connection.inputNode)->connections.push_back(new_connection);
-      ((Node *)new_connection.outputNode)
-          ->connections.push_back(new_connection);
-    }
-
-    // Render output connections
-    for (const Connection &connection : connections) {
-      if (connection.outputNode != this)
-        continue;
-
-      bool signal = Evaluate();
-      ImColor activeColor = IM_COL32(50, 255, 150, 255);
-      ImColor inactiveColor = IM_COL32(80, 90, 100, 255);
-
-      auto *canvas = ImNodes::GetCurrentCanvas();
-      ImColor originalConnectionColor = canvas->Colors[ImNodes::ColConnection];
-
-      // Check if both nodes are selected for connection highlighting
-      bool bothSelected = selected && ((Node *)connection.inputNode)->selected;
-      if (bothSelected) {
-        canvas->Colors[ImNodes::ColConnection] = IM_COL32(0, 200, 255, 255);
-      } else {
-        canvas->Colors[ImNodes::ColConnection] =
-            signal ? activeColor : inactiveColor;
-      }
-
-      if (!ImNodes::Connection(
-              connection.inputNode, connection.inputSlot.c_str(),
-              connection.outputNode, connection.outputSlot.c_str())) {
-        ((Node *)connection.inputNode)->DeleteConnection(connection);
-        ((Node *)connection.outputNode)->DeleteConnection(connection);
-      }
-      canvas->Colors[ImNodes::ColConnection] = originalConnectionColor;
-    }
   }
 
   ImNodes::Ez::EndNode();
@@ -124,8 +64,9 @@ void Gate::Render() {
     if (ImGui::MenuItem("Duplicate")) {
       nodeToDuplicate = this;
     }
-    if (std::string(title) != "In" && std::string(title) != "Out") {
-      bool isCustom = CustomGate::GateRegistry.count(title);
+    bool isCustom = CustomGate::FindDefinition(title) != nullptr;
+    // Split and Merge have no logic code to edit
+    if (isCustom || !logicCode.empty()) {
       if (ImGui::MenuItem(isCustom ? "Edit Circuit" : "Edit Logic")) {
         nodeToEdit = this;
       }
@@ -152,7 +93,7 @@ bool Gate::EvaluateExpression() {
     bool val = false;
     for (const auto &conn : connections) {
       if (conn.inputNode == this && conn.inputSlot == name) {
-        val = ((Node *)conn.outputNode)->Evaluate();
+        val = ReadInput(conn) != 0;
         break;
       }
     }
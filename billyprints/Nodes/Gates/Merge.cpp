@@ -0,0 +1,35 @@
+#include "Merge.hpp"
+
+namespace Billyprints {
+Merge::Merge(int width) : Gate("Merge", {}, {{"out"}}) { SetWidth(width); }
+
+bool Merge::SetWidth(int bits) {
+  if (bits < 1 || bits > MaxBusWidth)
+    return false;
+  width = bits;
+  word &= BusMask(bits);
+  inputSlots.resize(bits);
+  for (int i = 0; i < bits; ++i)
+    inputSlots[i] = {IndexedSlotName(true, i, bits), 1};
+  inputSlotCount = bits;
+  outputSlots[0].kind = bits;
+  return true;
+}
+
+bool Merge::Evaluate() { return EvaluateWord() != 0; }
+
+uint64_t Merge::EvaluateWord() {
+  if (isEvaluating || lastEvaluatedFrame == GlobalFrameCount)
+    return word;
+
+  isEvaluating = true;
+  uint64_t result = 0;
+  for (int i = 0; i < inputSlotCount; ++i)
+    result |= (InputWord(i) & 1) << i;
+  word = result;
+  value = word != 0;
+  lastEvaluatedFrame = GlobalFrameCount;
+  isEvaluating = false;
+  return word;
+}
+} // namespace Billyprints
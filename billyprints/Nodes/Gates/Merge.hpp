@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Gate.hpp"
+
+namespace Billyprints {
+// Packs single bits into a bus: inN drives bit N of "out"
+class Merge : public Gate {
+public:
+  explicit Merge(int width = 1);
+
+  bool Evaluate() override;
+  uint64_t EvaluateWord() override;
+  bool SetWidth(int bits) override;
+};
+} // namespace Billyprints
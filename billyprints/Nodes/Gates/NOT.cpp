@@ -12,6 +12,8 @@ bool NOT::NOT_F(const std::vector<bool> &input, const int &) {
 }
 
 bool NOT::Evaluate() {
+  if (width > 1)
+    return EvaluateWord() != 0;
   if (isEvaluating || lastEvaluatedFrame == GlobalFrameCount)
     return value;
 
@@ -23,7 +25,7 @@ bool NOT::Evaluate() {
     std::vector<bool> input;
     for (const auto &cn : connections)
       if (cn.inputNode == this)
-        input.push_back(((Node *)cn.outputNode)->Evaluate());
+        input.push_back(ReadInput(cn) != 0);
 
     value = NOT_F(input, inputSlotCount);
   }
@@ -32,4 +34,18 @@ bool NOT::Evaluate() {
   isEvaluating = false;
   return value;
 }
+
+uint64_t NOT::EvaluateWord() {
+  if (width == 1)
+    return Evaluate() ? 1 : 0;
+  if (isEvaluating || lastEvaluatedFrame == GlobalFrameCount)
+    return word;
+
+  isEvaluating = true;
+  word = ~InputWord(0) & BusMask(width);
+  value = word != 0;
+  lastEvaluatedFrame = GlobalFrameCount;
+  isEvaluating = false;
+  return word;
+}
 } // namespace Billyprints
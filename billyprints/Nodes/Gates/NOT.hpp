@@ -10,5 +10,7 @@ namespace Billyprints {
 		static bool NOT_F(const std::vector<bool>& input, const int&);
 
 		bool Evaluate() override;
+		uint64_t EvaluateWord() override;
+		bool SetWidth(int bits) override { return SetBusWidth(bits); }
 	};
 }
@@ -52,6 +52,11 @@ ImU32 PlaceholderGate::GetColor() const {
   return IM_COL32(120, 40, 40, 255);
 }
 
+ImU32 PlaceholderGate::GetConnectionColor(int /*outputSlot*/) const {
+  // Gray/muted connection color to indicate inactive
+  return IM_COL32(100, 80, 80, 180);
+}
+
 void PlaceholderGate::Render() {
   ImU32 color = GetColor();
   ImU32 borderColor = IM_COL32(200, 80, 80, 255); // Red border
@@ -75,65 +80,6 @@ void PlaceholderGate::Render() {
   if (open) {
     ImNodes::Ez::InputSlots(inputSlots.data(), (int)inputSlots.size());
     ImNodes::Ez::OutputSlots(outputSlots.data(), (int)outputSlots.size());
-
-    // Handle new connections (same as Gate::Render)
-    void *inNode, *outNode;
-    const char *inSlot, *outSlot;
-    if (ImNodes::GetNewConnection(&inNode, &inSlot, &outNode, &outSlot)) {
-      Connection new_connection;
-      new_connection.inputNode = inNode;
-      new_connection.inputSlot = inSlot;
-      new_connection.outputNode = outNode;
-      new_connection.outputSlot = outSlot;
-
-      Node *inputNode = (Node *)new_connection.inputNode;
-      Connection existingConnection = {};
-      bool foundExisting = false;
-
-      for (const auto &conn : inputNode->connections) {
-        if (conn.inputNode == inputNode &&
-            conn.inputSlot == new_connection.inputSlot) {
-          existingConnection = conn;
-          foundExisting = true;
-          break;
-        }
-      }
-
-      if (foundExisting) {
-        ((Node *)existingConnection.outputNode)
-            ->DeleteConnection(existingConnection);
-        inputNode->DeleteConnection(existingConnection);
-      }
-
-      ((Node *)new_connection.inputNode)->connections.push_back(new_connection);
-      ((Node *)new_connection.outputNode)->connections.push_back(new_connection);
-    }
-
-    // Render connections (grayed out since gate doesn't work)
-    for (const Connection &connection : connections) {
-      if (connection.outputNode != this)
-        continue;
-
-      auto *canvas = ImNodes::GetCurrentCanvas();
-      ImColor originalColor = canvas->Colors[ImNodes::ColConnection];
-
-      // Gray/muted connection color to indicate inactive
-      bool bothSelected = selected && ((Node *)connection.inputNode)->selected;
-      if (bothSelected) {
-        canvas->Colors[ImNodes::ColConnection] = IM_COL32(0, 200, 255, 255);
-      } else {
-        canvas->Colors[ImNodes::ColConnection] = IM_COL32(100, 80, 80, 180);
-      }
-
-      if (!ImNodes::Connection(connection.inputNode, connection.inputSlot.c_str(),
-                               connection.outputNode,
-                               connection.outputSlot.c_str())) {
-        ((Node *)connection.inputNode)->DeleteConnection(connection);
-        ((Node *)connection.outputNode)->DeleteConnection(connection);
-      }
-
-      canvas->Colors[ImNodes::ColConnection] = originalColor;
-    }
   }
 
   ImNodes::Ez::EndNode();
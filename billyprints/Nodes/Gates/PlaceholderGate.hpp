@@ -18,6 +18,7 @@ public:
   bool Evaluate() override;
   void Render() override;
   ImU32 GetColor() const override;
+  ImU32 GetConnectionColor(int outputSlot) const override;
 
   // The original type name (e.g., "HalfAdder") for later upgrade
   std::string missingTypeName;
@@ -0,0 +1,38 @@
+#include "Split.hpp"
+
+namespace Billyprints {
+Split::Split(int width) : Gate("Split", {{"in"}}, {}) { SetWidth(width); }
+
+bool Split::SetWidth(int bits) {
+  if (bits < 1 || bits > MaxBusWidth)
+    return false;
+  width = bits;
+  inputSlots[0].kind = bits;
+  outputSlots.resize(bits);
+  for (int i = 0; i < bits; ++i)
+    outputSlots[i] = {IndexedSlotName(false, i, bits), 1};
+  outputSlotCount = bits;
+  return true;
+}
+
+bool Split::Evaluate() { return EvaluateWord() != 0; }
+
+// The node's word is the whole bus; each output slot picks one bit of it
+uint64_t Split::EvaluateWord() {
+  if (isEvaluating || lastEvaluatedFrame == GlobalFrameCount)
+    return word;
+
+  isEvaluating = true;
+  word = InputWord(0) & BusMask(width);
+  value = word != 0;
+  lastEvaluatedFrame = GlobalFrameCount;
+  isEvaluating = false;
+  return word;
+}
+
+uint64_t Split::EvaluateSlot(int outputSlot) {
+  if (outputSlot < 0 || outputSlot >= width)
+    return 0;
+  return (EvaluateWord() >> outputSlot) & 1;
+}
+} // namespace Billyprints
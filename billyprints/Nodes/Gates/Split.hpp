@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Gate.hpp"
+
+namespace Billyprints {
+// Breaks a bus into its bits: "in" carries the bus, outN carries bit N
+class Split : public Gate {
+public:
+  explicit Split(int width = 1);
+
+  bool Evaluate() override;
+  uint64_t EvaluateWord() override;
+  uint64_t EvaluateSlot(int outputSlot) override;
+  bool SetWidth(int bits) override;
+};
+} // namespace Billyprints
@@ -1,7 +1,10 @@
 #include "Node.hpp"
+#include <deque>
+#include <mutex>
 
 namespace Billyprints {
 uint64_t Node::GlobalFrameCount = 0;
+const SimulationSnapshot *Node::Snapshot = nullptr;
 Node::Node(const char *_title, std::vector<ImNodes::Ez::SlotInfo> &&_inputSlots,
            std::vector<ImNodes::Ez::SlotInfo> &&_outputSlots) {
   title = _title;
@@ -12,6 +15,41 @@ Node::Node(const char *_title, std::vector<ImNodes::Ez::SlotInfo> &&_inputSlots,
   outputSlotCount = static_cast<int>(outputSlots.size());
 }
 
+int SlotIndexFromName(const std::string &slotName) {
+  size_t prefix = 0;
+  if (slotName.compare(0, 3, "out") == 0)
+    prefix = 3;
+  else if (slotName.compare(0, 2, "in") == 0)
+    prefix = 2;
+  else
+    return -1;
+
+  if (slotName.size() == prefix)
+    return 0; // Single slot ("in" / "out")
+
+  int index = 0;
+  for (size_t i = prefix; i < slotName.size(); ++i) {
+    if (slotName[i] < '0' || slotName[i] > '9')
+      return -1;
+    index = index * 10 + (slotName[i] - '0');
+  }
+  return index;
+}
+
+const char *IndexedSlotName(bool isInput, int index, int slotCount) {
+  if (slotCount == 1)
+    return isInput ? "in" : "out";
+  // Custom gates can have any number of pins, so the table grows on demand.
+  // A deque never moves its strings, so the titles stay valid.
+  static std::mutex mutex;
+  static std::deque<std::string> names[2];
+  std::lock_guard<std::mutex> lock(mutex);
+  std::deque<std::string> &table = names[isInput];
+  while ((int)table.size() <= index)
+    table.push_back((isInput ? "in" : "out") + std::to_string(table.size()));
+  return table[index].c_str();
+}
+
 void Node::DeleteConnection(const Connection &connection) {
   for (auto it = connections.begin(); it != connections.end(); ++it) {
     if (connection == *it) {
@@ -21,6 +59,60 @@ void Node::DeleteConnection(const Connection &connection) {
   }
 }
 
+int Node::InputSlotIndex(const std::string &slotName) const {
+  int guess = SlotIndexFromName(slotName);
+  if (guess >= 0 && guess < inputSlotCount &&
+      slotName == inputSlots[guess].title)
+    return guess;
+  for (int i = 0; i < inputSlotCount; ++i) {
+    if (slotName == inputSlots[i].title)
+      return i;
+  }
+  return -1;
+}
+
+int Node::OutputSlotIndex(const std::string &slotName) const {
+  int guess = SlotIndexFromName(slotName);
+  if (guess >= 0 && guess < outputSlotCount &&
+      slotName == outputSlots[guess].title)
+    return guess;
+  for (int i = 0; i < outputSlotCount; ++i) {
+    if (slotName == outputSlots[i].title)
+      return i;
+  }
+  return -1;
+}
+
+uint64_t Node::ReadInput(const Connection &connection) {
+  Node *source = (Node *)connection.outputNode;
+  return source->EvaluateSlot(source->OutputSlotIndex(connection.outputSlot));
+}
+
+uint64_t Node::InputWord(int slot) {
+  const char *name = inputSlots[slot].title;
+  for (const auto &connection : connections)
+    if (connection.inputNode == this && connection.inputSlot == name)
+      return ReadInput(connection);
+  return 0;
+}
+
+int Node::SlotWidth(int slot, bool isInput) const {
+  const auto &slots = isInput ? inputSlots : outputSlots;
+  return slot >= 0 && slot < (int)slots.size() ? slots[slot].kind : 0;
+}
+
+bool Node::SetBusWidth(int bits) {
+  if (bits < 1 || bits > MaxBusWidth)
+    return false;
+  width = bits;
+  word &= BusMask(bits);
+  for (auto &slot : inputSlots)
+    slot.kind = bits;
+  for (auto &slot : outputSlots)
+    slot.kind = bits;
+  return true;
+}
+
 bool Node::Evaluate() {
   if (isEvaluating || lastEvaluatedFrame == GlobalFrameCount)
     return value;
@@ -29,6 +121,26 @@ bool Node::Evaluate() {
 
 ImU32 Node::GetColor() const { return IM_COL32(40, 40, 45, 255); }
 
+bool Node::Signal() const {
+  if (!Snapshot || netId < 0)
+    return false;
+  int nets = outputSlotCount > 0 ? outputSlotCount : 1;
+  for (int slot = 0; slot < nets; ++slot)
+    if (Snapshot->Get(netId + slot))
+      return true;
+  return false;
+}
+
+ImU32 Node::GetConnectionColor(int outputSlot) const {
+  // Read from the bit or bus this slot carries, not the node's whole word:
+  // a Split's outputs are one bit each
+  bool signal = SlotSignalWord(outputSlot) != 0;
+  // Buses are drawn in their own hue so they stand out from single wires
+  if (SlotWidth(outputSlot, false) > 1)
+    return signal ? IM_COL32(80, 200, 255, 255) : IM_COL32(60, 90, 130, 255);
+  return signal ? IM_COL32(50, 255, 150, 255) : IM_COL32(80, 90, 100, 255);
+}
+
 void Node::Render() {
   // Default empty render - individual types should override
 }
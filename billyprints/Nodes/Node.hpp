@@ -1,10 +1,21 @@
 #pragma once
 
 #include "Connection.hpp"
+#include "Simulator.hpp"
 #include "pch.hpp"
 #include <string>
 
 namespace Billyprints {
+// Slots follow the "in"/"inN" and "out"/"outN" naming convention, so
+// definitions and wires only need to remember the slot index.
+int SlotIndexFromName(const std::string &slotName);
+
+// Buses are packed into one machine word, so they are at most 64 bits wide
+constexpr int MaxBusWidth = 64;
+inline uint64_t BusMask(int width) {
+  return width >= 64 ? ~0ull : (1ull << width) - 1;
+}
+
 class Node {
 public:
   /// Node title
@@ -12,10 +23,18 @@ public:
   std::string id = "";
   bool selected = false;
   ImVec2 pos{};
+  ImVec2 size{}; // Canvas-space size from the last frame it was rendered
+  bool scriptEdited = false; // Set by Render() when a scripted field changes
   bool value = false;
+  // Bits per signal for nodes that can carry a bus, see SetWidth()
+  int width = 1;
+  uint64_t word = 0; // Output of bus nodes, packed bit 0 first
   uint64_t lastEvaluatedFrame = 0;
   bool isEvaluating = false;
   static uint64_t GlobalFrameCount;
+  int netId = -1; // Net of the first output slot, see Simulator
+  // Snapshot that Render() and colors read signal values from
+  static const SimulationSnapshot *Snapshot;
 
   std::vector<Connection> connections{};
   std::vector<ImNodes::Ez::SlotInfo> inputSlots{};
@@ -27,8 +46,39 @@ public:
   Node(const char *title, std::vector<ImNodes::Ez::SlotInfo> &&_inputSlots,
        std::vector<ImNodes::Ez::SlotInfo> &&_outputSlots);
   void DeleteConnection(const Connection &connection);
+  int InputSlotIndex(const std::string &slotName) const;
+  int OutputSlotIndex(const std::string &slotName) const;
   virtual bool Evaluate();
+  // Output as a packed word; single-bit nodes return 0 or 1
+  virtual uint64_t EvaluateWord() { return Evaluate() ? 1 : 0; }
+  // Value of one output slot, for nodes whose slots differ
+  virtual uint64_t EvaluateSlot(int /*outputSlot*/) { return EvaluateWord(); }
+  // Resizes a bus-capable node. Returns false if the type is single-bit.
+  virtual bool SetWidth(int bits) { return bits == 1; }
+  // Bits carried by a slot. It doubles as the ImNodes slot kind, so only
+  // slots of equal width can be wired together.
+  int SlotWidth(int slot, bool isInput) const;
   virtual void Render();
+  // Values from the current snapshot. Never evaluate. Signal() is true when
+  // any output is high; SignalWord() is the first output's word.
+  bool Signal() const;
+  uint64_t SignalWord() const { return SlotSignalWord(0); }
+  uint64_t SlotSignalWord(int outputSlot) const {
+    return Snapshot && netId >= 0 ? Snapshot->GetWord(netId + outputSlot) : 0;
+  }
   virtual ImU32 GetColor() const;
+  // Color of wires leaving 'outputSlot', from the value it carries
+  virtual ImU32 GetConnectionColor(int outputSlot) const;
+
+protected:
+  // Value arriving over a connection, read from the slot it leaves
+  static uint64_t ReadInput(const Connection &connection);
+  // Value on an input slot, 0 when unconnected
+  uint64_t InputWord(int slot);
+  // SetWidth() for nodes whose slots all carry the bus
+  bool SetBusWidth(int bits);
 };
+
+// Stable "inN" / "outN" slot titles for nodes sized at runtime
+const char *IndexedSlotName(bool isInput, int index, int slotCount);
 } // namespace Billyprints
\ No newline at end of file
@@ -7,6 +7,13 @@ class PinIn : public Node {
 public:
   PinIn();
   bool Evaluate() override;
+  uint64_t EvaluateWord() override;
+  bool SetWidth(int bits) override { return SetBusWidth(bits); }
+  // Sets the pin's value from outside, e.g. a custom gate's input slot
+  void Drive(uint64_t input) {
+    word = input & BusMask(width);
+    value = word != 0;
+  }
   void Render() override;
   bool isMomentary = false;
   ImU32 GetColor() const override { return IM_COL32(40, 40, 45, 255); }
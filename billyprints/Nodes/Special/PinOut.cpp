@@ -4,12 +4,14 @@ namespace Billyprints {
 PinOut::PinOut() : Node("Out", {{"in"}}, {}) { value = true; };
 
 bool PinOut::Evaluate() {
+  if (width > 1)
+    return EvaluateWord() != 0;
   if (isEvaluating || lastEvaluatedFrame == GlobalFrameCount)
     return value;
 
   isEvaluating = true;
   for (const auto &cn : connections) {
-    if (cn.inputNode == this && ((Node *)cn.outputNode)->Evaluate()) {
+    if (cn.inputNode == this && ReadInput(cn)) {
       value = true;
       lastEvaluatedFrame = GlobalFrameCount;
       isEvaluating = false;
@@ -23,11 +25,25 @@ bool PinOut::Evaluate() {
   return value;
 };
 
+uint64_t PinOut::EvaluateWord() {
+  if (width == 1)
+    return Evaluate() ? 1 : 0;
+  if (isEvaluating || lastEvaluatedFrame == GlobalFrameCount)
+    return word;
+
+  isEvaluating = true;
+  word = InputWord(0) & BusMask(width);
+  value = word != 0;
+  lastEvaluatedFrame = GlobalFrameCount;
+  isEvaluating = false;
+  return word;
+}
+
 void PinOut::Render() {
   ImU32 color = GetColor();
   color = (color & 0x00FFFFFF) | 0xFF000000;
   ImU32 borderColor =
-      Evaluate() ? IM_COL32(50, 255, 150, 255) : IM_COL32(50, 50, 50, 50);
+      Signal() ? IM_COL32(50, 255, 150, 255) : IM_COL32(50, 50, 50, 50);
 
   // Selection highlight - bright cyan border when selected
   if (selected) {
@@ -45,11 +61,19 @@ void PinOut::Render() {
   if (ImNodes::Ez::BeginNode(this, "", &pos, &selected)) {
     ImNodes::Ez::InputSlots(inputSlots.data(), inputSlotCount);
 
-    bool signal = Evaluate();
+    bool signal = Signal();
     ImGui::PushStyleColor(ImGuiCol_Button, signal
                                                ? ImVec4(0, 0.8f, 0, 1)
                                                : ImVec4(0.1f, 0.1f, 0.1f, 1));
-    ImGui::Button(signal ? "HIGH" : "LOW", ImVec2(40, 30));
+    if (width > 1) {
+      char text[20];
+      snprintf(text, sizeof(text), "%llX", (unsigned long long)SignalWord());
+      float textWidth = ImGui::CalcTextSize(text).x +
+                        ImGui::GetStyle().FramePadding.x * 2;
+      ImGui::Button(text, ImVec2(ImMax(40.0f, textWidth), 30));
+    } else {
+      ImGui::Button(signal ? "HIGH" : "LOW", ImVec2(40, 30));
+    }
     ImGui::PopStyleColor();
 
     ImNodes::Ez::OutputSlots(outputSlots.data(), outputSlotCount);
@@ -7,6 +7,8 @@ class PinOut : public Node {
 public:
   PinOut();
   bool Evaluate() override;
+  uint64_t EvaluateWord() override;
+  bool SetWidth(int bits) override { return SetBusWidth(bits); }
   void Render() override;
   ImU32 GetColor() const override { return IM_COL32(40, 40, 45, 255); }
 };
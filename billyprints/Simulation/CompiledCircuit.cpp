@@ -0,0 +1,405 @@
+#include "CompiledCircuit.hpp"
+#include "../Editor/AigerCircuit.hpp"
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+
+namespace Billyprints {
+
+namespace {
+constexpr uint32_t None = UINT32_MAX;
+
+// The custom gates a compiled circuit was expanded with. It is out of date
+// once any of them is no longer the registered gate of its name.
+using GateUses =
+    std::vector<std::pair<uint32_t, std::weak_ptr<const GateDefinition>>>;
+
+// 'circuit' is null for a definition that couldn't be compiled, so it isn't
+// tried again until it or a gate it uses changes
+struct CacheEntry {
+  std::weak_ptr<const GateDefinition> definition;
+  CompiledCircuitRef circuit;
+  GateUses uses;
+  std::vector<uint32_t> missing; // Gates used that weren't loaded
+};
+
+// Keyed by address; 'definition' tells a live entry from one whose
+// definition is gone and whose address was reused
+std::unordered_map<const GateDefinition *, CacheEntry> &Cache() {
+  static std::unordered_map<const GateDefinition *, CacheEntry> cache;
+  return cache;
+}
+
+bool UpToDate(const CacheEntry &entry, const GateDefinitionRef &def) {
+  if (entry.definition.lock() != def)
+    return false;
+  for (const auto &use : entry.uses) {
+    auto it = CustomGate::GateRegistry.find(GateTypeName(use.first));
+    if (it == CustomGate::GateRegistry.end() ||
+        it->second != use.second.lock())
+      return false;
+  }
+  // A missing gate may have been defined or loaded since
+  for (uint32_t type : entry.missing)
+    if (CustomGate::FindDefinition(GateTypeName(type)))
+      return false;
+  return true;
+}
+
+// AND and NOT bits in 'def' with the gates it uses expanded, as the
+// flattener expands them. Each gate used is recorded once in 'uses', with
+// a null definition if it isn't loaded. Runs before flattening, so a gate
+// that contains itself counts as empty inside itself.
+size_t CountGates(const GateDefinition &def, GateUses &uses,
+                  std::unordered_map<uint32_t, size_t> &counts) {
+  size_t gates = 0;
+  for (const auto &nd : def.nodes) {
+    if (nd.type == GateType_AND || nd.type == GateType_NOT) {
+      gates += nd.width;
+      continue;
+    }
+    if (nd.type < GateType_BuiltinCount)
+      continue;
+    auto counted = counts.find(nd.type);
+    if (counted == counts.end()) {
+      counts.emplace(nd.type, 0);
+      GateDefinitionRef gate =
+          CustomGate::FindDefinition(GateTypeName(nd.type));
+      uses.emplace_back(nd.type, gate);
+      size_t count = gate ? CountGates(*gate, uses, counts) : 0;
+      counted = counts.find(nd.type);
+      counted->second = count;
+    }
+    gates += counted->second;
+  }
+  return gates;
+}
+
+// Optimization passes. Each returns a new graph computing the same outputs
+// from the same inputs, with the ANDs no output depends on swept away.
+
+bool IsAnd(const AigerGraph &aig, uint32_t literal) {
+  return (literal >> 1) > aig.inputCount;
+}
+
+const AigerGraph::And &GateOf(const AigerGraph &aig, uint32_t literal) {
+  return aig.ands[(literal >> 1) - aig.inputCount - 1];
+}
+
+// Dead logic: drops the ANDs that can't reach an output, such as leftovers
+// of an experiment, and renumbers the rest
+AigerGraph Sweep(const AigerGraph &aig) {
+  const uint32_t first = aig.inputCount + 1; // Variable of the first AND
+  std::vector<uint8_t> used(aig.VariableCount() + 1, 0);
+  for (uint32_t literal : aig.outputs)
+    used[literal >> 1] = 1;
+  for (size_t i = aig.ands.size(); i-- > 0;) {
+    if (used[first + i]) {
+      used[aig.ands[i].left >> 1] = 1;
+      used[aig.ands[i].right >> 1] = 1;
+    }
+  }
+
+  AigerGraph out;
+  std::vector<uint32_t> literals(used.size());
+  auto map = [&](uint32_t literal) {
+    return literals[literal >> 1] ^ (literal & 1);
+  };
+  literals[0] = AigerGraph::False;
+  for (uint32_t i = 1; i < first; ++i)
+    literals[i] = out.AddInput();
+  for (size_t i = 0; i < aig.ands.size(); ++i)
+    if (used[first + i])
+      literals[first + i] =
+          out.AddGate(map(aig.ands[i].left), map(aig.ands[i].right));
+  for (uint32_t literal : aig.outputs)
+    out.AddOutput(map(literal));
+  return out;
+}
+
+// Copies 'aig' gate by gate, each AND made by 'make' from the inputs it has
+// in the new graph, and sweeps whatever that leaves unused
+template <typename Make> AigerGraph Rebuild(const AigerGraph &aig, Make make) {
+  AigerGraph out;
+  std::vector<uint32_t> literals(aig.VariableCount() + 1);
+  auto map = [&](uint32_t literal) {
+    return literals[literal >> 1] ^ (literal & 1);
+  };
+  literals[0] = AigerGraph::False;
+  for (uint32_t i = 1; i <= aig.inputCount; ++i)
+    literals[i] = out.AddInput();
+  for (size_t i = 0; i < aig.ands.size(); ++i)
+    literals[aig.inputCount + 1 + i] =
+        make(out, map(aig.ands[i].left), map(aig.ands[i].right));
+  for (uint32_t literal : aig.outputs)
+    out.AddOutput(map(literal));
+  return Sweep(out);
+}
+
+// Constant propagation: an AND with a false input is false and one with a
+// true input is the other input. Unconnected inputs read false, so whatever
+// they drive folds away.
+AigerGraph PropagateConstants(const AigerGraph &aig) {
+  return Rebuild(aig, [](AigerGraph &out, uint32_t left, uint32_t right) {
+    if (left == AigerGraph::False || right == AigerGraph::False)
+      return AigerGraph::False;
+    if (left == AigerGraph::True)
+      return right;
+    if (right == AigerGraph::True)
+      return left;
+    return out.AddGate(left, right);
+  });
+}
+
+// Structural hashing: ANDs of the same two signals become one, see
+// AigerGraph::AddAnd()
+AigerGraph Strash(const AigerGraph &aig) {
+  return Rebuild(aig, [](AigerGraph &out, uint32_t left, uint32_t right) {
+    return out.AddAnd(left, right);
+  });
+}
+
+// The AND of 'left', an AND gate, with 'right' by the two-level rules of
+// Brummayer and Biere that never add gates, or None if none applies
+uint32_t RewriteWith(AigerGraph &aig, uint32_t left, uint32_t right) {
+  using G = AigerGraph;
+  const uint32_t a = GateOf(aig, left).left, b = GateOf(aig, left).right;
+  const bool rightIsAnd = IsAnd(aig, right);
+  uint32_t c = 0, d = 0;
+  if (rightIsAnd) {
+    c = GateOf(aig, right).left;
+    d = GateOf(aig, right).right;
+  }
+  auto negates = [&](uint32_t x) { return x == G::Not(a) || x == G::Not(b); };
+
+  if (!(left & 1)) {
+    // (a & b) & !a = 0, and the same with two ANDs
+    if (negates(right) ||
+        (rightIsAnd && !(right & 1) && (negates(c) || negates(d))))
+      return G::False;
+    // (a & b) & a = a & b
+    if (right == a || right == b)
+      return left;
+    return None;
+  }
+  // !(a & b) & !a = !a, and (c & d) implies !(a & b) when c is !a
+  if (negates(right) ||
+      (rightIsAnd && !(right & 1) && (negates(c) || negates(d))))
+    return right;
+  // !(a & b) & a = a & !b
+  if (right == a)
+    return aig.AddAnd(a, G::Not(b));
+  if (right == b)
+    return aig.AddAnd(b, G::Not(a));
+  // !(a & b) & !(a & !b) = !a
+  if (rightIsAnd && (right & 1)) {
+    if ((c == a && d == G::Not(b)) || (d == a && c == G::Not(b)))
+      return G::Not(a);
+    if ((c == b && d == G::Not(a)) || (d == b && c == G::Not(a)))
+      return G::Not(b);
+  }
+  return None;
+}
+
+// Local rewriting of each AND against the gates feeding it
+AigerGraph Rewrite(const AigerGraph &aig) {
+  return Rebuild(aig, [](AigerGraph &out, uint32_t left, uint32_t right) {
+    uint32_t literal = None;
+    if (IsAnd(out, left))
+      literal = RewriteWith(out, left, right);
+    if (literal == None && IsAnd(out, right))
+      literal = RewriteWith(out, right, left);
+    return literal != None ? literal : out.AddAnd(left, right);
+  });
+}
+
+// Balancing: each tree of ANDs whose inner gates feed only the next gate up
+// is rebuilt from its leaves as a balanced tree, pairing the shallowest
+// first. Leaves that repeat are used once and a leaf next to its inverse
+// makes the tree false, which a chain of two-input gates can hide.
+AigerGraph Balance(const AigerGraph &aig) {
+  const uint32_t first = aig.inputCount + 1;
+  const uint32_t variables = aig.VariableCount() + 1;
+  // A gate read once, uninverted, by another gate is part of that gate's
+  // tree
+  std::vector<uint32_t> reads(variables, 0);
+  std::vector<uint8_t> root(variables, 0);
+  for (const auto &gate : aig.ands) {
+    for (uint32_t literal : {gate.left, gate.right}) {
+      ++reads[literal >> 1];
+      if (literal & 1)
+        root[literal >> 1] = 1;
+    }
+  }
+  for (uint32_t literal : aig.outputs)
+    root[literal >> 1] = 1;
+  auto inner = [&](uint32_t literal) {
+    uint32_t variable = literal >> 1;
+    return !(literal & 1) && variable >= first && reads[variable] == 1 &&
+           !root[variable];
+  };
+
+  AigerGraph out;
+  std::vector<uint32_t> literals(variables);
+  std::vector<uint32_t> levels(first, 0); // Of the gates in 'out'
+  auto map = [&](uint32_t literal) {
+    return literals[literal >> 1] ^ (literal & 1);
+  };
+  auto level = [&](uint32_t literal) { return levels[literal >> 1]; };
+  literals[0] = AigerGraph::False;
+  for (uint32_t i = 1; i < first; ++i)
+    literals[i] = out.AddInput();
+
+  std::vector<uint32_t> leaves, stack;
+  for (size_t i = 0; i < aig.ands.size(); ++i) {
+    const uint32_t variable = first + (uint32_t)i;
+    if (inner(2 * variable))
+      continue; // Built with the tree it belongs to
+
+    leaves.clear();
+    stack.assign({aig.ands[i].left, aig.ands[i].right});
+    while (!stack.empty()) {
+      uint32_t literal = stack.back();
+      stack.pop_back();
+      if (inner(literal)) {
+        const auto &gate = GateOf(aig, literal);
+        stack.push_back(gate.left);
+        stack.push_back(gate.right);
+      } else {
+        leaves.push_back(map(literal));
+      }
+    }
+    std::sort(leaves.begin(), leaves.end());
+    leaves.erase(std::unique(leaves.begin(), leaves.end()), leaves.end());
+    bool contradiction = leaves[0] == AigerGraph::False;
+    for (size_t j = 1; j < leaves.size(); ++j)
+      contradiction |= leaves[j] == AigerGraph::Not(leaves[j - 1]);
+    if (contradiction) {
+      literals[variable] = AigerGraph::False;
+      continue;
+    }
+
+    // Shallowest pair first, keeping the tree's depth down
+    auto deeper = [&](uint32_t x, uint32_t y) { return level(x) > level(y); };
+    std::make_heap(leaves.begin(), leaves.end(), deeper);
+    while (leaves.size() > 1) {
+      std::pop_heap(leaves.begin(), leaves.end(), deeper);
+      uint32_t x = leaves.back();
+      leaves.pop_back();
+      std::pop_heap(leaves.begin(), leaves.end(), deeper);
+      uint32_t y = leaves.back();
+      leaves.pop_back();
+      uint32_t literal = out.AddAnd(x, y);
+      if ((literal >> 1) >= levels.size())
+        levels.push_back(1 + std::max(level(x), level(y)));
+      leaves.push_back(literal);
+      std::push_heap(leaves.begin(), leaves.end(), deeper);
+    }
+    literals[variable] = leaves[0];
+  }
+  for (uint32_t literal : aig.outputs)
+    out.AddOutput(map(literal));
+  return Sweep(out);
+}
+} // namespace
+
+void CompiledCircuit::Evaluate(const uint64_t *inputs, uint64_t *outputs,
+                               std::vector<uint8_t> &signals) const {
+  // One byte per variable, 0 or 1; variable 0 is the constant false
+  signals.resize(inputCount + ands.size() + 1);
+  uint8_t *value = signals.data();
+  value[0] = 0;
+  uint32_t variable = 1;
+  for (size_t pin = 0; pin < inputWidths.size(); ++pin)
+    for (int bit = 0; bit < inputWidths[pin]; ++bit)
+      value[variable++] = (inputs[pin] >> bit) & 1;
+  for (const auto &gate : ands)
+    value[variable++] = (value[gate.left >> 1] ^ (gate.left & 1)) &
+                        (value[gate.right >> 1] ^ (gate.right & 1));
+
+  const uint32_t *literal = this->outputs.data();
+  for (size_t pin = 0; pin < outputWidths.size(); ++pin) {
+    uint64_t word = 0;
+    for (int bit = 0; bit < outputWidths[pin]; ++bit, ++literal)
+      word |= (uint64_t)(value[*literal >> 1] ^ (*literal & 1)) << bit;
+    outputs[pin] = word;
+  }
+}
+
+CompiledCircuitRef FindCompiledCircuit(const GateDefinitionRef &def) {
+  auto &cache = Cache();
+  auto cached = cache.find(def.get());
+  // A failure's missing gates are only checked by loading them
+  if (cached == cache.end() || !cached->second.circuit ||
+      !UpToDate(cached->second, def))
+    return nullptr;
+  return cached->second.circuit;
+}
+
+CompiledCircuitRef CompileCircuit(const GateDefinitionRef &def) {
+  auto &cache = Cache();
+  auto cached = cache.find(def.get());
+  if (cached != cache.end() && UpToDate(cached->second, def))
+    return cached->second.circuit;
+
+  // Entries of definitions that are gone are dropped now and then, so the
+  // cache doesn't grow with every edit of a define block
+  static size_t sweepAt = 64;
+  if (cache.size() >= sweepAt) {
+    for (auto it = cache.begin(); it != cache.end();)
+      it = it->second.definition.expired() ? cache.erase(it) : std::next(it);
+    sweepAt = std::max<size_t>(64, 2 * cache.size());
+  }
+  CacheEntry &entry = cache[def.get()];
+  entry = CacheEntry();
+  entry.definition = def;
+  std::unordered_map<uint32_t, size_t> counts;
+  size_t sourceGates = CountGates(*def, entry.uses, counts);
+  auto loaded = std::stable_partition(
+      entry.uses.begin(), entry.uses.end(),
+      [](const GateUses::value_type &use) { return !use.second.expired(); });
+  for (auto use = loaded; use != entry.uses.end(); ++use)
+    entry.missing.push_back(use->first);
+  entry.uses.erase(loaded, entry.uses.end());
+
+  AigerGraph raw;
+  std::string error;
+  if (!DefinitionToAiger(*def, raw, error, false))
+    return nullptr;
+
+  auto circuit = std::make_shared<CompiledCircuit>();
+  circuit->sourceGates = sourceGates;
+  // Pins in node order, like the slots of a CustomGate
+  for (const auto &nd : def->nodes) {
+    if (nd.type == GateType_In)
+      circuit->inputWidths.push_back(nd.width);
+    else if (nd.type == GateType_Out)
+      circuit->outputWidths.push_back(nd.width);
+  }
+
+  // NOTs cost nothing once they are inverted edges
+  circuit->passes.push_back(
+      {"Inverters", circuit->sourceGates - raw.ands.size()});
+  AigerGraph aig = std::move(raw);
+  auto run = [&](const char *name, AigerGraph (*pass)(const AigerGraph &)) {
+    AigerGraph next = pass(aig);
+    size_t removed = 0;
+    if (next.ands.size() <= aig.ands.size()) {
+      removed = aig.ands.size() - next.ands.size();
+      aig = std::move(next);
+    }
+    circuit->passes.push_back({name, removed});
+  };
+  run("Dead logic", Sweep);
+  run("Constant propagation", PropagateConstants);
+  run("Structural hashing", Strash);
+  run("Rewriting", Rewrite);
+  run("Balancing", Balance);
+
+  circuit->inputCount = aig.inputCount;
+  circuit->ands = std::move(aig.ands);
+  circuit->outputs = std::move(aig.outputs);
+  entry.circuit = circuit;
+  return circuit;
+}
+} // namespace Billyprints
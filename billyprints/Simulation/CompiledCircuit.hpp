@@ -0,0 +1,54 @@
+#pragma once
+
+#include "../Editor/AigerFile.hpp"
+#include "../Nodes/Gates/CustomGate.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Billyprints {
+// A custom gate flattened into one And-Inverter Graph, so an instance is
+// simulated as a single pass over an array of ANDs instead of as a network
+// of nodes. Custom gates inside it are expanded and buses split into bits,
+// NOTs become inverted edges, and the result goes through optimization
+// passes: dead logic removal, constant propagation, structural hashing,
+// local rewriting and balancing. Only the pins are observable, so the
+// passes are free to change everything in between.
+struct CompiledCircuit {
+  // The AIG: inputs bit by bit, pin by pin, then the ANDs in evaluation
+  // order; outputs are literals in the same bit and pin order
+  uint32_t inputCount = 0;
+  std::vector<AigerGraph::And> ands;
+  std::vector<uint32_t> outputs;
+  std::vector<int> inputWidths, outputWidths; // Per pin
+
+  // What compiling saved, pass by pass, for display
+  struct Pass {
+    const char *name;
+    size_t removed; // Gates
+  };
+  size_t sourceGates = 0; // AND and NOT bits of the flattened definition
+  std::vector<Pass> passes;
+
+  // Computes 'outputs' (a word per output pin) from 'inputs' (a word per
+  // input pin). 'signals' is scratch space, kept between calls so it is
+  // only allocated once.
+  void Evaluate(const uint64_t *inputs, uint64_t *outputs,
+                std::vector<uint8_t> &signals) const;
+};
+
+using CompiledCircuitRef = std::shared_ptr<const CompiledCircuit>;
+
+// The compiled form of 'def', shared by all its instances and compiled
+// again only once a gate it uses is redefined. Returns nullptr if 'def'
+// can't be compiled: it has a feedback loop, such as a latch, or uses a gate
+// that isn't loaded. Such gates are simulated node by node. Failures are
+// cached too, until a gate involved is redefined or loaded. Not
+// thread-safe, like the gate registry.
+CompiledCircuitRef CompileCircuit(const GateDefinitionRef &def);
+// The compiled form of 'def' if CompileCircuit() already made it and it is
+// still current, or nullptr. Never compiles or loads, so it is cheap enough
+// to call while drawing.
+CompiledCircuitRef FindCompiledCircuit(const GateDefinitionRef &def);
+} // namespace Billyprints
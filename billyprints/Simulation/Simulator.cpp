@@ -0,0 +1,22 @@
+#include "Simulator.hpp"
+#include "Node.hpp"
+
+namespace Billyprints {
+bool Simulator::Step(const std::vector<Node *> &nodes) {
+  // Evaluation is memoized per GlobalFrameCount, so each node is computed
+  // once no matter how many nodes read it.
+  nextValues.clear();
+  for (Node *node : nodes) {
+    node->netId = (int)nextValues.size();
+    if (node->outputSlotCount == 0)
+      nextValues.push_back(node->EvaluateWord());
+    for (int slot = 0; slot < node->outputSlotCount; ++slot)
+      nextValues.push_back(node->EvaluateSlot(slot));
+  }
+
+  bool changed = nextValues != snapshot.values;
+  snapshot.values.swap(nextValues);
+  snapshot.step++;
+  return changed;
+}
+} // namespace Billyprints
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Billyprints {
+class Node;
+
+// Signal value of every net, produced once per simulation step. Each output
+// slot drives its own net, addressed by Node::netId plus the slot index; a
+// node without outputs still gets one net for its value. A net holds a whole
+// bus packed into one word, bit 0 first; single-bit nets are 0 or 1.
+// Rendering reads values from here and never evaluates nodes itself.
+struct SimulationSnapshot {
+  uint64_t step = 0;
+  std::vector<uint64_t> values;
+
+  bool Get(int net) const { return GetWord(net) != 0; }
+  uint64_t GetWord(int net) const {
+    return net >= 0 && net < (int)values.size() ? values[net] : 0;
+  }
+};
+
+class Simulator {
+public:
+  // Evaluates every node once, assigns net ids and publishes a new snapshot.
+  // Returns true when any net changed since the previous step.
+  bool Step(const std::vector<Node *> &nodes);
+
+  const SimulationSnapshot &GetSnapshot() const { return snapshot; }
+
+private:
+  SimulationSnapshot snapshot;
+  std::vector<uint64_t> nextValues;
+};
+} // namespace Billyprints
@@ -52,28 +52,18 @@ struct _DragConnectionPayload {
   const char *SlotTitle = nullptr;
   /// Source slot kind.
   int SlotKind = 0;
+  /// Position storage of the source slot, see BeginSlot().
+  const ImVec2 *SlotPosition = nullptr;
 };
 
-/// Node-slot combination.
-struct _IgnoreSlot {
-  /// Node id.
-  void *NodeId = nullptr;
-  /// Slot name.
-  const char *SlotName = nullptr;
-  /// Slot kind. Not actual slot kind, but +1 or -1. Used to determine if slot
-  /// is input or output.
-  int SlotKind = 0;
-
-  /// Equality operator, required by ImVector.
-  bool operator==(const _IgnoreSlot &other) const {
-    if (NodeId != other.NodeId || SlotKind != other.SlotKind)
-      return false;
-
-    if (SlotName != nullptr && other.SlotName != nullptr)
-      return strcmp(SlotName, other.SlotName) == 0;
-
-    return other.SlotName == SlotName;
-  }
+/// Connection queued for drawing by BatchConnection().
+struct _BatchedConnection {
+  /// Curve color.
+  ImU32 Color = 0;
+  /// First point of the tessellated curve in _CanvasStateImpl::BatchPoints.
+  int FirstPoint = 0;
+  /// Number of points in the tessellated curve.
+  int PointCount = 0;
 };
 
 struct _CanvasStateImpl {
@@ -94,6 +84,9 @@ struct _CanvasStateImpl {
   struct {
     int Kind = 0;
     const char *Title = nullptr;
+    /// User-provided storage for the slot position. Its address also
+    /// identifies the slot for hover and connection bookkeeping.
+    ImVec2 *Position = nullptr;
   } slot{};
   /// Node id which will be positioned at the mouse cursor on next frame.
   void *AutoPositionNodeId = nullptr;
@@ -126,9 +119,9 @@ struct _CanvasStateImpl {
   /// Previous canvas pointer. Used to restore proper gCanvas value when nesting
   /// canvases.
   CanvasState *PrevCanvas = nullptr;
-  /// A list of node/slot combos that can not connect to current pending
+  /// Slots (by position storage) that can not connect to current pending
   /// connection.
-  ImVector<_IgnoreSlot> IgnoreConnections{};
+  ImVector<const ImVec2 *> IgnoreConnections{};
   int PrevSelectCount = 0;
   int CurrSelectCount = 0;
   ImGuiID PendingActiveItemId = 0;
@@ -139,6 +132,19 @@ struct _CanvasStateImpl {
   /// The ID of the pending top-most hovered node determined thus far this
   /// frame.
   ImGuiID PendingHoveredNodeId = 0;
+  /// Slots at the ends of curves hovered on the previous frame, read by
+  /// IsSlotCurveHovered().
+  ImVector<const ImVec2 *> HoveredSlots{};
+  /// Slots at the ends of curves hovered so far this frame.
+  ImVector<const ImVec2 *> NextHoveredSlots{};
+  /// Connections queued between BeginConnections() and EndConnections().
+  ImVector<_BatchedConnection> Batch{};
+  /// Tessellated points of all queued connections.
+  ImVector<ImVec2> BatchPoints{};
+  /// Scratch buffer for per-point normals while emitting vertices.
+  ImVector<ImVec2> BatchNormals{};
+  /// Whether the mouse can hover connections in the current batch.
+  bool BatchHoverable = false;
 };
 
 CanvasState::CanvasState() noexcept {
@@ -158,15 +164,14 @@ CanvasState::CanvasState() noexcept {
 
 CanvasState::~CanvasState() { delete _Impl; }
 
-ImU32 MakeSlotDataID(const char *data, const char *slot_title, void *node_id,
-                     bool input_slot) {
-  ImU32 slot_id =
-      ImHashStr(slot_title, 0, ImHashData(&node_id, sizeof(node_id)));
-  if (input_slot) {
-    // Ensure that input and output slots with same name have different ids.
-    slot_id ^= ~0U;
-  }
-  return ImHashStr(data, 0, slot_id);
+// Slot positions are stored in canvas space so they remain valid while a node
+// is not being rendered (for example when the application culls it).
+ImVec2 CanvasToScreen(const ImVec2 &pos) {
+  return ImGui::GetWindowPos() + pos * gCanvas->Zoom + gCanvas->Offset;
+}
+
+ImVec2 ScreenToCanvas(const ImVec2 &pos) {
+  return (pos - ImGui::GetWindowPos() - gCanvas->Offset) / gCanvas->Zoom;
 }
 
 // Based on http://paulbourke.net/geometry/pointlineplane/
@@ -254,8 +259,9 @@ void BeginCanvas(CanvasState *canvas) {
             ImVec2{ImGui::GetMousePos().x - ImGui::GetWindowPos().x,
                    ImGui::GetMousePos().y - ImGui::GetWindowPos().y};
         float prevZoom = canvas->Zoom;
-        canvas->Zoom = ImClamp(
-            canvas->Zoom + io.MouseWheel * canvas->Zoom / 16.f, 0.3f, 3.f);
+        canvas->Zoom =
+            ImClamp(canvas->Zoom + io.MouseWheel * canvas->Zoom / 16.f,
+                    canvas->Style.MinZoom, canvas->Style.MaxZoom);
         float zoomFactor = (prevZoom - canvas->Zoom) / prevZoom;
         canvas->Offset += (mouseRel - canvas->Offset) * zoomFactor;
       }
@@ -268,20 +274,28 @@ void BeginCanvas(CanvasState *canvas) {
   ImVec2 size = ImGui::GetWindowSize();
 
   ImU32 grid_color = ImColor(canvas->Colors[ColCanvasLines]);
-  for (float x = fmodf(canvas->Offset.x, grid); x < size.x;) {
-    draw_list->AddLine(ImVec2(x, 0) + pos, ImVec2(x, size.y) + pos, grid_color);
-    x += grid;
-  }
+  // Skip the grid when it is hidden or too dense to read when zoomed out.
+  if ((grid_color & IM_COL32_A_MASK) != 0 && grid >= 4.0f) {
+    for (float x = fmodf(canvas->Offset.x, grid); x < size.x;) {
+      draw_list->AddLine(ImVec2(x, 0) + pos, ImVec2(x, size.y) + pos,
+                         grid_color);
+      x += grid;
+    }
 
-  for (float y = fmodf(canvas->Offset.y, grid); y < size.y;) {
-    draw_list->AddLine(ImVec2(0, y) + pos, ImVec2(size.x, y) + pos, grid_color);
-    y += grid;
+    for (float y = fmodf(canvas->Offset.y, grid); y < size.y;) {
+      draw_list->AddLine(ImVec2(0, y) + pos, ImVec2(size.x, y) + pos,
+                         grid_color);
+      y += grid;
+    }
   }
 
   ImGui::SetWindowFontScale(canvas->Zoom);
 
   canvas->_Impl->PrevSelectCount = canvas->_Impl->CurrSelectCount;
   canvas->_Impl->CurrSelectCount = 0;
+
+  canvas->_Impl->HoveredSlots.swap(canvas->_Impl->NextHoveredSlots);
+  canvas->_Impl->NextHoveredSlots.resize(0);
 }
 
 void EndCanvas() {
@@ -297,14 +311,7 @@ void EndCanvas() {
     if (strncmp(payload->DataType, data_type_fragment,
                 sizeof(data_type_fragment) - 1) == 0) {
       auto *drag_data = (_DragConnectionPayload *)payload->Data;
-      ImVec2 slot_pos{
-          impl->CachedData.GetFloat(
-              MakeSlotDataID("x", drag_data->SlotTitle, drag_data->NodeId,
-                             IsInputSlotKind(drag_data->SlotKind))),
-          impl->CachedData.GetFloat(
-              MakeSlotDataID("y", drag_data->SlotTitle, drag_data->NodeId,
-                             IsInputSlotKind(drag_data->SlotKind))),
-      };
+      ImVec2 slot_pos = CanvasToScreen(*drag_data->SlotPosition);
 
       float connection_indent = canvas->Style.ConnectionIndent * canvas->Zoom;
 
@@ -650,15 +657,45 @@ bool GetPendingConnection(void **node_id, const char **slot_title,
   return false;
 }
 
-bool Connection(void *input_node, const char *input_slot, void *output_node,
-                const char *output_slot) {
+// Keeps the pending connection from being connected to the other end of an
+// existing curve a second time.
+static void IgnorePendingConnectionEnds(const ImVec2 *input_slot,
+                                        const ImVec2 *output_slot) {
+  auto *impl = gCanvas->_Impl;
+  const ImGuiPayload *payload = ImGui::GetDragDropPayload();
+  char drag_id[] = "new-node-connection-";
+  if (payload == nullptr ||
+      strncmp(drag_id, payload->DataType, sizeof(drag_id) - 1) != 0)
+    return;
+
+  const ImVec2 *pending_slot =
+      ((_DragConnectionPayload *)payload->Data)->SlotPosition;
+  const ImVec2 *ignored = nullptr;
+  if (pending_slot == input_slot)
+    ignored = output_slot;
+  else if (pending_slot == output_slot)
+    ignored = input_slot;
+  if (ignored != nullptr && !impl->IgnoreConnections.contains(ignored))
+    impl->IgnoreConnections.push_back(ignored);
+}
+
+void BeginConnections() {
+  IM_ASSERT(gCanvas != nullptr);
+  auto *impl = gCanvas->_Impl;
+  impl->Batch.resize(0);
+  impl->BatchPoints.resize(0);
+  impl->BatchHoverable = ImGui::IsWindowHovered();
+}
+
+bool BatchConnection(void *input_node, const ImVec2 *input_slot,
+                     void *output_node, const ImVec2 *output_slot,
+                     ImU32 color) {
   IM_ASSERT(gCanvas != nullptr);
   IM_ASSERT(input_node != nullptr);
   IM_ASSERT(input_slot != nullptr);
   IM_ASSERT(output_node != nullptr);
   IM_ASSERT(output_slot != nullptr);
 
-  bool is_connected = true;
   auto *canvas = gCanvas;
   auto *impl = canvas->_Impl;
 
@@ -666,79 +703,232 @@ bool Connection(void *input_node, const char *input_slot, void *output_node,
       output_node == impl->AutoPositionNodeId)
     // Do not render connection to newly added output node because node is
     // rendered outside of screen on the first frame and will be repositioned.
-    return is_connected;
-
-  ImVec2 input_slot_pos{
-      impl->CachedData.GetFloat(
-          MakeSlotDataID("x", input_slot, input_node, true)),
-      impl->CachedData.GetFloat(
-          MakeSlotDataID("y", input_slot, input_node, true)),
-  };
-
-  ImVec2 output_slot_pos{
-      impl->CachedData.GetFloat(
-          MakeSlotDataID("x", output_slot, output_node, false)),
-      impl->CachedData.GetFloat(
-          MakeSlotDataID("y", output_slot, output_node, false)),
-  };
+    return true;
+
+  IgnorePendingConnectionEnds(input_slot, output_slot);
+
+  ImVec2 p1 = CanvasToScreen(*input_slot);
+  ImVec2 p4 = CanvasToScreen(*output_slot);
 
   // Indent connection a bit into slot widget.
   float connection_indent = canvas->Style.ConnectionIndent * canvas->Zoom;
-  input_slot_pos.x += connection_indent;
-  output_slot_pos.x -= connection_indent;
+  p1.x += connection_indent;
+  p4.x -= connection_indent;
+
+  float thickness = canvas->Style.CurveThickness * canvas->Zoom;
+  float dx = ImFabs(p1.x - p4.x);
+  float strength = ImMin(canvas->Style.CurveStrength * canvas->Zoom, dx * 0.5f);
+  ImVec2 p2 = p1 - ImVec2{strength, 0};
+  ImVec2 p3 = p4 + ImVec2{strength, 0};
+
+  // The curve lies inside the hull of its control points.
+  ImRect bounds{ImMin(ImMin(p1, p2), ImMin(p3, p4)),
+                ImMax(ImMax(p1, p2), ImMax(p3, p4))};
+  bounds.Expand(thickness);
+
+  ImDrawList *draw_list = ImGui::GetWindowDrawList();
+  ImRect clip{draw_list->GetClipRectMin(), draw_list->GetClipRectMax()};
+  if (!clip.Overlaps(bounds))
+    return true;
+  if (bounds.GetWidth() < thickness + 1.0f &&
+      bounds.GetHeight() < thickness + 1.0f)
+    return true; // Sub-pixel
+
+  // Tessellate: straight when zoomed out, otherwise by on-screen length.
+  int first_point = impl->BatchPoints.Size;
+  if (canvas->Zoom < canvas->Style.StraightConnectionZoom || strength < 1.0f) {
+    impl->BatchPoints.push_back(p1);
+    impl->BatchPoints.push_back(p4);
+  } else {
+    // Wang's formula: segments needed to stay within the tessellation
+    // tolerance of the true curve.
+    float tol = ImMax(ImGui::GetStyle().CurveTessellationTol, 0.1f);
+    float m = ImMax(ImLengthSqr(p1 - p2 * 2.0f + p3),
+                    ImLengthSqr(p2 - p3 * 2.0f + p4));
+    int segments =
+        ImClamp((int)ImCeil(ImSqrt(0.75f * ImSqrt(m) / tol)), 2, 32);
+    float step = 1.0f / segments;
+    for (int i = 0; i <= segments; i++)
+      impl->BatchPoints.push_back(
+          ImBezierCubicCalc(p1, p2, p3, p4, i * step));
+  }
+  int point_count = impl->BatchPoints.Size - first_point;
+
+  // Hover test only when the mouse is inside the curve's bounds.
+  bool is_connected = true;
+  bool curve_hovered = false;
+  ImVec2 mouse = ImGui::GetMousePos();
+  if (impl->BatchHoverable && bounds.Contains(mouse)) {
+    const ImVec2 *pts = impl->BatchPoints.Data + first_point;
+    for (int i = 0; i + 1 < point_count && !curve_hovered; i++)
+      curve_hovered =
+          GetDistanceToLineSquared(mouse, pts[i], pts[i + 1]) <=
+          thickness * thickness;
+  }
 
-  bool curve_hovered = RenderConnection(input_slot_pos, output_slot_pos,
-                                        canvas->Style.CurveThickness);
-  if (curve_hovered && ImGui::IsWindowHovered()) {
-    if (ImGui::IsMouseDoubleClicked(0))
+  if (curve_hovered) {
+    if (ImGui::IsMouseDoubleClicked(0)) {
       is_connected = false;
+      impl->BatchPoints.resize(first_point);
+      return is_connected;
+    }
+    impl->NextHoveredSlots.push_back(input_slot);
+    impl->NextHoveredSlots.push_back(output_slot);
+    color = canvas->Colors[ColConnectionActive];
   }
 
-  impl->CachedData.SetFloat(
-      MakeSlotDataID("hovered", input_slot, input_node, true),
-      curve_hovered && is_connected);
-  impl->CachedData.SetFloat(
-      MakeSlotDataID("hovered", output_slot, output_node, false),
-      curve_hovered && is_connected);
-
-  void *pending_node_id;
-  const char *pending_slot_title;
-  int pending_slot_kind;
-  if (GetPendingConnection(&pending_node_id, &pending_slot_title,
-                           &pending_slot_kind)) {
-    _IgnoreSlot ignore_connection{};
-    if (IsInputSlotKind(pending_slot_kind)) {
-      if (pending_node_id == input_node &&
-          strcmp(pending_slot_title, input_slot) == 0) {
-        ignore_connection.NodeId = output_node;
-        ignore_connection.SlotName = output_slot;
-        ignore_connection.SlotKind = OutputSlotKind(1);
+  _BatchedConnection batched;
+  batched.Color = color;
+  batched.FirstPoint = first_point;
+  batched.PointCount = point_count;
+  impl->Batch.push_back(batched);
+  return is_connected;
+}
+
+static int IMGUI_CDECL CompareBatchedConnections(const void *lhs,
+                                                 const void *rhs) {
+  ImU32 a = ((const _BatchedConnection *)lhs)->Color;
+  ImU32 b = ((const _BatchedConnection *)rhs)->Color;
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+void EndConnections() {
+  IM_ASSERT(gCanvas != nullptr);
+  auto *canvas = gCanvas;
+  auto *impl = canvas->_Impl;
+  if (impl->Batch.empty())
+    return;
+
+  ImDrawList *draw_list = ImGui::GetWindowDrawList();
+  const ImVec2 uv = draw_list->_Data->TexUvWhitePixel;
+
+  // Thickness is snapped to whole pixels so the anti-aliased line texture can
+  // be used: 2 vertices per point instead of 4 for a geometry fringe.
+  float thickness = canvas->Style.CurveThickness * canvas->Zoom;
+  int integer_thickness = ImMax((int)(thickness + 0.5f), 1);
+  const bool use_texture =
+      (draw_list->Flags & ImDrawListFlags_AntiAliasedLinesUseTex) &&
+      integer_thickness < IM_DRAWLIST_TEX_LINES_WIDTH_MAX;
+  const int vtx_per_point = use_texture ? 2 : 4;
+  const int idx_per_segment = use_texture ? 6 : 18;
+  const float aa_size = draw_list->_FringeScale;
+  const float half_inner = ImMax((integer_thickness - aa_size) * 0.5f, 0.0f);
+  const float half_outer =
+      use_texture ? integer_thickness * 0.5f + 1.0f : half_inner + aa_size;
+  ImVec2 tex_uv0 = uv, tex_uv1 = uv;
+  if (use_texture) {
+    ImVec4 tex_uvs = draw_list->_Data->TexUvLines[integer_thickness];
+    tex_uv0 = ImVec2{tex_uvs.x, tex_uvs.y};
+    tex_uv1 = ImVec2{tex_uvs.z, tex_uvs.w};
+  }
+
+  // Group by color so each run is reserved and written in one go.
+  ImQsort(impl->Batch.Data, (size_t)impl->Batch.Size,
+          sizeof(_BatchedConnection), CompareBatchedConnections);
+
+  // Keep each reservation well within 16-bit indices.
+  const int max_run_vertices = 32768;
+  int run_begin = 0;
+  while (run_begin < impl->Batch.Size) {
+    int run_end = run_begin;
+    int vtx_count = 0, idx_count = 0;
+    ImU32 color = impl->Batch[run_begin].Color;
+    while (run_end < impl->Batch.Size && impl->Batch[run_end].Color == color &&
+           (run_end == run_begin ||
+            vtx_count + impl->Batch[run_end].PointCount * vtx_per_point <=
+                max_run_vertices)) {
+      vtx_count += impl->Batch[run_end].PointCount * vtx_per_point;
+      idx_count += (impl->Batch[run_end].PointCount - 1) * idx_per_segment;
+      run_end++;
+    }
+
+    ImU32 color_trans = color & ~IM_COL32_A_MASK;
+    draw_list->PrimReserve(idx_count, vtx_count);
+    for (int c = run_begin; c < run_end; c++) {
+      const _BatchedConnection &batched = impl->Batch[c];
+      const ImVec2 *pts = impl->BatchPoints.Data + batched.FirstPoint;
+      int count = batched.PointCount;
+
+      // Segment normals, then averaged per point.
+      impl->BatchNormals.resize(count);
+      ImVec2 *normals = impl->BatchNormals.Data;
+      for (int i = 0; i + 1 < count; i++) {
+        ImVec2 d = pts[i + 1] - pts[i];
+        float inv_len = ImInvLength(d, 0.0f);
+        normals[i] = ImVec2{d.y * inv_len, -d.x * inv_len};
       }
-    } else {
-      if (pending_node_id == output_node &&
-          strcmp(pending_slot_title, output_slot) == 0) {
-        ignore_connection.NodeId = input_node;
-        ignore_connection.SlotName = input_slot;
-        ignore_connection.SlotKind = InputSlotKind(1);
+      normals[count - 1] = normals[count - 2];
+      for (int i = count - 2; i > 0; i--) {
+        ImVec2 n = (normals[i - 1] + normals[i]) * 0.5f;
+        float d2 = n.x * n.x + n.y * n.y;
+        if (d2 > 0.000001f)
+          n = n * ImMin(1.0f / d2, 100.0f);
+        normals[i] = n;
       }
+
+      unsigned int base = draw_list->_VtxCurrentIdx;
+      ImDrawVert *v = draw_list->_VtxWritePtr;
+      for (int i = 0; i < count; i++) {
+        ImVec2 outer = normals[i] * half_outer;
+        if (use_texture) {
+          v[0].pos = pts[i] + outer; v[0].uv = tex_uv0; v[0].col = color;
+          v[1].pos = pts[i] - outer; v[1].uv = tex_uv1; v[1].col = color;
+          v += 2;
+        } else {
+          ImVec2 inner = normals[i] * half_inner;
+          v[0].pos = pts[i] + outer; v[0].uv = uv; v[0].col = color_trans;
+          v[1].pos = pts[i] + inner; v[1].uv = uv; v[1].col = color;
+          v[2].pos = pts[i] - inner; v[2].uv = uv; v[2].col = color;
+          v[3].pos = pts[i] - outer; v[3].uv = uv; v[3].col = color_trans;
+          v += 4;
+        }
+      }
+      draw_list->_VtxWritePtr = v;
+
+      ImDrawIdx *idx = draw_list->_IdxWritePtr;
+      for (int i = 0; i + 1 < count; i++) {
+        unsigned int a = base + i * vtx_per_point;
+        unsigned int b = a + vtx_per_point;
+        for (int k = 0; k + 1 < vtx_per_point; k++) {
+          idx[0] = (ImDrawIdx)(a + k);
+          idx[1] = (ImDrawIdx)(a + k + 1);
+          idx[2] = (ImDrawIdx)(b + k + 1);
+          idx[3] = (ImDrawIdx)(a + k);
+          idx[4] = (ImDrawIdx)(b + k + 1);
+          idx[5] = (ImDrawIdx)(b + k);
+          idx += 6;
+        }
+      }
+      draw_list->_IdxWritePtr = idx;
+      draw_list->_VtxCurrentIdx += (unsigned int)(count * vtx_per_point);
     }
-    if (ignore_connection.NodeId) {
-      if (!impl->IgnoreConnections.contains(ignore_connection))
-        impl->IgnoreConnections.push_back(ignore_connection);
-    }
+    run_begin = run_end;
   }
 
+  impl->Batch.resize(0);
+  impl->BatchPoints.resize(0);
+}
+
+bool Connection(void *input_node, const ImVec2 *input_slot, void *output_node,
+                const ImVec2 *output_slot) {
+  IM_ASSERT(gCanvas != nullptr);
+  BeginConnections();
+  bool is_connected =
+      BatchConnection(input_node, input_slot, output_node, output_slot,
+                      gCanvas->Colors[ColConnection]);
+  EndConnections();
   return is_connected;
 }
 
 CanvasState *GetCurrentCanvas() { return gCanvas; }
 
-bool BeginSlot(const char *title, int kind) {
+bool BeginSlot(const char *title, int kind, ImVec2 *position) {
   auto *canvas = gCanvas;
   auto *impl = canvas->_Impl;
 
   impl->slot.Title = title;
   impl->slot.Kind = kind;
+  impl->slot.Position = position;
 
   ImGui::BeginGroup();
   return true;
@@ -765,24 +955,19 @@ void EndSlot() {
     ImGui::ClearActiveID();
 
   // Store slot edge positions, curves will connect there
-  {
+  if (impl->slot.Position) {
     float x;
     if (IsInputSlotKind(impl->slot.Kind))
       x = slot_rect.Min.x;
     else
       x = slot_rect.Max.x;
 
-    impl->CachedData.SetFloat(MakeSlotDataID("x", impl->slot.Title,
-                                             impl->Node.Id,
-                                             IsInputSlotKind(impl->slot.Kind)),
-                              x);
-    impl->CachedData.SetFloat(MakeSlotDataID("y", impl->slot.Title,
-                                             impl->Node.Id,
-                                             IsInputSlotKind(impl->slot.Kind)),
-                              slot_rect.Max.y - slot_rect.GetHeight() / 2);
+    *impl->slot.Position = ScreenToCanvas(
+        ImVec2{x, slot_rect.Max.y - slot_rect.GetHeight() / 2});
   }
 
-  if (ImGui::BeginDragDropSource()) {
+  // Slots without position storage can not be connected.
+  if (impl->slot.Position && ImGui::BeginDragDropSource()) {
     auto *payload = ImGui::GetDragDropPayload();
     char drag_id[32];
     snprintf(drag_id, sizeof(drag_id), "new-node-connection-%08X",
@@ -792,6 +977,7 @@ void EndSlot() {
       drag_data.NodeId = impl->Node.Id;
       drag_data.SlotKind = impl->slot.Kind;
       drag_data.SlotTitle = impl->slot.Title;
+      drag_data.SlotPosition = impl->slot.Position;
 
       ImGui::SetDragDropPayload(drag_id, &drag_data, sizeof(drag_data));
 
@@ -859,9 +1045,8 @@ bool IsSlotCurveHovered() {
   }
 
   // Actual curve is hovered
-  return impl->CachedData.GetBool(
-      MakeSlotDataID("hovered", impl->slot.Title, impl->Node.Id,
-                     IsInputSlotKind(impl->slot.Kind)));
+  return impl->slot.Position != nullptr &&
+         impl->HoveredSlots.contains(impl->slot.Position);
 }
 
 bool IsConnectingCompatibleSlot() {
@@ -876,36 +1061,24 @@ bool IsConnectingCompatibleSlot() {
       // Node can not connect to itself
       return false;
 
+    if (impl->slot.Position == nullptr)
+      return false;
+
     char drag_id[32];
     snprintf(drag_id, sizeof(drag_id), "new-node-connection-%08X",
              impl->slot.Kind * -1);
     if (strcmp(drag_id, payload->DataType) != 0)
       return false;
 
-    for (int i = 0; i < impl->IgnoreConnections.size(); i++) {
-      const _IgnoreSlot &ignored = impl->IgnoreConnections[i];
-      if (ignored.NodeId == impl->Node.Id &&
-          strcmp(ignored.SlotName, impl->slot.Title) == 0 &&
-          IsInputSlotKind(ignored.SlotKind) == IsInputSlotKind(impl->slot.Kind))
-        return false;
-    }
-
-    return true;
+    return !impl->IgnoreConnections.contains(impl->slot.Position);
   }
 
   return false;
 }
 
-bool GetSlotPosition(void *node_id, const char *slot_title, bool is_input,
-                     ImVec2 *out_pos) {
+void *GetAutoPositionNode() {
   IM_ASSERT(gCanvas != nullptr);
-  IM_ASSERT(out_pos != nullptr);
-  auto *impl = gCanvas->_Impl;
-  out_pos->x = impl->CachedData.GetFloat(
-      MakeSlotDataID("x", slot_title, node_id, is_input));
-  out_pos->y = impl->CachedData.GetFloat(
-      MakeSlotDataID("y", slot_title, node_id, is_input));
-  return true;
+  return gCanvas->_Impl->AutoPositionNodeId;
 }
 
 } // namespace ImNodes
@@ -62,6 +62,11 @@ struct IMGUI_API CanvasState
 
         float GridSpacing = 64.0f;
         float CurveStrength = 100.0f;
+        /// Below this zoom connections are drawn as straight lines.
+        float StraightConnectionZoom = 0.5f;
+        /// Zoom range reachable with Ctrl + mouse wheel.
+        float MinZoom = 0.3f;
+        float MaxZoom = 3.0f;
         float NodeRounding = 1.0f;
         ImVec2 NodeSpacing{4.0f, 4.0f};
     } Style;
@@ -89,8 +94,16 @@ IMGUI_API void AutoPositionNode(void* node_id);
 IMGUI_API bool GetNewConnection(void** input_node, const char** input_slot_title, void** output_node, const char** output_slot_title);
 /// Get information of connection that is being made and has only one end connected. Returns true when pending connection exists, false otherwise.
 IMGUI_API bool GetPendingConnection(void** node_id, const char** slot_title, int* slot_kind);
-/// Render a connection. Returns `true` when connection is present, `false` if it is deleted.
-IMGUI_API bool Connection(void* input_node, const char* input_slot, void* output_node, const char* output_slot);
+/// Render a connection between two slots, identified by the position storage they were rendered with (see BeginSlot()).
+/// Returns `true` when connection is present, `false` if it is deleted.
+IMGUI_API bool Connection(void* input_node, const ImVec2* input_slot, void* output_node, const ImVec2* output_slot);
+/// Begin a batch of connections. Connections queued with BatchConnection() are culled, tessellated by zoom and drawn
+/// grouped by color in EndConnections().
+IMGUI_API void BeginConnections();
+/// Queue a connection with the given color. Returns `true` when connection is present, `false` if it is deleted.
+IMGUI_API bool BatchConnection(void* input_node, const ImVec2* input_slot, void* output_node, const ImVec2* output_slot, ImU32 color);
+/// Draw all connections queued since BeginConnections().
+IMGUI_API void EndConnections();
 /// Returns active canvas state when called between BeginCanvas() and EndCanvas(). Returns nullptr otherwise. This function is not thread-safe.
 IMGUI_API CanvasState* GetCurrentCanvas();
 /// Convert kind id to input type.
@@ -102,11 +115,14 @@ inline bool IsInputSlotKind(int kind) { return kind < 0; }
 /// Returns `true` if `kind` is from output slot.
 inline bool IsOutputSlotKind(int kind) { return kind > 0; }
 /// Begins slot region. Kind is unique value indicating slot type. Negative values mean input slots, positive - output slots.
-IMGUI_API bool BeginSlot(const char* title, int kind);
+/// `position` is user storage (usually one element of a per-node slot array) that receives the canvas-space point where
+/// curves attach when the slot ends. Its address identifies the slot for connections, so it must stay valid while the
+/// node exists. Slots rendered without storage can not be connected.
+IMGUI_API bool BeginSlot(const char* title, int kind, ImVec2* position = nullptr);
 /// Begins slot region. Kind is unique value whose sign is ignored.
-inline bool BeginInputSlot(const char* title, int kind) { return BeginSlot(title, InputSlotKind(kind)); }
+inline bool BeginInputSlot(const char* title, int kind, ImVec2* position = nullptr) { return BeginSlot(title, InputSlotKind(kind), position); }
 /// Begins slot region. Kind is unique value whose sign is ignored.
-inline bool BeginOutputSlot(const char* title, int kind) { return BeginSlot(title, OutputSlotKind(kind)); }
+inline bool BeginOutputSlot(const char* title, int kind, ImVec2* position = nullptr) { return BeginSlot(title, OutputSlotKind(kind), position); }
 /// Rends rendering of slot. Call only if Begin*Slot() returned `true`.
 IMGUI_API void EndSlot();
 /// Returns `true` if curve connected to current slot is hovered. Call between `Begin*Slot()` and `EndSlot()`. In-progress
@@ -114,7 +130,11 @@ IMGUI_API void EndSlot();
 IMGUI_API bool IsSlotCurveHovered();
 /// Returns `true` when new slot is being created and current slot can be connected. Call between `Begin*Slot()` and `EndSlot()`.
 IMGUI_API bool IsConnectingCompatibleSlot();
-/// Returns the cached screen position of a slot. Call after the slot has been rendered at least once.
-IMGUI_API bool GetSlotPosition(void* node_id, const char* slot_title, bool is_input, ImVec2* out_pos);
+/// Convert a canvas-space position (such as a stored slot position) to screen space of the current canvas.
+IMGUI_API ImVec2 CanvasToScreen(const ImVec2& pos);
+/// Convert a screen-space position to canvas space of the current canvas.
+IMGUI_API ImVec2 ScreenToCanvas(const ImVec2& pos);
+/// Returns the node that is waiting to be positioned at the mouse cursor, or nullptr.
+IMGUI_API void* GetAutoPositionNode();
 
 }   // namespace ImNodes
@@ -221,7 +221,7 @@ void EndNode() {
   g.NodeSplitter.Merge(draw_list);
 }
 
-bool Slot(const char *title, int kind, ImVec2 &pos) {
+bool Slot(const char *title, int kind, ImVec2 &pos, ImVec2 *slot_pos) {
   IM_ASSERT(GContext != nullptr);
   Context &g = *GContext;
   auto *storage = ImGui::GetStateStorage();
@@ -236,7 +236,7 @@ bool Slot(const char *title, int kind, ImVec2 &pos) {
 
   pos.y += ImMax(title_size.y, 2 * CIRCLE_RADIUS) + g.Style.ItemSpacing.y;
 
-  if (ImNodes::BeginSlot(title, kind)) {
+  if (ImNodes::BeginSlot(title, kind, slot_pos)) {
     auto *draw_lists = ImGui::GetWindowDrawList();
 
     // Slot appearance can be altered depending on curve hovering state.
@@ -296,7 +296,7 @@ bool Slot(const char *title, int kind, ImVec2 &pos) {
   return false;
 }
 
-void InputSlots(const SlotInfo *slots, int snum) {
+void InputSlots(SlotInfo *slots, int snum) {
   IM_ASSERT(GContext != nullptr);
   Context &g = *GContext;
   ImGuiStorage *storage = ImGui::GetStateStorage();
@@ -313,7 +313,7 @@ void InputSlots(const SlotInfo *slots, int snum) {
   {
     for (int i = 0; i < snum; i++)
       ImNodes::Ez::Slot(slots[i].title, ImNodes::InputSlotKind(slots[i].kind),
-                        pos);
+                        pos, &slots[i].pos);
   }
   ImGui::EndGroup();
 
@@ -329,7 +329,7 @@ void InputSlots(const SlotInfo *slots, int snum) {
   ImGui::BeginGroup();
 }
 
-void OutputSlots(const SlotInfo *slots, int snum) {
+void OutputSlots(SlotInfo *slots, int snum) {
   IM_ASSERT(GContext != nullptr);
   Context &g = *GContext;
   ImGuiStorage *storage = ImGui::GetStateStorage();
@@ -356,7 +356,7 @@ void OutputSlots(const SlotInfo *slots, int snum) {
   {
     for (int i = 0; i < snum; i++)
       ImNodes::Ez::Slot(slots[i].title, ImNodes::OutputSlotKind(slots[i].kind),
-                        pos);
+                        pos, &slots[i].pos);
   }
   ImGui::EndGroup();
 
@@ -365,15 +365,31 @@ void OutputSlots(const SlotInfo *slots, int snum) {
   PopStyleVar(2);
 }
 
-bool Connection(void *input_node, const char *input_slot, void *output_node,
-                const char *output_slot) {
+bool Connection(void *input_node, const SlotInfo &input_slot,
+                void *output_node, const SlotInfo &output_slot) {
   IM_ASSERT(GContext != nullptr);
   Context &g = *GContext;
   auto draw_list = ImGui::GetWindowDrawList();
 
   g.CanvasSplitter.SetCurrentChannel(draw_list, 0); // Connection layer.
 
-  return ImNodes::Connection(input_node, input_slot, output_node, output_slot);
+  return ImNodes::Connection(input_node, &input_slot.pos, output_node,
+                             &output_slot.pos);
+}
+
+void BeginConnections() {
+  IM_ASSERT(GContext != nullptr);
+  ImNodes::BeginConnections();
+}
+
+void EndConnections() {
+  IM_ASSERT(GContext != nullptr);
+  Context &g = *GContext;
+  auto draw_list = ImGui::GetWindowDrawList();
+
+  g.CanvasSplitter.SetCurrentChannel(draw_list, 0); // Connection layer.
+
+  ImNodes::EndConnections();
 }
 
 void PushStyleVar(ImNodesStyleVar idx, float val) {
@@ -22,6 +22,7 @@
 //
 #pragma once
 
+#include <cfloat>
 #include "ImNodes.h"
 
 //
@@ -72,6 +73,8 @@ struct SlotInfo
     const char* title;
     /// Slot kind, will be used for matching connections to slots of same kind.
     int kind = 1;
+    /// Canvas-space point where curves attach. Written when the slot is rendered, FLT_MAX until then.
+    ImVec2 pos{FLT_MAX, FLT_MAX};
 };
 
 // Style which holds the extended variables and colors not already stored in ImNodes::CanvasState.
@@ -109,13 +112,18 @@ IMGUI_API void EndNode();
 /// Renders input slot region. Kind is unique value whose sign is ignored.
 /// This function must always be called after BeginNode() and before OutputSlots().
 /// When no input slots are rendered call InputSlots(nullptr, 0);
-IMGUI_API void InputSlots(const SlotInfo* slots, int snum);
+IMGUI_API void InputSlots(SlotInfo* slots, int snum);
 /// Renders output slot region. Kind is unique value whose sign is ignored. This function must always be called after InputSlots() and function call is required (not optional).
 /// This function must always be called after InputSlots() and before EndNode().
 /// When no input slots are rendered call OutputSlots(nullptr, 0);
-IMGUI_API void OutputSlots(const SlotInfo* slots, int snum);
-
-bool Connection(void* input_node, const char* input_slot, void* output_node, const char* output_slot);
+IMGUI_API void OutputSlots(SlotInfo* slots, int snum);
+
+/// Render a connection between two slots previously passed to InputSlots() / OutputSlots().
+bool Connection(void* input_node, const SlotInfo& input_slot, void* output_node, const SlotInfo& output_slot);
+/// Begins a batch of connections queued with ImNodes::BatchConnection(). Call after all nodes were rendered.
+IMGUI_API void BeginConnections();
+/// Draws the batch into the connection layer, behind the nodes.
+IMGUI_API void EndConnections();
 
 IMGUI_API void PushStyleVar(ImNodesStyleVar idx, float val);
 IMGUI_API void PushStyleVar(ImNodesStyleVar idx, const ImVec2 &val);
@@ -37,6 +37,7 @@ project "Billyprints"
         "billyprints/Nodes/Gates",
         "billyprints/Nodes/Special",
         "billyprints/Editor",
+        "billyprints/Simulation",
         "libs/glfw/include",
         "libs/imgui",
         "libs/imnodes",